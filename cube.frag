@@ -24,11 +24,23 @@ THE SOFTWARE.
 #version 450 core
 
 #include "shaderDefines.h"
+#include "utils.h"
+
+
+#ifdef PACKED_CUBES
+
+readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
+    PackedCube cubes[];
+};
+
+#else  // PACKED_CUBES
 
 readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
     Cube cubes[];
 };
 
+#endif  // PACKED_CUBES
+
 
 layout(location = 0) flat in int instance;
 
@@ -38,9 +50,13 @@ layout (location = 0) out vec4 outColor;
 
 void main(void)
 {
+#ifdef PACKED_CUBES
+    vec4 color = vec4(sRGB2linear(unpackUnorm4x8(cubes[instance].color).xyz), 0.0);
+#else  // PACKED_CUBES
     Cube cube = cubes[instance];
 
     vec4 color = vec4(cube.color, 0.0);
+#endif  // PACKED_CUBES
 
     color.w = dot(color.xyz, vec3(0.299, 0.587, 0.114));
     outColor = color;
@@ -24,36 +24,68 @@ THE SOFTWARE.
 #version 450 core
 
 #include "shaderDefines.h"
+#include "utils.h"
 
 
 layout(location = ATTR_POS) in vec3 position;
 
 
+#ifdef PACKED_CUBES
+
+readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
+    PackedCube cubes[];
+};
+
+#else  // PACKED_CUBES
+
 readonly restrict layout(std430, set = 1, binding = 0) buffer cubeData {
     Cube cubes[];
 };
 
+#endif  // PACKED_CUBES
+
+
+// culled and sorted cube indices
+readonly restrict layout(std430, set = 1, binding = 1) buffer visibleData {
+    uint visibleCubes[];
+};
+
 
 layout(location = 0) flat out int instance;
 
 
 void main(void)
 {
-    Cube cube = cubes[gl_InstanceIndex];
+    uint cubeIndex = visibleCubes[gl_InstanceIndex];
+
+#ifdef PACKED_CUBES
+
+    PackedCube cube = cubes[cubeIndex];
+    vec4 rotation   = unpackQuaternion(cube.rotation);
+    uvec3 gridPos   = uvec3(cube.position, cube.position >> 10, cube.position >> 20) & 0x3FFU;
+    vec3 cubePos    = vec3(gridPos) * cubeGridSpacing + cubeGridOrigin;
+
+#else  // PACKED_CUBES
+
+    Cube cube     = cubes[cubeIndex];
+    vec4 rotation = cube.rotation;
+    vec3 cubePos  = cube.position;
+
+#endif  // PACKED_CUBES
 
     // rotate
     // this is quaternion multiplication from glm
     vec3 v = position;
-    vec3 rotationQuat = cube.rotation.xyz;
-    float qw = cube.rotation.w;
+    vec3 rotationQuat = rotation.xyz;
+    float qw = rotation.w;
     vec3 uv = cross(rotationQuat, v);
     vec3 uuv = cross(rotationQuat, uv);
     uv *= (2.0 * qw);
     uuv *= 2.0;
     vec3 rotatedPos = v + uv + uuv;
 
-    gl_Position = viewProj * vec4(rotatedPos + cube.position, 1.0);
-    instance = gl_InstanceIndex;
+    gl_Position = viewProj * vec4(rotatedPos + cubePos, 1.0);
+    instance = int(cubeIndex);
 
 #ifdef VULKAN_FLIP
     gl_Position.y = -gl_Position.y;
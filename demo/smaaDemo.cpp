@@ -44,8 +44,17 @@ THE SOFTWARE.
 
 #include <pcg_random.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif  // defined(__SSE2__) || defined(_M_X64)
+
+#include "renderer/FrameGraph.h"
 #include "renderer/Renderer.h"
+#include "utils/FramePacer.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
+#include "utils/WorkerPool.h"
 
 #include "AreaTex.h"
 #include "SearchTex.h"
@@ -84,7 +93,8 @@ class SMAADemo;
 enum class AAMethod : uint8_t {
 	  FXAA
 	, SMAA
-	, LAST = SMAA
+	, SMAACompute
+	, LAST = SMAACompute
 };
 
 
@@ -97,6 +107,10 @@ const char *name(AAMethod m) {
 	case AAMethod::SMAA:
 		return "SMAA";
 		break;
+
+	case AAMethod::SMAACompute:
+		return "SMAA compute";
+		break;
 	}
 
 	UNREACHABLE();
@@ -107,6 +121,13 @@ const char *smaaDebugModes[3] = { "None", "Edges", "Weights" };
 
 static const unsigned int inputTextBufferSize = 1024;
 
+// camera rotation per benchmark frame, as if running at 60 fps
+static const uint64_t benchmarkFrameStep = 1000000000ULL / 60;
+
+// about 4M cubes, keeps the GPU cull dispatch under the 65535 group limit
+static const unsigned int maxCubesPerSide = 160;
+static_assert((maxCubesPerSide * maxCubesPerSide * maxCubesPerSide + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE <= 65535, "too many cubes for GPU culling");
+
 
 const char* GetClipboardText(void* user_data) {
 	char *clipboard = SDL_GetClipboardText();
@@ -144,6 +165,12 @@ public:
 	}
 
 
+	RandomGen(uint64_t seed, uint64_t stream)
+	: rng(seed, stream)
+	{
+	}
+
+
 	float randFloat() {
 		uint32_t u = randU32();
 		// because 24 bits mantissa
@@ -155,9 +182,25 @@ public:
 	uint32_t randU32() {
 		return rng();
 	}
+
+
+	uint64_t randU64() {
+		uint64_t hi = randU32();
+		return (hi << 32) | randU32();
+	}
+
+
+	void seed(uint64_t s) {
+		rng.seed(s);
+	}
 };
 
 
+// cubes are generated in fixed size chunks, each with its own random stream
+// so the result does not depend on the number of threads
+static const unsigned int cubeChunkSize = 4096;
+
+
 static const char *fxaaQualityLevels[] =
 { "10", "15", "20", "29", "39" };
 
@@ -189,6 +232,25 @@ enum class SMAAEdgeMethod : uint8_t {
 };
 
 
+const char *name(SMAAEdgeMethod m) {
+	switch (m) {
+	case SMAAEdgeMethod::Color:
+		return "color";
+		break;
+
+	case SMAAEdgeMethod::Luma:
+		return "luma";
+		break;
+
+	case SMAAEdgeMethod::Depth:
+		return "depth";
+		break;
+	}
+
+	UNREACHABLE();
+}
+
+
 namespace RenderTargets {
 
 	enum RenderTargets {
@@ -197,6 +259,8 @@ namespace RenderTargets {
 		, Edges
 		, BlendWeights
 		, FinalRender
+		// invalid when there's no supported stencil format
+		, SMAAStencil
 		, Count
 	};
 
@@ -242,6 +306,8 @@ struct SMAAKey {
 	unsigned int quality;
 	SMAAEdgeMethod  edgeMethod;
 	bool            predication;
+	// edges and blend weights with compute shaders
+	bool            compute;
 	// TODO: more options
 
 
@@ -249,6 +315,7 @@ struct SMAAKey {
 	: quality(0)
 	, edgeMethod(SMAAEdgeMethod::Color)
     , predication(false)
+	, compute(false)
 	{
 	}
 
@@ -274,6 +341,10 @@ struct SMAAKey {
 			return false;
 		}
 
+		if (this->compute     != other.compute) {
+			return false;
+		}
+
 		return true;
 	}
 };
@@ -287,6 +358,7 @@ namespace std {
 			temp |= (static_cast<uint64_t>(k.quality)    <<  0);
 			temp |= (static_cast<uint64_t>(k.edgeMethod) <<  8);
 			temp |= (static_cast<uint64_t>(k.predication) <<  9);
+			temp |= (static_cast<uint64_t>(k.compute)     << 10);
 
 			return hash<uint64_t>()(temp);
 		}
@@ -308,12 +380,43 @@ struct SMAAPipelines {
 };
 
 
+// what decides which passes render() declares
+struct PassConfig {
+	bool                    antialiasing;
+	AAMethod                aaMethod;
+	// only compute and edgeMethod change the passes
+	SMAAKey                 smaaKey;
+	unsigned int            debugMode;
+	// only needed for running the passes, not for planning
+	ShaderDefines::Globals  globals;
+	uint64_t                elapsed;
+
+
+	PassConfig()
+	: antialiasing(false)
+	, aaMethod(AAMethod::FXAA)
+	, debugMode(0)
+	, globals()
+	, elapsed(0)
+	{
+	}
+};
+
+
 class SMAADemo {
 	// command line things
 	bool            glDebug;
 	bool            tracing;
 	bool            noShaderCache;
+	unsigned int    ringBenchThreads;
 	std::vector<std::string> imageFiles;
+	// report file, empty unless benchmarking
+	std::string     benchmarkFile;
+	unsigned int    benchmarkWarmup;
+	unsigned int    benchmarkFrames;
+#ifdef ENABLE_PROFILER
+	std::string     profileFile;
+#endif  // ENABLE_PROFILER
 
 	// global window things
 	unsigned int    windowWidth, windowHeight;
@@ -331,6 +434,9 @@ class SMAADemo {
 	unsigned int  colorMode;
 	unsigned int  fxaaQuality;
 	SMAAKey       smaaKey;
+	// key of the pipelines used for rendering
+	// differs from smaaKey while new pipelines are being compiled
+	SMAAKey       activeSMAAKey;
 	ShaderDefines::SMAAParameters  smaaParameters;
 
 	float         predicationThreshold;
@@ -340,7 +446,7 @@ class SMAADemo {
 	// timing things
 	bool            fpsLimitActive;
 	uint32_t        fpsLimit;
-	uint64_t        sleepFudge;
+	FramePacer      framePacer;
 	uint64_t      tickBase;
 	uint64_t      lastTime;
 	uint64_t      freqMult;
@@ -355,14 +461,52 @@ class SMAADemo {
 	float         cameraRotation;
 	float         cameraDistance;
 	uint64_t      rotationTime;
+	uint64_t      randomSeed;
 	RandomGen     random;
 	std::vector<Image> images;
 	std::vector<ShaderDefines::Cube> cubes;
+	// range of cubes changed since they were last uploaded
+	unsigned int  cubesDirtyBegin;
+	unsigned int  cubesDirtyEnd;
+	// cube positions are origin + spacing * grid coordinates
+	float         cubeGridSpacing;
+	float         cubeGridOrigin;
+	// upload cubes in the compact format, unpacked kept around for comparison
+	bool          packedCubes;
+	// packed by colorCubes whichever format is uploaded
+	std::vector<ShaderDefines::PackedCube> packedCubeData;
+	// frustum cull and sort front to back on CPU
+	bool          cullCubes;
+	// frustum cull with a compute shader and draw indirect instead, no sorting
+	bool          gpuCull;
+	unsigned int  visibleCubeCount;
+	uint64_t      cullTime;
+	uint64_t      sortTime;
+	// cube generation, culling and sorting split their chunks over these
+	WorkerPool    workers;
+	// depth key in upper 32 bits, cube index in lower
+	std::vector<uint64_t>     cullKeys;
+	std::vector<uint64_t>     sortTemp;
+	std::vector<unsigned int> chunkCounts;
+	std::vector<uint32_t>     visibleCubes;
 
 	Renderer        renderer;
+	FrameGraph      frameGraph;
 	Format          depthFormat;
+	// edge mask for SMAA passes, Invalid if not supported
+	Format          stencilFormat;
+	// format of the final render pass
+	// same as the swapchain when rendering there directly, sRGBA8 and a blit otherwise
+	Format          finalFormat;
+	bool            directPresent;
 
 	PipelineHandle     cubePipeline;
+	PipelineHandle     packedCubePipeline;
+	// same as above but reading GPUCubeSceneDS
+	PipelineHandle     gpuCubePipeline;
+	PipelineHandle     packedGPUCubePipeline;
+	PipelineHandle     cullPipeline;
+	PipelineHandle     packedCullPipeline;
 	PipelineHandle     imagePipeline;
 	PipelineHandle     blitPipeline;
 	PipelineHandle     guiPipeline;
@@ -374,6 +518,14 @@ class SMAADemo {
 
 	BufferHandle       cubeVBO;
 	BufferHandle       cubeIBO;
+	BufferHandle       cubeInstances;
+	unsigned int       cubeInstancesCount;
+	bool               cubeInstancesPacked;
+	// GPU culling results, room for every cube
+	BufferHandle       gpuVisibleCubes;
+	unsigned int       gpuVisibleCubesCount;
+	// DrawIndexedIndirectArgs, instance count filled by GPU culling
+	BufferHandle       cubeDrawArgs;
 
 	SamplerHandle      linearSampler;
 	SamplerHandle      nearestSampler;
@@ -403,6 +555,7 @@ class SMAADemo {
 	SMAADemo &operator=(SMAADemo &&) = delete;
 
 	const SMAAPipelines &getSMAAPipelines(const SMAAKey &key);
+	const SMAAPipelines *requestSMAAPipelines(const SMAAKey &key);
 	const PipelineHandle &getFXAAPipeline(unsigned int q);
 
 
@@ -422,6 +575,14 @@ public:
 
 	void colorCubes();
 
+	void markCubesDirty(unsigned int first, unsigned int count);
+
+	void uploadCubes();
+
+	void cullAndSortCubes(const glm::mat4 &viewProj, float nearPlane, float farPlane);
+
+	void gpuCullCubes(const glm::mat4 &viewProj, const ShaderDefines::Globals &globals);
+
 	void mainLoopIteration();
 
 	bool shouldKeepGoing() const {
@@ -430,10 +591,24 @@ public:
 
 	void render();
 
+	void declarePasses(const PassConfig &config);
+
 	void drawGUI(uint64_t elapsed);
 
 	void loadImage(const std::string &filename);
 
+	bool wantRingBufferBenchmark() const {
+		return ringBenchThreads != 0;
+	}
+
+	void ringBufferBenchmark();
+
+	bool wantBenchmark() const {
+		return !benchmarkFile.empty();
+	}
+
+	void benchmark();
+
 	uint64_t getNanoseconds() {
 		return (SDL_GetPerformanceCounter() - tickBase) * freqMult / freqDiv;
 	}
@@ -445,6 +620,9 @@ SMAADemo::SMAADemo()
 : glDebug(false)
 , tracing(false)
 , noShaderCache(false)
+, ringBenchThreads(0)
+, benchmarkWarmup(0)
+, benchmarkFrames(0)
 
 , windowWidth(1280)
 , windowHeight(720)
@@ -466,7 +644,7 @@ SMAADemo::SMAADemo()
 
 , fpsLimitActive(true)
 , fpsLimit(0)
-, sleepFudge(0)
+, framePacer([this] () { return getNanoseconds(); })
 , tickBase(0)
 , lastTime(0)
 , freqMult(0)
@@ -478,9 +656,27 @@ SMAADemo::SMAADemo()
 , cameraRotation(0.0f)
 , cameraDistance(25.0f)
 , rotationTime(0)
-, random(1)
+, randomSeed(1)
+, random(randomSeed)
+, cubesDirtyBegin(0)
+, cubesDirtyEnd(0)
+, cubeGridSpacing(0.0f)
+, cubeGridOrigin(0.0f)
+, packedCubes(true)
+, cullCubes(true)
+, gpuCull(false)
+, visibleCubeCount(0)
+, cullTime(0)
+, sortTime(0)
+, workers(std::max(std::thread::hardware_concurrency(), 1U) - 1)
 
 , depthFormat(Format::Invalid)
+, stencilFormat(Format::Invalid)
+, finalFormat(Format::Invalid)
+, directPresent(false)
+, cubeInstancesCount(0)
+, cubeInstancesPacked(false)
+, gpuVisibleCubesCount(0)
 
 , textInputActive(false)
 , rightShift(false)
@@ -499,27 +695,22 @@ SMAADemo::SMAADemo()
 	freqDiv   /= g;
 	LOG("freqMult: %" PRIu64 "\n", freqMult);
 	LOG("freqDiv: %"  PRIu64 "\n", freqDiv);
+#ifdef ENABLE_PROFILER
+	profilerInit(tickBase, freqMult, freqDiv);
+#endif  // ENABLE_PROFILER
 
 	lastTime = getNanoseconds();
 
-	// measure minimum sleep length and use it as fudge factor
-	sleepFudge = 1000ULL * 1000ULL;
-	for (unsigned int i = 0; i < 8; i++) {
-		std::this_thread::sleep_for(std::chrono::nanoseconds(1));
-		uint64_t ticks = getNanoseconds();
-		uint64_t diff  = ticks - lastTime;
-		sleepFudge     = std::min(sleepFudge, diff);
-		lastTime       = ticks;
-	}
-
-	LOG("sleep fudge (nanoseconds): %" PRIu64 "\n", sleepFudge);
-
 	memset(imageFileName, 0, inputTextBufferSize);
 	memset(clipboardText, 0, inputTextBufferSize);
 }
 
 
 SMAADemo::~SMAADemo() {
+#ifdef ENABLE_PROFILER
+	profilerWriteTrace(profileFile);
+#endif  // ENABLE_PROFILER
+
 	ImGui::Shutdown();
 
 	if (sceneFramebuffer) {
@@ -535,8 +726,12 @@ SMAADemo::~SMAADemo() {
 		renderer.deleteFramebuffer(smaaWeightsFramebuffer);
 
 		for (unsigned int i = 0; i < RenderTargets::Count; i++) {
-			assert(rendertargets[i]);
-			renderer.deleteRenderTarget(rendertargets[i]);
+			assert(rendertargets[i] || i == RenderTargets::SMAAStencil);
+			if (rendertargets[i] == renderer.getSwapchainRenderTarget()) {
+				rendertargets[i] = RenderTargetHandle();
+			} else if (rendertargets[i]) {
+				renderer.deleteRenderTarget(rendertargets[i]);
+			}
 		}
 
 		assert(sceneRenderPass);
@@ -557,6 +752,21 @@ SMAADemo::~SMAADemo() {
 		cubeIBO = BufferHandle();
 	}
 
+	if (cubeInstances) {
+		renderer.deleteBuffer(cubeInstances);
+		cubeInstances = BufferHandle();
+	}
+
+	if (gpuVisibleCubes) {
+		renderer.deleteBuffer(gpuVisibleCubes);
+		gpuVisibleCubes = BufferHandle();
+	}
+
+	if (cubeDrawArgs) {
+		renderer.deleteBuffer(cubeDrawArgs);
+		cubeDrawArgs = BufferHandle();
+	}
+
 	if (linearSampler) {
 		renderer.deleteSampler(linearSampler);
 		linearSampler = SamplerHandle();
@@ -636,9 +846,20 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		TCLAP::SwitchArg                       noCacheSwitch("",      "nocache",    "Don't load shaders from cache", cmd, false);
 		TCLAP::SwitchArg                       fullscreenSwitch("f",  "fullscreen", "Start in fullscreen mode",      cmd, false);
 		TCLAP::SwitchArg                       noVsyncSwitch("",      "novsync",    "Disable vsync",                 cmd, false);
+		TCLAP::SwitchArg                       unpackedSwitch("",     "unpacked",   "Use unpacked cube instance data", cmd, false);
+		TCLAP::SwitchArg                       noCullSwitch("",       "nocull",     "Disable CPU culling and sorting of cubes", cmd, false);
+		TCLAP::SwitchArg                       gpuCullSwitch("",      "gpucull",    "Cull cubes with a compute shader", cmd, false);
 
 		TCLAP::ValueArg<unsigned int>          windowWidthSwitch("",  "width",      "Window width",  false, windowWidth,  "width",  cmd);
 		TCLAP::ValueArg<unsigned int>          windowHeightSwitch("", "height",     "Window height", false, windowHeight, "height", cmd);
+		TCLAP::ValueArg<unsigned int>          ringBenchSwitch("",    "ringbench",  "Benchmark ephemeral buffer allocation with up to this many threads and exit", false, 0, "threads", cmd);
+		TCLAP::ValueArg<std::string>           benchmarkSwitch("",    "benchmark",  "Run every AA method and preset, write a report (.json or .csv) and exit", false, "", "file", cmd);
+		TCLAP::ValueArg<unsigned int>          warmupSwitch("",       "warmup",     "Benchmark warm-up frames per configuration",  false, 60,  "frames", cmd);
+		TCLAP::ValueArg<unsigned int>          framesSwitch("",       "frames",     "Benchmark measured frames per configuration", false, 300, "frames", cmd);
+		TCLAP::ValueArg<uint64_t>              seedSwitch("",         "seed",       "Random seed for the cubes", false, randomSeed, "seed", cmd);
+#ifdef ENABLE_PROFILER
+		TCLAP::ValueArg<std::string>           profileSwitch("",      "profile",    "Write a CPU profile to this file on exit and when P is pressed", false, "profile.json", "file", cmd);
+#endif  // ENABLE_PROFILER
 
 		TCLAP::UnlabeledMultiArg<std::string>  imagesArg("images",    "image files", false, "image file", cmd, true, nullptr);
 
@@ -651,9 +872,28 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		windowWidth   = windowWidthSwitch.getValue();
 		windowHeight  = windowHeightSwitch.getValue();
 		vsync         = noVsyncSwitch.getValue() ? VSync::Off : VSync::On;
+		ringBenchThreads = ringBenchSwitch.getValue();
+		packedCubes   = !unpackedSwitch.getValue();
+		cullCubes     = !noCullSwitch.getValue();
+		gpuCull       = gpuCullSwitch.getValue();
 
 		imageFiles    = imagesArg.getValue();
 
+		benchmarkFile   = benchmarkSwitch.getValue();
+		benchmarkWarmup = warmupSwitch.getValue();
+		benchmarkFrames = std::max(framesSwitch.getValue(), 1U);
+		randomSeed      = seedSwitch.getValue();
+		random.seed(randomSeed);
+		if (!benchmarkFile.empty()) {
+			// nothing should hold frames back
+			vsync          = VSync::Off;
+			fpsLimitActive = false;
+			rotateCubes    = true;
+		}
+#ifdef ENABLE_PROFILER
+		profileFile   = profileSwitch.getValue();
+#endif  // ENABLE_PROFILER
+
 	} catch (TCLAP::ArgException &e) {
 		LOG("parseCommandLine exception: %s for arg %s\n", e.error().c_str(), e.argId().c_str());
 	} catch (...) {
@@ -663,9 +903,9 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 
 
 struct GlobalDS {
-	BufferHandle   globalUniforms;
-	SamplerHandle  linearSampler;
-	SamplerHandle  nearestSampler;
+	EphemeralBuffer  globalUniforms;
+	SamplerHandle    linearSampler;
+	SamplerHandle    nearestSampler;
 
 
 	static const DescriptorLayout layout[];
@@ -674,17 +914,18 @@ struct GlobalDS {
 
 
 const DescriptorLayout GlobalDS::layout[] = {
-	  { DescriptorType::UniformBuffer,  offsetof(GlobalDS, globalUniforms) }
-	, { DescriptorType::Sampler,        offsetof(GlobalDS, linearSampler ) }
-	, { DescriptorType::Sampler,        offsetof(GlobalDS, nearestSampler) }
-	, { DescriptorType::End,            0                                  }
+	  { DescriptorType::EphemeralUniformBuffer,  offsetof(GlobalDS, globalUniforms) }
+	, { DescriptorType::Sampler,                 offsetof(GlobalDS, linearSampler ) }
+	, { DescriptorType::Sampler,                 offsetof(GlobalDS, nearestSampler) }
+	, { DescriptorType::End,                     0                                  }
 };
 
 DSLayoutHandle GlobalDS::layoutHandle;
 
 
 struct CubeSceneDS {
-    BufferHandle instances;
+    BufferHandle    instances;
+    EphemeralBuffer visibleInstances;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
@@ -692,13 +933,55 @@ struct CubeSceneDS {
 
 
 const DescriptorLayout CubeSceneDS::layout[] = {
-	  { DescriptorType::StorageBuffer,  offsetof(CubeSceneDS, instances) }
-	, { DescriptorType::End,            0                                }
+	  { DescriptorType::StorageBuffer,           offsetof(CubeSceneDS, instances)        }
+	, { DescriptorType::EphemeralStorageBuffer,  offsetof(CubeSceneDS, visibleInstances) }
+	, { DescriptorType::End,                     0                                       }
 };
 
 DSLayoutHandle CubeSceneDS::layoutHandle;
 
 
+// same layout as CubeSceneDS but with GPU culling results
+struct GPUCubeSceneDS {
+    BufferHandle    instances;
+    BufferHandle    visibleInstances;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout GPUCubeSceneDS::layout[] = {
+	  { DescriptorType::StorageBuffer,  offsetof(GPUCubeSceneDS, instances)        }
+	, { DescriptorType::StorageBuffer,  offsetof(GPUCubeSceneDS, visibleInstances) }
+	, { DescriptorType::End,            0                                          }
+};
+
+DSLayoutHandle GPUCubeSceneDS::layoutHandle;
+
+
+struct CullDS {
+    BufferHandle    instances;
+    BufferHandle    visibleInstances;
+    BufferHandle    drawArgs;
+    EphemeralBuffer cullUniforms;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout CullDS::layout[] = {
+	  { DescriptorType::StorageBuffer,           offsetof(CullDS, instances)        }
+	, { DescriptorType::StorageBuffer,           offsetof(CullDS, visibleInstances) }
+	, { DescriptorType::StorageBuffer,           offsetof(CullDS, drawArgs)         }
+	, { DescriptorType::EphemeralUniformBuffer,  offsetof(CullDS, cullUniforms)     }
+	, { DescriptorType::End,                     0                                  }
+};
+
+DSLayoutHandle CullDS::layoutHandle;
+
+
 struct ColorCombinedDS {
 	CSampler color;
 
@@ -749,6 +1032,26 @@ const DescriptorLayout EdgeDetectionDS::layout[] = {
 DSLayoutHandle EdgeDetectionDS::layoutHandle;
 
 
+struct EdgeDetectionComputeDS {
+	CSampler       color;
+	CSampler       predicationTex;
+	TextureHandle  edges;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout EdgeDetectionComputeDS::layout[] = {
+	  { DescriptorType::CombinedSampler,  offsetof(EdgeDetectionComputeDS, color)          }
+	, { DescriptorType::CombinedSampler,  offsetof(EdgeDetectionComputeDS, predicationTex) }
+	, { DescriptorType::StorageImage,     offsetof(EdgeDetectionComputeDS, edges)          }
+	, { DescriptorType::End,              0,                                               }
+};
+
+DSLayoutHandle EdgeDetectionComputeDS::layoutHandle;
+
+
 struct BlendWeightDS {
 	CSampler edgesTex;
 	CSampler areaTex;
@@ -769,6 +1072,28 @@ const DescriptorLayout BlendWeightDS::layout[] = {
 DSLayoutHandle BlendWeightDS::layoutHandle;
 
 
+struct BlendWeightComputeDS {
+	CSampler       edgesTex;
+	CSampler       areaTex;
+	CSampler       searchTex;
+	TextureHandle  blendWeights;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout BlendWeightComputeDS::layout[] = {
+	  { DescriptorType::CombinedSampler,  offsetof(BlendWeightComputeDS, edgesTex)     }
+	, { DescriptorType::CombinedSampler,  offsetof(BlendWeightComputeDS, areaTex)      }
+	, { DescriptorType::CombinedSampler,  offsetof(BlendWeightComputeDS, searchTex)    }
+	, { DescriptorType::StorageImage,     offsetof(BlendWeightComputeDS, blendWeights) }
+	, { DescriptorType::End,              0,                                           }
+};
+
+DSLayoutHandle BlendWeightComputeDS::layoutHandle;
+
+
 struct NeighborBlendDS {
 	CSampler color;
 	CSampler blendweights;
@@ -791,6 +1116,10 @@ static const int numDepths = 5;
 static const std::array<Format, numDepths> depths
   = { { Format::Depth24X8, Format::Depth24S8, Format::Depth32Float, Format::Depth16, Format::Depth16S8 } };
 
+static const int numStencils = 2;
+static const std::array<Format, numStencils> stencils
+  = { { Format::Depth24S8, Format::Depth16S8 } };
+
 
 void SMAADemo::initRender() {
 	RendererDesc desc;
@@ -800,6 +1129,7 @@ void SMAADemo::initRender() {
 	desc.swapchain.fullscreen = fullscreen;
 	desc.swapchain.width      = windowWidth;
 	desc.swapchain.height     = windowHeight;
+	desc.swapchain.numFrames  = numFrames;
 	desc.swapchain.vsync      = vsync;
 
 	renderer = Renderer::createRenderer(desc);
@@ -817,6 +1147,7 @@ void SMAADemo::initRender() {
 	} else {
 		fpsLimit = 2 * refreshRate;
 	}
+	framePacer.setFrameRate(fpsLimit);
 
 	for (auto depth : depths) {
 		if (renderer.isRenderTargetFormatSupported(depth)) {
@@ -829,24 +1160,57 @@ void SMAADemo::initRender() {
 	}
 	LOG("Using depth format %s\n", formatName(depthFormat));
 
+	for (auto stencil : stencils) {
+		if (renderer.isRenderTargetFormatSupported(stencil)) {
+			stencilFormat = stencil;
+			break;
+		}
+	}
+	if (stencilFormat == Format::Invalid) {
+		LOG("No supported stencil formats, SMAA runs without edge mask\n");
+	} else {
+		LOG("Using stencil format %s\n", formatName(stencilFormat));
+	}
+
+	// passes write linear color and rely on the hardware to encode it
+	finalFormat   = renderer.getSwapchainFormat();
+	directPresent = (finalFormat == Format::sRGBA8 || finalFormat == Format::sBGRA8);
+	if (!directPresent) {
+		finalFormat = Format::sRGBA8;
+	}
+	LOG("Final pass renders to %s\n", directPresent ? "swapchain" : "offscreen target");
+
 	renderer.registerDescriptorSetLayout<GlobalDS>();
 	renderer.registerDescriptorSetLayout<CubeSceneDS>();
+	renderer.registerDescriptorSetLayout<GPUCubeSceneDS>();
+	renderer.registerDescriptorSetLayout<CullDS>();
 	renderer.registerDescriptorSetLayout<ColorCombinedDS>();
 	renderer.registerDescriptorSetLayout<ColorTexDS>();
 	renderer.registerDescriptorSetLayout<EdgeDetectionDS>();
+	renderer.registerDescriptorSetLayout<EdgeDetectionComputeDS>();
 	renderer.registerDescriptorSetLayout<BlendWeightDS>();
+	renderer.registerDescriptorSetLayout<BlendWeightComputeDS>();
 	renderer.registerDescriptorSetLayout<NeighborBlendDS>();
 
 	RenderPassDesc rpDesc;
-	rpDesc.color(0, Format::sRGBA8);
-	rpDesc.colorFinalLayout(Layout::TransferSrc);
+	rpDesc.color(0, finalFormat);
+	rpDesc.colorFinalLayout(directPresent ? Layout::Present : Layout::TransferSrc);
 	finalRenderPass       = renderer.createRenderPass(rpDesc.name("final"));
 
 	rpDesc.colorFinalLayout(Layout::ShaderRead);
 	rpDesc.color(0, Format::RGBA8);
+	// edge detection marks edge pixels in stencil, blend weights only runs on those
+	if (stencilFormat != Format::Invalid) {
+		rpDesc.depthStencil(stencilFormat);
+		rpDesc.stencilLoadOp(LoadOp::Clear).stencilStoreOp(StoreOp::Store);
+	}
 	smaaEdgesRenderPass   = renderer.createRenderPass(rpDesc.name("SMAA edges"));
+	if (stencilFormat != Format::Invalid) {
+		rpDesc.stencilLoadOp(LoadOp::Load).stencilStoreOp(StoreOp::DontCare);
+	}
 	smaaWeightsRenderPass = renderer.createRenderPass(rpDesc.name("SMAA weights"));
 
+	rpDesc.stencilLoadOp(LoadOp::DontCare).stencilStoreOp(StoreOp::DontCare);
 	rpDesc.color(0, Format::sRGBA8);
 	rpDesc.depthStencil(depthFormat);
 	sceneRenderPass       = renderer.createRenderPass(rpDesc.name("scene"));
@@ -866,19 +1230,49 @@ void SMAADemo::initRender() {
 	auto vertexShader   = renderer.createVertexShader("cube", macros);
 	auto fragmentShader = renderer.createFragmentShader("cube", macros);
 
-	cubePipeline = renderer.createPipeline(PipelineDesc()
-	                                        .vertexShader(vertexShader)
-	                                        .fragmentShader(fragmentShader)
-	                                        .renderPass(sceneRenderPass)
-	                                        .descriptorSetLayout<GlobalDS>(0)
-	                                        .descriptorSetLayout<CubeSceneDS>(1)
-	                                        .vertexAttrib(ATTR_POS, 0, 3, VtxFormat::Float, 0)
-	                                        .vertexBufferStride(ATTR_POS, sizeof(Vertex))
-	                                        .depthWrite(true)
-	                                        .depthTest(true)
-	                                        .cullFaces(true)
-	                                        .name("cubes")
-	                                       );
+	PipelineDesc cubeDesc;
+	cubeDesc.vertexShader(vertexShader)
+	        .fragmentShader(fragmentShader)
+	        .renderPass(sceneRenderPass)
+	        .descriptorSetLayout<GlobalDS>(0)
+	        .descriptorSetLayout<CubeSceneDS>(1)
+	        .vertexAttrib(ATTR_POS, 0, 3, VtxFormat::Float, 0)
+	        .vertexBufferStride(ATTR_POS, sizeof(Vertex))
+	        .depthWrite(true)
+	        .depthTest(true)
+	        .cullFaces(true)
+	        .name("cubes");
+	cubePipeline = renderer.createPipeline(cubeDesc);
+
+	macros.emplace("PACKED_CUBES", "1");
+	cubeDesc.vertexShader(renderer.createVertexShader("cube", macros))
+	        .fragmentShader(renderer.createFragmentShader("cube", macros))
+	        .name("packed cubes");
+	packedCubePipeline = renderer.createPipeline(cubeDesc);
+
+	// descriptor set 1 comes from the cull shader's output instead
+	cubeDesc.descriptorSetLayout<GPUCubeSceneDS>(1)
+	        .name("packed GPU culled cubes");
+	packedGPUCubePipeline = renderer.createPipeline(cubeDesc);
+	macros.clear();
+
+	cubeDesc.vertexShader(vertexShader)
+	        .fragmentShader(fragmentShader)
+	        .name("GPU culled cubes");
+	gpuCubePipeline = renderer.createPipeline(cubeDesc);
+
+	PipelineDesc cullDesc;
+	cullDesc.computeShader(renderer.createComputeShader("cull", macros))
+	        .descriptorSetLayout<GlobalDS>(0)
+	        .descriptorSetLayout<CullDS>(1)
+	        .name("cull");
+	cullPipeline = renderer.createPipeline(cullDesc);
+
+	macros.emplace("PACKED_CUBES", "1");
+	cullDesc.computeShader(renderer.createComputeShader("cull", macros))
+	        .name("packed cull");
+	packedCullPipeline = renderer.createPipeline(cullDesc);
+	macros.clear();
 
 	vertexShader   = renderer.createVertexShader("image", macros);
 	fragmentShader = renderer.createFragmentShader("image", macros);
@@ -923,8 +1317,8 @@ void SMAADemo::initRender() {
 	linearSampler  = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Linear). magFilter(FilterMode::Linear) .name("linear"));
 	nearestSampler = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Nearest).magFilter(FilterMode::Nearest).name("nearest"));
 
-	cubeVBO = renderer.createBuffer(sizeof(vertices), &vertices[0]);
-	cubeIBO = renderer.createBuffer(sizeof(indices), &indices[0]);
+	cubeVBO = renderer.createBuffer(BufferUsage::Static, sizeof(vertices), &vertices[0]);
+	cubeIBO = renderer.createBuffer(BufferUsage::Static, sizeof(indices), &indices[0]);
 
 #ifdef RENDERER_OPENGL
 
@@ -1022,6 +1416,46 @@ void SMAADemo::initRender() {
 		io.Fonts->TexID = nullptr;
 		ImGui::SetNextWindowPosCenter();
 	}
+
+	// create initial SMAA pipelines synchronously
+	// so there is always something to fall back on while switching
+	getSMAAPipelines(smaaKey);
+	activeSMAAKey = smaaKey;
+}
+
+
+static ShaderMacros smaaShaderMacros(const SMAAKey &key) {
+	ShaderMacros macros;
+	std::string qualityString(std::string("SMAA_PRESET_") + smaaQualityLevels[key.quality]);
+	macros.emplace(qualityString, "1");
+	if (key.edgeMethod != SMAAEdgeMethod::Color) {
+		// TODO: edge detection method only affects the first pass, share others
+		// TODO: also doesn't affect vertex shader
+		macros.emplace("EDGEMETHOD", std::to_string(static_cast<uint8_t>(key.edgeMethod)));
+	}
+
+	if (key.predication && key.edgeMethod != SMAAEdgeMethod::Depth) {
+		// TODO: predication only affects the first pass, share others
+		// TODO: also doesn't affect vertex shader
+		macros.emplace("SMAA_PREDICATION", "1");
+	}
+
+	return macros;
+}
+
+
+static ShaderMacros smaaComputeShaderMacros(const SMAAKey &key) {
+	ShaderMacros macros = smaaShaderMacros(key);
+
+	// fragment shaders get VULKAN_FLIP from the renderer
+	// compute shaders index images directly and need to know if they're stored bottom up
+#ifdef RENDERER_OPENGL
+	macros.emplace("SMAA_FLIP_Y", "1");
+#else  // RENDERER_OPENGL
+	macros.emplace("SMAA_FLIP_Y", "0");
+#endif  // RENDERER_OPENGL
+
+	return macros;
 }
 
 
@@ -1037,46 +1471,62 @@ const SMAAPipelines &SMAADemo::getSMAAPipelines(const SMAAKey &key) {
 			  .cullFaces(true);
 		plDesc.descriptorSetLayout<GlobalDS>(0);
 
-		ShaderMacros macros;
-		std::string qualityString(std::string("SMAA_PRESET_") + smaaQualityLevels[key.quality]);
-		macros.emplace(qualityString, "1");
-		if (key.edgeMethod != SMAAEdgeMethod::Color) {
-			// TODO: edge detection method only affects the first pass, share others
-			// TODO: also doesn't affect vertex shader
-			macros.emplace("EDGEMETHOD", std::to_string(static_cast<uint8_t>(key.edgeMethod)));
-		}
-
-		if (key.predication && key.edgeMethod != SMAAEdgeMethod::Depth) {
-			// TODO: predication only affects the first pass, share others
-			// TODO: also doesn't affect vertex shader
-			macros.emplace("SMAA_PREDICATION", "1");
-		}
-
-		auto vertexShader   = renderer.createVertexShader("smaaEdge", macros);
-		auto fragmentShader = renderer.createFragmentShader("smaaEdge", macros);
-
-		plDesc.renderPass(smaaEdgesRenderPass);
-		plDesc.vertexShader(vertexShader)
-		      .fragmentShader(fragmentShader);
-		plDesc.descriptorSetLayout<EdgeDetectionDS>(1);
-		std::string passName = std::string("SMAA edges ") + std::to_string(key.quality);
-		plDesc.name(passName.c_str());
+		ShaderMacros macros = smaaShaderMacros(key);
 
 		SMAAPipelines pipelines;
-		pipelines.edgePipeline      = renderer.createPipeline(plDesc);
-
-		vertexShader                = renderer.createVertexShader("smaaBlendWeight", macros);
-		fragmentShader              = renderer.createFragmentShader("smaaBlendWeight", macros);
-		plDesc.renderPass(smaaWeightsRenderPass);
-		plDesc.vertexShader(vertexShader)
-		      .fragmentShader(fragmentShader);
-		plDesc.descriptorSetLayout<BlendWeightDS>(1);
-		passName = std::string("SMAA weights ") + std::to_string(key.quality);
-		plDesc.name(passName.c_str());
-		pipelines.blendWeightPipeline = renderer.createPipeline(plDesc);
+		std::string passName;
+
+		if (key.compute) {
+			ShaderMacros computeMacros = smaaComputeShaderMacros(key);
+			PipelineDesc computeDesc;
+			computeDesc.computeShader(renderer.createComputeShader("smaaEdge", computeMacros))
+			           .descriptorSetLayout<GlobalDS>(0)
+			           .descriptorSetLayout<EdgeDetectionComputeDS>(1);
+			passName = std::string("SMAA compute edges ") + std::to_string(key.quality);
+			computeDesc.name(passName.c_str());
+			pipelines.edgePipeline        = renderer.createPipeline(computeDesc);
+
+			computeDesc.computeShader(renderer.createComputeShader("smaaBlendWeight", computeMacros))
+			           .descriptorSetLayout<BlendWeightComputeDS>(1);
+			passName = std::string("SMAA compute weights ") + std::to_string(key.quality);
+			computeDesc.name(passName.c_str());
+			pipelines.blendWeightPipeline = renderer.createPipeline(computeDesc);
+		} else {
+			auto vertexShader   = renderer.createVertexShader("smaaEdge", macros);
+			auto fragmentShader = renderer.createFragmentShader("smaaEdge", macros);
+
+			plDesc.renderPass(smaaEdgesRenderPass);
+			plDesc.vertexShader(vertexShader)
+			      .fragmentShader(fragmentShader);
+			plDesc.descriptorSetLayout<EdgeDetectionDS>(1);
+			// pixels without edges are discarded and leave stencil at zero
+			if (stencilFormat != Format::Invalid) {
+				plDesc.stencilTest(true)
+				      .stencilOp(CompareOp::Always, StencilOp::Replace, 1);
+			}
+			passName = std::string("SMAA edges ") + std::to_string(key.quality);
+			plDesc.name(passName.c_str());
+
+			pipelines.edgePipeline      = renderer.createPipeline(plDesc);
+
+			vertexShader                = renderer.createVertexShader("smaaBlendWeight", macros);
+			fragmentShader              = renderer.createFragmentShader("smaaBlendWeight", macros);
+			plDesc.renderPass(smaaWeightsRenderPass);
+			plDesc.vertexShader(vertexShader)
+			      .fragmentShader(fragmentShader);
+			plDesc.descriptorSetLayout<BlendWeightDS>(1);
+			// weights of pixels without edges stay at the clear value of zero
+			if (stencilFormat != Format::Invalid) {
+				plDesc.stencilOp(CompareOp::Equal, StencilOp::Keep, 1);
+			}
+			passName = std::string("SMAA weights ") + std::to_string(key.quality);
+			plDesc.name(passName.c_str());
+			pipelines.blendWeightPipeline = renderer.createPipeline(plDesc);
+			plDesc.stencilTest(false);
+		}
 
-		vertexShader                = renderer.createVertexShader("smaaNeighbor", macros);
-		fragmentShader              = renderer.createFragmentShader("smaaNeighbor", macros);
+		auto vertexShader           = renderer.createVertexShader("smaaNeighbor", macros);
+		auto fragmentShader         = renderer.createFragmentShader("smaaNeighbor", macros);
 		plDesc.renderPass(finalRenderPass);
 		plDesc.vertexShader(vertexShader)
 		      .fragmentShader(fragmentShader);
@@ -1094,6 +1544,46 @@ const SMAAPipelines &SMAADemo::getSMAAPipelines(const SMAAKey &key) {
 }
 
 
+const SMAAPipelines *SMAADemo::requestSMAAPipelines(const SMAAKey &key) {
+	const SMAAPipelines *pipelines = nullptr;
+	auto it = smaaPipelines.find(key);
+	if (it != smaaPipelines.end()) {
+		pipelines = &it->second;
+	} else {
+		// start compiling all the shaders before checking any of them
+		ShaderMacros macros = smaaShaderMacros(key);
+		bool ready = renderer.prepareShaders("smaaNeighbor",    macros);
+		if (key.compute) {
+			ShaderMacros computeMacros = smaaComputeShaderMacros(key);
+			ready  = renderer.prepareComputeShader("smaaEdge",        computeMacros) && ready;
+			ready  = renderer.prepareComputeShader("smaaBlendWeight", computeMacros) && ready;
+		} else {
+			ready  = renderer.prepareShaders("smaaEdge",        macros) && ready;
+			ready  = renderer.prepareShaders("smaaBlendWeight", macros) && ready;
+		}
+
+		if (!ready) {
+			return nullptr;
+		}
+
+		// shaders are ready, creating the pipelines won't wait for the compiler
+		// but the driver might still be building them
+		pipelines = &getSMAAPipelines(key);
+	}
+
+	// check all of them so the driver gets to work on every one
+	bool ready = renderer.isPipelineReady(pipelines->edgePipeline);
+	ready      = renderer.isPipelineReady(pipelines->blendWeightPipeline) && ready;
+	ready      = renderer.isPipelineReady(pipelines->neighborPipeline)    && ready;
+
+	if (!ready) {
+		return nullptr;
+	}
+
+	return pipelines;
+}
+
+
 const PipelineHandle &SMAADemo::getFXAAPipeline(unsigned int q) {
 	FXAAKey key;
 	key.quality = q;
@@ -1132,6 +1622,8 @@ const PipelineHandle &SMAADemo::getFXAAPipeline(unsigned int q) {
 
 
 void SMAADemo::loadImage(const std::string &filename) {
+	PROFILE_FUNCTION();
+
 	int width = 0, height = 0;
 	unsigned char *imageData = stbi_load(filename.c_str(), &width, &height, NULL, 4);
 	LOG(" %s : %p  %dx%d\n", filename.c_str(), imageData, width, height);
@@ -1168,6 +1660,237 @@ void SMAADemo::loadImage(const std::string &filename) {
 }
 
 
+void SMAADemo::ringBufferBenchmark() {
+	// meant for the null renderer so we measure only the allocator and not the driver
+	const unsigned int benchFrames    = 200;
+	const unsigned int allocsPerFrame = 512;
+	const unsigned int allocSize      = 64;
+
+	std::vector<char> data(allocSize, 0);
+
+	LOG("Ring buffer benchmark: %u frames, %u allocations of %u bytes per frame\n", benchFrames, allocsPerFrame, allocSize);
+	for (unsigned int numThreads = 1; numThreads <= ringBenchThreads; numThreads *= 2) {
+		unsigned int allocsPerThread = allocsPerFrame / numThreads;
+		uint64_t total = 0;
+
+		for (unsigned int f = 0; f < benchFrames; f++) {
+			renderer.beginFrame();
+
+			uint64_t start = getNanoseconds();
+			std::vector<std::thread> threads;
+			threads.reserve(numThreads);
+			for (unsigned int t = 0; t < numThreads; t++) {
+				threads.emplace_back([this, allocsPerThread, &data] () {
+					for (unsigned int i = 0; i < allocsPerThread; i++) {
+						renderer.createEphemeralBuffer(static_cast<uint32_t>(data.size()), &data[0]);
+					}
+				} );
+			}
+			for (auto &t : threads) {
+				t.join();
+			}
+			total += getNanoseconds() - start;
+
+			renderer.presentFrame(rendertargets[RenderTargets::FinalRender]);
+		}
+
+		uint64_t numAllocs = uint64_t(benchFrames) * allocsPerThread * numThreads;
+		LOG(" %2u threads: %8.3f ms per frame  %6.1f ns per allocation\n", numThreads, double(total) / benchFrames / 1000000.0, double(total) / numAllocs);
+	}
+}
+
+
+struct BenchmarkCase {
+	std::string     name;
+	bool            antialiasing;
+	AAMethod        aaMethod;
+	unsigned int    quality;
+	SMAAEdgeMethod  edgeMethod;
+	// milliseconds per measured frame
+	std::vector<double>  cpu;
+	// sum of the frame graph pass timestamps, empty if the renderer has no timestamps
+	std::vector<double>  gpu;
+
+
+	BenchmarkCase()
+	: antialiasing(false)
+	, aaMethod(AAMethod::FXAA)
+	, quality(0)
+	, edgeMethod(SMAAEdgeMethod::Color)
+	{
+	}
+};
+
+
+struct Percentiles {
+	double p50;
+	double p95;
+	double p99;
+	double max;
+};
+
+
+// nearest rank, sorts samples
+static Percentiles percentiles(std::vector<double> &samples) {
+	assert(!samples.empty());
+	std::sort(samples.begin(), samples.end());
+
+	auto rank = [&] (double p) {
+		size_t i = static_cast<size_t>(ceil(p * samples.size()));
+		return samples[std::max(i, size_t(1)) - 1];
+	};
+
+	Percentiles result;
+	result.p50 = rank(0.50);
+	result.p95 = rank(0.95);
+	result.p99 = rank(0.99);
+	result.max = samples.back();
+
+	return result;
+}
+
+
+void SMAADemo::benchmark() {
+	std::vector<BenchmarkCase> cases;
+	{
+		BenchmarkCase c;
+		c.name = "none";
+		cases.push_back(c);
+	}
+
+	for (unsigned int q = 0; q < maxFXAAQuality; q++) {
+		BenchmarkCase c;
+		c.name         = std::string("FXAA ") + fxaaQualityLevels[q];
+		c.antialiasing = true;
+		c.aaMethod     = AAMethod::FXAA;
+		c.quality      = q;
+		cases.push_back(c);
+	}
+
+	for (AAMethod method : { AAMethod::SMAA, AAMethod::SMAACompute }) {
+		// skip custom, it's whatever the parameters happen to be
+		for (unsigned int q = 1; q < maxSMAAQuality; q++) {
+			for (SMAAEdgeMethod edgeMethod : { SMAAEdgeMethod::Color, SMAAEdgeMethod::Luma, SMAAEdgeMethod::Depth }) {
+				BenchmarkCase c;
+				c.name         = std::string(name(method)) + " " + smaaQualityLevels[q] + " " + name(edgeMethod);
+				c.antialiasing = true;
+				c.aaMethod     = method;
+				c.quality      = q;
+				c.edgeMethod   = edgeMethod;
+				cases.push_back(c);
+			}
+		}
+	}
+
+	LOG("Benchmark: %u configurations, %u warm-up and %u measured frames each, seed %" PRIu64 "\n", static_cast<unsigned int>(cases.size()), benchmarkWarmup, benchmarkFrames, randomSeed);
+
+	for (auto &c : cases) {
+		antialiasing = c.antialiasing;
+		aaMethod     = c.aaMethod;
+		debugMode    = 0;
+		if (c.aaMethod == AAMethod::FXAA) {
+			fxaaQuality = c.quality;
+		} else {
+			smaaKey.quality    = c.quality;
+			smaaKey.edgeMethod = c.edgeMethod;
+			smaaKey.compute    = (c.aaMethod == AAMethod::SMAACompute);
+			smaaParameters     = defaultSMAAParameters[c.quality];
+
+			// compile now so no frames are rendered with the previous pipelines
+			getSMAAPipelines(smaaKey);
+			activeSMAAKey = smaaKey;
+		}
+
+		// same camera path for every configuration
+		rotationTime = 0;
+
+		c.cpu.reserve(benchmarkFrames);
+		c.gpu.reserve(benchmarkFrames);
+		for (unsigned int i = 0; i < benchmarkWarmup + benchmarkFrames; i++) {
+			SDL_Event event;
+			while (SDL_PollEvent(&event)) {
+				if (event.type == SDL_QUIT) {
+					LOG("Benchmark interrupted\n");
+					return;
+				}
+			}
+
+			uint64_t start = getNanoseconds();
+			render();
+			uint64_t end   = getNanoseconds();
+
+			if (i < benchmarkWarmup) {
+				continue;
+			}
+
+			c.cpu.push_back(double(end - start) / 1000000.0);
+
+			// timings are numFrames frames old, earlier ones belong to the previous configuration
+			if (i < numFrames) {
+				continue;
+			}
+
+			std::vector<GPUTiming> timings = renderer.getFrameTimings();
+			if (!timings.empty()) {
+				double gpu = 0.0;
+				for (const auto &t : timings) {
+					gpu += t.milliseconds;
+				}
+				c.gpu.push_back(gpu);
+			}
+		}
+
+		Percentiles cpu = percentiles(c.cpu);
+		LOG(" %-28s cpu p50 %7.3f p99 %7.3f ms\n", c.name.c_str(), cpu.p50, cpu.p99);
+	}
+
+	bool csv = (benchmarkFile.size() >= 4 && benchmarkFile.compare(benchmarkFile.size() - 4, 4, ".csv") == 0);
+
+	std::string report;
+	char buf[256];
+	if (csv) {
+		report += "name,cpu_p50,cpu_p95,cpu_p99,cpu_max,gpu_p50,gpu_p95,gpu_p99,gpu_max\n";
+	} else {
+		snprintf(buf, sizeof(buf), "{\n\t\"width\": %u,\n\t\"height\": %u,\n\t\"seed\": %" PRIu64 ",\n\t\"warmupFrames\": %u,\n\t\"frames\": %u,\n\t\"results\": [\n", windowWidth, windowHeight, randomSeed, benchmarkWarmup, benchmarkFrames);
+		report += buf;
+	}
+
+	for (unsigned int i = 0; i < cases.size(); i++) {
+		auto &c = cases[i];
+		Percentiles cpu = percentiles(c.cpu);
+		if (csv) {
+			snprintf(buf, sizeof(buf), "%s,%.4f,%.4f,%.4f,%.4f", c.name.c_str(), cpu.p50, cpu.p95, cpu.p99, cpu.max);
+			report += buf;
+			if (c.gpu.empty()) {
+				report += ",,,,\n";
+			} else {
+				Percentiles gpu = percentiles(c.gpu);
+				snprintf(buf, sizeof(buf), ",%.4f,%.4f,%.4f,%.4f\n", gpu.p50, gpu.p95, gpu.p99, gpu.max);
+				report += buf;
+			}
+		} else {
+			snprintf(buf, sizeof(buf), "\t\t{ \"name\": \"%s\", \"cpu\": { \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }, \"gpu\": ", c.name.c_str(), cpu.p50, cpu.p95, cpu.p99, cpu.max);
+			report += buf;
+			if (c.gpu.empty()) {
+				report += "null";
+			} else {
+				Percentiles gpu = percentiles(c.gpu);
+				snprintf(buf, sizeof(buf), "{ \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }", gpu.p50, gpu.p95, gpu.p99, gpu.max);
+				report += buf;
+			}
+			report += (i + 1 < cases.size()) ? " },\n" : " }\n";
+		}
+	}
+
+	if (!csv) {
+		report += "\t]\n}\n";
+	}
+
+	writeFile(benchmarkFile, report.c_str(), report.size());
+	LOG("Benchmark report written to \"%s\"\n", benchmarkFile.c_str());
+}
+
+
 void SMAADemo::createFramebuffers() {
 	if (rendertargets[0]) {
 		assert(sceneFramebuffer);
@@ -1183,23 +1906,90 @@ void SMAADemo::createFramebuffers() {
 		renderer.deleteFramebuffer(smaaWeightsFramebuffer);
 
 		for (unsigned int i = 0; i < RenderTargets::Count; i++) {
-			assert(rendertargets[i]);
-			renderer.deleteRenderTarget(rendertargets[i]);
+			assert(rendertargets[i] || i == RenderTargets::SMAAStencil);
+			if (rendertargets[i] == renderer.getSwapchainRenderTarget()) {
+				rendertargets[i] = RenderTargetHandle();
+			} else if (rendertargets[i]) {
+				renderer.deleteRenderTarget(rendertargets[i]);
+			}
 		}
+		frameGraph.forgetRenderTargets();
 	}
 
+	// everything except main color is dead by the end of the frame
+	// transient ones get memory after their lifetimes are known
 	RenderTargetDesc rtDesc;
 	rtDesc.width(windowWidth).height(windowHeight).format(Format::sRGBA8).name("main color");
 	rtDesc.additionalViewFormat(Format::RGBA8);
 	rendertargets[RenderTargets::MainColor] = renderer.createRenderTarget(rtDesc);
 	rtDesc.additionalViewFormat(Format::Invalid);
 
-	rtDesc.width(windowWidth).height(windowHeight).format(Format::sRGBA8).name("final");
-	rendertargets[RenderTargets::FinalRender] = renderer.createRenderTarget(rtDesc);
+	rtDesc.transient(true);
+	// window size comes from the drawable size so only the format can differ
+	if (directPresent) {
+		rendertargets[RenderTargets::FinalRender] = renderer.getSwapchainRenderTarget();
+	} else {
+		rtDesc.width(windowWidth).height(windowHeight).format(finalFormat).name("final");
+		rendertargets[RenderTargets::FinalRender] = renderer.createRenderTarget(rtDesc);
+	}
 
 	rtDesc.format(depthFormat).name("main depth");
 	rendertargets[RenderTargets::MainDepth] = renderer.createRenderTarget(rtDesc);
 
+	// SMAA edge mask shared by the edges and blend weights FBOs
+	if (stencilFormat != Format::Invalid) {
+		rtDesc.format(stencilFormat).name("SMAA stencil");
+		rendertargets[RenderTargets::SMAAStencil] = renderer.createRenderTarget(rtDesc);
+	}
+
+	// SMAA edges and blending weights textures
+	// compute SMAA writes these as storage images
+	rtDesc.width(windowWidth).height(windowHeight).format(Format::RGBA8).storage(true).name("SMAA edges");
+	rendertargets[RenderTargets::Edges] = renderer.createRenderTarget(rtDesc);
+
+	rtDesc.name("SMAA weights");
+	rendertargets[RenderTargets::BlendWeights] = renderer.createRenderTarget(rtDesc);
+
+	// every combination of passes render() can declare
+	// debug modes and edge methods change what is read where
+	PassConfig config;
+	config.antialiasing = false;
+	declarePasses(config);
+	frameGraph.plan();
+
+	config.antialiasing = true;
+	config.aaMethod     = AAMethod::FXAA;
+	declarePasses(config);
+	frameGraph.plan();
+
+	config.aaMethod     = AAMethod::SMAA;
+	for (bool compute : { false, true }) {
+		for (SMAAEdgeMethod edgeMethod : { SMAAEdgeMethod::Color, SMAAEdgeMethod::Luma, SMAAEdgeMethod::Depth }) {
+			for (unsigned int debug = 0; debug < 3; debug++) {
+				config.smaaKey.compute    = compute;
+				config.smaaKey.edgeMethod = edgeMethod;
+				config.debugMode          = debug;
+				declarePasses(config);
+				frameGraph.plan();
+			}
+		}
+	}
+
+	// edges dies after the blend weight pass, final and blend weights come later
+	// which ones can actually share depends on what the renderer can alias
+	std::vector<RenderTargetHandle> transients;
+	transients.push_back(rendertargets[RenderTargets::MainDepth]);
+	transients.push_back(rendertargets[RenderTargets::Edges]);
+	transients.push_back(rendertargets[RenderTargets::BlendWeights]);
+	if (!directPresent) {
+		transients.push_back(rendertargets[RenderTargets::FinalRender]);
+	}
+	if (rendertargets[RenderTargets::SMAAStencil]) {
+		transients.push_back(rendertargets[RenderTargets::SMAAStencil]);
+	}
+	frameGraph.allocateTransients(renderer, transients);
+	LOG("%ux%u render targets, %.2f MB saved by aliasing\n", windowWidth, windowHeight, double(renderer.getMemStats().aliasedBytes) / (1024.0 * 1024.0));
+
 	FramebufferDesc fbDesc;
 	fbDesc.depthStencil(rendertargets[RenderTargets::MainDepth]).color(0, rendertargets[RenderTargets::MainColor]);
 	fbDesc.name("scene");
@@ -1211,24 +2001,56 @@ void SMAADemo::createFramebuffers() {
 	fbDesc.renderPass(finalRenderPass);
 	finalFramebuffer = renderer.createFramebuffer(fbDesc);
 
-	// SMAA edges texture and FBO
-	rtDesc.width(windowWidth).height(windowHeight).format(Format::RGBA8).name("SMAA edges");
-	rendertargets[RenderTargets::Edges] = renderer.createRenderTarget(rtDesc);
-	fbDesc.depthStencil(RenderTargetHandle()).color(0, rendertargets[RenderTargets::Edges]);
+	fbDesc.depthStencil(rendertargets[RenderTargets::SMAAStencil]).color(0, rendertargets[RenderTargets::Edges]);
 	fbDesc.name("SMAA edges");
 	fbDesc.renderPass(smaaEdgesRenderPass);
 	smaaEdgesFramebuffer = renderer.createFramebuffer(fbDesc);
 
-	// SMAA blending weights texture and FBO
-	fbDesc.name("SMAA weights");
-	rendertargets[RenderTargets::BlendWeights] = renderer.createRenderTarget(rtDesc);
-	fbDesc.depthStencil(RenderTargetHandle()).color(0, rendertargets[RenderTargets::BlendWeights]);
+	fbDesc.depthStencil(rendertargets[RenderTargets::SMAAStencil]).color(0, rendertargets[RenderTargets::BlendWeights]);
 	fbDesc.name("SMAA weights");
 	fbDesc.renderPass(smaaWeightsRenderPass);
 	smaaWeightsFramebuffer = renderer.createFramebuffer(fbDesc);
 }
 
 
+static void normalizeRotations(ShaderDefines::Cube *cubes, unsigned int count) {
+	unsigned int i = 0;
+
+#ifdef HAVE_SSE2
+
+	// four quaternions at a time, transposed so each register holds one component
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(&cubes[i + 0].rotation.x);
+		__m128 y = _mm_loadu_ps(&cubes[i + 1].rotation.x);
+		__m128 z = _mm_loadu_ps(&cubes[i + 2].rotation.x);
+		__m128 w = _mm_loadu_ps(&cubes[i + 3].rotation.x);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))
+		                        , _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+		__m128 reciprocLen = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lenSq));
+		x = _mm_mul_ps(x, reciprocLen);
+		y = _mm_mul_ps(y, reciprocLen);
+		z = _mm_mul_ps(z, reciprocLen);
+		w = _mm_mul_ps(w, reciprocLen);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		_mm_storeu_ps(&cubes[i + 0].rotation.x, x);
+		_mm_storeu_ps(&cubes[i + 1].rotation.x, y);
+		_mm_storeu_ps(&cubes[i + 2].rotation.x, z);
+		_mm_storeu_ps(&cubes[i + 3].rotation.x, w);
+	}
+
+#endif  // HAVE_SSE2
+
+	for (; i < count; i++) {
+		glm::vec4 &q = cubes[i].rotation;
+		float reciprocLen = 1.0f / sqrtf(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+		q *= reciprocLen;
+	}
+}
+
+
 void SMAADemo::createCubes() {
 	// cube of cubes, n^3 cubes total
 	const unsigned int numCubes = static_cast<unsigned int>(pow(cubesPerSide, 3));
@@ -1238,33 +2060,39 @@ void SMAADemo::createCubes() {
 
 	const float bigCubeSide = cubeDistance * cubesPerSide;
 
-	cubes.clear();
-	cubes.reserve(numCubes);
-
-	for (unsigned int x = 0; x < cubesPerSide; x++) {
-		for (unsigned int y = 0; y < cubesPerSide; y++) {
-			for (unsigned int z = 0; z < cubesPerSide; z++) {
-				float qx = random.randFloat();
-				float qy = random.randFloat();
-				float qz = random.randFloat();
-				float qw = random.randFloat();
-				float reciprocLen = 1.0f / sqrtf(qx*qx + qy*qy + qz*qz + qw*qw);
-				qx *= reciprocLen;
-				qy *= reciprocLen;
-				qz *= reciprocLen;
-				qw *= reciprocLen;
-
-				ShaderDefines::Cube cube;
-				cube.position = glm::vec3((x * cubeDistance) - (bigCubeSide / 2.0f)
-				                        , (y * cubeDistance) - (bigCubeSide / 2.0f)
-				                        , (z * cubeDistance) - (bigCubeSide / 2.0f));
-
-				cube.rotation = glm::vec4(qx, qy, qz, qw);
-				cube.color    = glm::vec3(1.0f, 1.0f, 1.0f);
-				cubes.emplace_back(cube);
-			}
+	cubeGridSpacing = cubeDistance;
+	cubeGridOrigin  = -(bigCubeSide / 2.0f);
+
+	cubes.resize(numCubes);
+
+	const uint64_t seed = random.randU64();
+	const unsigned int n = cubesPerSide;
+	const unsigned int numChunks = (numCubes + cubeChunkSize - 1) / cubeChunkSize;
+	workers.run(numChunks, [&] (unsigned int chunk) {
+		RandomGen chunkRandom(seed, chunk);
+		unsigned int begin = chunk * cubeChunkSize;
+		unsigned int end   = std::min(begin + cubeChunkSize, numCubes);
+
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int x = i / (n * n);
+			unsigned int y = (i / n) % n;
+			unsigned int z = i % n;
+
+			ShaderDefines::Cube &cube = cubes[i];
+			cube.position = glm::vec3((x * cubeDistance) - (bigCubeSide / 2.0f)
+			                        , (y * cubeDistance) - (bigCubeSide / 2.0f)
+			                        , (z * cubeDistance) - (bigCubeSide / 2.0f));
+
+			float qx = chunkRandom.randFloat();
+			float qy = chunkRandom.randFloat();
+			float qz = chunkRandom.randFloat();
+			float qw = chunkRandom.randFloat();
+			cube.rotation = glm::vec4(qx, qy, qz, qw);
+			cube.color    = glm::vec3(1.0f, 1.0f, 1.0f);
 		}
-	}
+
+		normalizeRotations(&cubes[begin], end - begin);
+	} );
 
 	colorCubes();
 }
@@ -1279,36 +2107,177 @@ static float sRGB2linear(float v) {
 }
 
 
+// colors end up in 8 bits anyway so a table covers every value exactly
+static const std::array<float, 256> &sRGB2linearTable() {
+	static const std::array<float, 256> table = [] () {
+		std::array<float, 256> t;
+		for (unsigned int i = 0; i < 256; i++) {
+			t[i] = sRGB2linear(float(i) / 255.0f);
+		}
+		return t;
+	} ();
+
+	return table;
+}
+
+
+static uint32_t unorm8(float v) {
+	return static_cast<uint32_t>(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+
+// smallest three, drop the largest component and store the others in 10 bits each
+// q and -q are the same rotation so flip the sign to make the dropped one positive
+// decoded by unpackQuaternion in utils.h
+static uint32_t packQuaternion(const glm::vec4 &q) {
+	unsigned int largest = 0;
+	for (unsigned int i = 1; i < 4; i++) {
+		if (fabsf(q[i]) > fabsf(q[largest])) {
+			largest = i;
+		}
+	}
+
+	const float sign  = (q[largest] < 0.0f) ? -1.0f : 1.0f;
+	uint32_t packed   = largest << 30;
+	unsigned int shift = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		if (i == largest) {
+			continue;
+		}
+
+		// others are in [-1/sqrt(2), 1/sqrt(2)]
+		float v = sign * q[i] * 1.41421356f;
+		uint32_t bits = static_cast<uint32_t>(glm::clamp(v * 0.5f + 0.5f, 0.0f, 1.0f) * 1023.0f + 0.5f);
+		packed |= bits << shift;
+		shift += 10;
+	}
+
+	return packed;
+}
+
+
+// color is already 8 bit sRGB, red in the low byte
+static ShaderDefines::PackedCube packCube(const ShaderDefines::Cube &cube, uint32_t color, float gridSpacing, float gridOrigin) {
+	ShaderDefines::PackedCube packed;
+
+	glm::vec3 grid = glm::round((cube.position - gridOrigin) / gridSpacing);
+	glm::uvec3 g   = glm::uvec3(glm::clamp(grid, 0.0f, 1023.0f));
+	packed.position = g.x | (g.y << 10) | (g.z << 20);
+
+	packed.rotation = packQuaternion(cube.rotation);
+
+	packed.color    = (color & 0x00FFFFFFU) | (255U << 24);
+
+	return packed;
+}
+
+
 void SMAADemo::colorCubes() {
-	if (colorMode == 0) {
-		for (auto &cube : cubes) {
-			// random RGB
-			cube.color.x = sRGB2linear(random.randFloat());
-			cube.color.y = sRGB2linear(random.randFloat());
-			cube.color.z = sRGB2linear(random.randFloat());
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	const std::array<float, 256> &table = sRGB2linearTable();
+
+	packedCubeData.resize(numCubes);
+
+	const uint64_t seed = random.randU64();
+	const unsigned int numChunks = (numCubes + cubeChunkSize - 1) / cubeChunkSize;
+	// colors are picked as 8 bit sRGB, table gives the linear ones
+	// and the packed cube takes the bytes as they are
+	workers.run(numChunks, [&] (unsigned int chunk) {
+		RandomGen chunkRandom(seed, chunk);
+		unsigned int begin = chunk * cubeChunkSize;
+		unsigned int end   = std::min(begin + cubeChunkSize, numCubes);
+
+		if (colorMode == 0) {
+			for (unsigned int i = begin; i < end; i++) {
+				// random RGB
+				uint32_t rgb = chunkRandom.randU32();
+				cubes[i].color.x = table[ rgb        & 0xFF];
+				cubes[i].color.y = table[(rgb >> 8)  & 0xFF];
+				cubes[i].color.z = table[(rgb >> 16) & 0xFF];
+				packedCubeData[i] = packCube(cubes[i], rgb, cubeGridSpacing, cubeGridOrigin);
+			}
+		} else {
+			for (unsigned int i = begin; i < end; i++) {
+				// YCbCr, fixed luma, random chroma, alpha = 1.0
+				// worst case scenario for luma edge detection
+				// TODO: use the same luma as shader
+
+				float y = 0.3f;
+				const float c_red   = 0.299f
+				          , c_green = 0.587f
+				          , c_blue  = 0.114f;
+				float cb = chunkRandom.randFloat() * 2.0f - 1.0f;
+				float cr = chunkRandom.randFloat() * 2.0f - 1.0f;
+
+				float r = cr * (2 - 2 * c_red) + y;
+				float g = (y - c_blue * cb - c_red * cr) / c_green;
+				float b = cb * (2 - 2 * c_blue) + y;
+
+				uint32_t rgb = unorm8(r) | (unorm8(g) << 8) | (unorm8(b) << 16);
+				cubes[i].color.x = table[ rgb        & 0xFF];
+				cubes[i].color.y = table[(rgb >> 8)  & 0xFF];
+				cubes[i].color.z = table[(rgb >> 16) & 0xFF];
+				packedCubeData[i] = packCube(cubes[i], rgb, cubeGridSpacing, cubeGridOrigin);
+			}
 		}
+	} );
+
+	markCubesDirty(0, numCubes);
+}
+
+
+void SMAADemo::markCubesDirty(unsigned int first, unsigned int count) {
+	assert(first + count <= cubes.size());
+
+	if (cubesDirtyBegin == cubesDirtyEnd) {
+		cubesDirtyBegin = first;
+		cubesDirtyEnd   = first + count;
+	} else {
+		cubesDirtyBegin = std::min(cubesDirtyBegin, first);
+		cubesDirtyEnd   = std::max(cubesDirtyEnd,   first + count);
+	}
+}
+
+
+void SMAADemo::uploadCubes() {
+	// number of cubes or format changed, need a new buffer
+	bool recreate = (cubeInstancesCount != cubes.size()) || (cubeInstancesPacked != packedCubes);
+	if (recreate) {
+		cubesDirtyBegin = 0;
+		cubesDirtyEnd   = static_cast<unsigned int>(cubes.size());
+	}
+
+	if (cubesDirtyBegin == cubesDirtyEnd) {
+		return;
+	}
+
+	const void *data  = nullptr;
+	uint32_t cubeSize = 0;
+	if (packedCubes) {
+		// already packed by colorCubes
+		assert(packedCubeData.size() == cubes.size());
+		data     = &packedCubeData[0];
+		cubeSize = sizeof(ShaderDefines::PackedCube);
 	} else {
-		for (auto &cube : cubes) {
-			// YCbCr, fixed luma, random chroma, alpha = 1.0
-			// worst case scenario for luma edge detection
-			// TODO: use the same luma as shader
-
-			float y = 0.3f;
-			const float c_red   = 0.299f
-			          , c_green = 0.587f
-			          , c_blue  = 0.114f;
-			float cb = random.randFloat() * 2.0f - 1.0f;
-			float cr = random.randFloat() * 2.0f - 1.0f;
-
-			float r = cr * (2 - 2 * c_red) + y;
-			float g = (y - c_blue * cb - c_red * cr) / c_green;
-			float b = cb * (2 - 2 * c_blue) + y;
-
-			cube.color.x = sRGB2linear(r);
-			cube.color.y = sRGB2linear(g);
-			cube.color.z = sRGB2linear(b);
+		data     = &cubes[0];
+		cubeSize = sizeof(ShaderDefines::Cube);
+	}
+
+	if (recreate) {
+		if (cubeInstances) {
+			renderer.deleteBuffer(cubeInstances);
 		}
+
+		cubeInstancesCount  = static_cast<unsigned int>(cubes.size());
+		cubeInstancesPacked = packedCubes;
+		cubeInstances       = renderer.createBuffer(BufferUsage::Dynamic, cubeSize * cubeInstancesCount, data);
+	} else {
+		// only upload what changed
+		renderer.updateBuffer(cubeInstances, cubesDirtyBegin * cubeSize, (cubesDirtyEnd - cubesDirtyBegin) * cubeSize, reinterpret_cast<const char *>(data) + cubesDirtyBegin * cubeSize);
 	}
+
+	cubesDirtyBegin = 0;
+	cubesDirtyEnd   = 0;
 }
 
 
@@ -1319,6 +2288,9 @@ static void printHelp() {
 	printf(" f                - toggle fullscreen\n");
 	printf(" h                - print help\n");
 	printf(" m                - change antialiasing method\n");
+#ifdef ENABLE_PROFILER
+	printf(" p                - write CPU profile\n");
+#endif  // ENABLE_PROFILER
 	printf(" q                - cycle through AA quality levels\n");
 	printf(" v                - toggle vsync\n");
 	printf(" LEFT/RIGHT ARROW - cycle through scenes\n");
@@ -1327,7 +2299,283 @@ static void printHelp() {
 }
 
 
+// bounding sphere of a cube
+// vertices are at +-sqrt(3) / 2 on each axis so corners are sqrt(3) * sqrt(3) / 2 = 1.5 from the center
+static const float cubeRadius = 1.5f;
+
+
+struct CullParams {
+	// normalized frustum planes, xyz is normal and w distance
+	std::array<glm::vec4, 6> planes;
+	// dot with position gives clip space w, which is view depth
+	glm::vec4                depthRow;
+	float                    depthBias;
+	float                    depthScale;
+};
+
+
+// Gribb & Hartmann, glm is column major so row r is m[0][r], m[1][r], ...
+static void frustumPlanes(const glm::mat4 &viewProj, glm::vec4 *planes) {
+	auto row = [&] (unsigned int r) {
+		return glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+	};
+
+	planes[0] = row(3) + row(0);  // left
+	planes[1] = row(3) - row(0);  // right
+	planes[2] = row(3) + row(1);  // bottom
+	planes[3] = row(3) - row(1);  // top
+	planes[4] = row(2);           // near, depth is zero to one
+	planes[5] = row(3) - row(2);  // far
+	for (unsigned int i = 0; i < 6; i++) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+
+static uint64_t cullKey(float depth, const CullParams &params, unsigned int index) {
+	// 16 bits of linear depth is plenty for front to back order
+	float d = glm::clamp((depth - params.depthBias) * params.depthScale, 0.0f, 65535.0f);
+	return (uint64_t(d) << 32) | index;
+}
+
+
+// writes visible cubes to out, returns how many
+static unsigned int cullCubeRange(const ShaderDefines::Cube *cubes, unsigned int begin, unsigned int end, const CullParams &params, uint64_t *out) {
+	unsigned int count = 0;
+	unsigned int i     = begin;
+
+#ifdef HAVE_SSE2
+
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (unsigned int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(params.planes[p].x);
+		planeY[p] = _mm_set1_ps(params.planes[p].y);
+		planeZ[p] = _mm_set1_ps(params.planes[p].z);
+		planeW[p] = _mm_set1_ps(params.planes[p].w + cubeRadius);
+	}
+	const __m128 depthX = _mm_set1_ps(params.depthRow.x);
+	const __m128 depthY = _mm_set1_ps(params.depthRow.y);
+	const __m128 depthZ = _mm_set1_ps(params.depthRow.z);
+	const __m128 depthW = _mm_set1_ps(params.depthRow.w);
+	const __m128 zero   = _mm_setzero_ps();
+
+	// four cubes at a time, position and padding are contiguous so one load each
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(&cubes[i + 0].position.x);
+		__m128 y = _mm_loadu_ps(&cubes[i + 1].position.x);
+		__m128 z = _mm_loadu_ps(&cubes[i + 2].position.x);
+		__m128 w = _mm_loadu_ps(&cubes[i + 3].position.x);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (unsigned int p = 0; p < 6; p++) {
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p]))
+			                       , _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		if (mask == 0) {
+			continue;
+		}
+
+		__m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, depthX), _mm_mul_ps(y, depthY))
+		                        , _mm_add_ps(_mm_mul_ps(z, depthZ), depthW));
+		alignas(16) float cubeDepths[4];
+		_mm_store_ps(cubeDepths, depth);
+		for (unsigned int k = 0; k < 4; k++) {
+			if (mask & (1 << k)) {
+				out[count++] = cullKey(cubeDepths[k], params, i + k);
+			}
+		}
+	}
+
+#endif  // HAVE_SSE2
+
+	for (; i < end; i++) {
+		glm::vec4 pos(cubes[i].position, 1.0f);
+		bool inside = true;
+		for (const auto &plane : params.planes) {
+			inside = inside && (glm::dot(plane, pos) >= -cubeRadius);
+		}
+
+		if (inside) {
+			out[count++] = cullKey(glm::dot(params.depthRow, pos), params, i);
+		}
+	}
+
+	return count;
+}
+
+
+// stable LSD radix sort on the 16 bit depth key, in place
+// each pass counts digits per chunk in parallel and then scatters per chunk in parallel
+static void radixSortCubes(WorkerPool &workers, std::vector<uint64_t> &keys, std::vector<uint64_t> &temp, unsigned int count) {
+	if (count < 2) {
+		return;
+	}
+
+	const unsigned int numChunks = (count + cubeChunkSize - 1) / cubeChunkSize;
+	std::vector<std::array<unsigned int, 256> > offsets(numChunks);
+	temp.resize(keys.size());
+
+	uint64_t *src = &keys[0];
+	uint64_t *dst = &temp[0];
+	for (unsigned int shift = 32; shift < 48; shift += 8) {
+		workers.run(numChunks, [&] (unsigned int chunk) {
+			auto &histogram = offsets[chunk];
+			histogram.fill(0);
+			unsigned int end = std::min((chunk + 1) * cubeChunkSize, count);
+			for (unsigned int i = chunk * cubeChunkSize; i < end; i++) {
+				histogram[(src[i] >> shift) & 0xFF]++;
+			}
+		} );
+
+		// turn counts into output positions, digit major so equal keys keep chunk order
+		unsigned int sum = 0;
+		for (unsigned int digit = 0; digit < 256; digit++) {
+			for (auto &chunkOffsets : offsets) {
+				unsigned int c = chunkOffsets[digit];
+				chunkOffsets[digit] = sum;
+				sum += c;
+			}
+		}
+		assert(sum == count);
+
+		workers.run(numChunks, [&] (unsigned int chunk) {
+			auto &pos = offsets[chunk];
+			unsigned int end = std::min((chunk + 1) * cubeChunkSize, count);
+			for (unsigned int i = chunk * cubeChunkSize; i < end; i++) {
+				dst[pos[(src[i] >> shift) & 0xFF]++] = src[i];
+			}
+		} );
+
+		std::swap(src, dst);
+	}
+
+	// even number of passes so result is back in keys
+	assert(src == &keys[0]);
+}
+
+
+void SMAADemo::cullAndSortCubes(const glm::mat4 &viewProj, float nearPlane, float farPlane) {
+	PROFILE_FUNCTION();
+
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	visibleCubes.resize(numCubes);
+
+	if (!cullCubes) {
+		for (unsigned int i = 0; i < numCubes; i++) {
+			visibleCubes[i] = i;
+		}
+		visibleCubeCount = numCubes;
+		cullTime         = 0;
+		sortTime         = 0;
+		return;
+	}
+
+	uint64_t start = getNanoseconds();
+
+	CullParams params;
+	frustumPlanes(viewProj, &params.planes[0]);
+	// dot with clip space w row gives view depth
+	params.depthRow   = glm::vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+	params.depthBias  = nearPlane;
+	params.depthScale = 65535.0f / std::max(farPlane - nearPlane, 1.0f);
+
+	// each chunk writes its visible cubes at its own start, compacted after
+	const unsigned int numChunks = (numCubes + cubeChunkSize - 1) / cubeChunkSize;
+	cullKeys.resize(numCubes);
+	chunkCounts.resize(numChunks);
+	workers.run(numChunks, [&] (unsigned int chunk) {
+		unsigned int begin = chunk * cubeChunkSize;
+		unsigned int end   = std::min(begin + cubeChunkSize, numCubes);
+		chunkCounts[chunk] = cullCubeRange(&cubes[0], begin, end, params, &cullKeys[begin]);
+	} );
+
+	unsigned int count = 0;
+	for (unsigned int chunk = 0; chunk < numChunks; chunk++) {
+		unsigned int begin = chunk * cubeChunkSize;
+		if (begin == count) {
+			// nothing culled so far, already in place
+			count += chunkCounts[chunk];
+			continue;
+		}
+		std::copy(cullKeys.begin() + begin, cullKeys.begin() + begin + chunkCounts[chunk], cullKeys.begin() + count);
+		count += chunkCounts[chunk];
+	}
+	visibleCubeCount = count;
+
+	uint64_t culled = getNanoseconds();
+	cullTime = culled - start;
+
+	radixSortCubes(workers, cullKeys, sortTemp, count);
+	for (unsigned int i = 0; i < count; i++) {
+		visibleCubes[i] = static_cast<uint32_t>(cullKeys[i]);
+	}
+
+	sortTime = getNanoseconds() - culled;
+}
+
+
+void SMAADemo::gpuCullCubes(const glm::mat4 &viewProj, const ShaderDefines::Globals &globals) {
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+
+	// results stay on the GPU, CPU side stats don't apply
+	visibleCubeCount = 0;
+	cullTime         = 0;
+	sortTime         = 0;
+
+	if (gpuVisibleCubesCount != numCubes) {
+		if (gpuVisibleCubes) {
+			renderer.deleteBuffer(gpuVisibleCubes);
+		}
+		gpuVisibleCubesCount = numCubes;
+		gpuVisibleCubes      = renderer.createBuffer(BufferUsage::Dynamic, numCubes * sizeof(uint32_t), nullptr);
+	}
+
+	if (!cubeDrawArgs) {
+		cubeDrawArgs = renderer.createBuffer(BufferUsage::Dynamic, sizeof(ShaderDefines::DrawIndexedIndirectArgs), nullptr);
+	}
+
+	// culling appends to instanceCount
+	ShaderDefines::DrawIndexedIndirectArgs drawArgs;
+	drawArgs.indexCount    = 3 * 2 * 6;
+	drawArgs.instanceCount = 0;
+	drawArgs.firstIndex    = 0;
+	drawArgs.vertexOffset  = 0;
+	drawArgs.firstInstance = 0;
+	renderer.updateBuffer(cubeDrawArgs, 0, sizeof(drawArgs), &drawArgs);
+
+	ShaderDefines::CullParameters cullParams;
+	frustumPlanes(viewProj, &cullParams.planes[0]);
+	cullParams.cubeRadius = cubeRadius;
+	cullParams.numCubes   = numCubes;
+	cullParams.pad0       = 0;
+	cullParams.pad1       = 0;
+
+	renderer.bindPipeline(packedCubes ? packedCullPipeline : cullPipeline);
+
+	GlobalDS globalDS;
+	globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler  = linearSampler;
+	globalDS.nearestSampler = nearestSampler;
+	renderer.bindDescriptorSet(0, globalDS);
+
+	CullDS cullDS;
+	cullDS.instances        = cubeInstances;
+	cullDS.visibleInstances = gpuVisibleCubes;
+	cullDS.drawArgs         = cubeDrawArgs;
+	cullDS.cullUniforms     = renderer.createEphemeralBuffer(sizeof(ShaderDefines::CullParameters), &cullParams);
+	renderer.bindDescriptorSet(1, cullDS);
+
+	renderer.dispatch((numCubes + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+
 void SMAADemo::mainLoopIteration() {
+	PROFILE_FUNCTION();
+
 	ImGuiIO& io = ImGui::GetIO();
 
 	// TODO: timing
@@ -1376,7 +2624,7 @@ void SMAADemo::mainLoopIteration() {
 				break;
 
 			case SDL_SCANCODE_D:
-				if (antialiasing && aaMethod == AAMethod::SMAA) {
+				if (antialiasing && (aaMethod == AAMethod::SMAA || aaMethod == AAMethod::SMAACompute)) {
 					if (leftShift || rightShift) {
 						debugMode = (debugMode + 3 - 1) % 3;
 					} else {
@@ -1393,6 +2641,12 @@ void SMAADemo::mainLoopIteration() {
 				aaMethod = AAMethod((int(aaMethod) + 1) % (int(AAMethod::LAST) + 1));
 				break;
 
+#ifdef ENABLE_PROFILER
+			case SDL_SCANCODE_P:
+				profilerWriteTrace(profileFile);
+				break;
+#endif  // ENABLE_PROFILER
+
 			case SDL_SCANCODE_Q:
 				switch (aaMethod) {
 				case AAMethod::FXAA:
@@ -1405,6 +2659,7 @@ void SMAADemo::mainLoopIteration() {
 					break;
 
 				case AAMethod::SMAA:
+				case AAMethod::SMAACompute:
 					if (leftShift || rightShift) {
 						smaaKey.quality = smaaKey.quality + maxSMAAQuality - 1;
 					} else {
@@ -1543,6 +2798,8 @@ void SMAADemo::mainLoopIteration() {
 
 
 void SMAADemo::render() {
+	PROFILE_FUNCTION();
+
 	if (recreateSwapchain) {
 		SwapchainDesc desc;
 		desc.fullscreen = fullscreen;
@@ -1554,20 +2811,15 @@ void SMAADemo::render() {
 		renderer.setSwapchainDesc(desc);
 	}
 
-	uint64_t ticks   = getNanoseconds();
-	uint64_t elapsed = ticks - lastTime;
-
+	uint64_t ticks;
 	if (fpsLimitActive) {
-		uint64_t nsLimit = 1000000000ULL / fpsLimit;
-		while (elapsed + sleepFudge < nsLimit) {
-			// limit reached, throttle
-			uint64_t nsWait = nsLimit - (elapsed + sleepFudge);
-			std::this_thread::sleep_for(std::chrono::nanoseconds(nsWait));
-			ticks   = getNanoseconds();
-			elapsed = ticks - lastTime;
-		}
+		ticks = framePacer.wait();
+	} else {
+		framePacer.reset();
+		ticks = getNanoseconds();
 	}
 
+	uint64_t elapsed = ticks - lastTime;
 	lastTime = ticks;
 
 	renderer.beginFrame();
@@ -1598,13 +2850,19 @@ void SMAADemo::render() {
 	globals.predicationStrength  = predicationStrength;
 	globals.pad0 = 0;
 
-	renderer.beginRenderPass(sceneRenderPass, sceneFramebuffer);
+	globals.cubeGridSpacing      = cubeGridSpacing;
+	globals.cubeGridOrigin       = cubeGridOrigin;
+	globals.pad1 = 0;
+	globals.pad2 = 0;
 
-	if (activeScene == 0) {
-		renderer.bindPipeline(cubePipeline);
+	// buffer updates must happen outside render passes
+	uploadCubes();
 
+	// culling has to happen before the render pass since it might use compute
+	if (activeScene == 0) {
 		if (rotateCubes) {
-			rotationTime += elapsed;
+			// benchmarks step a fixed amount per frame so every run sees the same frames
+			rotationTime += wantBenchmark() ? benchmarkFrameStep : elapsed;
 
 			const uint64_t rotationPeriod = 30 * 1000000000ULL;
 			rotationTime   = rotationTime % rotationPeriod;
@@ -1623,148 +2881,310 @@ void SMAADemo::render() {
 		glm::mat4 proj   = glm::perspective(float(65.0f * M_PI * 2.0f / 360.0f), float(windowWidth) / windowHeight, nearPlane, farPlane);
 		globals.viewProj = proj * view * model;
 
-		renderer.setViewport(0, 0, windowWidth, windowHeight);
+		if (cullCubes && gpuCull) {
+			gpuCullCubes(globals.viewProj, globals);
+		} else {
+			cullAndSortCubes(globals.viewProj, nearPlane, farPlane);
+		}
+	}
 
-		GlobalDS globalDS;
-		globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &globals);
-		globalDS.linearSampler  = linearSampler;
-		globalDS.nearestSampler = nearestSampler;
-		renderer.bindDescriptorSet(0, globalDS);
+	PassConfig config;
+	config.antialiasing = antialiasing;
+	config.aaMethod     = aaMethod;
+	config.debugMode    = debugMode;
+	config.globals      = globals;
+	config.elapsed      = elapsed;
 
-		renderer.bindVertexBuffer(0, cubeVBO);
-		renderer.bindIndexBuffer(cubeIBO, false);
+	if (antialiasing && aaMethod != AAMethod::FXAA) {
+		smaaKey.compute = (aaMethod == AAMethod::SMAACompute);
 
-		CubeSceneDS cubeDS;
-		cubeDS.instances = renderer.createEphemeralBuffer(static_cast<uint32_t>(sizeof(ShaderDefines::Cube) * cubes.size()), &cubes[0]);
-		renderer.bindDescriptorSet(1, cubeDS);
+		// keep using the previous pipelines until the new ones are ready
+		// switch all of them at once so passes always match
+		if (requestSMAAPipelines(smaaKey)) {
+			activeSMAAKey = smaaKey;
+		}
+	}
+	config.smaaKey      = activeSMAAKey;
 
-		renderer.drawIndexedInstanced(3 * 2 * 6, static_cast<unsigned int>(cubes.size()));
-	} else {
-		renderer.bindPipeline(imagePipeline);
+	declarePasses(config);
+	frameGraph.execute(renderer);
+}
 
-		const auto &image = images.at(activeScene - 1);
 
-		renderer.setViewport(0, 0, windowWidth, windowHeight);
+void SMAADemo::declarePasses(const PassConfig &config) {
+	PROFILE_FUNCTION();
 
-		GlobalDS globalDS;
-		globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &globals);
-		globalDS.linearSampler = linearSampler;
-		globalDS.nearestSampler = nearestSampler;
-		renderer.bindDescriptorSet(0, globalDS);
+	frameGraph.renderPass("scene", sceneRenderPass, sceneFramebuffer)
+	          .writes(rendertargets[RenderTargets::MainColor])
+	          .depthStencil(rendertargets[RenderTargets::MainDepth])
+	          .function([=] () {
+		if (activeScene == 0) {
+			bool culledOnGPU = cullCubes && gpuCull;
+			if (culledOnGPU) {
+				renderer.bindPipeline(packedCubes ? packedGPUCubePipeline : gpuCubePipeline);
+			} else {
+				renderer.bindPipeline(packedCubes ? packedCubePipeline : cubePipeline);
+			}
 
-		assert(activeScene - 1 < images.size());
-		ColorTexDS colorDS;
-		colorDS.color = image.tex;
-		renderer.bindDescriptorSet(1, colorDS);
-		renderer.draw(0, 3);
-	}
-	renderer.endRenderPass();
+			renderer.setViewport(0, 0, windowWidth, windowHeight);
+
+			GlobalDS globalDS;
+			globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &config.globals);
+			globalDS.linearSampler  = linearSampler;
+			globalDS.nearestSampler = nearestSampler;
+			renderer.bindDescriptorSet(0, globalDS);
+
+			renderer.bindVertexBuffer(0, cubeVBO);
+			renderer.bindIndexBuffer(cubeIBO, false);
+
+			if (culledOnGPU) {
+				GPUCubeSceneDS cubeDS;
+				cubeDS.instances        = cubeInstances;
+				cubeDS.visibleInstances = gpuVisibleCubes;
+				renderer.bindDescriptorSet(1, cubeDS);
 
-	if (antialiasing) {
-		switch (aaMethod) {
+				renderer.drawIndexedIndirect(cubeDrawArgs, 0);
+			} else if (visibleCubeCount > 0) {
+				// nothing to draw if everything was culled
+				CubeSceneDS cubeDS;
+				cubeDS.instances        = cubeInstances;
+				cubeDS.visibleInstances = renderer.createEphemeralBuffer(visibleCubeCount * sizeof(uint32_t), &visibleCubes[0]);
+				renderer.bindDescriptorSet(1, cubeDS);
+
+				renderer.drawIndexedInstanced(3 * 2 * 6, visibleCubeCount);
+			}
+		} else {
+			renderer.bindPipeline(imagePipeline);
+
+			const auto &image = images.at(activeScene - 1);
+
+			renderer.setViewport(0, 0, windowWidth, windowHeight);
+
+			GlobalDS globalDS;
+			globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &config.globals);
+			globalDS.linearSampler = linearSampler;
+			globalDS.nearestSampler = nearestSampler;
+			renderer.bindDescriptorSet(0, globalDS);
+
+			assert(activeScene - 1 < images.size());
+			// large images are streamed in over several frames, leave the screen clear until done
+			if (renderer.isTextureReady(image.tex)) {
+				ColorTexDS colorDS;
+				colorDS.color = image.tex;
+				renderer.bindDescriptorSet(1, colorDS);
+				renderer.draw(0, 3);
+			}
+		}
+	});
+
+	if (config.antialiasing) {
+		switch (config.aaMethod) {
 		case AAMethod::FXAA: {
-			renderer.beginRenderPass(finalRenderPass, finalFramebuffer);
-			renderer.bindPipeline(getFXAAPipeline(fxaaQuality));
-			ColorCombinedDS colorDS;
-			colorDS.color.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainColor]);
-			colorDS.color.sampler = linearSampler;
-			renderer.bindDescriptorSet(1, colorDS);
-			renderer.draw(0, 3);
-			drawGUI(elapsed);
-			renderer.endRenderPass();
+			frameGraph.renderPass("FXAA", finalRenderPass, finalFramebuffer)
+			          .reads(rendertargets[RenderTargets::MainColor])
+			          .writes(rendertargets[RenderTargets::FinalRender])
+			          .function([=] () {
+				renderer.bindPipeline(getFXAAPipeline(fxaaQuality));
+				ColorCombinedDS colorDS;
+				colorDS.color.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainColor]);
+				colorDS.color.sampler = linearSampler;
+				renderer.bindDescriptorSet(1, colorDS);
+				renderer.draw(0, 3);
+				drawGUI(config.elapsed);
+			});
 		} break;
 
-		case AAMethod::SMAA: {
-			// edges pass
-			const SMAAPipelines &pipelines = getSMAAPipelines(smaaKey);
-			renderer.beginRenderPass(smaaEdgesRenderPass, smaaEdgesFramebuffer);
-			renderer.bindPipeline(pipelines.edgePipeline);
-
-			EdgeDetectionDS edgeDS;
-			if (smaaKey.edgeMethod == SMAAEdgeMethod::Depth) {
-				edgeDS.color.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainDepth]);
+		case AAMethod::SMAA:
+		case AAMethod::SMAACompute: {
+			// pipelines are looked up when the passes run
+			// createFramebuffers declares these before any exist
+			const bool depthEdges = (config.smaaKey.edgeMethod == SMAAEdgeMethod::Depth);
+			RenderTargetHandle edgeInputRT = rendertargets[depthEdges ? RenderTargets::MainDepth : RenderTargets::MainColor];
+
+			if (config.smaaKey.compute) {
+				// edges and weights can't be merged into one dispatch
+				// weight search needs the edges of neighboring tiles
+				const unsigned int groupsX = (windowWidth  + SMAA_TILE_SIZE - 1) / SMAA_TILE_SIZE;
+				const unsigned int groupsY = (windowHeight + SMAA_TILE_SIZE - 1) / SMAA_TILE_SIZE;
+
+				auto edgesPass = frameGraph.computePass("SMAA edges");
+				edgesPass.reads(edgeInputRT);
+				if (edgeInputRT == rendertargets[RenderTargets::MainColor]) {
+					// predication
+					edgesPass.reads(rendertargets[RenderTargets::MainDepth]);
+				}
+				edgesPass.writes(rendertargets[RenderTargets::Edges])
+				         .function([=] () {
+					const SMAAPipelines &pipelines = getSMAAPipelines(config.smaaKey);
+					renderer.bindPipeline(pipelines.edgePipeline);
+
+					GlobalDS globalDS;
+					globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &config.globals);
+					globalDS.linearSampler  = linearSampler;
+					globalDS.nearestSampler = nearestSampler;
+					renderer.bindDescriptorSet(0, globalDS);
+
+					TextureHandle edgeInput = depthEdges ? renderer.getRenderTargetTexture(edgeInputRT) : renderer.getRenderTargetView(edgeInputRT, Format::RGBA8);
+					EdgeDetectionComputeDS edgeDS;
+					edgeDS.color.tex              = edgeInput;
+					edgeDS.color.sampler          = nearestSampler;
+					edgeDS.predicationTex.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainDepth]);
+					edgeDS.predicationTex.sampler = nearestSampler;
+					edgeDS.edges                  = renderer.getRenderTargetTexture(rendertargets[RenderTargets::Edges]);
+					renderer.bindDescriptorSet(1, edgeDS);
+					renderer.dispatch(groupsX, groupsY, 1);
+				});
+
+				frameGraph.computePass("SMAA weights")
+				          .reads(rendertargets[RenderTargets::Edges])
+				          .writes(rendertargets[RenderTargets::BlendWeights])
+				          .function([=] () {
+					const SMAAPipelines &pipelines = getSMAAPipelines(config.smaaKey);
+					renderer.bindPipeline(pipelines.blendWeightPipeline);
+
+					GlobalDS globalDS;
+					globalDS.globalUniforms = renderer.createEphemeralBuffer(sizeof(ShaderDefines::Globals), &config.globals);
+					globalDS.linearSampler  = linearSampler;
+					globalDS.nearestSampler = nearestSampler;
+					renderer.bindDescriptorSet(0, globalDS);
+
+					BlendWeightComputeDS blendWeightDS;
+					blendWeightDS.edgesTex.tex      = renderer.getRenderTargetTexture(rendertargets[RenderTargets::Edges]);
+					blendWeightDS.edgesTex.sampler  = linearSampler;
+					blendWeightDS.areaTex.tex       = areaTex;
+					blendWeightDS.areaTex.sampler   = linearSampler;
+					blendWeightDS.searchTex.tex     = searchTex;
+					blendWeightDS.searchTex.sampler = linearSampler;
+					blendWeightDS.blendWeights      = renderer.getRenderTargetTexture(rendertargets[RenderTargets::BlendWeights]);
+					renderer.bindDescriptorSet(1, blendWeightDS);
+					renderer.dispatch(groupsX, groupsY, 1);
+				});
 			} else {
-				edgeDS.color.tex     = renderer.getRenderTargetView(rendertargets[RenderTargets::MainColor], Format::RGBA8);
+				auto edgesPass = frameGraph.renderPass("SMAA edges", smaaEdgesRenderPass, smaaEdgesFramebuffer);
+				edgesPass.reads(edgeInputRT);
+				if (edgeInputRT == rendertargets[RenderTargets::MainColor]) {
+					// predication
+					edgesPass.reads(rendertargets[RenderTargets::MainDepth]);
+				}
+				if (rendertargets[RenderTargets::SMAAStencil]) {
+					edgesPass.depthStencil(rendertargets[RenderTargets::SMAAStencil]);
+				}
+				edgesPass.writes(rendertargets[RenderTargets::Edges])
+				         .function([=] () {
+					const SMAAPipelines &pipelines = getSMAAPipelines(config.smaaKey);
+					renderer.bindPipeline(pipelines.edgePipeline);
+
+					TextureHandle edgeInput = depthEdges ? renderer.getRenderTargetTexture(edgeInputRT) : renderer.getRenderTargetView(edgeInputRT, Format::RGBA8);
+					EdgeDetectionDS edgeDS;
+					edgeDS.color.tex     = edgeInput;
+					edgeDS.color.sampler = nearestSampler;
+					edgeDS.predicationTex.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainDepth]);
+					edgeDS.predicationTex.sampler = nearestSampler;
+					renderer.bindDescriptorSet(1, edgeDS);
+					renderer.draw(0, 3);
+				});
+
+				auto weightsPass = frameGraph.renderPass("SMAA weights", smaaWeightsRenderPass, smaaWeightsFramebuffer);
+				weightsPass.reads(rendertargets[RenderTargets::Edges]);
+				if (rendertargets[RenderTargets::SMAAStencil]) {
+					weightsPass.depthStencil(rendertargets[RenderTargets::SMAAStencil]);
+				}
+				weightsPass.writes(rendertargets[RenderTargets::BlendWeights])
+				           .function([=] () {
+					const SMAAPipelines &pipelines = getSMAAPipelines(config.smaaKey);
+					renderer.bindPipeline(pipelines.blendWeightPipeline);
+					BlendWeightDS blendWeightDS;
+					blendWeightDS.edgesTex.tex      = renderer.getRenderTargetTexture(rendertargets[RenderTargets::Edges]);
+					blendWeightDS.edgesTex.sampler  = linearSampler;
+					blendWeightDS.areaTex.tex       = areaTex;
+					blendWeightDS.areaTex.sampler   = linearSampler;
+					blendWeightDS.searchTex.tex     = searchTex;
+					blendWeightDS.searchTex.sampler = linearSampler;
+					renderer.bindDescriptorSet(1, blendWeightDS);
+
+					renderer.draw(0, 3);
+				});
 			}
-			edgeDS.color.sampler = nearestSampler;
-			edgeDS.predicationTex.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainDepth]);
-			edgeDS.predicationTex.sampler = nearestSampler;
-			renderer.bindDescriptorSet(1, edgeDS);
-			renderer.draw(0, 3);
-			renderer.endRenderPass();
-
-			// blendweights pass
-			renderer.beginRenderPass(smaaWeightsRenderPass, smaaWeightsFramebuffer);
-			renderer.bindPipeline(pipelines.blendWeightPipeline);
-			BlendWeightDS blendWeightDS;
-			blendWeightDS.edgesTex.tex      = renderer.getRenderTargetTexture(rendertargets[RenderTargets::Edges]);
-			blendWeightDS.edgesTex.sampler  = linearSampler;
-			blendWeightDS.areaTex.tex       = areaTex;
-			blendWeightDS.areaTex.sampler   = linearSampler;
-			blendWeightDS.searchTex.tex     = searchTex;
-			blendWeightDS.searchTex.sampler = linearSampler;
-			renderer.bindDescriptorSet(1, blendWeightDS);
-
-			renderer.draw(0, 3);
-			renderer.endRenderPass();
 
 			// final blending pass/debug pass
-			renderer.beginRenderPass(finalRenderPass, finalFramebuffer);
-
-			switch (debugMode) {
-			case 0: {
-				// full effect
-				renderer.bindPipeline(pipelines.neighborPipeline);
-
-				NeighborBlendDS neighborBlendDS;
-				neighborBlendDS.color.tex            = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainColor]);
-				neighborBlendDS.color.sampler        = linearSampler;
-				neighborBlendDS.blendweights.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::BlendWeights]);
-				neighborBlendDS.blendweights.sampler = linearSampler;
-				renderer.bindDescriptorSet(1, neighborBlendDS);
-			} break;
-
-			case 1: {
-				// visualize edges
-				ColorTexDS blitDS;
-				renderer.bindPipeline(blitPipeline);
-				blitDS.color   = renderer.getRenderTargetTexture(rendertargets[RenderTargets::Edges]);
-				renderer.bindDescriptorSet(1, blitDS);
-			} break;
+			// debug modes only read one of the SMAA targets so the graph culls what they don't need
+			auto blendPass = frameGraph.renderPass("SMAA blend", finalRenderPass, finalFramebuffer);
+			switch (config.debugMode) {
+			case 0:
+				blendPass.reads(rendertargets[RenderTargets::MainColor])
+				         .reads(rendertargets[RenderTargets::BlendWeights]);
+				break;
 
-			case 2: {
-				// visualize blend weights
-				ColorTexDS blitDS;
-				renderer.bindPipeline(blitPipeline);
-				blitDS.color   = renderer.getRenderTargetTexture(rendertargets[RenderTargets::BlendWeights]);
-				renderer.bindDescriptorSet(1, blitDS);
-			} break;
+			case 1:
+				blendPass.reads(rendertargets[RenderTargets::Edges]);
+				break;
 
+			case 2:
+				blendPass.reads(rendertargets[RenderTargets::BlendWeights]);
+				break;
 			}
-			renderer.draw(0, 3);
-			drawGUI(elapsed);
 
-			renderer.endRenderPass();
+			blendPass.writes(rendertargets[RenderTargets::FinalRender])
+			         .function([=] () {
+				const SMAAPipelines &pipelines = getSMAAPipelines(config.smaaKey);
+
+				switch (config.debugMode) {
+				case 0: {
+					// full effect
+					renderer.bindPipeline(pipelines.neighborPipeline);
+
+					NeighborBlendDS neighborBlendDS;
+					neighborBlendDS.color.tex            = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainColor]);
+					neighborBlendDS.color.sampler        = linearSampler;
+					neighborBlendDS.blendweights.tex     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::BlendWeights]);
+					neighborBlendDS.blendweights.sampler = linearSampler;
+					renderer.bindDescriptorSet(1, neighborBlendDS);
+				} break;
+
+				case 1: {
+					// visualize edges
+					ColorTexDS blitDS;
+					renderer.bindPipeline(blitPipeline);
+					blitDS.color   = renderer.getRenderTargetTexture(rendertargets[RenderTargets::Edges]);
+					renderer.bindDescriptorSet(1, blitDS);
+				} break;
+
+				case 2: {
+					// visualize blend weights
+					ColorTexDS blitDS;
+					renderer.bindPipeline(blitPipeline);
+					blitDS.color   = renderer.getRenderTargetTexture(rendertargets[RenderTargets::BlendWeights]);
+					renderer.bindDescriptorSet(1, blitDS);
+				} break;
+
+				}
+				renderer.draw(0, 3);
+				drawGUI(config.elapsed);
+			});
 		} break;
 		}
 
 	} else {
-		renderer.beginRenderPass(finalRenderPass, finalFramebuffer);
-		renderer.bindPipeline(blitPipeline);
-		ColorTexDS colorDS;
-		colorDS.color     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainColor]);
-		renderer.bindDescriptorSet(1, colorDS);
-		renderer.draw(0, 3);
-		drawGUI(elapsed);
-		renderer.endRenderPass();
+		frameGraph.renderPass("final", finalRenderPass, finalFramebuffer)
+		          .reads(rendertargets[RenderTargets::MainColor])
+		          .writes(rendertargets[RenderTargets::FinalRender])
+		          .function([=] () {
+			renderer.bindPipeline(blitPipeline);
+			ColorTexDS colorDS;
+			colorDS.color     = renderer.getRenderTargetTexture(rendertargets[RenderTargets::MainColor]);
+			renderer.bindDescriptorSet(1, colorDS);
+			renderer.draw(0, 3);
+			drawGUI(config.elapsed);
+		});
 	}
 
-	renderer.presentFrame(rendertargets[RenderTargets::FinalRender]);
-
+	frameGraph.present(rendertargets[RenderTargets::FinalRender]);
 }
 
 
 void SMAADemo::drawGUI(uint64_t elapsed) {
+	PROFILE_FUNCTION();
+
 	ImGuiIO& io    = ImGui::GetIO();
 	io.DeltaTime   = float(double(elapsed) / double(1000000000ULL));
 	io.DisplaySize = ImVec2(static_cast<float>(windowWidth), static_cast<float>(windowHeight));
@@ -1792,7 +3212,8 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 			ImGui::Checkbox("Antialiasing", &antialiasing);
 			int aa = static_cast<int>(aaMethod);
 			ImGui::RadioButton("FXAA", &aa, static_cast<int>(AAMethod::FXAA)); ImGui::SameLine();
-			ImGui::RadioButton("SMAA", &aa, static_cast<int>(AAMethod::SMAA));
+			ImGui::RadioButton("SMAA", &aa, static_cast<int>(AAMethod::SMAA)); ImGui::SameLine();
+			ImGui::RadioButton("SMAA compute", &aa, static_cast<int>(AAMethod::SMAACompute));
 			aaMethod = static_cast<AAMethod>(aa);
 
 			int sq = smaaKey.quality;
@@ -1915,7 +3336,7 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 
 			int m = cubesPerSide;
 			bool changed = ImGui::InputInt("Cubes per side", &m);
-			if (changed && m > 0 && m < 64) {
+			if (changed && m > 0 && m <= int(maxCubesPerSide)) {
 				cubesPerSide = m;
 				createCubes();
 			}
@@ -1926,6 +3347,9 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 			}
 
 			ImGui::Checkbox("Rotate cubes", &rotateCubes);
+			ImGui::Checkbox("Packed cube data", &packedCubes);
+			ImGui::Checkbox("Cull and sort cubes", &cullCubes);
+			ImGui::Checkbox("Cull on GPU", &gpuCull);
 
 			ImGui::Separator();
 			ImGui::Text("Cube coloring mode");
@@ -1970,17 +3394,58 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 			bool changed = ImGui::InputInt("Max FPS", &f);
 			if (changed && f > 0) {
 				fpsLimit = f;
+				framePacer.setFrameRate(fpsLimit);
+			}
+
+			if (fpsLimitActive) {
+				// log2 microsecond buckets, see FramePacer
+				const auto &histogram = framePacer.getErrorHistogram();
+				std::array<float, FRAME_PACER_BUCKETS> values;
+				for (unsigned int i = 0; i < FRAME_PACER_BUCKETS; i++) {
+					values[i] = float(histogram[i]);
+				}
+				ImGui::PlotHistogram("Start error", &values[0], FRAME_PACER_BUCKETS, 0, "log2 us", 0.0f, FLT_MAX, ImVec2(0, 60));
+				ImGui::LabelText("Max start error us", "%.1f", double(framePacer.getMaxError()) / 1000.0);
+				ImGui::LabelText("Sleep slack us",     "%.1f", double(framePacer.getSlack()) / 1000.0);
+				if (ImGui::Button("Clear pacing stats")) {
+					framePacer.clearHistogram();
+				}
 			}
 
 			ImGui::Separator();
-			// TODO: measure actual GPU time
 			ImGui::LabelText("FPS", "%.1f", io.Framerate);
 			ImGui::LabelText("Frame time ms", "%.1f", 1000.0f / io.Framerate);
+			ImGui::LabelText("Culled passes", "%u", frameGraph.getCulledPasses());
+
+			// one per frame graph pass
+			// a few frames old since they're read back without waiting for the GPU
+			std::vector<GPUTiming> timings = renderer.getFrameTimings();
+			if (!timings.empty()) {
+				ImGui::Separator();
+				ImGui::Text("GPU ms (min / avg / max)");
+				double total = 0.0;
+				for (const auto &t : timings) {
+					ImGui::LabelText(t.name.c_str(), "%.3f / %.3f / %.3f", t.minMilliseconds, t.avgMilliseconds, t.maxMilliseconds);
+					total += t.milliseconds;
+				}
+				ImGui::LabelText("Sum of passes", "%.3f ms", total);
+			}
+
+			if (activeScene == 0) {
+				ImGui::Separator();
+				if (cullCubes && gpuCull) {
+					ImGui::LabelText("Visible cubes", "culled on GPU");
+				} else {
+					ImGui::LabelText("Visible cubes", "%u / %u", visibleCubeCount, static_cast<unsigned int>(cubes.size()));
+				}
+				ImGui::LabelText("Cull time ms",  "%.3f", double(cullTime) / 1000000.0);
+				ImGui::LabelText("Sort time ms",  "%.3f", double(sortTime) / 1000000.0);
+			}
 
-#ifdef RENDERER_VULKAN
 			ImGui::Separator();
-			// VMA memory allocation stats
 			MemoryStats stats = renderer.getMemStats();
+#ifdef RENDERER_VULKAN
+			// VMA memory allocation stats
 			float usedMegabytes = static_cast<float>(stats.usedBytes) / (1024.0f * 1024.0f);
 			float totalMegabytes = static_cast<float>(stats.usedBytes + stats.unusedBytes) / (1024.0f * 1024.0f);
 			ImGui::LabelText("Allocation count", "%u", stats.allocationCount);
@@ -1988,6 +3453,26 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 			ImGui::LabelText("Used memory (MB)", "%.2f", usedMegabytes);
 			ImGui::LabelText("Total memory (MB)", "%.2f", totalMegabytes);
 #endif
+			ImGui::LabelText("Aliased memory (MB)", "%.2f", static_cast<float>(stats.aliasedBytes) / (1024.0f * 1024.0f));
+
+			ImGui::Separator();
+			RingBufferStats ringStats = renderer.getRingBufferStats();
+			ImGui::LabelText("Ring segment (KB)",   "%u", ringStats.segmentSize / 1024);
+			ImGui::LabelText("Ring segments",       "%u (%u free)", ringStats.numSegments, ringStats.freeSegments);
+			ImGui::LabelText("Ring high water",     "%u", ringStats.highWaterMark);
+			ImGui::LabelText("Ring last frame",     "%u", ringStats.lastFrameSegments);
+			ImGui::LabelText("Ring grow / shrink",  "%u / %u", ringStats.growthEvents, ringStats.shrinkEvents);
+
+			ImGui::Separator();
+			RenderStats frameStats = renderer.getFrameStats();
+			ImGui::LabelText("Draw calls",          "%u", frameStats.drawCalls);
+			ImGui::LabelText("Dispatches",          "%u", frameStats.dispatches);
+			ImGui::LabelText("Render passes",       "%u", frameStats.renderPasses);
+			ImGui::LabelText("Pipeline binds",      "%u", frameStats.pipelineBinds);
+			ImGui::LabelText("Descriptor binds",    "%u", frameStats.descriptorSetBinds);
+			ImGui::LabelText("Barriers",            "%u", frameStats.barriers);
+			ImGui::LabelText("Ephemeral (KB)",      "%u in %u buffers", static_cast<unsigned int>(frameStats.ephemeralBytes / 1024), frameStats.ephemeralBuffers);
+			ImGui::LabelText("GL state calls",      "%u (%u elided)", frameStats.stateCallsIssued, frameStats.stateCallsElided);
 		}
 
 		if (ImGui::Button("Quit")) {
@@ -2027,8 +3512,8 @@ void SMAADemo::drawGUI(uint64_t elapsed) {
 		for (int n = 0; n < drawData->CmdListsCount; n++) {
 			const ImDrawList* cmd_list = drawData->CmdLists[n];
 
-			BufferHandle vtxBuf = renderer.createEphemeralBuffer(cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), cmd_list->VtxBuffer.Data);
-			BufferHandle idxBuf = renderer.createEphemeralBuffer(cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), cmd_list->IdxBuffer.Data);
+			EphemeralBuffer vtxBuf = renderer.createEphemeralBuffer(cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), cmd_list->VtxBuffer.Data);
+			EphemeralBuffer idxBuf = renderer.createEphemeralBuffer(cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), cmd_list->IdxBuffer.Data);
 			renderer.bindIndexBuffer(idxBuf, true);
 			renderer.bindVertexBuffer(0, vtxBuf);
 
@@ -2071,7 +3556,21 @@ int main(int argc, char *argv[]) {
 		demo->parseCommandLine(argc, argv);
 
 		demo->initRender();
+
+		if (demo->wantRingBufferBenchmark()) {
+			demo->ringBufferBenchmark();
+			logShutdown();
+			return 0;
+		}
+
 		demo->createCubes();
+
+		if (demo->wantBenchmark()) {
+			demo->benchmark();
+			logShutdown();
+			return 0;
+		}
+
 		printHelp();
 
 		while (demo->shouldKeepGoing()) {
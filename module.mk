@@ -40,6 +40,13 @@ LDFLAGS+=-fsanitize=undefined -fno-sanitize-recover=all
 endif  # UBSAN
 
 
+ifeq ($(PROFILER),y)
+
+CFLAGS+=-DENABLE_PROFILER
+
+endif  # PROFILER
+
+
 ifeq ($(LTO),y)
 
 CFLAGS+=$(LTOCFLAGS)
@@ -0,0 +1,507 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#include "FrameGraph.h"
+#include "utils/Utils.h"
+
+#include <algorithm>
+
+
+namespace renderer {
+
+
+static bool isRead(Access access) {
+	switch (access) {
+	case Access::ColorAttachment:
+	case Access::ComputeWrite:
+	case Access::DepthStencilAttachment:
+		return false;
+
+	case Access::ComputeRead:
+	case Access::FragmentRead:
+	case Access::TransferRead:
+		return true;
+	}
+
+	UNREACHABLE();
+	return false;
+}
+
+
+// previous contents don't matter
+static bool isOverwrite(Access access) {
+	return (access == Access::ColorAttachment || access == Access::ComputeWrite);
+}
+
+
+static bool contains(const std::vector<RenderTargetHandle> &rts, RenderTargetHandle rt) {
+	return std::find(rts.begin(), rts.end(), rt) != rts.end();
+}
+
+
+void FrameGraph::PassBuilder::use(RenderTargetHandle rt, Access access) {
+	assert(rt);
+	auto &pass = graph.passes.at(index);
+
+	// one use per render target, can't read and write the same thing
+	for (const auto &u : pass.uses) {
+		assert(!(u.rt == rt));
+	}
+
+	Use u;
+	u.rt     = rt;
+	u.access = access;
+	pass.uses.push_back(u);
+}
+
+
+FrameGraph::PassBuilder &FrameGraph::PassBuilder::reads(RenderTargetHandle rt) {
+	bool compute = !graph.passes.at(index).renderPass;
+	use(rt, compute ? Access::ComputeRead : Access::FragmentRead);
+	return *this;
+}
+
+
+FrameGraph::PassBuilder &FrameGraph::PassBuilder::writes(RenderTargetHandle rt) {
+	bool compute = !graph.passes.at(index).renderPass;
+	use(rt, compute ? Access::ComputeWrite : Access::ColorAttachment);
+	return *this;
+}
+
+
+FrameGraph::PassBuilder &FrameGraph::PassBuilder::depthStencil(RenderTargetHandle rt) {
+	assert(graph.passes.at(index).renderPass);
+	use(rt, Access::DepthStencilAttachment);
+	return *this;
+}
+
+
+FrameGraph::PassBuilder &FrameGraph::PassBuilder::function(std::function<void()> &&f) {
+	graph.passes.at(index).function = std::move(f);
+	return *this;
+}
+
+
+FrameGraph::FrameGraph()
+: numCulled(0)
+{
+}
+
+
+FrameGraph::~FrameGraph() {
+	assert(passes.empty());
+}
+
+
+FrameGraph::PassBuilder FrameGraph::renderPass(const std::string &name, RenderPassHandle renderPass, FramebufferHandle framebuffer) {
+	assert(renderPass);
+
+	Pass pass;
+	pass.name        = name;
+	pass.renderPass  = renderPass;
+	pass.framebuffer = framebuffer;
+	passes.push_back(std::move(pass));
+
+	return PassBuilder(*this, static_cast<unsigned int>(passes.size() - 1));
+}
+
+
+FrameGraph::PassBuilder FrameGraph::computePass(const std::string &name) {
+	Pass pass;
+	pass.name = name;
+	passes.push_back(std::move(pass));
+
+	return PassBuilder(*this, static_cast<unsigned int>(passes.size() - 1));
+}
+
+
+void FrameGraph::present(RenderTargetHandle rt) {
+	assert(rt);
+	assert(!output);
+	output = rt;
+}
+
+
+void FrameGraph::cull(std::vector<bool> &live) const {
+	// walk backwards from the output, a pass is live if
+	// something live later reads one of the render targets it writes
+	std::vector<RenderTargetHandle> needed;
+	needed.push_back(output);
+
+	for (unsigned int i = static_cast<unsigned int>(passes.size()); i-- > 0; ) {
+		const auto &pass = passes[i];
+
+		bool isLive = false;
+		for (const auto &u : pass.uses) {
+			if (!isRead(u.access) && contains(needed, u.rt)) {
+				isLive = true;
+				break;
+			}
+		}
+
+		if (!isLive) {
+			continue;
+		}
+		live[i] = true;
+
+		// earlier writers of overwritten targets are not needed for this
+		for (const auto &u : pass.uses) {
+			if (isOverwrite(u.access)) {
+				needed.erase(std::remove(needed.begin(), needed.end(), u.rt), needed.end());
+			}
+		}
+
+		for (const auto &u : pass.uses) {
+			if (!isOverwrite(u.access) && !contains(needed, u.rt)) {
+				needed.push_back(u.rt);
+			}
+		}
+	}
+}
+
+
+void FrameGraph::schedule(const std::vector<bool> &live) {
+	const unsigned int numPasses = static_cast<unsigned int>(passes.size());
+
+	// pass depends on every earlier pass it shares a render target with
+	// unless both only read it
+	std::vector<std::vector<unsigned int> > dependencies(numPasses);
+	for (unsigned int j = 0; j < numPasses; j++) {
+		if (!live[j]) {
+			continue;
+		}
+
+		for (unsigned int i = 0; i < j; i++) {
+			if (!live[i]) {
+				continue;
+			}
+
+			bool depends = false;
+			for (const auto &ui : passes[i].uses) {
+				for (const auto &uj : passes[j].uses) {
+					if (ui.rt == uj.rt && !(isRead(ui.access) && isRead(uj.access))) {
+						depends = true;
+					}
+				}
+			}
+
+			if (depends) {
+				dependencies[j].push_back(i);
+			}
+		}
+	}
+
+	// list scheduling in declaration order
+	// but prefer a pass which doesn't depend on the previous one
+	// so the GPU can run them without a barrier in between
+	std::vector<bool> done(numPasses, false);
+	unsigned int numLive = static_cast<unsigned int>(std::count(live.begin(), live.end(), true));
+	order.clear();
+	order.reserve(numLive);
+
+	while (order.size() < numLive) {
+		bool          found       = false;
+		unsigned int  firstReady  = 0;
+		bool          independent = false;
+		unsigned int  pick        = 0;
+
+		for (unsigned int i = 0; i < numPasses; i++) {
+			if (!live[i] || done[i]) {
+				continue;
+			}
+
+			const auto &deps = dependencies[i];
+			bool ready = std::all_of(deps.begin(), deps.end(), [&done] (unsigned int d) { return done[d]; });
+			if (!ready) {
+				continue;
+			}
+
+			if (!found) {
+				found      = true;
+				firstReady = i;
+			}
+
+			if (order.empty() || std::find(deps.begin(), deps.end(), order.back()) == deps.end()) {
+				independent = true;
+				pick        = i;
+				break;
+			}
+		}
+
+		// dependencies only point backwards so something is always ready
+		assert(found);
+		if (!independent) {
+			pick = firstReady;
+		}
+
+		done[pick] = true;
+		order.push_back(pick);
+	}
+}
+
+
+void FrameGraph::lifetimes(std::vector<Lifetime> &result) const {
+	result.clear();
+
+	for (unsigned int i = 0; i < order.size(); i++) {
+		for (const auto &u : passes[order[i]].uses) {
+			auto it = std::find_if(result.begin(), result.end(), [&u] (const Lifetime &l) { return l.rt == u.rt; });
+			if (it == result.end()) {
+				Lifetime l;
+				l.rt    = u.rt;
+				l.first = i;
+				l.last  = i;
+				result.push_back(l);
+			} else {
+				it->last = i;
+			}
+		}
+	}
+
+	// output is needed until it's presented
+	auto it = std::find_if(result.begin(), result.end(), [this] (const Lifetime &l) { return l.rt == output; });
+	assert(it != result.end());
+	it->last = static_cast<unsigned int>(order.size());
+}
+
+
+bool FrameGraph::overlapping(RenderTargetHandle a, RenderTargetHandle b) const {
+	return std::any_of(overlaps.begin(), overlaps.end(), [&a, &b] (const RenderTargetPair &p) {
+		return (p.first == a && p.second == b) || (p.first == b && p.second == a);
+	} );
+}
+
+
+void FrameGraph::transition(RenderTargetHandle rt, Access access, std::vector<RenderTargetBarrier> &barriers) {
+	// memory last used through another render target
+	// wait for that and forget whatever this one had
+	for (unsigned int g = 0; g < aliasGroups.size(); g++) {
+		if (!contains(aliasGroups[g], rt)) {
+			continue;
+		}
+
+		RenderTargetHandle previous = memoryUsers[g];
+		memoryUsers[g] = rt;
+		if (!previous || previous == rt) {
+			break;
+		}
+
+		// transient contents don't survive, first use in a frame can't be a read
+		assert(!isRead(access));
+		auto prev = std::find_if(states.begin(), states.end(), [&previous] (const State &s) { return s.rt == previous; });
+		assert(prev != states.end());
+
+		RenderTargetBarrier b;
+		b.rt      = rt;
+		b.before  = prev->lastAccess;
+		b.after   = access;
+		b.discard = true;
+		barriers.push_back(b);
+
+		auto it = std::find_if(states.begin(), states.end(), [&rt] (const State &s) { return s.rt == rt; });
+		if (it == states.end()) {
+			State s;
+			s.rt = rt;
+			states.push_back(s);
+			it = states.end() - 1;
+		}
+		it->lastAccess = access;
+		return;
+	}
+
+	auto it = std::find_if(states.begin(), states.end(), [&rt] (const State &s) { return s.rt == rt; });
+	if (it == states.end()) {
+		// first use, render pass takes it from undefined
+		State s;
+		s.rt         = rt;
+		s.lastAccess = access;
+		states.push_back(s);
+
+		// dispatch can't, the barrier has to do it
+		if (access == Access::ComputeWrite) {
+			RenderTargetBarrier b;
+			b.rt      = rt;
+			b.before  = access;
+			b.after   = access;
+			b.discard = true;
+			barriers.push_back(b);
+		}
+		return;
+	}
+
+	// reading again the same way needs nothing
+	if (isRead(access) && it->lastAccess == access) {
+		return;
+	}
+
+	RenderTargetBarrier b;
+	b.rt     = rt;
+	b.before = it->lastAccess;
+	b.after  = access;
+	barriers.push_back(b);
+
+	it->lastAccess = access;
+}
+
+
+void FrameGraph::execute(Renderer &renderer) {
+	assert(output);
+
+	std::vector<bool> live(passes.size(), false);
+	cull(live);
+	schedule(live);
+	numCulled = static_cast<unsigned int>(passes.size() - order.size());
+
+#ifndef NDEBUG
+	// a combination of passes which wasn't planned could break aliasing
+	{
+		std::vector<Lifetime> alive;
+		lifetimes(alive);
+		for (const auto &group : aliasGroups) {
+			for (const auto &a : alive) {
+				for (const auto &b : alive) {
+					if (!(a.rt == b.rt) && contains(group, a.rt) && contains(group, b.rt)) {
+						assert(a.last < b.first || b.last < a.first);
+					}
+				}
+			}
+		}
+	}
+#endif  // NDEBUG
+
+	std::vector<RenderTargetBarrier> barriers;
+	for (unsigned int i : order) {
+		auto &pass = passes[i];
+		assert(pass.function);
+		assert(!pass.renderPass || pass.framebuffer);
+
+		barriers.clear();
+		for (const auto &u : pass.uses) {
+			transition(u.rt, u.access, barriers);
+		}
+		if (!barriers.empty()) {
+			renderer.renderTargetBarriers(barriers);
+		}
+
+		// outside the render pass so load and store ops are included
+		renderer.beginTimestampScope(pass.name);
+		if (pass.renderPass) {
+			renderer.beginRenderPass(pass.renderPass, pass.framebuffer);
+			pass.function();
+			renderer.endRenderPass();
+		} else {
+			pass.function();
+		}
+		renderer.endTimestampScope();
+	}
+
+	// the swapchain render target is presented as is, anything else is blitted
+	if (!(output == renderer.getSwapchainRenderTarget())) {
+		barriers.clear();
+		transition(output, Access::TransferRead, barriers);
+		if (!barriers.empty()) {
+			renderer.renderTargetBarriers(barriers);
+		}
+	}
+	renderer.presentFrame(output);
+
+	passes.clear();
+	output = RenderTargetHandle();
+}
+
+
+void FrameGraph::plan() {
+	assert(output);
+
+	std::vector<bool> live(passes.size(), false);
+	cull(live);
+	schedule(live);
+
+	std::vector<Lifetime> alive;
+	lifetimes(alive);
+	for (unsigned int i = 0; i < alive.size(); i++) {
+		for (unsigned int j = i + 1; j < alive.size(); j++) {
+			const auto &a = alive[i];
+			const auto &b = alive[j];
+			if (a.last < b.first || b.last < a.first) {
+				continue;
+			}
+
+			if (!overlapping(a.rt, b.rt)) {
+				overlaps.emplace_back(a.rt, b.rt);
+			}
+		}
+	}
+
+	passes.clear();
+	order.clear();
+	output = RenderTargetHandle();
+}
+
+
+void FrameGraph::allocateTransients(Renderer &renderer, const std::vector<RenderTargetHandle> &rts) {
+	assert(passes.empty());
+	assert(aliasGroups.empty());
+
+	// greedy, first group where this doesn't overlap anything and the renderer agrees
+	for (const auto &rt : rts) {
+		bool placed = false;
+		for (auto &group : aliasGroups) {
+			bool fits = std::none_of(group.begin(), group.end(), [this, &rt] (const RenderTargetHandle &other) {
+				return overlapping(rt, other);
+			} );
+			if (!fits) {
+				continue;
+			}
+
+			group.push_back(rt);
+			if (renderer.canAliasRenderTargets(group)) {
+				placed = true;
+				break;
+			}
+			group.pop_back();
+		}
+
+		if (!placed) {
+			aliasGroups.emplace_back(1, rt);
+		}
+	}
+
+	for (const auto &group : aliasGroups) {
+		renderer.aliasRenderTargets(group);
+	}
+	memoryUsers.clear();
+	memoryUsers.resize(aliasGroups.size());
+}
+
+
+void FrameGraph::forgetRenderTargets() {
+	states.clear();
+	overlaps.clear();
+	aliasGroups.clear();
+	memoryUsers.clear();
+}
+
+
+}  // namespace renderer
@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+
+#include "Renderer.h"
+
+#include <functional>
+
+
+namespace renderer {
+
+
+// one frame worth of passes and the render targets they use
+// passes are declared in data flow order, execute() culls the ones which
+// don't contribute to the presented image, moves independent passes next
+// to each other so they can overlap and issues barriers in between
+class FrameGraph {
+	struct Use {
+		RenderTargetHandle  rt;
+		Access              access;
+	};
+
+	struct Pass {
+		std::string            name;
+		// both invalid for compute passes
+		RenderPassHandle       renderPass;
+		FramebufferHandle      framebuffer;
+		std::vector<Use>       uses;
+		std::function<void()>  function;
+	};
+
+	// last access to a render target
+	// kept across frames so the first use in a frame waits for the previous one
+	struct State {
+		RenderTargetHandle  rt;
+		Access              lastAccess;
+	};
+
+	// first and last index in order of the passes using a render target
+	struct Lifetime {
+		RenderTargetHandle  rt;
+		unsigned int        first;
+		unsigned int        last;
+	};
+
+	typedef std::pair<RenderTargetHandle, RenderTargetHandle>  RenderTargetPair;
+
+	std::vector<Pass>          passes;
+	RenderTargetHandle         output;
+	std::vector<State>         states;
+	// indices into passes in execution order, culled passes are missing
+	std::vector<unsigned int>  order;
+	unsigned int               numCulled;
+	// render targets which were alive at the same time in some planned frame
+	std::vector<RenderTargetPair>                   overlaps;
+	// transient render targets sharing memory
+	std::vector<std::vector<RenderTargetHandle> >   aliasGroups;
+	// per alias group, the render target which used the memory last
+	std::vector<RenderTargetHandle>                 memoryUsers;
+
+	void cull(std::vector<bool> &live) const;
+	void schedule(const std::vector<bool> &live);
+	void lifetimes(std::vector<Lifetime> &result) const;
+	bool overlapping(RenderTargetHandle a, RenderTargetHandle b) const;
+	void transition(RenderTargetHandle rt, Access access, std::vector<RenderTargetBarrier> &barriers);
+
+
+public:
+
+	class PassBuilder {
+		FrameGraph    &graph;
+		unsigned int  index;
+
+
+		PassBuilder(FrameGraph &graph_, unsigned int index_)
+		: graph(graph_)
+		, index(index_)
+		{
+		}
+
+		void use(RenderTargetHandle rt, Access access);
+
+		friend class FrameGraph;
+
+	public:
+
+		// sampled in shaders
+		PassBuilder &reads(RenderTargetHandle rt);
+
+		// color attachment or storage image, previous contents are not kept
+		PassBuilder &writes(RenderTargetHandle rt);
+
+		// might be loaded so counts as both read and write
+		PassBuilder &depthStencil(RenderTargetHandle rt);
+
+		// records the commands of the pass, called by execute() unless culled
+		// render passes are already begun when this is called
+		// each pass is timed with a timestamp scope named after it, don't begin another one inside
+		PassBuilder &function(std::function<void()> &&f);
+	};
+
+
+	FrameGraph();
+
+	FrameGraph(const FrameGraph &)            = delete;
+	FrameGraph(FrameGraph &&)                 = delete;
+
+	FrameGraph &operator=(const FrameGraph &) = delete;
+	FrameGraph &operator=(FrameGraph &&)      = delete;
+
+	~FrameGraph();
+
+	// framebuffer can be invalid when only planning
+	PassBuilder renderPass(const std::string &name, RenderPassHandle renderPass, FramebufferHandle framebuffer);
+	PassBuilder computePass(const std::string &name);
+
+	// render target shown on the screen, everything else is culled unless it contributes to this
+	// blitted unless it's the swapchain render target
+	void present(RenderTargetHandle rt);
+
+	// record live passes and present
+	// declared passes are forgotten afterwards, next frame must declare them again
+	void execute(Renderer &renderer);
+
+	// cull and schedule the declared passes like execute() but don't record anything
+	// remembers which render targets are alive at the same time
+	// declare and plan every combination of passes a frame might have
+	// before allocating transient render targets
+	void plan();
+
+	// shares memory between transient render targets
+	// whose lifetimes didn't overlap in any planned frame
+	// targets earlier in the list get first pick
+	void allocateTransients(Renderer &renderer, const std::vector<RenderTargetHandle> &rts);
+
+	// call after deleting render targets
+	// forgets planned lifetimes too
+	void forgetRenderTargets();
+
+	// from the last execute()
+	unsigned int getCulledPasses() const {
+		return numCulled;
+	}
+};
+
+
+}  // namespace renderer
+
+
+#endif  // FRAMEGRAPH_H
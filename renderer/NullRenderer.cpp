@@ -24,6 +24,7 @@ THE SOFTWARE.
 #ifdef RENDERER_NULL
 
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 
@@ -38,23 +39,39 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	currentRefreshRate = 60;
 	maxRefreshRate     = 60;
 
-	recreateRingBuffer(desc.ephemeralRingBufSize);
+	ringAlign          = 256;
+
 	drawableSize   = glm::uvec2(desc.swapchain.width, desc.swapchain.height);
 
 	frames.resize(desc.swapchain.numFrames);
+
+	swapchainFormat = Format::sRGBA8;
+	auto result = rendertargets.add();
+	result.first.desc.width(drawableSize.x).height(drawableSize.y).format(swapchainFormat).name("swapchain");
+	swapchainRenderTarget = result.second;
 }
 
 
-void RendererImpl::recreateRingBuffer(unsigned int newSize) {
-	assert(newSize > 0);
+void RendererImpl::createRingSegment(RingBufferSegment &seg, unsigned int size) {
+	assert(seg.size == 0);
+	assert(size > 0);
 
-	ringBufPtr  = 0;
-	ringBufSize = newSize;
-	ringBuffer.resize(newSize, 0);
+	seg.storage.resize(size, 0);
+	seg.mapping = &seg.storage[0];
+	seg.size    = size;
 	// TODO: use valgrind to make sure we only write to intended parts of ring buffer
 }
 
 
+void RendererImpl::deleteRingSegment(RingBufferSegment &seg) {
+	assert(seg.size != 0);
+
+	std::vector<char>().swap(seg.storage);
+	seg.mapping = nullptr;
+	seg.size    = 0;
+}
+
+
 RendererImpl::~RendererImpl() {
 	for (unsigned int i = 0; i < frames.size(); i++) {
 		auto &f = frames.at(i);
@@ -66,6 +83,8 @@ RendererImpl::~RendererImpl() {
 	}
 	frames.clear();
 
+	ringBufferShutdown();
+
 	SDL_Quit();
 }
 
@@ -76,40 +95,38 @@ bool RendererImpl::isRenderTargetFormatSupported(Format /* format */) const {
 }
 
 
-BufferHandle RendererImpl::createBuffer(uint32_t size, const void *contents) {
+BufferHandle RendererImpl::createBuffer(BufferUsage usage, uint32_t size, const void *contents) {
 	assert(size != 0);
-	assert(contents != nullptr);
+	assert(contents != nullptr || usage == BufferUsage::Dynamic);
 
 	auto result    = buffers.add();
 	Buffer &buffer = result.first;
-	buffer.ringBufferAlloc = false;
-	buffer.beginOffs       = 0;
 	buffer.size            = size;
-
-	// TODO: store contents into buffer
+	buffer.usage           = usage;
+	buffer.contents.resize(size, 0);
+	if (contents) {
+		memcpy(&buffer.contents[0], contents, size);
+	}
 
 	return result.second;
 }
 
 
-BufferHandle RendererImpl::createEphemeralBuffer(uint32_t size, const void *contents) {
+EphemeralBuffer RendererImpl::createEphemeralBuffer(uint32_t size, const void *contents) {
 	assert(size != 0);
 	assert(contents != nullptr);
 
-	unsigned int beginPtr = ringBufferAllocate(size, 256);
+	auto alloc = ringBufferAllocate(size, 256);
 
 	// TODO: use valgrind to enforce we only write to intended parts of ring buffer
-	memcpy(&ringBuffer[beginPtr], contents, size);
+	memcpy(ringSegments[alloc.segment].mapping + alloc.offset, contents, size);
 
-	auto result    = buffers.add();
-	Buffer &buffer = result.first;
-	buffer.ringBufferAlloc = true;
-	buffer.beginOffs       = beginPtr;
-	buffer.size            = size;
+	EphemeralBuffer buffer;
+	buffer.segment = alloc.segment;
+	buffer.offset  = alloc.offset;
+	buffer.size    = size;
 
-	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
-
-	return result.second;
+	return buffer;
 }
 
 
@@ -132,6 +149,18 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 
 
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PROFILE_FUNCTION();
+
+	if (desc.computeShader_) {
+		assert(!desc.vertexShader_);
+		assert(!desc.fragmentShader_);
+		assert(!desc.renderPass_);
+	} else {
+		assert(desc.vertexShader_);
+		assert(desc.fragmentShader_);
+		assert(desc.renderPass_);
+	}
+
 	auto result = pipelines.add();
 	auto &pipeline = result.first;
 	pipeline.desc = desc;
@@ -161,6 +190,17 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 }
 
 
+ComputeShaderHandle RendererImpl::createComputeShader(const std::string &name, const ShaderMacros & /* macros */) {
+	std::string computeShaderName = name + ".comp";
+
+	auto result_ = computeShaders.add();
+	auto &c = result_.first;
+	c.name      = computeShaderName;
+
+	return result_.second;
+}
+
+
 VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, const ShaderMacros & /* macros */) {
 	std::string vertexShaderName   = name + ".vert";
 
@@ -183,6 +223,26 @@ FragmentShaderHandle RendererImpl::createFragmentShader(const std::string &name,
 }
 
 
+bool RendererImpl::prepareShaders(const std::string & /* name */, const ShaderMacros & /* macros */) {
+	// nothing to compile
+	return true;
+}
+
+
+bool RendererImpl::prepareComputeShader(const std::string & /* name */, const ShaderMacros & /* macros */) {
+	// nothing to compile
+	return true;
+}
+
+
+bool RendererImpl::isPipelineReady(PipelineHandle handle) {
+	// make sure it exists
+	pipelines.get(handle);
+
+	return true;
+}
+
+
 TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	assert(desc.width_   > 0);
 	assert(desc.height_  > 0);
@@ -227,6 +287,26 @@ TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle /* handle */,
 }
 
 
+bool RendererImpl::isTextureReady(TextureHandle /* handle */) const {
+	return true;
+}
+
+
+void RendererImpl::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(size != 0);
+	assert(contents != nullptr);
+
+	Buffer &buffer = buffers.get(handle);
+	assert(buffer.usage == BufferUsage::Dynamic);
+	assert(offset + size <= buffer.size);
+
+	// no frames in flight to keep the old contents for
+	memcpy(&buffer.contents[offset], contents, size);
+}
+
+
 void RendererImpl::deleteBuffer(BufferHandle /* handle */) {
 }
 
@@ -251,9 +331,28 @@ void RendererImpl::deleteTexture(TextureHandle /* handle */) {
 }
 
 
+bool RendererImpl::canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const {
+	for (const auto &handle : rts) {
+		if (!rendertargets.get(handle).desc.transient_) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void RendererImpl::aliasRenderTargets(const std::vector<RenderTargetHandle> &rts) {
+	assert(!rts.empty());
+	assert(canAliasRenderTargets(rts));
+}
+
+
 void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 	swapchainDesc  = desc;
 	drawableSize   = glm::uvec2(desc.width, desc.height);
+
+	rendertargets.get(swapchainRenderTarget).desc.width(desc.width).height(desc.height);
 }
 
 
@@ -264,6 +363,8 @@ MemoryStats RendererImpl::getMemStats() const {
 
 
 void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
 	assert(!inFrame);
 	inFrame       = true;
 	inRenderPass  = false;
@@ -280,16 +381,21 @@ void RendererImpl::beginFrame() {
 		waitForFrame(currentFrameIdx);
 	}
 	assert(!frame.outstanding);
+
+	frame.commands.clear();
 }
 
 
 void RendererImpl::presentFrame(RenderTargetHandle /* rt */) {
+	PROFILE_FUNCTION();
+
 	assert(inFrame);
+	assert(!inTimestampScope);
 	inFrame = false;
 
 	auto &frame = frames.at(currentFrameIdx);
 
-	frame.usedRingBufPtr = ringBufPtr;
+	ringBufferEndFrame(frame);
 	frame.outstanding    = true;
 	frame.lastFrameNum   = frameNum;
 
@@ -303,27 +409,36 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 	Frame &frame = frames.at(frameIdx);
 	assert(frame.outstanding);
 
-	for (auto handle : frame.ephemeralBuffers) {
-		Buffer &buffer = buffers.get(handle);
-		if (buffer.ringBufferAlloc) {
-			buffer.ringBufferAlloc = false;
-		}
-
-		assert(buffer.size   >  0);
-		buffer.size = 0;
-		buffer.beginOffs = 0;
-
-		buffers.remove(handle);
-	}
-	frame.ephemeralBuffers.clear();
+	ringBufferRetireFrame(frame);
 	frame.outstanding    = false;
 	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
-	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+
+	// no GPU so nothing was timed, same as a device without timestamps
+	// zeros would look like measurements in benchmark reports
+	frameTimings.clear();
+	frame.timestampScopes.clear();
+	updateTimingHistory();
 }
 
 
 void RendererImpl::deleteFrameInternal(Frame &f) {
 	assert(!f.outstanding);
+	f.commands.clear();
+}
+
+
+void RendererImpl::record(CommandType type, std::initializer_list<uint32_t> args) {
+	record(type, args.begin(), args.size());
+}
+
+
+void RendererImpl::record(CommandType type, const uint32_t *args, size_t numArgs) {
+	assert(inFrame);
+	assert(numArgs < (1U << 24));
+
+	auto &commands = frames.at(currentFrameIdx).commands;
+	commands.push_back(static_cast<uint32_t>(type) | (static_cast<uint32_t>(numArgs) << 8));
+	commands.insert(commands.end(), args, args + numArgs);
 }
 
 
@@ -338,6 +453,8 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 
 	// make sure renderpass and framebuffer match
 	assert(fb.renderPass == rpHandle);
+
+	record(CommandType::BeginRenderPass, { rpHandle.handle, fbHandle.handle });
 }
 
 
@@ -345,57 +462,152 @@ void RendererImpl::endRenderPass() {
 	assert(inFrame);
 	assert(inRenderPass);
 	inRenderPass = false;
+
+	record(CommandType::EndRenderPass, {});
 }
 
 
 void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 	assert(inFrame);
 	assert(pipeline);
-	assert(inRenderPass);
 	assert(pipelineDrawn);
 	pipelineDrawn = false;
 	validPipeline = true;
 	scissorSet = false;
 
 	currentPipeline = pipelines.get(pipeline).desc;
+	// compute pipelines are used outside render passes, graphics inside
+	assert(inRenderPass == !currentPipeline.computeShader_);
+
+	record(CommandType::BindPipeline, { pipeline.handle });
 }
 
 
-void RendererImpl::bindIndexBuffer(BufferHandle /* buffer */, bool /* bit16 */ ) {
+void RendererImpl::bindIndexBuffer(BufferHandle buffer, bool bit16) {
 	assert(inFrame);
 	assert(validPipeline);
+
+	record(CommandType::BindIndexBuffer, { buffer.handle, bit16 ? 1U : 0U });
 }
 
 
-void RendererImpl::bindVertexBuffer(unsigned int /* binding */, BufferHandle /* buffer */) {
+void RendererImpl::bindIndexBuffer(EphemeralBuffer buffer, bool bit16) {
 	assert(inFrame);
 	assert(validPipeline);
+	assert(buffer.size > 0);
+	assert(ringSegments[buffer.segment].size >= buffer.offset + buffer.size);
+
+	record(CommandType::BindIndexBuffer, { buffer.segment, buffer.offset, buffer.size, bit16 ? 1U : 0U });
 }
 
 
-void RendererImpl::bindDescriptorSet(unsigned int /* index */, DSLayoutHandle /* layout */, const void * /* data_ */) {
+void RendererImpl::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
+	assert(inFrame);
 	assert(validPipeline);
+
+	record(CommandType::BindVertexBuffer, { binding, buffer.handle });
 }
 
 
-void RendererImpl::setViewport(unsigned int /* x */, unsigned int /* y */, unsigned int /* width */, unsigned int /* height */) {
+void RendererImpl::bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer) {
 	assert(inFrame);
+	assert(validPipeline);
+	assert(buffer.size > 0);
+	assert(ringSegments[buffer.segment].size >= buffer.offset + buffer.size);
+
+	record(CommandType::BindVertexBuffer, { binding, buffer.segment, buffer.offset, buffer.size });
 }
 
 
-void RendererImpl::setScissorRect(unsigned int /* x */, unsigned int /* y */, unsigned int /* width */, unsigned int /* height */) {
+void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHandle, const void *data_) {
+	assert(validPipeline);
+
+	const DescriptorSetLayout &layout = dsLayouts.get(layoutHandle);
+
+	// resolve the descriptors now like the other backends do, the caller's struct is gone by execution time
+	// collected first so the header has the real number of argument words
+	descriptorWords.clear();
+	descriptorWords.push_back(index);
+	descriptorWords.push_back(layoutHandle.handle);
+	const char *data = reinterpret_cast<const char *>(data_);
+	for (const auto &l : layout.layout) {
+		switch (l.type) {
+		case DescriptorType::End:
+			// can't happen because createDesciptorSetLayout doesn't let it
+			UNREACHABLE();
+			break;
+
+		case DescriptorType::UniformBuffer:
+		case DescriptorType::StorageBuffer: {
+			// this is part of the struct, we know it's correctly aligned and right type
+			const BufferHandle &handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
+			assert(buffers.get(handle).size > 0);
+			descriptorWords.push_back(handle.handle);
+		} break;
+
+		case DescriptorType::EphemeralUniformBuffer:
+		case DescriptorType::EphemeralStorageBuffer: {
+			const EphemeralBuffer &buffer = *reinterpret_cast<const EphemeralBuffer *>(data + l.offset);
+			assert(buffer.size > 0);
+			assert(buffer.offset + buffer.size <= ringSegments[buffer.segment].size);
+			descriptorWords.push_back(buffer.segment);
+			descriptorWords.push_back(buffer.offset);
+			descriptorWords.push_back(buffer.size);
+		} break;
+
+		case DescriptorType::Sampler: {
+			const SamplerHandle &handle = *reinterpret_cast<const SamplerHandle *>(data + l.offset);
+			descriptorWords.push_back(handle.handle);
+		} break;
+
+		case DescriptorType::Texture:
+		case DescriptorType::StorageImage: {
+			// render target textures are all invalid handles here
+			const TextureHandle &handle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
+			descriptorWords.push_back(handle.handle);
+		} break;
+
+		case DescriptorType::CombinedSampler: {
+			const CSampler &combined = *reinterpret_cast<const CSampler *>(data + l.offset);
+			descriptorWords.push_back(combined.tex.handle);
+			descriptorWords.push_back(combined.sampler.handle);
+		} break;
+
+		case DescriptorType::Count:
+			UNREACHABLE(); // shouldn't happen
+			break;
+
+		}
+	}
+
+	record(CommandType::BindDescriptorSet, descriptorWords.data(), descriptorWords.size());
+}
+
+
+void RendererImpl::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	assert(inFrame);
+
+	record(CommandType::SetViewport, { x, y, width, height });
+}
+
+
+void RendererImpl::setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
 	assert(validPipeline);
 	assert(currentPipeline.scissorTest_);
 	scissorSet = true;
+
+	record(CommandType::SetScissorRect, { x, y, width, height });
 }
 
 
-void RendererImpl::draw(unsigned int /* firstVertex */, unsigned int vertexCount) {
+void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
 	assert(inRenderPass);
 	assert(validPipeline);
 	assert(vertexCount > 0);
 	assert(!currentPipeline.scissorTest_ || scissorSet);
 	pipelineDrawn = true;
+
+	record(CommandType::Draw, { firstVertex, vertexCount });
 }
 
 
@@ -406,15 +618,80 @@ void RendererImpl::drawIndexedInstanced(unsigned int vertexCount, unsigned int i
 	assert(instanceCount > 0);
 	assert(!currentPipeline.scissorTest_ || scissorSet);
 	pipelineDrawn = true;
+
+	record(CommandType::DrawIndexedInstanced, { vertexCount, instanceCount });
 }
 
 
-void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int /* firstIndex */) {
+void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex) {
 	assert(inRenderPass);
 	assert(validPipeline);
 	assert(vertexCount > 0);
 	assert(!currentPipeline.scissorTest_ || scissorSet);
 	pipelineDrawn = true;
+
+	record(CommandType::DrawIndexedOffset, { vertexCount, firstIndex });
+}
+
+
+void RendererImpl::drawIndexedIndirect(BufferHandle buffer, unsigned int offset) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(!currentPipeline.scissorTest_ || scissorSet);
+	assert(offset % 4 == 0);
+	assert(offset + 5 * sizeof(uint32_t) <= buffers.get(buffer).size);
+	pipelineDrawn = true;
+
+	record(CommandType::DrawIndexedIndirect, { buffer.handle, offset });
+}
+
+
+void RendererImpl::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(currentPipeline.computeShader_);
+	assert(x > 0);
+	assert(y > 0);
+	assert(z > 0);
+	pipelineDrawn = true;
+
+	record(CommandType::Dispatch, { x, y, z });
+}
+
+
+void RendererImpl::renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers) {
+	assert(inFrame);
+	assert(!inRenderPass);
+
+	for (const auto &b : barriers) {
+		// make sure it exists
+		rendertargets.get(b.rt);
+
+		record(CommandType::RenderTargetBarrier, { b.rt.handle, static_cast<uint32_t>(b.before), static_cast<uint32_t>(b.after), b.discard ? 1U : 0U });
+	}
+}
+
+
+void RendererImpl::beginTimestampScope(const std::string &name) {
+	assert(inFrame);
+	assert(!inTimestampScope);
+	inTimestampScope = true;
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(frame.timestampScopes.size() < MAX_TIMESTAMP_SCOPES);
+	frame.timestampScopes.push_back(name);
+
+	record(CommandType::BeginTimestampScope, { static_cast<uint32_t>(frame.timestampScopes.size() - 1) });
+}
+
+
+void RendererImpl::endTimestampScope() {
+	assert(inFrame);
+	assert(inTimestampScope);
+	inTimestampScope = false;
+
+	record(CommandType::EndTimestampScope, {});
 }
 
 
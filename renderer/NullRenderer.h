@@ -29,15 +29,14 @@ namespace renderer {
 
 
 struct Buffer {
-	bool          ringBufferAlloc;
-	unsigned int  beginOffs;
-	unsigned int  size;
-	// TODO: usage flags for debugging
+	unsigned int       size;
+	BufferUsage        usage;
+	std::vector<char>  contents;
 
 
 	Buffer()
-	: ringBufferAlloc(false)
-	, size(0)
+	: size(0)
+	, usage(BufferUsage::Static)
 	{
 	}
 
@@ -45,12 +44,10 @@ struct Buffer {
 	Buffer &operator=(const Buffer &) = delete;
 
 	Buffer(Buffer &&other)
-	: ringBufferAlloc(other.ringBufferAlloc)
-	, beginOffs(other.beginOffs)
-	, size(other.size)
+	: size(other.size)
+	, usage(other.usage)
+	, contents(std::move(other.contents))
 	{
-		other.ringBufferAlloc = false;
-		other.beginOffs       = 0;
 		other.size            = 0;
 	}
 
@@ -59,12 +56,10 @@ struct Buffer {
 			return *this;
 		}
 
-		ringBufferAlloc       = other.ringBufferAlloc;
-		beginOffs             = other.beginOffs;
 		size                  = other.size;
+		usage                 = other.usage;
+		contents              = std::move(other.contents);
 
-		other.ringBufferAlloc = false;
-		other.beginOffs       = 0;
 		other.size            = 0;
 
 		return *this;
@@ -75,6 +70,41 @@ struct Buffer {
 };
 
 
+struct ComputeShader {
+	std::string name;
+
+
+	ComputeShader()
+	{
+	}
+
+
+	ComputeShader(const ComputeShader &)            = delete;
+	ComputeShader &operator=(const ComputeShader &) = delete;
+
+	ComputeShader(ComputeShader &&other)
+	: name(std::move(other.name))
+	{
+		assert(other.name.empty());
+	}
+
+	ComputeShader &operator=(ComputeShader &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		name            = std::move(other.name);
+
+		assert(other.name.empty());
+
+		return *this;
+	}
+
+	~ComputeShader() {
+	}
+};
+
+
 struct DescriptorSetLayout {
 	std::vector<DescriptorLayout> layout;
 
@@ -365,21 +395,69 @@ struct VertexShader {
 };
 
 
+struct RingBufferSegment {
+	unsigned int      size;
+	char              *mapping;
+	std::vector<char> storage;
+
+
+	RingBufferSegment()
+	: size(0)
+	, mapping(nullptr)
+	{}
+
+	RingBufferSegment(const RingBufferSegment &)            = delete;
+	RingBufferSegment &operator=(const RingBufferSegment &) = delete;
+
+	RingBufferSegment(RingBufferSegment &&)                 = delete;
+	RingBufferSegment &operator=(RingBufferSegment &&)      = delete;
+
+	~RingBufferSegment() {
+		assert(size == 0);
+	}
+};
+
+
+// what a command buffer would contain, recorded so the null renderer does the
+// same amount of work per call as a real backend minus the driver
+// each command is a header word with the type in the low 8 bits and
+// the number of argument words above it, followed by the arguments
+enum class CommandType : uint8_t {
+	  BeginRenderPass
+	, BeginTimestampScope
+	, BindDescriptorSet
+	, BindIndexBuffer
+	, BindPipeline
+	, BindVertexBuffer
+	, Dispatch
+	, Draw
+	, DrawIndexedIndirect
+	, DrawIndexedInstanced
+	, DrawIndexedOffset
+	, EndRenderPass
+	, EndTimestampScope
+	, RenderTargetBarrier
+	, SetScissorRect
+	, SetViewport
+};
+
+
 struct Frame {
 	bool                      outstanding;
 	uint32_t                  lastFrameNum;
-	unsigned int              usedRingBufPtr;
-	std::vector<BufferHandle> ephemeralBuffers;
+	std::vector<unsigned int> ringSegments;
+	std::vector<std::string>  timestampScopes;
+	// kept until the frame is reused like a real command buffer
+	std::vector<uint32_t>     commands;
 
 
 	Frame()
 	: outstanding(false)
 	, lastFrameNum(0)
-	, usedRingBufPtr(0)
 	{}
 
 	~Frame() {
-		assert(ephemeralBuffers.empty());
+		assert(ringSegments.empty());
 		assert(!outstanding);
 	}
 
@@ -389,27 +467,28 @@ struct Frame {
 	Frame(Frame &&other)
 	: outstanding(other.outstanding)
 	, lastFrameNum(other.lastFrameNum)
-	, usedRingBufPtr(other.usedRingBufPtr)
-	, ephemeralBuffers(std::move(other.ephemeralBuffers))
+	, ringSegments(std::move(other.ringSegments))
+	, timestampScopes(std::move(other.timestampScopes))
+	, commands(std::move(other.commands))
 	{
 		other.outstanding      = false;
 		other.lastFrameNum     = 0;
-		other.usedRingBufPtr   = 0;
 	}
 
 	Frame &operator=(Frame &&other) {
-		assert(ephemeralBuffers.empty());
-		ephemeralBuffers = std::move(other.ephemeralBuffers);
-		assert(other.ephemeralBuffers.empty());
-
 		outstanding = other.outstanding;
 		other.outstanding = false;
 
 		lastFrameNum = other.lastFrameNum;
 		other.lastFrameNum = 0;
 
-		usedRingBufPtr       = other.usedRingBufPtr;
-		other.usedRingBufPtr = 0;
+		assert(ringSegments.empty());
+		ringSegments = std::move(other.ringSegments);
+		assert(other.ringSegments.empty());
+
+		timestampScopes = std::move(other.timestampScopes);
+
+		commands = std::move(other.commands);
 
 		return *this;
 	}
@@ -417,11 +496,12 @@ struct Frame {
 
 
 struct RendererImpl : public RendererBase {
-	std::vector<char> ringBuffer;
+	std::array<RingBufferSegment, MAX_RING_SEGMENTS>  ringSegments;
 
 	std::vector<Frame>                       frames;
 
 	ResourceContainer<Buffer>              buffers;
+	ResourceContainer<ComputeShader>       computeShaders;
 	ResourceContainer<DescriptorSetLayout>  dsLayouts;
 	ResourceContainer<FragmentShader>        fragmentShaders;
 	ResourceContainer<Framebuffer>         framebuffers;
@@ -434,13 +514,24 @@ struct RendererImpl : public RendererBase {
 
 	PipelineDesc  currentPipeline;
 
+	// bindDescriptorSet arguments, kept to avoid reallocating every call
+	std::vector<uint32_t>  descriptorWords;
 
-	void recreateRingBuffer(unsigned int newSize);
-	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
+
+	void createRingSegment(RingBufferSegment &seg, unsigned int size);
+	void deleteRingSegment(RingBufferSegment &seg);
+	RingBufferAllocation ringBufferAllocate(unsigned int size, unsigned int alignment);
+	unsigned int ringBufferNewSegment(unsigned int size);
+	void ringBufferEndFrame(Frame &frame);
+	void ringBufferRetireFrame(Frame &frame);
+	void ringBufferShutdown();
 
 	void waitForFrame(unsigned int frameIdx);
 	void deleteFrameInternal(Frame &f);
 
+	void record(CommandType type, std::initializer_list<uint32_t> args);
+	void record(CommandType type, const uint32_t *args, size_t numArgs);
+
 	explicit RendererImpl(const RendererDesc &desc);
 
 	~RendererImpl();
@@ -449,13 +540,17 @@ struct RendererImpl : public RendererBase {
 	bool isRenderTargetFormatSupported(Format format) const;
 
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
+	ComputeShaderHandle  createComputeShader(const std::string &name, const ShaderMacros &macros);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
 	FragmentShaderHandle createFragmentShader(const std::string &name, const ShaderMacros &macros);
+	bool                 prepareShaders(const std::string &name, const ShaderMacros &macros);
+	bool                 prepareComputeShader(const std::string &name, const ShaderMacros &macros);
+	bool                 isPipelineReady(PipelineHandle handle);
 	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
 	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
 	PipelineHandle       createPipeline(const PipelineDesc &desc);
-	BufferHandle         createBuffer(uint32_t size, const void *contents);
-	BufferHandle         createEphemeralBuffer(uint32_t size, const void *contents);
+	BufferHandle         createBuffer(BufferUsage usage, uint32_t size, const void *contents);
+	EphemeralBuffer      createEphemeralBuffer(uint32_t size, const void *contents);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
 
@@ -463,7 +558,9 @@ struct RendererImpl : public RendererBase {
 
 	TextureHandle        getRenderTargetTexture(RenderTargetHandle handle);
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+	bool                 isTextureReady(TextureHandle handle) const;
 
+	void updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents);
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
 	void deleteRenderPass(RenderPassHandle fbo);
@@ -471,6 +568,9 @@ struct RendererImpl : public RendererBase {
 	void deleteTexture(TextureHandle handle);
 	void deleteRenderTarget(RenderTargetHandle &fbo);
 
+	bool canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const;
+	void aliasRenderTargets(const std::vector<RenderTargetHandle> &rts);
+
 
 	void setSwapchainDesc(const SwapchainDesc &desc);
 	MemoryStats getMemStats() const;
@@ -486,13 +586,23 @@ struct RendererImpl : public RendererBase {
 
 	void bindPipeline(PipelineHandle pipeline);
 	void bindIndexBuffer(BufferHandle buffer, bool bit16);
+	void bindIndexBuffer(EphemeralBuffer buffer, bool bit16);
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
+	void bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer);
 
 	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int offset);
+
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+
+	void renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers);
+
+	void beginTimestampScope(const std::string &name);
+	void endTimestampScope();
 };
 
 
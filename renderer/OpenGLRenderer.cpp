@@ -36,6 +36,7 @@ THE SOFTWARE.
 #include "Renderer.h"
 #include "utils/Utils.h"
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 
 
 namespace renderer {
@@ -44,8 +45,24 @@ namespace renderer {
 void GLAPIENTRY glDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei /* length */, const GLchar *message, const void * /* userParam */);
 
 
-static GLuint createShader(GLenum type, const std::string &name, const std::vector<char> &src) {
-	assert(type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER);
+static void logShaderInfo(GLuint shader, const std::string &name) {
+	GLint infoLogLen = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLen);
+	if (infoLogLen != 0) {
+		std::vector<char> infoLog(infoLogLen + 1, '\0');
+		// TODO: better logging
+		glGetShaderInfoLog(shader, infoLogLen, NULL, &infoLog[0]);
+		if (infoLog[0] != '\0') {
+			LOG("shader \"%s\" info log:\n%s\ninfo log end\n", name.c_str(), &infoLog[0]); fflush(stdout);
+		}
+	}
+}
+
+
+// with parallel shader compile the status is not checked here since that would wait for the compiler
+// errors are reported when the program fails to link instead
+static GLuint createShader(GLenum type, const std::string &name, const std::vector<char> &src, bool parallelCompile) {
+	assert(type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER || type == GL_COMPUTE_SHADER);
 
 	const char *sourcePointer = &src[0];
 	GLint sourceLen = src.size();
@@ -54,22 +71,14 @@ static GLuint createShader(GLenum type, const std::string &name, const std::vect
 	glShaderSource(shader, 1, &sourcePointer, &sourceLen);
 	glCompileShader(shader);
 
-	// TODO: defer checking to enable multithreaded shader compile
+	if (parallelCompile) {
+		return shader;
+	}
+
 	GLint status = 0;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 
-	{
-		GLint infoLogLen = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLen);
-		if (infoLogLen != 0) {
-			std::vector<char> infoLog(infoLogLen + 1, '\0');
-			// TODO: better logging
-			glGetShaderInfoLog(shader, infoLogLen, NULL, &infoLog[0]);
-			if (infoLog[0] != '\0') {
-				LOG("shader \"%s\" info log:\n%s\ninfo log end\n", name.c_str(), &infoLog[0]); fflush(stdout);
-			}
-		}
-	}
+	logShaderInfo(shader, name);
 
 	if (status != GL_TRUE) {
 		glDeleteShader(shader);
@@ -100,6 +109,10 @@ static GLenum glTexFormat(Format format) {
 	case Format::sRGBA8:
 		return GL_SRGB8_ALPHA8;
 
+	// byte order is not visible in GL
+	case Format::sBGRA8:
+		return GL_SRGB8_ALPHA8;
+
 	case Format::Depth16:
 		return GL_DEPTH_COMPONENT16;
 
@@ -141,6 +154,9 @@ static GLenum glTexBaseFormat(Format format) {
 	case Format::sRGBA8:
 		return GL_RGBA;
 
+	case Format::sBGRA8:
+		return GL_RGBA;
+
 	case Format::Depth16:
 		// not supposed to use this format here
 		assert(false);
@@ -172,6 +188,43 @@ static GLenum glTexBaseFormat(Format format) {
 }
 
 
+static GLenum glCompareFunc(CompareOp op) {
+	switch (op) {
+	case CompareOp::Always:
+		return GL_ALWAYS;
+
+	case CompareOp::Equal:
+		return GL_EQUAL;
+
+	case CompareOp::Never:
+		return GL_NEVER;
+
+	case CompareOp::NotEqual:
+		return GL_NOTEQUAL;
+
+	}
+
+	UNREACHABLE();
+}
+
+
+static GLenum glStencilPassOp(StencilOp op) {
+	switch (op) {
+	case StencilOp::Keep:
+		return GL_KEEP;
+
+	case StencilOp::Replace:
+		return GL_REPLACE;
+
+	case StencilOp::Zero:
+		return GL_ZERO;
+
+	}
+
+	UNREACHABLE();
+}
+
+
 static const char *errorSource(GLenum source)
 {
 	switch (source)
@@ -338,6 +391,19 @@ void mergeShaderResources(ShaderResources &first, const ShaderResources &second)
 			first.samplers.push_back(idx);
 		}
 	}
+
+	for (unsigned int i = 0; i < second.images.size(); i++) {
+		DSIndex idx = second.images.at(i);
+		if (i < first.images.size()) {
+			DSIndex other = first.images.at(i);
+			if (idx != other) {
+				LOG("ERROR: mismatch when merging shader images, %u is (%u, %u) when expecting (%u, %u)\n", i, idx.set, idx.binding, other.set, other.binding);
+				throw std::runtime_error("resource mismatch");
+			}
+		} else {
+			first.images.push_back(idx);
+		}
+	}
 }
 
 
@@ -345,15 +411,22 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
 , window(nullptr)
 , context(nullptr)
-, ringBuffer(0)
 , persistentMapInUse(false)
-, persistentMapping(nullptr)
+, uploadBuffer(0)
+, uploadMapping(nullptr)
+, uploadBufSize(0)
+, uploadBufPtr(0)
+, lastSyncedUploadBufPtr(0)
 , decriptorSetsDirty(true)
+, dirtyDescriptors(0)
 , debug(desc.debug)
 , tracing(desc.tracing)
+, multiBind(false)
+, parallelShaderCompile(false)
 , vao(0)
 , idxBuf16Bit(false)
 , indexBufByteOffset(0)
+, aliasedBytes(0)
 {
 
 	// TODO: check return value
@@ -473,6 +546,18 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		throw std::runtime_error("ARB_texture_view not found");
 	}
 
+	// optional, used for binding descriptors if present
+	multiBind = GLEW_ARB_multi_bind || GLEW_VERSION_4_4;
+	LOG("ARB_multi_bind %s\n", multiBind ? "found" : "not found");
+
+	// optional, lets the driver compile and link shaders on its own threads
+	parallelShaderCompile = GLEW_ARB_parallel_shader_compile;
+	LOG("ARB_parallel_shader_compile %s\n", parallelShaderCompile ? "found" : "not found");
+	if (parallelShaderCompile) {
+		// let the driver choose the number of threads
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFFU);
+	}
+
 	if (wantKHRDebug) {
 		if (!GLEW_KHR_debug) {
 			LOG("KHR_debug not found\n");
@@ -502,61 +587,61 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	ssboAlign = temp;
 	LOG("SSBO align: %d\n", ssboAlign);
 
+	// vertex and index data only need 16
+	ringAlign = std::max(std::max(uboAlign, ssboAlign), 16U);
+
 	// TODO: use GL_UPPER_LEFT to match Vulkan
 	glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
 
 	glCreateVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
+	resetGLState();
+
 	recreateSwapchain();
-	recreateRingBuffer(desc.ephemeralRingBufSize);
 
-	// swap once to get better traces
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-	SDL_GL_SwapWindow(window);
-}
+	// if tracing is on, disable persistent buffers because apitrace can't trace them
+	persistentMapInUse = !tracing;
 
+	// rows of streamed texture uploads are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-void RendererImpl::recreateRingBuffer(unsigned int newSize) {
-	assert(newSize > 0);
+	if (persistentMapInUse) {
+		uploadBufSize = desc.uploadRingBufSize;
+		assert(uploadBufSize > 0);
 
-	// if buffer already exists, free it after it's no longer in use
-	if (ringBuffer) {
-		assert(ringBufSize       != 0);
+		GLbitfield uploadFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &uploadBuffer);
+		glNamedBufferStorage(uploadBuffer, uploadBufSize, nullptr, uploadFlags);
+		uploadMapping = reinterpret_cast<char *>(glMapNamedBufferRange(uploadBuffer, 0, uploadBufSize, uploadFlags));
+		assert(uploadMapping != nullptr);
 
-		if (persistentMapInUse) {
-			glUnmapNamedBuffer(ringBuffer);
-			persistentMapping = nullptr;
+		if (tracing) {
+			glObjectLabel(GL_BUFFER, uploadBuffer, -1, "Texture upload buffer");
 		}
+	}
 
-		auto result = buffers.add();
-		frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
-
-		Buffer &buffer = result.first;
-
-		buffer.buffer          = ringBuffer;
-		ringBuffer             = 0;
+	// swap once to get better traces
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	SDL_GL_SwapWindow(window);
+}
 
-		buffer.ringBufferAlloc = false;
-		buffer.offset          = 0;
 
-		buffer.size            = ringBufSize;
-		ringBufSize            = 0;
+void RendererImpl::createRingSegment(RingBufferSegment &seg, unsigned int size) {
+	assert(seg.size   == 0);
+	assert(seg.buffer == 0);
+	assert(size > 0);
 
-		ringBufPtr             = 0;
+	// GL calls are only legal on the thread owning the context
+	if (std::this_thread::get_id() != renderThread) {
+		LOG("Ring buffer segment needed on a worker thread, increase ephemeralRingBufSize\n");
+		throw std::runtime_error("Ring buffer segment needed on a worker thread");
 	}
 
-	// set up ring buffer
-	glCreateBuffers(1, &ringBuffer);
+	glCreateBuffers(1, &seg.buffer);
 	// TODO: proper error checking
-	assert(ringBuffer != 0);
-	assert(ringBufSize               == 0);
-	assert(ringBufPtr                == 0);
-	assert(persistentMapping         == nullptr);
+	assert(seg.buffer != 0);
 	unsigned int bufferFlags = 0;
-	// if tracing is on, disable persistent buffer because apitrace can't trace it
-	persistentMapInUse = !tracing;
-	ringBufSize        = newSize;
 
 	if (!persistentMapInUse) {
 		// need GL_DYNAMIC_STORAGE_BIT since we intend to glBufferSubData it
@@ -574,16 +659,33 @@ void RendererImpl::recreateRingBuffer(unsigned int newSize) {
 		bufferFlags |= GL_MAP_READ_BIT;
 	}
 
-	glNamedBufferStorage(ringBuffer, ringBufSize, nullptr, bufferFlags);
+	glNamedBufferStorage(seg.buffer, size, nullptr, bufferFlags);
 	if (persistentMapInUse) {
-		persistentMapping = reinterpret_cast<char *>(glMapNamedBufferRange(ringBuffer, 0, ringBufSize, bufferFlags));
+		seg.mapping = reinterpret_cast<char *>(glMapNamedBufferRange(seg.buffer, 0, size, bufferFlags));
 	}
+	seg.size = size;
 }
 
 
-RendererImpl::~RendererImpl() {
-	assert(ringBuffer != 0);
+void RendererImpl::deleteRingSegment(RingBufferSegment &seg) {
+	assert(seg.size   != 0);
+	assert(seg.buffer != 0);
+
+	if (persistentMapInUse) {
+		glUnmapNamedBuffer(seg.buffer);
+		seg.mapping = nullptr;
+	} else {
+		assert(seg.mapping == nullptr);
+	}
+
+	forgetBuffer(seg.buffer);
+	glDeleteBuffers(1, &seg.buffer);
+	seg.buffer = 0;
+	seg.size   = 0;
+}
 
+
+RendererImpl::~RendererImpl() {
 	for (unsigned int i = 0; i < frames.size(); i++) {
 		auto &f = frames.at(i);
 		if (f.outstanding) {
@@ -594,26 +696,32 @@ RendererImpl::~RendererImpl() {
 	}
 	frames.clear();
 
+	ringBufferShutdown();
 
-	if (persistentMapInUse) {
-		glUnmapNamedBuffer(ringBuffer);
-		persistentMapping = nullptr;
-	} else {
-		assert(persistentMapping == nullptr);
+	// textures are deleted below, drop whatever they were still waiting for
+	pendingUploads.clear();
+	if (uploadBuffer != 0) {
+		glUnmapNamedBuffer(uploadBuffer);
+		uploadMapping = nullptr;
+		glDeleteBuffers(1, &uploadBuffer);
+		uploadBuffer = 0;
 	}
 
-	glDeleteBuffers(1, &ringBuffer);
-	ringBuffer = 0;
-
 	framebuffers.clearWith([](Framebuffer &fb) {
-		assert(fb.fbo != 0);
-		glDeleteFramebuffers(1, &fb.fbo);
-		fb.fbo = 0;
+		// default framebuffer is not ours to delete
+		if (fb.fbo != 0) {
+			glDeleteFramebuffers(1, &fb.fbo);
+			fb.fbo = 0;
+		}
 	} );
 
 	renderPasses.clearWith([](RenderPass &) {
 	} );
 
+	// only a stand-in for the default framebuffer
+	renderTargets.remove(swapchainRenderTarget);
+	swapchainRenderTarget = RenderTargetHandle();
+
 	renderTargets.clearWith([this](RenderTarget &rt) {
 		assert(rt.texture);
 
@@ -658,6 +766,12 @@ RendererImpl::~RendererImpl() {
 		v.shader = 0;
 	} );
 
+	computeShaders.clearWith([](ComputeShader &c) {
+		assert(c.shader != 0);
+		glDeleteShader(c.shader);
+		c.shader = 0;
+	} );
+
 	fragmentShaders.clearWith([](FragmentShader &f) {
 		assert(f.shader != 0);
 		glDeleteShader(f.shader);
@@ -717,50 +831,67 @@ bool RendererImpl::isRenderTargetFormatSupported(Format format) const {
 }
 
 
-BufferHandle RendererImpl::createBuffer(uint32_t size, const void *contents) {
+BufferHandle RendererImpl::createBuffer(BufferUsage usage, uint32_t size, const void *contents) {
 	assert(size != 0);
+	assert(contents != nullptr || usage == BufferUsage::Dynamic);
 
 	auto result    = buffers.add();
 	Buffer &buffer = result.first;
 	glCreateBuffers(1, &buffer.buffer);
+	// dynamic buffers are updated with buffer copies which don't need GL_DYNAMIC_STORAGE_BIT
 	glNamedBufferStorage(buffer.buffer, size, contents, 0);
-	buffer.ringBufferAlloc = false;
 	buffer.offset          = 0;
 	buffer.size            = size;
+	buffer.usage           = usage;
 
 	return result.second;
 }
 
 
-BufferHandle RendererImpl::createEphemeralBuffer(uint32_t size, const void *contents) {
+EphemeralBuffer RendererImpl::createEphemeralBuffer(uint32_t size, const void *contents) {
 	assert(size != 0);
 	assert(contents != nullptr);
 
 	// TODO: use appropriate alignment
 	// TODO: need buffer usage flags for that
-	unsigned int beginPtr = ringBufferAllocate(size, std::max(uboAlign, ssboAlign));
+	auto alloc = ringBufferAllocate(size, std::max(uboAlign, ssboAlign));
+	const auto &seg = ringSegments[alloc.segment];
 
 	if (persistentMapInUse) {
-		memcpy(persistentMapping + beginPtr, contents, size);
+		memcpy(seg.mapping + alloc.offset, contents, size);
 	} else {
-		glNamedBufferSubData(ringBuffer, beginPtr, size, contents);
+		glNamedBufferSubData(seg.buffer, alloc.offset, size, contents);
 	}
 
-	auto result    = buffers.add();
-	Buffer &buffer = result.first;
-	buffer.buffer          = ringBuffer;
-	buffer.ringBufferAlloc = true;
-	buffer.offset          = beginPtr;
-	buffer.size            = size;
+	EphemeralBuffer buffer;
+	buffer.segment = alloc.segment;
+	buffer.offset  = alloc.offset;
+	buffer.size    = size;
 
-	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
+	return buffer;
+}
 
-	return result.second;
+
+// GL indices are assigned in this order separately for each stage
+// so sort by set and binding, otherwise the stages of one program
+// can disagree when spirv-cross lists them in different order
+static void sortByBinding(spirv_cross::CompilerGLSL &glsl, std::vector<spirv_cross::Resource> &resources) {
+	std::sort(resources.begin(), resources.end(), [&glsl] (const spirv_cross::Resource &a, const spirv_cross::Resource &b) {
+		uint32_t setA = glsl.get_decoration(a.id, spv::DecorationDescriptorSet);
+		uint32_t setB = glsl.get_decoration(b.id, spv::DecorationDescriptorSet);
+		if (setA != setB) {
+			return setA < setB;
+		}
+
+		return glsl.get_decoration(a.id, spv::DecorationBinding) < glsl.get_decoration(b.id, spv::DecorationBinding);
+	});
 }
 
 
 ShaderResources processShaderResources(spirv_cross::CompilerGLSL &glsl) {
 	auto spvResources = glsl.get_shader_resources();
+	sortByBinding(glsl, spvResources.uniform_buffers);
+	sortByBinding(glsl, spvResources.storage_buffers);
 
 	// TODO: map descriptor sets to opengl indices for textures/samplers
 
@@ -836,6 +967,19 @@ ShaderResources processShaderResources(spirv_cross::CompilerGLSL &glsl) {
 		glsl.unset_decoration(c.sampler_id, spv::DecorationBinding);
 	}
 
+	for (const auto &image : spvResources.storage_images) {
+		DSIndex idx;
+		idx.set     = glsl.get_decoration(image.id, spv::DecorationDescriptorSet);
+		idx.binding = glsl.get_decoration(image.id, spv::DecorationBinding);
+
+		unsigned int openglIDX = resources.images.size();
+		resources.images.push_back(idx);
+
+		// opengl doesn't like set decorations, strip them
+		glsl.unset_decoration(image.id, spv::DecorationDescriptorSet);
+		glsl.set_decoration(image.id, spv::DecorationBinding, openglIDX);
+	}
+
 	return resources;
 }
 
@@ -883,6 +1027,26 @@ static std::vector<char> spirv2glsl(const std::string &name, const ShaderMacros
 }
 
 
+ComputeShaderHandle RendererImpl::createComputeShader(const std::string &name, const ShaderMacros &macros) {
+	std::string computeShaderName = name + ".comp";
+
+	std::vector<uint32_t> spirv = compileSpirv(computeShaderName, macros, shaderc_glsl_compute_shader);
+
+	spirv_cross::CompilerGLSL glsl(spirv);
+
+	auto resources = processShaderResources(glsl);
+	std::vector<char> src = spirv2glsl(name, macros, glsl);
+
+	auto result_ = computeShaders.add();
+	auto &c = result_.first;
+	c.shader    = createShader(GL_COMPUTE_SHADER, computeShaderName, src, parallelShaderCompile);
+	c.name      = computeShaderName;
+	c.resources = std::move(resources);
+
+	return result_.second;
+}
+
+
 VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, const ShaderMacros &macros) {
 	std::string vertexShaderName   = name + ".vert";
 
@@ -898,7 +1062,7 @@ VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, con
 
 	auto result_ = vertexShaders.add();
 	auto &v = result_.first;
-	v.shader    = createShader(GL_VERTEX_SHADER, vertexShaderName, src);
+	v.shader    = createShader(GL_VERTEX_SHADER, vertexShaderName, src, parallelShaderCompile);
 	v.name      = vertexShaderName;
 	v.resources = std::move(resources);
 
@@ -921,7 +1085,7 @@ FragmentShaderHandle RendererImpl::createFragmentShader(const std::string &name,
 
 	auto result_ = fragmentShaders.add();
 	auto &f = result_.first;
-	f.shader = createShader(GL_FRAGMENT_SHADER, name, src);
+	f.shader = createShader(GL_FRAGMENT_SHADER, name, src, parallelShaderCompile);
 	f.name      = fragmentShaderName;
 	f.resources = std::move(resources);
 
@@ -929,10 +1093,25 @@ FragmentShaderHandle RendererImpl::createFragmentShader(const std::string &name,
 }
 
 
+bool RendererImpl::prepareShaders(const std::string &name, const ShaderMacros &macros) {
+	// spir-v compile happens in the background
+	// glsl compile and link happen on driver threads if it supports ARB_parallel_shader_compile
+	bool vertexReady   = compileSpirvAsync(name + ".vert", macros, shaderc_glsl_vertex_shader);
+	bool fragmentReady = compileSpirvAsync(name + ".frag", macros, shaderc_glsl_fragment_shader);
+
+	return vertexReady && fragmentReady;
+}
+
+
+bool RendererImpl::prepareComputeShader(const std::string &name, const ShaderMacros &macros) {
+	return compileSpirvAsync(name + ".comp", macros, shaderc_glsl_compute_shader);
+}
+
+
 static void checkShaderResources(const std::string &name, const ShaderResources &resources, const std::unordered_map<DSIndex, DescriptorType> &layoutMap) {
 	for (const auto &r : resources.ubos) {
 		auto type = layoutMap.at(r);
-		if (type != DescriptorType::UniformBuffer) {
+		if (type != DescriptorType::UniformBuffer && type != DescriptorType::EphemeralUniformBuffer) {
 			LOG("ERROR: set %u binding %u type %s in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, descriptorTypeName(DescriptorType::UniformBuffer), name.c_str(), descriptorTypeName(type));
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
@@ -940,7 +1119,7 @@ static void checkShaderResources(const std::string &name, const ShaderResources
 
 	for (const auto &r : resources.ssbos) {
 		auto type = layoutMap.at(r);
-		if (type != DescriptorType::StorageBuffer) {
+		if (type != DescriptorType::StorageBuffer && type != DescriptorType::EphemeralStorageBuffer) {
 			LOG("ERROR: set %u binding %u type %s in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, descriptorTypeName(DescriptorType::StorageBuffer), name.c_str(), descriptorTypeName(type));
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
@@ -961,14 +1140,136 @@ static void checkShaderResources(const std::string &name, const ShaderResources
 			throw std::runtime_error("descriptor set layout mismatch");
 		}
 	}
+
+	for (const auto &r : resources.images) {
+		auto type = layoutMap.at(r);
+		if (type != DescriptorType::StorageImage) {
+			LOG("ERROR: set %u binding %u type image in shader \"%s\" doesn't match ds layout (%s)\n", r.set, r.binding, name.c_str(), descriptorTypeName(type));
+			throw std::runtime_error("descriptor set layout mismatch");
+		}
+	}
+
+	if (resources.images.size() > MAX_GL_IMAGE_UNITS) {
+		LOG("ERROR: shader \"%s\" uses %u images, only %u supported\n", name.c_str(), static_cast<unsigned int>(resources.images.size()), MAX_GL_IMAGE_UNITS);
+		throw std::runtime_error("too many images");
+	}
+}
+
+
+static std::unordered_map<DSIndex, DescriptorType> descriptorLayoutMap(const std::array<DSLayoutHandle, MAX_DESCRIPTOR_SETS> &layouts, const ResourceContainer<DescriptorSetLayout> &dsLayouts) {
+	std::unordered_map<DSIndex, DescriptorType> layoutMap;
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		if (layouts[i]) {
+			const auto &layoutDesc = dsLayouts.get(layouts[i]).descriptors;
+			for (unsigned int binding = 0; binding < layoutDesc.size(); binding++) {
+				DSIndex idx;
+				idx.set     = i;
+				idx.binding = binding;
+				layoutMap.emplace(idx, layoutDesc.at(binding).type);
+			}
+		}
+	}
+
+	return layoutMap;
+}
+
+
+// doesn't check the result, see finishPipeline
+static GLuint linkProgram(const std::vector<GLuint> &shaders) {
+	GLuint program = glCreateProgram();
+
+	for (GLuint shader : shaders) {
+		glAttachShader(program, shader);
+	}
+	glLinkProgram(program);
+
+	return program;
+}
+
+
+void RendererImpl::finishPipeline(Pipeline &p) {
+	assert(!p.linked);
+
+	// waits for the driver if it's still compiling
+	GLint status = 0;
+	glGetProgramiv(p.shader, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		glGetProgramiv(p.shader, GL_INFO_LOG_LENGTH, &status);
+		std::vector<char> infoLog(status + 1, '\0');
+		// TODO: better logging
+		glGetProgramInfoLog(p.shader, status, NULL, &infoLog[0]);
+		LOG("pipeline \"%s\" info log: %s\n", p.desc.name_.c_str(), &infoLog[0]); fflush(stdout);
+
+		if (parallelShaderCompile) {
+			// shader compile errors were not checked when they were created
+			std::array<GLuint, 2> shaders = { { 0, 0 } };
+			GLsizei numShaders = 0;
+			glGetAttachedShaders(p.shader, shaders.size(), &numShaders, &shaders[0]);
+			for (GLsizei i = 0; i < numShaders; i++) {
+				logShaderInfo(shaders[i], p.desc.name_);
+			}
+		}
+
+		throw std::runtime_error("shader link failed");
+	}
+
+	p.linked = true;
+}
+
+
+bool RendererImpl::isPipelineReady(PipelineHandle handle) {
+	auto &p = pipelines.get(handle);
+	if (p.linked) {
+		return true;
+	}
+
+	assert(parallelShaderCompile);
+	GLint done = GL_FALSE;
+	glGetProgramiv(p.shader, GL_COMPLETION_STATUS_ARB, &done);
+	if (done != GL_TRUE) {
+		return false;
+	}
+
+	finishPipeline(p);
+	return true;
 }
 
 
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PROFILE_FUNCTION();
+
+	assert(!desc.name_.empty());
+
+	if (desc.computeShader_) {
+		assert(!desc.vertexShader_);
+		assert(!desc.fragmentShader_);
+		assert(!desc.renderPass_);
+
+		const auto &c = computeShaders.get(desc.computeShader_);
+		checkShaderResources(c.name, c.resources, descriptorLayoutMap(desc.descriptorSetLayouts, dsLayouts));
+
+		GLuint program = linkProgram({ c.shader });
+
+		auto result = pipelines.add();
+		Pipeline &pipeline = result.first;
+		pipeline.desc      = desc;
+		pipeline.shader    = program;
+		pipeline.resources = c.resources;
+
+		if (tracing) {
+			glObjectLabel(GL_PROGRAM, program, desc.name_.size(), desc.name_.c_str());
+		}
+
+		if (!parallelShaderCompile) {
+			finishPipeline(pipeline);
+		}
+
+		return result.second;
+	}
+
 	assert(desc.vertexShader_);
 	assert(desc.fragmentShader_);
 	assert(desc.renderPass_);
-	assert(!desc.name_.empty());
 
 	const auto &v = vertexShaders.get(desc.vertexShader_);
     const auto &f = fragmentShaders.get(desc.fragmentShader_);
@@ -978,41 +1279,13 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 
 	// match shader resources against pipeline layouts
 	{
-		// construct layout map
-		std::unordered_map<DSIndex, DescriptorType> layoutMap;
-		for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
-			if (desc.descriptorSetLayouts[i]) {
-				const auto &layoutDesc = dsLayouts.get(desc.descriptorSetLayouts[i]).descriptors;
-				for (unsigned int binding = 0; binding < layoutDesc.size(); binding++) {
-					DSIndex idx;
-					idx.set     = i;
-					idx.binding = binding;
-					layoutMap.emplace(idx, layoutDesc.at(binding).type);
-				}
-			}
-		}
+		auto layoutMap = descriptorLayoutMap(desc.descriptorSetLayouts, dsLayouts);
 		checkShaderResources(v.name, v.resources, layoutMap);
 		checkShaderResources(f.name, f.resources, layoutMap);
 	}
 
 	// TODO: cache shaders
-	GLuint program = glCreateProgram();
-
-	glAttachShader(program, v.shader);
-	glAttachShader(program, f.shader);
-	glLinkProgram(program);
-
-	GLint status = 0;
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
-	if (status != GL_TRUE) {
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &status);
-		std::vector<char> infoLog(status + 1, '\0');
-		// TODO: better logging
-		glGetProgramInfoLog(program, status, NULL, &infoLog[0]);
-		LOG("info log: %s\n", &infoLog[0]); fflush(stdout);
-		throw std::runtime_error("shader link failed");
-	}
-	glUseProgram(program);
+	GLuint program = linkProgram({ v.shader, f.shader });
 
 	auto result = pipelines.add();
 	Pipeline &pipeline = result.first;
@@ -1024,6 +1297,10 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 		glObjectLabel(GL_PROGRAM, program, desc.name_.size(), desc.name_.c_str());
 	}
 
+	if (!parallelShaderCompile) {
+		finishPipeline(pipeline);
+	}
+
 	return result.second;
 }
 
@@ -1036,10 +1313,26 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 
 	auto result = framebuffers.add();
 	Framebuffer &fb = result.first;
-	glCreateFramebuffers(1, &fb.fbo);
 
 	const auto &colorRT = renderTargets.get(desc.colors_[0]);
 
+	if (desc.colors_[0] == swapchainRenderTarget) {
+		// default framebuffer, its depth and stencil are not ours
+		assert(!desc.depthStencil_);
+		assert(!desc.colors_[1]);
+		assert(colorRT.format == renderPass.desc.colorFormats_[0]);
+		assert(renderPass.desc.colorFinalLayout_ == Layout::Present);
+		fb.renderPass = desc.renderPass_;
+		fb.colors[0]  = desc.colors_[0];
+		fb.sRGB       = issRGBFormat(colorRT.format);
+		fb.width      = colorRT.width;
+		fb.height     = colorRT.height;
+
+		return result.second;
+	}
+
+	glCreateFramebuffers(1, &fb.fbo);
+
 	assert(colorRT.width  > 0);
 	assert(colorRT.height > 0);
 	assert(colorRT.texture);
@@ -1067,7 +1360,8 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		assert(depthRTtex.renderTarget);
 		assert(depthRTtex.tex != 0);
 		fb.depthStencil = desc.depthStencil_;
-		glNamedFramebufferTexture(fb.fbo, GL_DEPTH_ATTACHMENT, depthRTtex.tex, 0);
+		GLenum attachment = isStencilFormat(depthRT.format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		glNamedFramebufferTexture(fb.fbo, attachment, depthRTtex.tex, 0);
 	} else {
 		assert(renderPass.desc.depthStencilFormat_ == Format::Invalid);
 	}
@@ -1096,9 +1390,36 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	assert(desc.format_ != Format::Invalid);
 	assert(!desc.name_.empty());
 
+	auto result = renderTargets.add();
+	RenderTarget &rt = result.first;
+	rt.width  = desc.width_;
+	rt.height = desc.height_;
+	rt.format = desc.format_;
+	rt.desc   = desc;
+
+	// transient ones get their textures from aliasRenderTargets
+	if (!desc.transient_) {
+		createRenderTargetTextures(rt, 0);
+	}
+
+	return result.second;
+}
+
+
+void RendererImpl::createRenderTargetTextures(RenderTarget &rt, GLuint memoryOwner) {
+	assert(!rt.texture);
+	const auto &desc = rt.desc;
+
 	GLuint id = 0;
-	glCreateTextures(GL_TEXTURE_2D, 1, &id);
-	glTextureStorage2D(id, 1, glTexFormat(desc.format_), desc.width_, desc.height_);
+	if (memoryOwner == 0) {
+		glCreateTextures(GL_TEXTURE_2D, 1, &id);
+		glTextureStorage2D(id, 1, glTexFormat(desc.format_), desc.width_, desc.height_);
+	} else {
+		// GL can't place textures in memory, a view is the only way to share storage
+		// and it needs a name which has never been bound
+		glGenTextures(1, &id);
+		glTextureView(id, GL_TEXTURE_2D, memoryOwner, glTexFormat(desc.format_), 0, 1, 0, 1);
+	}
 	glTextureParameteri(id, GL_TEXTURE_MAX_LEVEL, 0);
 	if (tracing) {
 		glObjectLabel(GL_TEXTURE, id, desc.name_.size(), desc.name_.c_str());
@@ -1110,12 +1431,8 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	tex.width         = desc.width_;
 	tex.height        = desc.height_;
 	tex.renderTarget  = true;
+	tex.format        = desc.format_;
 
-	auto result = renderTargets.add();
-	RenderTarget &rt = result.first;
-	rt.width  = desc.width_;
-	rt.height = desc.height_;
-	rt.format = desc.format_;
 	// TODO: std::move?
 	rt.texture = textureResult.second;
 
@@ -1130,10 +1447,9 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 		view.width        = desc.width_;
 		view.height       = desc.height_;
 		view.renderTarget = true;
+		view.format       = desc.additionalViewFormat_;
 		rt.additionalView = viewResult.second;
 	}
-
-	return result.second;
 }
 
 
@@ -1162,85 +1478,245 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 
 	GLuint texture = 0;
 	glCreateTextures(GL_TEXTURE_2D, 1, &texture);
-	glTextureStorage2D(texture, 1, glTexFormat(desc.format_), desc.width_, desc.height_);
+	glTextureStorage2D(texture, desc.numMips_, glTexFormat(desc.format_), desc.width_, desc.height_);
 	glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, desc.numMips_ - 1);
-	unsigned int w = desc.width_, h = desc.height_;
-
-	for (unsigned int i = 0; i < desc.numMips_; i++) {
-		assert(desc.mipData_[i].data != nullptr);
-		assert(desc.mipData_[i].size != 0);
-		glTextureSubImage2D(texture, i, 0, 0, w, h, glTexBaseFormat(desc.format_), GL_UNSIGNED_BYTE, desc.mipData_[i].data);
-
-		w = std::max(w / 2, 1u);
-		h = std::max(h / 2, 1u);
-	}
 
 	auto result  = textures.add();
 	Texture &tex = result.first;
 	tex.tex    = texture;
 	tex.width  = desc.width_;
 	tex.height = desc.height_;
+	tex.format = desc.format_;
 	assert(!tex.renderTarget);
 
 	if (tracing) {
 		glObjectLabel(GL_TEXTURE, texture, desc.name_.size(), desc.name_.c_str());
 	}
 
-	return result.second;
-}
+	TextureUpload upload;
+	upload.handle  = result.second;
+	upload.format  = glTexBaseFormat(desc.format_);
+	upload.numMips = desc.numMips_;
 
+	// can we stream it? every row must fit in the upload buffer
+	bool streaming = (uploadBuffer != 0);
+	unsigned int totalSize = 0;
+	unsigned int h = desc.height_;
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		assert(desc.mipData_[i].data != nullptr);
+		assert(desc.mipData_[i].size != 0);
+		assert(desc.mipData_[i].size % h == 0);
+		upload.mipData[i]  = reinterpret_cast<const char *>(desc.mipData_[i].data);
+		upload.mipSizes[i] = desc.mipData_[i].size;
+		totalSize         += desc.mipData_[i].size;
+		if (desc.mipData_[i].size / h > uploadBufSize) {
+			streaming = false;
+		}
 
-DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *layout) {
-	auto result = dsLayouts.add();
-	DescriptorSetLayout &dsLayout = result.first;
+		h = std::max(h / 2, 1u);
+	}
 
-	while (layout->type != DescriptorType::End) {
-		dsLayout.descriptors.push_back(*layout);
-		layout++;
+	if (!streaming) {
+		// upload straight from client memory
+		unsigned int w = desc.width_;
+		h = desc.height_;
+		for (unsigned int i = 0; i < desc.numMips_; i++) {
+			glTextureSubImage2D(texture, i, 0, 0, w, h, upload.format, GL_UNSIGNED_BYTE, desc.mipData_[i].data);
+
+			w = std::max(w / 2, 1u);
+			h = std::max(h / 2, 1u);
+		}
+
+		return result.second;
 	}
-	assert(layout->offset == 0);
+
+	// go through the upload buffer
+	// if there's no room right now we copy the rest and continue in later frames
+	if (pendingUploads.empty() && streamTextureUpload(upload)) {
+		return result.second;
+	}
+
+	upload.storage.resize(totalSize);
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		memcpy(&upload.storage[offset], upload.mipData[i], upload.mipSizes[i]);
+		upload.mipData[i] = &upload.storage[offset];
+		offset += upload.mipSizes[i];
+	}
+	pendingUploads.emplace_back(std::move(upload));
 
 	return result.second;
 }
 
 
-TextureHandle RendererImpl::getRenderTargetTexture(RenderTargetHandle handle) {
-	const auto &rt = renderTargets.get(handle);
+bool RendererImpl::streamTextureUpload(TextureUpload &upload) {
+	assert(uploadBuffer != 0);
+	assert(uploadMapping != nullptr);
 
-	const auto &tex = textures.get(rt.texture);
-	assert(tex.renderTarget);
+	const auto &tex = textures.get(upload.handle);
+	assert(tex.tex != 0);
 
-	return rt.texture;
-}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
 
+	while (upload.currentMip < upload.numMips) {
+		unsigned int mip     = upload.currentMip;
+		unsigned int w       = std::max(tex.width  >> mip, 1u);
+		unsigned int h       = std::max(tex.height >> mip, 1u);
+		unsigned int rowSize = upload.mipSizes[mip] / h;
+		assert(rowSize <= uploadBufSize);
 
-TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle handle, Format /* f */) {
-	const auto &rt = renderTargets.get(handle);
+		unsigned int ptr        = (uploadBufPtr + 3) & ~3U;
+		unsigned int beginPtr   = ptr % uploadBufSize;
+		unsigned int contiguous = uploadBufSize - beginPtr;
+		// space not in use by frames still in flight
+		unsigned int available  = 0;
+		if (ptr < lastSyncedUploadBufPtr + uploadBufSize) {
+			available = lastSyncedUploadBufPtr + uploadBufSize - ptr;
+		}
 
-	const auto &tex = textures.get(rt.additionalView);
-	assert(tex.renderTarget);
+		unsigned int rows = std::min(h - upload.currentRow, std::min(contiguous, available) / rowSize);
+		if (rows == 0) {
+			if (contiguous < rowSize && available > contiguous) {
+				// row doesn't fit at the end, go back to beginning
+				uploadBufPtr = ptr + contiguous;
+				continue;
+			}
+
+			// out of space, continue when a frame completes
+			break;
+		}
+
+		unsigned int size = rows * rowSize;
+		memcpy(uploadMapping + beginPtr, upload.mipData[mip] + upload.currentRow * rowSize, size);
+		glTextureSubImage2D(tex.tex, mip, 0, upload.currentRow, w, rows, upload.format, GL_UNSIGNED_BYTE, reinterpret_cast<const void *>(static_cast<uintptr_t>(beginPtr)));
+		uploadBufPtr = ptr + size;
+
+		upload.currentRow += rows;
+		if (upload.currentRow == h) {
+			upload.currentMip++;
+			upload.currentRow = 0;
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	return (upload.currentMip == upload.numMips);
+}
+
+
+void RendererImpl::processTextureUploads() {
+	while (!pendingUploads.empty()) {
+		if (!streamTextureUpload(pendingUploads.front())) {
+			break;
+		}
+		pendingUploads.pop_front();
+	}
+}
+
+
+DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *layout) {
+	auto result = dsLayouts.add();
+	DescriptorSetLayout &dsLayout = result.first;
+
+	while (layout->type != DescriptorType::End) {
+		dsLayout.descriptors.push_back(*layout);
+		layout++;
+	}
+	assert(layout->offset == 0);
+	assert(dsLayout.descriptors.size() <= MAX_DESCRIPTOR_SET_BINDINGS);
+
+	return result.second;
+}
+
+
+TextureHandle RendererImpl::getRenderTargetTexture(RenderTargetHandle handle) {
+	const auto &rt = renderTargets.get(handle);
+
+	const auto &tex = textures.get(rt.texture);
+	assert(tex.renderTarget);
+
+	return rt.texture;
+}
+
+
+TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle handle, Format /* f */) {
+	const auto &rt = renderTargets.get(handle);
+
+	const auto &tex = textures.get(rt.additionalView);
+	assert(tex.renderTarget);
 
 	return rt.additionalView;
 }
 
 
+bool RendererImpl::isTextureReady(TextureHandle handle) const {
+	for (const auto &upload : pendingUploads) {
+		if (upload.handle == handle) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void RendererImpl::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(size != 0);
+	assert(contents != nullptr);
+
+	const Buffer &buffer = buffers.get(handle);
+	assert(buffer.usage == BufferUsage::Dynamic);
+	assert(buffer.buffer != 0);
+	assert(offset + size <= buffer.size);
+
+	// stage new contents in the ringbuffer and copy on the GPU
+	// the copy is ordered after earlier draws so frames in flight don't see it
+	// and the CPU never has to wait for them
+	auto alloc = ringBufferAllocate(size, 16);
+	const auto &seg = ringSegments[alloc.segment];
+
+	if (persistentMapInUse) {
+		memcpy(seg.mapping + alloc.offset, contents, size);
+	} else {
+		glNamedBufferSubData(seg.buffer, alloc.offset, size, contents);
+	}
+
+	glCopyNamedBufferSubData(seg.buffer, buffer.buffer, alloc.offset, buffer.offset + offset, size);
+}
+
+
 void RendererImpl::deleteBuffer(BufferHandle handle) {
-	buffers.removeWith(handle, [](struct Buffer &b) {
+	buffers.removeWith(handle, [this](struct Buffer &b) {
 		assert(b.buffer != 0);
+
+		forgetBuffer(b.buffer);
 		glDeleteBuffers(1, &b.buffer);
 		b.buffer = 0;
 
 		assert(b.size != 0);
 		b.size   = 0;
-
-		assert(!b.ringBufferAlloc);
 	} );
 }
 
 
 void RendererImpl::deleteFramebuffer(FramebufferHandle handle) {
-	framebuffers.removeWith(handle, [](Framebuffer &fb) {
-		assert(fb.fbo != 0);
+	framebuffers.removeWith(handle, [this](Framebuffer &fb) {
+		// default framebuffer is not ours to delete
+		if (fb.fbo == 0) {
+			assert(fb.colors[0] == swapchainRenderTarget);
+			return;
+		}
+
+		// deleting a framebuffer unbinds it
+		if (state.readFramebuffer == fb.fbo) {
+			state.readFramebuffer = 0;
+		}
+		if (state.drawFramebuffer == fb.fbo) {
+			state.drawFramebuffer = 0;
+		}
+
 		glDeleteFramebuffers(1, &fb.fbo);
 		fb.fbo = 0;
 	} );
@@ -1254,10 +1730,20 @@ void RendererImpl::deleteRenderPass(RenderPassHandle handle) {
 
 
 void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
+	assert(!(handle == swapchainRenderTarget));
+
 	renderTargets.removeWith(handle, [this](RenderTarget &rt) {
 		assert(rt.texture);
 
+		// views keep the storage alive so the others don't care which one goes first
+		assert(this->aliasedBytes >= rt.aliasedBytes);
+		this->aliasedBytes -= rt.aliasedBytes;
+		rt.aliasedBytes     = 0;
+
 		if (rt.readFBO != 0) {
+			if (this->state.readFramebuffer == rt.readFBO) {
+				this->state.readFramebuffer = 0;
+			}
 			glDeleteFramebuffers(1, &rt.readFBO);
 			rt.readFBO = 0;
 		}
@@ -1267,6 +1753,7 @@ void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 			assert(tex.renderTarget);
 			tex.renderTarget = false;
 			assert(tex.tex != 0);
+			this->forgetTexture(tex.tex);
 			glDeleteTextures(1, &tex.tex);
 			tex.tex = 0;
 		}
@@ -1278,6 +1765,7 @@ void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 			assert(view.renderTarget);
 			view.renderTarget = false;
 			assert(view.tex != 0);
+			this->forgetTexture(view.tex);
 			glDeleteTextures(1, &view.tex);
 			view.tex = 0;
 			this->textures.remove(rt.additionalView);
@@ -1287,10 +1775,61 @@ void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 }
 
 
+bool RendererImpl::canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const {
+	assert(!rts.empty());
+	const auto &first = renderTargets.get(rts[0]);
+
+	for (const auto &handle : rts) {
+		const auto &rt = renderTargets.get(handle);
+		if (!rt.desc.transient_ || rt.texture) {
+			return false;
+		}
+
+		if (&rt == &first) {
+			continue;
+		}
+
+		// must be a valid view of the first one's storage
+		// same size and same number of bits per pixel, depth can't be viewed as anything else
+		if (rt.width != first.width || rt.height != first.height) {
+			return false;
+		}
+
+		if (isDepthFormat(rt.format) || isDepthFormat(first.format)) {
+			return false;
+		}
+
+		if (formatSize(rt.format) != formatSize(first.format)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void RendererImpl::aliasRenderTargets(const std::vector<RenderTargetHandle> &rts) {
+	assert(canAliasRenderTargets(rts));
+
+	auto &owner = renderTargets.get(rts[0]);
+	createRenderTargetTextures(owner, 0);
+	GLuint storage = textures.get(owner.texture).tex;
+
+	for (unsigned int i = 1; i < rts.size(); i++) {
+		auto &rt = renderTargets.get(rts[i]);
+		createRenderTargetTextures(rt, storage);
+		owner.aliasedBytes += uint64_t(rt.width) * rt.height * formatSize(rt.format);
+	}
+
+	aliasedBytes += owner.aliasedBytes;
+}
+
+
 void RendererImpl::deleteSampler(SamplerHandle handle) {
-	samplers.removeWith(handle, [](Sampler &sampler) {
+	samplers.removeWith(handle, [this](Sampler &sampler) {
 		assert(sampler.sampler != 0);
 
+		forgetSampler(sampler.sampler);
 		glDeleteSamplers(1, &sampler.sampler);
 		sampler.sampler = 0;
 	} );
@@ -1298,10 +1837,15 @@ void RendererImpl::deleteSampler(SamplerHandle handle) {
 
 
 void RendererImpl::deleteTexture(TextureHandle handle) {
-	textures.removeWith(handle, [](Texture &tex) {
+	pendingUploads.erase(std::remove_if(pendingUploads.begin(), pendingUploads.end(), [handle] (const TextureUpload &upload) {
+		return upload.handle == handle;
+	} ), pendingUploads.end());
+
+	textures.removeWith(handle, [this](Texture &tex) {
 		assert(!tex.renderTarget);
 		assert(tex.tex != 0);
 
+		forgetTexture(tex.tex);
 		glDeleteTextures(1, &tex.tex);
 		tex.tex = 0;
 	} );
@@ -1397,6 +1941,27 @@ void RendererImpl::recreateSwapchain() {
 	swapchainDesc.numFrames  = numImages;
 	swapchainDesc.vsync      = wantedSwapchain.vsync;
 
+	// default framebuffer, no texture behind it
+	if (!swapchainRenderTarget) {
+		auto result           = renderTargets.add();
+		swapchainRenderTarget = result.second;
+	}
+	swapchainFormat = sRGBFramebuffer ? Format::sRGBA8 : Format::RGBA8;
+	{
+		auto &rt  = renderTargets.get(swapchainRenderTarget);
+		rt.width  = w;
+		rt.height = h;
+		rt.format = swapchainFormat;
+		rt.desc.width(w).height(h).format(swapchainFormat).name("swapchain");
+	}
+
+	framebuffers.forEach([this, w, h] (Framebuffer &fb) {
+		if (fb.colors[0] == swapchainRenderTarget) {
+			fb.width  = w;
+			fb.height = h;
+		}
+	} );
+
 	if (frames.size() != numImages) {
 		if (numImages < frames.size()) {
 			// decreasing, delete old and resize
@@ -1424,11 +1989,14 @@ void RendererImpl::recreateSwapchain() {
 
 MemoryStats RendererImpl::getMemStats() const {
 	MemoryStats stats;
+	stats.aliasedBytes = aliasedBytes;
 	return stats;
 }
 
 
 void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
 	assert(!inFrame);
 	inFrame       = true;
 	inRenderPass  = false;
@@ -1451,18 +2019,20 @@ void RendererImpl::beginFrame() {
 	}
 	assert(!frame.outstanding);
 
-	descriptors.clear();
+	renderTargets.get(swapchainRenderTarget).currentLayout = Layout::Invalid;
 
-	// TODO: reset all relevant state in case some 3rd-party program fucked them up
-	glDepthMask(GL_TRUE);
+	// upload buffer space might have been freed, continue streaming textures
+	processTextureUploads();
 
-	if (sRGBFramebuffer) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
-	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
-	}
+	// descriptors don't survive across frames since ephemeral buffers don't
+	descriptors.fill(Descriptor());
+	dirtyDescriptors = 0;
 
-	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	// TODO: reset all relevant state in case some 3rd-party program fucked them up
+	// GLState assumes nobody else touches GL state, call resetGLState() if they do
+	setDepthWrite(true);
+	setEnabled(GL_FRAMEBUFFER_SRGB, state.framebufferSRGB, sRGBFramebuffer);
+	setClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	// TODO: only clear depth/stencil if we have it
 	// TODO: set color/etc write masks if necessary
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -1470,49 +2040,53 @@ void RendererImpl::beginFrame() {
 
 
 void RendererImpl::presentFrame(RenderTargetHandle image) {
+	PROFILE_FUNCTION();
+
 	assert(inFrame);
+	assert(!inTimestampScope);
 	inFrame = false;
 
 	auto &frame = frames.at(currentFrameIdx);
 
 	auto &rt = renderTargets.get(image);
-	assert(rt.currentLayout == Layout::TransferSrc);
-
-	unsigned int width  = rt.width;
-	unsigned int height = rt.height;
 
-	// TODO: only if enabled
-	glDisable(GL_SCISSOR_TEST);
-	if (sRGBFramebuffer) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
+	if (image == swapchainRenderTarget) {
+		// the last render pass drew straight into the default framebuffer
+		assert(rt.currentLayout == Layout::Present || rt.currentLayout == Layout::Invalid);
 	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
-	}
+		assert(rt.currentLayout == Layout::TransferSrc);
 
+		unsigned int width  = rt.width;
+		unsigned int height = rt.height;
 
-	// TODO: necessary? should do linear blit?
-	assert(width  == swapchainDesc.width);
-	assert(height == swapchainDesc.height);
+		setEnabled(GL_SCISSOR_TEST,     state.scissorTest,     false);
+		setEnabled(GL_FRAMEBUFFER_SRGB, state.framebufferSRGB, sRGBFramebuffer);
 
-	assert(width > 0);
-	assert(height > 0);
+		// TODO: necessary? should do linear blit?
+		assert(width  == swapchainDesc.width);
+		assert(height == swapchainDesc.height);
 
-	if (rt.readFBO == 0) {
-		glCreateFramebuffers(1, &rt.readFBO);
-		const auto &colorTex = textures.get(rt.texture);
-		assert(colorTex.renderTarget);
-		assert(colorTex.tex != 0);
-		glNamedFramebufferTexture(rt.readFBO, GL_COLOR_ATTACHMENT0, colorTex.tex, 0);
-	}
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, rt.readFBO);
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		assert(width > 0);
+		assert(height > 0);
+
+		if (rt.readFBO == 0) {
+			glCreateFramebuffers(1, &rt.readFBO);
+			const auto &colorTex = textures.get(rt.texture);
+			assert(colorTex.renderTarget);
+			assert(colorTex.tex != 0);
+			glNamedFramebufferTexture(rt.readFBO, GL_COLOR_ATTACHMENT0, colorTex.tex, 0);
+		}
+		bindFramebuffer(GL_READ_FRAMEBUFFER, rt.readFBO);
+		bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
-	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
 
 	SDL_GL_SwapWindow(window);
 
 	frame.fence        = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-	frame.usedRingBufPtr = ringBufPtr;
+	ringBufferEndFrame(frame);
+	frame.usedUploadBufPtr = uploadBufPtr;
 	frame.outstanding  = true;
 	frame.lastFrameNum = frameNum;
 
@@ -1538,31 +2112,36 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 	glDeleteSync(frame.fence);
 	frame.fence = nullptr;
 
-	for (auto handle : frame.ephemeralBuffers) {
-		Buffer &buffer = buffers.get(handle);
-		if (buffer.ringBufferAlloc) {
-			buffer.buffer          = 0;
-			buffer.ringBufferAlloc = false;
-		} else {
-			glDeleteBuffers(1, &buffer.buffer);
-			buffer.buffer = 0;
-		}
-
-		assert(buffer.size   >  0);
-		buffer.size = 0;
-		buffer.offset = 0;
+	// the fence has signaled so query results are available without stalling
+	frameTimings.clear();
+	for (unsigned int i = 0; i < frame.timestampScopes.size(); i++) {
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.timestampQueries.at(2 * i),     GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.timestampQueries.at(2 * i + 1), GL_QUERY_RESULT, &end);
 
-		buffers.remove(handle);
+		GPUTiming t;
+		t.name         = std::move(frame.timestampScopes.at(i));
+		t.milliseconds = double(end - begin) / 1000000.0;
+		frameTimings.push_back(std::move(t));
 	}
-	frame.ephemeralBuffers.clear();
+	frame.timestampScopes.clear();
+	updateTimingHistory();
+
+	ringBufferRetireFrame(frame);
 	frame.outstanding = false;
 	lastSyncedFrame = std::max(lastSyncedFrame, frame.lastFrameNum);
-	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	lastSyncedUploadBufPtr = std::max(lastSyncedUploadBufPtr, frame.usedUploadBufPtr);
 }
 
 
 void RendererImpl::deleteFrameInternal(Frame &f) {
 	assert(!f.outstanding);
+
+	if (!f.timestampQueries.empty()) {
+		glDeleteQueries(static_cast<GLsizei>(f.timestampQueries.size()), &f.timestampQueries[0]);
+		f.timestampQueries.clear();
+	}
+	f.timestampScopes.clear();
 }
 
 
@@ -1574,30 +2153,38 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 
 	assert(fbHandle);
 	const auto &fb = framebuffers.get(fbHandle);
-	assert(fb.fbo != 0);
+	// zero is the default framebuffer
+	assert(fb.fbo != 0 || fb.colors[0] == swapchainRenderTarget);
 
 	// make sure renderpass and framebuffer match
 	// OpenGL doesn't care but Vulkan does
 	assert(fb.renderPass == rpHandle);
 
-	// TODO: should get clear bits from RenderPass object
+	const auto &pass = renderPasses.get(rpHandle);
+
+	// TODO: should get color and depth clear bits from RenderPass object
 	GLbitfield mask = GL_COLOR_BUFFER_BIT;
 	if (fb.depthStencil) {
 		mask |= GL_DEPTH_BUFFER_BIT;
+		if (pass.desc.stencilLoadOp_ == LoadOp::Clear) {
+			assert(isStencilFormat(pass.desc.depthStencilFormat_));
+			mask |= GL_STENCIL_BUFFER_BIT;
+		}
 	}
 
-	assert(fb.fbo != 0);
 	assert(fb.width > 0);
 	assert(fb.height > 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
-	glClear(mask);
+	bindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
 
-	if (fb.sRGB) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
-	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
+	// clear is affected by depth mask and scissor
+	if (fb.depthStencil) {
+		setDepthWrite(true);
 	}
+	setEnabled(GL_SCISSOR_TEST, state.scissorTest, false);
+	glClear(mask);
+
+	setEnabled(GL_FRAMEBUFFER_SRGB, state.framebufferSRGB, fb.sRGB);
 
 	currentRenderPass  = rpHandle;
 	currentFramebuffer = fbHandle;
@@ -1612,9 +2199,17 @@ void RendererImpl::endRenderPass() {
 	const auto &pass = renderPasses.get(currentRenderPass);
 	const auto &fb = framebuffers.get(currentFramebuffer);
 
-	// TODO: track depthstencil layout too
-	auto &rt = renderTargets.get(fb.colors[0]);
-	rt.currentLayout = pass.desc.colorFinalLayout_;
+	for (const auto &color : fb.colors) {
+		if (color) {
+			auto &rt = renderTargets.get(color);
+			rt.currentLayout = pass.desc.colorFinalLayout_;
+		}
+	}
+
+	if (fb.depthStencil) {
+		auto &rt = renderTargets.get(fb.depthStencil);
+		rt.currentLayout = pass.desc.depthStencilFinalLayout_;
+	}
 
 	currentRenderPass = RenderPassHandle();
 	currentFramebuffer = FramebufferHandle();
@@ -1623,7 +2218,16 @@ void RendererImpl::endRenderPass() {
 
 void RendererImpl::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
 	assert(inFrame);
+
+	std::array<GLint, 4> viewport = { { GLint(x), GLint(y), GLint(width), GLint(height) } };
+	if (state.viewport == viewport) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
 	glViewport(x, y, width, height);
+	state.viewport = viewport;
 }
 
 
@@ -1636,166 +2240,385 @@ void RendererImpl::setScissorRect(unsigned int x, unsigned int y, unsigned int w
 
 	// flip y from Vulkan convention to OpenGL convention
 	// TODO: should use current FB height
-	glScissor(x, swapchainDesc.height - (y + height), width, height);
+	std::array<GLint, 4> scissor = { { GLint(x), GLint(swapchainDesc.height - (y + height)), GLint(width), GLint(height) } };
+	if (state.scissor == scissor) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+	state.scissor = scissor;
 }
 
 
-void RendererImpl::bindPipeline(PipelineHandle pipeline) {
-	assert(inFrame);
-	assert(pipeline);
-	assert(inRenderPass);
-	assert(pipelineDrawn);
-	pipelineDrawn = false;
-	validPipeline = true;
-	scissorSet = false;
-	decriptorSetsDirty = true;
+void RendererImpl::resetGLState() {
+	// force GL to match shadow state
+	state = GLState();
 
-	const auto &p = pipelines.get(pipeline);
-	assert(p.desc.renderPass_ == currentRenderPass);
+	glUseProgram(state.program);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, state.readFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, state.drawFramebuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.indexBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, state.indirectBuffer);
 
-	// TODO: shadow state, set only necessary
-	glUseProgram(p.shader);
-	if (p.desc.depthWrite_) {
-		glDepthMask(GL_TRUE);
+	glDepthMask(state.depthWrite ? GL_TRUE : GL_FALSE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_FRAMEBUFFER_SRGB);
+
+	glBlendEquation(state.blendEquation);
+	glBlendFunc(state.blendSrc, state.blendDst);
+
+	glDisable(GL_STENCIL_TEST);
+	glStencilFunc(state.stencilFunc, state.stencilRef, 0xFF);
+	glStencilOp(GL_KEEP, GL_KEEP, state.stencilPass);
+	// never changed so clears always reach every stencil bit
+	glStencilMask(0xFF);
+
+	glClearColor(state.clearColor[0], state.clearColor[1], state.clearColor[2], state.clearColor[3]);
+
+	// viewport and scissor are all zeros in shadow state
+	// so the first real value always goes through
+	glViewport(0, 0, 0, 0);
+	glScissor(0, 0, 0, 0);
+
+	for (unsigned int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
+		const auto &attr = state.vertexAttribs[i];
+		glDisableVertexAttribArray(i);
+		glVertexAttribFormat(i, attr.size, attr.type, attr.normalized, attr.offset);
+		glVertexAttribBinding(i, attr.binding);
+	}
+
+	for (unsigned int i = 0; i < MAX_VERTEX_BUFFERS; i++) {
+		const auto &vb = state.vertexBuffers[i];
+		glBindVertexBuffer(i, vb.buffer, vb.offset, vb.stride);
+	}
+
+	for (unsigned int i = 0; i < MAX_GL_UNITS; i++) {
+		glBindBufferBase(GL_UNIFORM_BUFFER,        i, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+		glBindTextureUnit(i, 0);
+		glBindSampler(i, 0);
+	}
+}
+
+
+void RendererImpl::setEnabled(GLenum cap, bool &current, bool enabled) {
+	if (current == enabled) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	if (enabled) {
+		glEnable(cap);
 	} else {
-		glDepthMask(GL_FALSE);
+		glDisable(cap);
+	}
+	current = enabled;
+}
+
+
+void RendererImpl::useProgram(GLuint program) {
+	if (state.program == program) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glUseProgram(program);
+	state.program = program;
+}
+
+
+void RendererImpl::bindFramebuffer(GLenum target, GLuint fbo) {
+	bool read = (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER);
+	bool draw = (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER);
+	assert(read || draw);
+
+	if ((!read || state.readFramebuffer == fbo) && (!draw || state.drawFramebuffer == fbo)) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glBindFramebuffer(target, fbo);
+	if (read) {
+		state.readFramebuffer = fbo;
 	}
+	if (draw) {
+		state.drawFramebuffer = fbo;
+	}
+}
+
+
+void RendererImpl::setDepthWrite(bool enabled) {
+	if (state.depthWrite == enabled) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	state.depthWrite = enabled;
+}
 
-	if (p.desc.depthTest_) {
-		glEnable(GL_DEPTH_TEST);
+
+void RendererImpl::setBlendFunc(GLenum equation, GLenum src, GLenum dst) {
+	if (state.blendEquation == equation) {
+		frameStats.stateCallsElided++;
 	} else {
-		glDisable(GL_DEPTH_TEST);
+		frameStats.stateCallsIssued++;
+		glBlendEquation(equation);
+		state.blendEquation = equation;
 	}
 
-	if (p.desc.cullFaces_) {
-		glEnable(GL_CULL_FACE);
+	if (state.blendSrc == src && state.blendDst == dst) {
+		frameStats.stateCallsElided++;
 	} else {
-		glDisable(GL_CULL_FACE);
+		frameStats.stateCallsIssued++;
+		glBlendFunc(src, dst);
+		state.blendSrc = src;
+		state.blendDst = dst;
 	}
+}
 
-	if (p.desc.scissorTest_) {
-		glEnable(GL_SCISSOR_TEST);
+
+void RendererImpl::setStencilOp(GLenum func, GLint ref, GLenum pass) {
+	if (state.stencilFunc == func && state.stencilRef == ref) {
+		frameStats.stateCallsElided++;
 	} else {
-		glDisable(GL_SCISSOR_TEST);
+		frameStats.stateCallsIssued++;
+		glStencilFunc(func, ref, 0xFF);
+		state.stencilFunc = func;
+		state.stencilRef  = ref;
 	}
 
-	if (p.desc.blending_) {
-		glEnable(GL_BLEND);
-		// TODO: get from Pipeline
-		glBlendEquation(GL_FUNC_ADD);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (state.stencilPass == pass) {
+		frameStats.stateCallsElided++;
 	} else {
-		glDisable(GL_BLEND);
+		frameStats.stateCallsIssued++;
+		glStencilOp(GL_KEEP, GL_KEEP, pass);
+		state.stencilPass = pass;
 	}
+}
 
-	uint32_t oldMask = currentPipeline ? (pipelines.get(currentPipeline).desc.vertexAttribMask) : 0;
-	uint32_t newMask = p.desc.vertexAttribMask;
 
+void RendererImpl::setClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+	std::array<GLfloat, 4> color = { { r, g, b, a } };
+	if (state.clearColor == color) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glClearColor(r, g, b, a);
+	state.clearColor = color;
+}
+
+
+void RendererImpl::setVertexAttribMask(uint32_t mask) {
 	// enable/disable changed attributes
-	uint32_t vattrChanged = oldMask ^ newMask;
+	uint32_t vattrChanged = state.vertexAttribMask ^ mask;
+	unsigned int numChanged = 0;
+	// only attributes which stay enabled would have been set again without state tracking
+	uint32_t vattrKept = state.vertexAttribMask & mask;
 #ifdef __GNUC__
+	unsigned int numKept = __builtin_popcount(vattrKept);
 	while (vattrChanged != 0) {
 		int bit = __builtin_ctz(vattrChanged);
-		uint32_t mask = 1 << bit;
+		uint32_t bitMask = 1 << bit;
 
-		if (newMask & mask) {
+		if (mask & bitMask) {
 			glEnableVertexAttribArray(bit);
 		} else {
 			glDisableVertexAttribArray(bit);
 		}
+		numChanged++;
 
-		vattrChanged &= ~mask;
+		vattrChanged &= ~bitMask;
 	}
 #else
+  unsigned int numKept = __popcnt(vattrKept);
   while (true) {
     unsigned long bit = 0;
     if (!_BitScanForward(&bit, vattrChanged)) {
       break;
     }
-    uint32_t mask = 1 << bit;
+    uint32_t bitMask = 1 << bit;
 
-    if (newMask & mask) {
+    if (mask & bitMask) {
       glEnableVertexAttribArray(bit);
     }
     else {
       glDisableVertexAttribArray(bit);
     }
+    numChanged++;
 
-    vattrChanged &= ~mask;
+    vattrChanged &= ~bitMask;
   }
 #endif
 
-	// set format on new attributes
+	frameStats.stateCallsIssued += numChanged;
+	frameStats.stateCallsElided += numKept;
+	state.vertexAttribMask = mask;
+}
+
+
+void RendererImpl::setVertexAttribFormat(unsigned int attrib, const VertexAttribState &format) {
+	assert(attrib < MAX_VERTEX_ATTRIBS);
+	auto &current = state.vertexAttribs[attrib];
+
+	if (current.size       != format.size
+	 || current.type       != format.type
+	 || current.normalized != format.normalized
+	 || current.offset     != format.offset) {
+		frameStats.stateCallsIssued++;
+		glVertexAttribFormat(attrib, format.size, format.type, format.normalized, format.offset);
+	} else {
+		frameStats.stateCallsElided++;
+	}
+
+	if (current.binding != format.binding) {
+		frameStats.stateCallsIssued++;
+		glVertexAttribBinding(attrib, format.binding);
+	} else {
+		frameStats.stateCallsElided++;
+	}
+
+	current = format;
+}
+
+
+void RendererImpl::bindElementBuffer(GLuint buffer) {
+	// element array buffer binding is part of VAO state
+	// we only have one VAO so this is fine
+	if (state.indexBuffer == buffer) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	state.indexBuffer = buffer;
+}
+
+
+void RendererImpl::bindVertexBufferInternal(unsigned int binding, const VertexBufferState &vb) {
+	assert(binding < MAX_VERTEX_BUFFERS);
+	auto &current = state.vertexBuffers[binding];
+	if (current == vb) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	frameStats.stateCallsIssued++;
+	glBindVertexBuffer(binding, vb.buffer, vb.offset, vb.stride);
+	current = vb;
+}
+
+
+void RendererImpl::bindPipeline(PipelineHandle pipeline) {
+	assert(inFrame);
+	assert(pipeline);
+	assert(pipelineDrawn);
+	pipelineDrawn = false;
+	validPipeline = true;
+	scissorSet = false;
+	decriptorSetsDirty = true;
+	// new pipeline might map descriptors to different units
+	dirtyDescriptors = ~0U;
+
+	auto &p = pipelines.get(pipeline);
+	currentPipeline = pipeline;
+
+	if (!p.linked) {
+		finishPipeline(p);
+	}
+
+	if (p.desc.computeShader_) {
+		// compute only needs the program and descriptors
+		assert(!inRenderPass);
+		useProgram(p.shader);
+		return;
+	}
+
+	assert(inRenderPass);
+	assert(p.desc.renderPass_ == currentRenderPass);
+
+	useProgram(p.shader);
+	setDepthWrite(p.desc.depthWrite_);
+	setEnabled(GL_DEPTH_TEST,   state.depthTest,   p.desc.depthTest_);
+	setEnabled(GL_CULL_FACE,    state.cullFace,    p.desc.cullFaces_);
+	setEnabled(GL_SCISSOR_TEST, state.scissorTest, p.desc.scissorTest_);
+	setEnabled(GL_BLEND,        state.blend,       p.desc.blending_);
+	setEnabled(GL_STENCIL_TEST, state.stencilTest, p.desc.stencilTest_);
+	if (p.desc.blending_) {
+		// TODO: get from Pipeline
+		setBlendFunc(GL_FUNC_ADD, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	if (p.desc.stencilTest_) {
+		setStencilOp(glCompareFunc(p.desc.stencilCompare_), p.desc.stencilRef_, glStencilPassOp(p.desc.stencilPass_));
+	}
+
+	uint32_t newMask = p.desc.vertexAttribMask;
+	setVertexAttribMask(newMask);
+
+	// set format on enabled attributes
 	const auto &attribs = p.desc.vertexAttribs;
-#ifdef __GNUC__
-	while (newMask) {
-		int bit = __builtin_ctz(newMask);
-		uint32_t mask = 1 << bit;
+	for (unsigned int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
+		if (!(newMask & (1 << i))) {
+			continue;
+		}
 
-		const auto &attr = attribs[bit];
-		bool normalized = false;
-		GLenum format = GL_NONE;
+		const auto &attr = attribs[i];
+		VertexAttribState format;
+		format.size    = attr.count;
+		format.offset  = attr.offset;
+		format.binding = attr.bufBinding;
 		switch (attr.format) {
 		case VtxFormat::Float:
-			format = GL_FLOAT;
+			format.type       = GL_FLOAT;
+			format.normalized = GL_FALSE;
 			break;
 
 		case VtxFormat::UNorm8:
-			format = GL_UNSIGNED_BYTE;
-			normalized = true;
+			format.type       = GL_UNSIGNED_BYTE;
+			format.normalized = GL_TRUE;
 			break;
 		}
 
-		glVertexAttribFormat(bit, attr.count, format, normalized ? GL_TRUE : GL_FALSE, attr.offset);
-		glVertexAttribBinding(bit, attr.bufBinding);
-		newMask &= ~mask;
+		setVertexAttribFormat(i, format);
 	}
-#else
-  while (true) {
-    unsigned long bit = 0;
-    if (!_BitScanForward(&bit, vattrChanged)) {
-      break;
-    }
-    uint32_t mask = 1 << bit;
-
-    const auto &attr = attribs[bit];
-    bool normalized = false;
-    GLenum format = GL_NONE;
-    switch (attr.format) {
-    case VtxFormat::Float:
-      format = GL_FLOAT;
-      break;
+}
 
-    case VtxFormat::UNorm8:
-      format = GL_UNSIGNED_BYTE;
-      normalized = true;
-      break;
-    }
 
-    glVertexAttribFormat(bit, attr.count, format, normalized ? GL_TRUE : GL_FALSE, attr.offset);
-    glVertexAttribBinding(bit, attr.bufBinding);
-    newMask &= ~mask;
-  }
-#endif
+void RendererImpl::bindIndexBuffer(BufferHandle handle, bool bit16) {
+	assert(inFrame);
+	assert(validPipeline);
 
-	currentPipeline = pipeline;
+	const Buffer &buffer = buffers.get(handle);
+	assert(buffer.size > 0);
+	assert(buffer.buffer != 0);
+	assert(buffer.offset == 0);
+	bindElementBuffer(buffer.buffer);
+	indexBufByteOffset = buffer.offset;
+	idxBuf16Bit = bit16;
 }
 
 
-void RendererImpl::bindIndexBuffer(BufferHandle handle, bool bit16) {
+void RendererImpl::bindIndexBuffer(EphemeralBuffer buffer, bool bit16) {
 	assert(inFrame);
 	assert(validPipeline);
 
-	const Buffer &buffer = buffers.get(handle);
+	const auto &seg = ringSegments[buffer.segment];
 	assert(buffer.size > 0);
-	if (buffer.ringBufferAlloc) {
-		assert(buffer.buffer == ringBuffer);
-		assert(buffer.offset + buffer.size < ringBufSize);
-	} else {
-		assert(buffer.buffer != 0);
-		assert(buffer.offset == 0);
-	}
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.buffer);
+	assert(seg.buffer != 0);
+	assert(buffer.offset + buffer.size <= seg.size);
+	bindElementBuffer(seg.buffer);
 	indexBufByteOffset = buffer.offset;
 	idxBuf16Bit = bit16;
 }
@@ -1807,17 +2630,31 @@ void RendererImpl::bindVertexBuffer(unsigned int binding, BufferHandle handle) {
 
 	const Buffer &buffer = buffers.get(handle);
 	assert(buffer.size >  0);
-	if (buffer.ringBufferAlloc) {
-		// this is not strictly correct since we might have reallocated the ringbuf bigger
-		// but it should never fail, at worst it will not spot some errors immediately after realloc
-		// which are rare events anyway
-		assert(buffer.offset + buffer.size < ringBufSize);
-	} else {
-		assert(buffer.buffer != 0);
-		assert(buffer.offset == 0);
-	}
+	assert(buffer.buffer != 0);
+	assert(buffer.offset == 0);
 	const auto &p = pipelines.get(currentPipeline);
-	glBindVertexBuffer(binding, buffer.buffer, buffer.offset, p.desc.vertexBuffers[binding].stride);
+	VertexBufferState vb;
+	vb.buffer = buffer.buffer;
+	vb.offset = buffer.offset;
+	vb.stride = p.desc.vertexBuffers[binding].stride;
+	bindVertexBufferInternal(binding, vb);
+}
+
+
+void RendererImpl::bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer) {
+	assert(inFrame);
+	assert(validPipeline);
+
+	const auto &seg = ringSegments[buffer.segment];
+	assert(buffer.size >  0);
+	assert(seg.buffer != 0);
+	assert(buffer.offset + buffer.size <= seg.size);
+	const auto &p = pipelines.get(currentPipeline);
+	VertexBufferState vb;
+	vb.buffer = seg.buffer;
+	vb.offset = buffer.offset;
+	vb.stride = p.desc.vertexBuffers[binding].stride;
+	bindVertexBufferInternal(binding, vb);
 }
 
 
@@ -1836,6 +2673,8 @@ void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHa
 		DSIndex idx;
 		idx.set     = index;
 		idx.binding = descIndex;
+		unsigned int slot = descriptorSlot(idx);
+		dirtyDescriptors |= (1U << slot);
 
 		switch (l.type) {
 		case DescriptorType::End:
@@ -1843,45 +2682,43 @@ void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHa
 			UNREACHABLE();
 			break;
 
-		case DescriptorType::UniformBuffer: {
+		case DescriptorType::UniformBuffer:
+		case DescriptorType::StorageBuffer: {
 			// this is part of the struct, we know it's correctly aligned and right type
 			BufferHandle handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
 			const Buffer &buffer = buffers.get(handle);
 			assert(buffer.size > 0);
-			if (buffer.ringBufferAlloc) {
-				assert(buffer.buffer == ringBuffer);
-				assert(buffer.offset + buffer.size < ringBufSize);
-			} else {
-				assert(buffer.buffer != 0);
-				assert(buffer.offset == 0);
-			}
-			descriptors[idx] = handle;
+			assert(buffer.buffer != 0);
+			assert(buffer.offset == 0);
+			descriptors[slot] = handle;
 		} break;
 
-		case DescriptorType::StorageBuffer: {
-			BufferHandle handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
-			const Buffer &buffer = buffers.get(handle);
-			assert(buffer.size  > 0);
-			if (buffer.ringBufferAlloc) {
-				assert(buffer.buffer == ringBuffer);
-				assert(buffer.offset + buffer.size < ringBufSize);
-			} else {
-				assert(buffer.buffer != 0);
-				assert(buffer.offset == 0);
-			}
-			descriptors[idx] = handle;
+		case DescriptorType::EphemeralUniformBuffer:
+		case DescriptorType::EphemeralStorageBuffer: {
+			const EphemeralBuffer &buffer = *reinterpret_cast<const EphemeralBuffer *>(data + l.offset);
+			assert(buffer.size > 0);
+			assert(ringSegments[buffer.segment].buffer != 0);
+			assert(buffer.offset + buffer.size <= ringSegments[buffer.segment].size);
+			descriptors[slot] = buffer;
 		} break;
 
 		case DescriptorType::Sampler: {
 			SamplerHandle handle = *reinterpret_cast<const SamplerHandle *>(data + l.offset);
 			const auto &sampler = samplers.get(handle);
 			assert(sampler.sampler);
-			descriptors[idx] = handle;
+			descriptors[slot] = handle;
 		} break;
 
 		case DescriptorType::Texture: {
 			TextureHandle texHandle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
-			descriptors[idx] = texHandle;
+			descriptors[slot] = texHandle;
+		} break;
+
+		case DescriptorType::StorageImage: {
+			TextureHandle texHandle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
+			assert(textures.get(texHandle).renderTarget);
+			assert(!issRGBFormat(textures.get(texHandle).format));
+			descriptors[slot] = texHandle;
 		} break;
 
 		case DescriptorType::CombinedSampler: {
@@ -1893,7 +2730,7 @@ void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHa
 			const auto &sampler = samplers.get(combined.sampler);
 			assert(sampler.sampler);
 
-			descriptors[idx] = combined;
+			descriptors[slot] = combined;
 		} break;
 
 		case DescriptorType::Count:
@@ -1913,74 +2750,315 @@ void RendererImpl::rebindDescriptorSets() {
 	const auto &pipeline  = pipelines.get(currentPipeline);
 	const auto &resources = pipeline.resources;
 
-	// TODO: only change what is necessary
+	// only look at descriptors which changed, then only bind units which changed
+	uint32_t dirty = dirtyDescriptors;
+
+	uint32_t changed = 0;
 	for (unsigned int i = 0; i < resources.ubos.size(); i++) {
-		const auto &r = resources.ubos.at(i);
-		const auto &d = descriptors.at(r);
-		const Buffer &buffer = buffers.get(boost::get<BufferHandle>(d));
-		glBindBufferRange(GL_UNIFORM_BUFFER, i, buffer.buffer, buffer.offset, buffer.size);
+		unsigned int slot = descriptorSlot(resources.ubos[i]);
+		if (!(dirty & (1U << slot))) {
+			continue;
+		}
+
+		setBufferUnit(state.uboUnits, changed, i, descriptors[slot]);
 	}
+	flushBufferUnits(GL_UNIFORM_BUFFER, state.uboUnits, changed);
 
+	changed = 0;
 	for (unsigned int i = 0; i < resources.ssbos.size(); i++) {
-		const auto &r = resources.ssbos.at(i);
-		const auto &d = descriptors.at(r);
-		const Buffer &buffer = buffers.get(boost::get<BufferHandle>(d));
-		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, i, buffer.buffer, buffer.offset, buffer.size);
+		unsigned int slot = descriptorSlot(resources.ssbos[i]);
+		if (!(dirty & (1U << slot))) {
+			continue;
+		}
+
+		setBufferUnit(state.ssboUnits, changed, i, descriptors[slot]);
 	}
+	flushBufferUnits(GL_SHADER_STORAGE_BUFFER, state.ssboUnits, changed);
 
+	changed = 0;
 	for (unsigned int i = 0; i < resources.textures.size(); i++) {
-		const auto &r = resources.textures.at(i);
-		const auto &d = descriptors.at(r);
+		unsigned int slot = descriptorSlot(resources.textures[i]);
+		if (!(dirty & (1U << slot))) {
+			continue;
+		}
+		assert(i < MAX_GL_UNITS);
 
+		const auto &d = descriptors[slot];
+		GLuint tex = 0;
 		// TODO: find a better way than magic numbers
 		// std::variant has holds_alternative
 		switch (d.which()) {
 		case 1: {
 			const CSampler &combined = boost::get<CSampler>(d);
-			const Texture &tex  = textures.get(combined.tex);
-			glBindTextureUnit(i, tex.tex);
+			tex = textures.get(combined.tex).tex;
 		} break;
 
 		case 3: {
 			const TextureHandle &handle = boost::get<TextureHandle>(d);
-			const Texture &tex  = textures.get(handle);
-			glBindTextureUnit(i, tex.tex);
+			tex = textures.get(handle).tex;
 		} break;
 
 		default:
 			UNREACHABLE();
 			break;
 		}
+
+		if (state.textureUnits[i] == tex) {
+			frameStats.stateCallsElided++;
+		} else {
+			state.textureUnits[i] = tex;
+			changed |= (1U << i);
+		}
 	}
+	flushTextureUnits(changed);
 
+	changed = 0;
 	for (unsigned int i = 0; i < resources.samplers.size(); i++) {
-		const auto &r = resources.samplers.at(i);
-		const auto &d = descriptors.at(r);
+		unsigned int slot = descriptorSlot(resources.samplers[i]);
+		if (!(dirty & (1U << slot))) {
+			continue;
+		}
+		assert(i < MAX_GL_UNITS);
+
+		const auto &d = descriptors[slot];
+		GLuint sampler = 0;
 		// TODO: find a better way than magic numbers
 		// std::variant has holds_alternative
 		switch (d.which()) {
 		case 1: {
 			const CSampler &combined = boost::get<CSampler>(d);
-			const auto &sampler = samplers.get(combined.sampler);
-			glBindSampler(i, sampler.sampler);
+			sampler = samplers.get(combined.sampler).sampler;
 		} break;
 
 		case 2: {
 			const SamplerHandle &handle = boost::get<SamplerHandle>(d);
-			const auto &sampler = samplers.get(handle);
-			glBindSampler(i, sampler.sampler);
+			sampler = samplers.get(handle).sampler;
 		} break;
 
 		default:
 			UNREACHABLE();
 			break;
 		}
+
+		if (state.samplerUnits[i] == sampler) {
+			frameStats.stateCallsElided++;
+		} else {
+			state.samplerUnits[i] = sampler;
+			changed |= (1U << i);
+		}
 	}
+	flushSamplerUnits(changed);
 
+	for (unsigned int i = 0; i < resources.images.size(); i++) {
+		unsigned int slot = descriptorSlot(resources.images[i]);
+		if (!(dirty & (1U << slot))) {
+			continue;
+		}
+
+		setImageUnit(i, descriptors[slot]);
+	}
+
+	dirtyDescriptors   = 0;
 	decriptorSetsDirty = false;
 }
 
 
+void RendererImpl::setBufferUnit(BufferUnits &units, uint32_t &changed, unsigned int unit, const Descriptor &d) {
+	assert(unit < MAX_GL_UNITS);
+
+	GLuint     glBuffer = 0;
+	GLintptr   offset   = 0;
+	GLsizeiptr size     = 0;
+	// TODO: find a better way than magic numbers
+	switch (d.which()) {
+	case 0: {
+		const Buffer &buffer = buffers.get(boost::get<BufferHandle>(d));
+		glBuffer = buffer.buffer;
+		offset   = buffer.offset;
+		size     = buffer.size;
+	} break;
+
+	case 4: {
+		const EphemeralBuffer &buffer = boost::get<EphemeralBuffer>(d);
+		glBuffer = ringSegments[buffer.segment].buffer;
+		offset   = buffer.offset;
+		size     = buffer.size;
+	} break;
+
+	default:
+		UNREACHABLE();
+		break;
+	}
+	assert(glBuffer != 0);
+
+	if (units.buffers[unit] == glBuffer
+	 && units.offsets[unit] == offset
+	 && units.sizes[unit]   == size) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	units.buffers[unit] = glBuffer;
+	units.offsets[unit] = offset;
+	units.sizes[unit]   = size;
+	changed |= (1U << unit);
+}
+
+
+void RendererImpl::setImageUnit(unsigned int unit, const Descriptor &d) {
+	assert(unit < MAX_GL_IMAGE_UNITS);
+	// TODO: find a better way than magic numbers
+	assert(d.which() == 3);
+	const Texture &tex = textures.get(boost::get<TextureHandle>(d));
+	assert(tex.tex != 0);
+
+	if (state.imageUnits[unit] == tex.tex) {
+		frameStats.stateCallsElided++;
+		return;
+	}
+
+	// images are rare enough that multi-bind isn't worth it
+	frameStats.stateCallsIssued++;
+	glBindImageTexture(unit, tex.tex, 0, GL_FALSE, 0, GL_READ_WRITE, glTexFormat(tex.format));
+	state.imageUnits[unit] = tex.tex;
+}
+
+
+// for multi-bind, bind everything from lowest to highest changed unit in one call
+// unchanged units in between get rebound with their current values
+
+static void changedRange(uint32_t changed, unsigned int &first, unsigned int &count) {
+	assert(changed != 0);
+#ifdef __GNUC__
+	first             = __builtin_ctz(changed);
+	unsigned int last = 31 - __builtin_clz(changed);
+#else
+	unsigned long first_ = 0, last_ = 0;
+	_BitScanForward(&first_, changed);
+	_BitScanReverse(&last_, changed);
+	first             = first_;
+	unsigned int last = last_;
+#endif
+	count = last - first + 1;
+}
+
+
+void RendererImpl::flushBufferUnits(GLenum target, const BufferUnits &units, uint32_t changed) {
+	if (changed == 0) {
+		return;
+	}
+
+	if (multiBind) {
+		unsigned int first = 0, count = 0;
+		changedRange(changed, first, count);
+		frameStats.stateCallsIssued++;
+		glBindBuffersRange(target, first, count, &units.buffers[first], &units.offsets[first], &units.sizes[first]);
+		return;
+	}
+
+	for (unsigned int i = 0; i < MAX_GL_UNITS; i++) {
+		if (changed & (1U << i)) {
+			frameStats.stateCallsIssued++;
+			glBindBufferRange(target, i, units.buffers[i], units.offsets[i], units.sizes[i]);
+		}
+	}
+}
+
+
+void RendererImpl::flushTextureUnits(uint32_t changed) {
+	if (changed == 0) {
+		return;
+	}
+
+	if (multiBind) {
+		unsigned int first = 0, count = 0;
+		changedRange(changed, first, count);
+		frameStats.stateCallsIssued++;
+		glBindTextures(first, count, &state.textureUnits[first]);
+		return;
+	}
+
+	for (unsigned int i = 0; i < MAX_GL_UNITS; i++) {
+		if (changed & (1U << i)) {
+			frameStats.stateCallsIssued++;
+			glBindTextureUnit(i, state.textureUnits[i]);
+		}
+	}
+}
+
+
+void RendererImpl::flushSamplerUnits(uint32_t changed) {
+	if (changed == 0) {
+		return;
+	}
+
+	if (multiBind) {
+		unsigned int first = 0, count = 0;
+		changedRange(changed, first, count);
+		frameStats.stateCallsIssued++;
+		glBindSamplers(first, count, &state.samplerUnits[first]);
+		return;
+	}
+
+	for (unsigned int i = 0; i < MAX_GL_UNITS; i++) {
+		if (changed & (1U << i)) {
+			frameStats.stateCallsIssued++;
+			glBindSampler(i, state.samplerUnits[i]);
+		}
+	}
+}
+
+
+void RendererImpl::forgetBuffer(GLuint buffer) {
+	if (state.indexBuffer == buffer) {
+		state.indexBuffer = 0;
+	}
+
+	if (state.indirectBuffer == buffer) {
+		state.indirectBuffer = 0;
+	}
+
+	for (auto &vb : state.vertexBuffers) {
+		if (vb.buffer == buffer) {
+			vb.buffer = 0;
+		}
+	}
+
+	for (unsigned int i = 0; i < MAX_GL_UNITS; i++) {
+		if (state.uboUnits.buffers[i] == buffer) {
+			state.uboUnits.buffers[i] = 0;
+		}
+		if (state.ssboUnits.buffers[i] == buffer) {
+			state.ssboUnits.buffers[i] = 0;
+		}
+	}
+}
+
+
+void RendererImpl::forgetTexture(GLuint tex) {
+	for (auto &t : state.textureUnits) {
+		if (t == tex) {
+			t = 0;
+		}
+	}
+
+	for (auto &i : state.imageUnits) {
+		if (i == tex) {
+			i = 0;
+		}
+	}
+}
+
+
+void RendererImpl::forgetSampler(GLuint sampler) {
+	for (auto &s : state.samplerUnits) {
+		if (s == sampler) {
+			s = 0;
+		}
+	}
+}
+
+
 void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
 	assert(inRenderPass);
 	assert(validPipeline);
@@ -2048,6 +3126,140 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firs
 }
 
 
+void RendererImpl::drawIndexedIndirect(BufferHandle handle, unsigned int offset) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(offset % 4 == 0);
+	const auto &p = pipelines.get(currentPipeline);
+	assert(!p.desc.scissorTest_ || scissorSet);
+	assert(p.desc.renderPass_ == currentRenderPass);
+	pipelineDrawn = true;
+
+	const Buffer &buffer = buffers.get(handle);
+	assert(buffer.buffer != 0);
+	assert(buffer.offset + offset + 5 * sizeof(uint32_t) <= buffer.size);
+	// firstIndex is in the arguments, no way to add our byte offset
+	assert(indexBufByteOffset == 0);
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	if (state.indirectBuffer != buffer.buffer) {
+		frameStats.stateCallsIssued++;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.buffer);
+		state.indirectBuffer = buffer.buffer;
+	} else {
+		frameStats.stateCallsElided++;
+	}
+
+	// TODO: get primitive from current pipeline
+	GLenum format = idxBuf16Bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	glDrawElementsIndirect(GL_TRIANGLES, format, reinterpret_cast<const void *>(buffer.offset + offset));
+}
+
+
+void RendererImpl::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(x > 0);
+	assert(y > 0);
+	assert(z > 0);
+	assert(pipelines.get(currentPipeline).desc.computeShader_);
+	pipelineDrawn = true;
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	glDispatchCompute(x, y, z);
+
+	// we don't know who reads buffers so make them visible to everyone
+	// storage images get their barriers from renderTargetBarriers
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_UNIFORM_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+
+static GLbitfield glAccessBarrierBits(Access access) {
+	switch (access) {
+	case Access::ColorAttachment:
+	case Access::DepthStencilAttachment:
+	case Access::TransferRead:
+		return GL_FRAMEBUFFER_BARRIER_BIT;
+
+	case Access::ComputeRead:
+	case Access::FragmentRead:
+		return GL_TEXTURE_FETCH_BARRIER_BIT;
+
+	case Access::ComputeWrite:
+		return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	}
+
+	UNREACHABLE();
+}
+
+
+void RendererImpl::renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers) {
+	assert(inFrame);
+	assert(!inRenderPass);
+
+	// GL orders everything else itself, only image stores are incoherent
+	GLbitfield bits = 0;
+	for (const auto &b : barriers) {
+		auto &rt = renderTargets.get(b.rt);
+		if (b.before == Access::ComputeWrite) {
+			bits |= glAccessBarrierBits(b.after);
+		}
+
+		Layout layout = accessLayout(b.after);
+		if (layout != Layout::Invalid) {
+			rt.currentLayout = layout;
+		}
+	}
+
+	if (bits != 0) {
+		glMemoryBarrier(bits);
+	}
+}
+
+
+void RendererImpl::beginTimestampScope(const std::string &name) {
+	assert(inFrame);
+	assert(!inTimestampScope);
+	inTimestampScope = true;
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(frame.timestampScopes.size() < MAX_TIMESTAMP_SCOPES);
+	unsigned int idx = static_cast<unsigned int>(frame.timestampScopes.size());
+	frame.timestampScopes.push_back(name);
+
+	if (frame.timestampQueries.size() < 2 * (idx + 1)) {
+		std::array<GLuint, 2> queries = { { 0, 0 } };
+		glGenQueries(2, &queries[0]);
+		frame.timestampQueries.push_back(queries[0]);
+		frame.timestampQueries.push_back(queries[1]);
+	}
+
+	glQueryCounter(frame.timestampQueries.at(2 * idx), GL_TIMESTAMP);
+}
+
+
+void RendererImpl::endTimestampScope() {
+	assert(inFrame);
+	assert(inTimestampScope);
+	inTimestampScope = false;
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(!frame.timestampScopes.empty());
+	unsigned int idx = static_cast<unsigned int>(frame.timestampScopes.size() - 1);
+
+	glQueryCounter(frame.timestampQueries.at(2 * idx + 1), GL_TIMESTAMP);
+}
+
+
 } // namespace renderer
 
 
@@ -27,6 +27,8 @@ THE SOFTWARE.
 
 #include <GL/glew.h>
 
+#include <deque>
+
 // TODO: use std::variant if the compiler has C++17
 #include <boost/variant/variant.hpp>
 #include <boost/variant/apply_visitor.hpp>
@@ -74,6 +76,7 @@ struct ShaderResources {
 	std::vector<DSIndex>        ssbos;
 	std::vector<DSIndex>        textures;
 	std::vector<DSIndex>        samplers;
+	std::vector<DSIndex>        images;
 
 
 	ShaderResources() {}
@@ -89,30 +92,29 @@ struct ShaderResources {
 
 
 struct Buffer {
-	bool           ringBufferAlloc;
 	uint32_t       size;
 	uint32_t       offset;
 	GLuint         buffer;
+	BufferUsage    usage;
 	// TODO: access type bits (for debugging)
 
 
 	Buffer()
-	: ringBufferAlloc(false)
-	, size(0)
+	: size(0)
 	, offset(0)
 	, buffer(0)
+	, usage(BufferUsage::Static)
 	{}
 
 	Buffer(const Buffer &)            = delete;
 	Buffer &operator=(const Buffer &) = delete;
 
 	Buffer(Buffer &&other)
-	: ringBufferAlloc(other.ringBufferAlloc)
-	, size(other.size)
+	: size(other.size)
 	, offset(other.offset)
 	, buffer(other.buffer)
+	, usage(other.usage)
 	{
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = 0;
@@ -125,12 +127,11 @@ struct Buffer {
 
 		assert(!buffer);
 
-		ringBufferAlloc       = other.ringBufferAlloc;
 		size                  = other.size;
 		offset                = other.offset;
 		buffer                = other.buffer;
+		usage                 = other.usage;
 
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = 0;
@@ -139,7 +140,6 @@ struct Buffer {
 	}
 
 	~Buffer() {
-		assert(!ringBufferAlloc);
 		assert(size   == 0);
 		assert(offset == 0);
 		assert(!buffer);
@@ -147,6 +147,52 @@ struct Buffer {
 };
 
 
+struct ComputeShader {
+	GLuint           shader;
+	std::string      name;
+	ShaderResources  resources;
+
+
+	ComputeShader()
+	: shader(0)
+	{
+	}
+
+	ComputeShader(const ComputeShader &)            = delete;
+	ComputeShader &operator=(const ComputeShader &) = delete;
+
+	ComputeShader(ComputeShader &&other)
+	: shader(other.shader)
+	, name(std::move(other.name))
+	, resources(other.resources)
+	{
+		other.shader    = 0;
+		assert(other.name.empty());
+		other.resources = ShaderResources();
+	}
+
+	ComputeShader &operator=(ComputeShader &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		shader          = other.shader;
+		name            = std::move(other.name);
+		resources       = other.resources;
+
+		other.shader    = 0;
+		assert(other.name.empty());
+		other.resources = ShaderResources();
+
+		return *this;
+	}
+
+	~ComputeShader() {
+		assert(!shader);
+	}
+};
+
+
 struct DescriptorSetLayout {
 	std::vector<DescriptorLayout>  descriptors;
 
@@ -274,6 +320,8 @@ struct Pipeline {
 	PipelineDesc    desc;
 	GLuint          shader;
 	ShaderResources  resources;
+	// false until link status has been checked
+	bool            linked;
 
 
 	Pipeline(const Pipeline &)            = delete;
@@ -283,10 +331,12 @@ struct Pipeline {
 	: desc(other.desc)
 	, shader(other.shader)
 	, resources(other.resources)
+	, linked(other.linked)
 	{
 		other.desc      = PipelineDesc();
 		other.shader    = 0;
 		other.resources = ShaderResources();
+		other.linked    = false;
 	}
 
 	Pipeline &operator=(Pipeline &&other) {
@@ -297,16 +347,19 @@ struct Pipeline {
 		desc            = other.desc;
 		shader          = other.shader;
 		resources       = other.resources;
+		linked          = other.linked;
 
 		other.desc      = PipelineDesc();
 		other.shader    = 0;
 		other.resources = ShaderResources();
+		other.linked    = false;
 
 		return *this;
 	}
 
 	Pipeline()
 	: shader(0)
+	, linked(false)
 	{
 	}
 
@@ -353,6 +406,10 @@ struct RenderTarget {
 	TextureHandle  additionalView;
 	GLuint         readFBO;
 	Format         format;
+	// textures are created late for transient render targets
+	RenderTargetDesc  desc;
+	// memory saved by other render targets aliasing this one
+	uint64_t       aliasedBytes;
 
 
 	RenderTarget()
@@ -361,6 +418,7 @@ struct RenderTarget {
 	, currentLayout(Layout::Invalid)
 	, readFBO(0)
 	, format(Format::Invalid)
+	, aliasedBytes(0)
 	{
 	}
 
@@ -375,6 +433,8 @@ struct RenderTarget {
 	, additionalView(other.additionalView)
 	, readFBO(other.readFBO)
 	, format(other.format)
+	, desc(other.desc)
+	, aliasedBytes(other.aliasedBytes)
 	{
 		other.width         = 0;
 		other.height        = 0;
@@ -383,6 +443,8 @@ struct RenderTarget {
 		other.additionalView = TextureHandle();
 		other.readFBO       = 0;
 		other.format        = Format::Invalid;
+		other.desc          = RenderTargetDesc();
+		other.aliasedBytes  = 0;
 	}
 
 	RenderTarget &operator=(RenderTarget &&other) {
@@ -400,6 +462,8 @@ struct RenderTarget {
 		additionalView = other.additionalView;
 		readFBO       = other.readFBO;
 		format        = other.format;
+		desc          = other.desc;
+		aliasedBytes  = other.aliasedBytes;
 
 		other.width         = 0;
 		other.height        = 0;
@@ -408,6 +472,8 @@ struct RenderTarget {
 		other.additionalView = TextureHandle();
 		other.readFBO       = 0;
 		other.format        = Format::Invalid;
+		other.desc          = RenderTargetDesc();
+		other.aliasedBytes  = 0;
 
 		return *this;
 	};
@@ -460,6 +526,8 @@ struct Sampler {
 struct Texture {
 	unsigned int  width, height;
 	bool          renderTarget;
+	// needed for binding as image
+	Format        format;
 	// TODO: need target for anything?
 	GLuint        tex;
 
@@ -468,6 +536,7 @@ struct Texture {
 	: width(0)
 	, height(0)
 	, renderTarget(false)
+	, format(Format::Invalid)
 	, tex(0)
 	{
 	}
@@ -480,12 +549,14 @@ struct Texture {
 	: width(other.width)
 	, height(other.height)
 	, renderTarget(other.renderTarget)
+	, format(other.format)
 	, tex(other.tex)
 	{
 		other.tex          = 0;
 		other.width        = 0;
 		other.height       = 0;
 		other.renderTarget = false;
+		other.format       = Format::Invalid;
 	}
 
 	Texture &operator=(Texture &&other) {
@@ -496,11 +567,13 @@ struct Texture {
 		width              = other.width;
 		height             = other.height;
 		renderTarget       = other.renderTarget;
+		format             = other.format;
 		tex                = other.tex;
 
 		other.width        = 0;
 		other.height       = 0;
 		other.renderTarget = false;
+		other.format       = Format::Invalid;
 		other.tex          = 0;
 
 		return *this;
@@ -561,28 +634,251 @@ struct VertexShader {
 };
 
 
-typedef boost::variant<BufferHandle, CSampler, SamplerHandle, TextureHandle> Descriptor;
+typedef boost::variant<BufferHandle, CSampler, SamplerHandle, TextureHandle, EphemeralBuffer> Descriptor;
+
+
+// descriptors are stored flat, indexed by set * MAX_DESCRIPTOR_SET_BINDINGS + binding
+#define MAX_DESCRIPTORS  (MAX_DESCRIPTOR_SETS * MAX_DESCRIPTOR_SET_BINDINGS)
+
+// a pipeline can't use more units of one kind than there are descriptors
+#define MAX_GL_UNITS     MAX_DESCRIPTORS
+
+static_assert(MAX_DESCRIPTORS <= 32, "descriptor dirty bits must fit in uint32_t");
+
+// GL only guarantees this many image units
+#define MAX_GL_IMAGE_UNITS  8
+
+
+static inline unsigned int descriptorSlot(const DSIndex &idx) {
+	assert(idx.set     < MAX_DESCRIPTOR_SETS);
+	assert(idx.binding < MAX_DESCRIPTOR_SET_BINDINGS);
+	return idx.set * MAX_DESCRIPTOR_SET_BINDINGS + idx.binding;
+}
+
+
+// buffers bound to indexed UBO/SSBO binding points
+// struct of arrays so these can be passed to glBindBuffersRange directly
+struct BufferUnits {
+	std::array<GLuint,     MAX_GL_UNITS>  buffers;
+	std::array<GLintptr,   MAX_GL_UNITS>  offsets;
+	std::array<GLsizeiptr, MAX_GL_UNITS>  sizes;
+
+
+	BufferUnits() {
+		buffers.fill(0);
+		offsets.fill(0);
+		sizes.fill(0);
+	}
+};
+
+
+struct VertexAttribState {
+	GLint      size;
+	GLenum     type;
+	GLboolean  normalized;
+	GLuint     offset;
+	GLuint     binding;
+
+
+	VertexAttribState()
+	: size(4)
+	, type(GL_FLOAT)
+	, normalized(GL_FALSE)
+	, offset(0)
+	, binding(0)
+	{}
+
+	bool operator==(const VertexAttribState &other) const {
+		return (size       == other.size)
+		    && (type       == other.type)
+		    && (normalized == other.normalized)
+		    && (offset     == other.offset)
+		    && (binding    == other.binding);
+	}
+
+	bool operator!=(const VertexAttribState &other) const {
+		return !(*this == other);
+	}
+};
+
+
+struct VertexBufferState {
+	GLuint    buffer;
+	GLintptr  offset;
+	GLsizei   stride;
+
+
+	VertexBufferState()
+	: buffer(0)
+	, offset(0)
+	, stride(16)
+	{}
+
+	bool operator==(const VertexBufferState &other) const {
+		return (buffer == other.buffer)
+		    && (offset == other.offset)
+		    && (stride == other.stride);
+	}
+
+	bool operator!=(const VertexBufferState &other) const {
+		return !(*this == other);
+	}
+};
+
+
+// shadow copy of GL state so we only call GL when something actually changes
+// initial values match GL defaults, resetGLState() makes sure GL agrees
+struct GLState {
+	GLuint                                             program;
+	GLuint                                             readFramebuffer;
+	GLuint                                             drawFramebuffer;
+	GLuint                                             indexBuffer;
+	GLuint                                             indirectBuffer;
+
+	bool                                               depthWrite;
+	bool                                               depthTest;
+	bool                                               cullFace;
+	bool                                               scissorTest;
+	bool                                               blend;
+	bool                                               framebufferSRGB;
+	bool                                               stencilTest;
+
+	GLenum                                             blendEquation;
+	GLenum                                             blendSrc;
+	GLenum                                             blendDst;
+
+	GLenum                                             stencilFunc;
+	GLint                                              stencilRef;
+	GLenum                                             stencilPass;
+
+	std::array<GLint, 4>                               viewport;
+	std::array<GLint, 4>                               scissor;
+	std::array<GLfloat, 4>                             clearColor;
+
+	uint32_t                                           vertexAttribMask;
+	std::array<VertexAttribState, MAX_VERTEX_ATTRIBS>  vertexAttribs;
+	std::array<VertexBufferState, MAX_VERTEX_BUFFERS>  vertexBuffers;
+
+	BufferUnits                                        uboUnits;
+	BufferUnits                                        ssboUnits;
+	std::array<GLuint, MAX_GL_UNITS>                   textureUnits;
+	std::array<GLuint, MAX_GL_UNITS>                   samplerUnits;
+	std::array<GLuint, MAX_GL_IMAGE_UNITS>             imageUnits;
+
+
+	GLState()
+	: program(0)
+	, readFramebuffer(0)
+	, drawFramebuffer(0)
+	, indexBuffer(0)
+	, indirectBuffer(0)
+	, depthWrite(true)
+	, depthTest(false)
+	, cullFace(false)
+	, scissorTest(false)
+	, blend(false)
+	, framebufferSRGB(false)
+	, stencilTest(false)
+	, blendEquation(GL_FUNC_ADD)
+	, blendSrc(GL_ONE)
+	, blendDst(GL_ZERO)
+	, stencilFunc(GL_ALWAYS)
+	, stencilRef(0)
+	, stencilPass(GL_KEEP)
+	, vertexAttribMask(0)
+	{
+		viewport.fill(0);
+		scissor.fill(0);
+		clearColor.fill(0.0f);
+		textureUnits.fill(0);
+		samplerUnits.fill(0);
+		imageUnits.fill(0);
+	}
+
+	GLState(const GLState &)            = default;
+	GLState(GLState &&)                 = default;
+
+	GLState &operator=(const GLState &) = default;
+	GLState &operator=(GLState &&)      = default;
+
+	~GLState() {}
+};
+
+
+// texture contents waiting for space in the upload buffer
+struct TextureUpload {
+	TextureHandle                                    handle;
+	GLenum                                           format;
+	unsigned int                                     numMips;
+	// next rows to upload
+	unsigned int                                     currentMip;
+	unsigned int                                     currentRow;
+	std::array<const char *, MAX_TEXTURE_MIPLEVELS>  mipData;
+	std::array<unsigned int, MAX_TEXTURE_MIPLEVELS>  mipSizes;
+	// owns mipData once the upload is deferred past createTexture
+	std::vector<char>                                storage;
+
+
+	TextureUpload()
+	: format(GL_NONE)
+	, numMips(0)
+	, currentMip(0)
+	, currentRow(0)
+	{
+		mipData.fill(nullptr);
+		mipSizes.fill(0);
+	}
+};
+
+
+struct RingBufferSegment {
+	unsigned int  size;
+	char          *mapping;
+	GLuint        buffer;
+
+
+	RingBufferSegment()
+	: size(0)
+	, mapping(nullptr)
+	, buffer(0)
+	{}
+
+	RingBufferSegment(const RingBufferSegment &)            = delete;
+	RingBufferSegment &operator=(const RingBufferSegment &) = delete;
+
+	RingBufferSegment(RingBufferSegment &&)                 = delete;
+	RingBufferSegment &operator=(RingBufferSegment &&)      = delete;
+
+	~RingBufferSegment() {
+		assert(size   == 0);
+		assert(buffer == 0);
+	}
+};
 
 
 struct Frame {
 	bool                      outstanding;
 	uint32_t                  lastFrameNum;
-	unsigned int              usedRingBufPtr;
-	std::vector<BufferHandle> ephemeralBuffers;
+	std::vector<unsigned int> ringSegments;
+	unsigned int              usedUploadBufPtr;
 	GLsync                    fence;
+	// two per scope, created on demand and reused
+	std::vector<GLuint>       timestampQueries;
+	std::vector<std::string>  timestampScopes;
 
 
 	Frame()
 	: outstanding(false)
 	, lastFrameNum(0)
-	, usedRingBufPtr(0)
+	, usedUploadBufPtr(0)
 	, fence(nullptr)
 	{}
 
 	~Frame() {
 		assert(!outstanding);
 		assert(!fence);
-		assert(ephemeralBuffers.empty());
+		assert(ringSegments.empty());
+		assert(timestampQueries.empty());
 	}
 
 	Frame(const Frame &)            = delete;
@@ -591,14 +887,16 @@ struct Frame {
 	Frame(Frame &&other)
 	: outstanding(other.outstanding)
 	, lastFrameNum(other.lastFrameNum)
-	, usedRingBufPtr(other.usedRingBufPtr)
-	, ephemeralBuffers(std::move(other.ephemeralBuffers))
+	, ringSegments(std::move(other.ringSegments))
+	, usedUploadBufPtr(other.usedUploadBufPtr)
 	, fence(other.fence)
+	, timestampQueries(std::move(other.timestampQueries))
+	, timestampScopes(std::move(other.timestampScopes))
 	{
 		other.outstanding     = false;
 		other.fence           = nullptr;
-		other.usedRingBufPtr  = 0;
-		assert(other.ephemeralBuffers.empty());
+		other.usedUploadBufPtr = 0;
+		assert(other.timestampQueries.empty());
 	}
 
 	Frame &operator=(Frame &&other) {
@@ -608,16 +906,22 @@ struct Frame {
 
 		lastFrameNum           = other.lastFrameNum;
 
-		usedRingBufPtr         = other.usedRingBufPtr;
-		other.usedRingBufPtr   = 0;
+		assert(ringSegments.empty());
+		ringSegments           = std::move(other.ringSegments);
+		assert(other.ringSegments.empty());
+
+		usedUploadBufPtr       = other.usedUploadBufPtr;
+		other.usedUploadBufPtr = 0;
 
 		assert(!fence);
 		fence                  = other.fence;
 		other.fence            = nullptr;
 
-		assert(ephemeralBuffers.empty());
-		ephemeralBuffers       = std::move(other.ephemeralBuffers);
-		assert(other.ephemeralBuffers.empty());
+		assert(timestampQueries.empty());
+		timestampQueries       = std::move(other.timestampQueries);
+		assert(other.timestampQueries.empty());
+
+		timestampScopes        = std::move(other.timestampScopes);
 
 		return *this;
 	}
@@ -632,6 +936,7 @@ struct RendererImpl : public RendererBase {
 	std::vector<Frame>                       frames;
 
 	ResourceContainer<Buffer>                buffers;
+	ResourceContainer<ComputeShader>         computeShaders;
 	ResourceContainer<DescriptorSetLayout>   dsLayouts;
 	ResourceContainer<FragmentShader>        fragmentShaders;
 	ResourceContainer<Framebuffer>           framebuffers;
@@ -642,29 +947,81 @@ struct RendererImpl : public RendererBase {
 	ResourceContainer<Texture>               textures;
 	ResourceContainer<VertexShader>          vertexShaders;
 
-	GLuint                                   ringBuffer;
+	std::array<RingBufferSegment, MAX_RING_SEGMENTS>  ringSegments;
+	// false when tracing because apitrace can't trace persistent mappings
 	bool                                     persistentMapInUse;
-	char                                     *persistentMapping;
+
+	// persistently mapped pixel unpack buffer for streaming texture uploads
+	// 0 when tracing since apitrace can't see persistent mappings
+	GLuint                                   uploadBuffer;
+	char                                     *uploadMapping;
+	unsigned int                             uploadBufSize;
+	unsigned int                             uploadBufPtr;
+	unsigned int                             lastSyncedUploadBufPtr;
+	std::deque<TextureUpload>                pendingUploads;
 
 	PipelineHandle                           currentPipeline;
 	RenderPassHandle                         currentRenderPass;
 	FramebufferHandle                        currentFramebuffer;
 
 	bool                                     decriptorSetsDirty;
-	std::unordered_map<DSIndex, Descriptor>  descriptors;
+	// bit per descriptor slot, set when it needs to be checked against bound units
+	uint32_t                                 dirtyDescriptors;
+	std::array<Descriptor, MAX_DESCRIPTORS>  descriptors;
+
+	GLState                                  state;
 
 	bool                                     debug;
 	bool                                     tracing;
+	bool                                     multiBind;
+	bool                                     parallelShaderCompile;
 	GLuint                                   vao;
 	bool                                     idxBuf16Bit;
 	unsigned int                             indexBufByteOffset;
+	uint64_t                                 aliasedBytes;
 
 
 	void rebindDescriptorSets();
+	// checks link status, blocks if the driver is still compiling
+	void finishPipeline(Pipeline &p);
+	// memoryOwner is 0 or the texture whose storage a transient render target aliases
+	void createRenderTargetTextures(RenderTarget &rt, GLuint memoryOwner);
+
+	// shadowed GL state setters
+	void resetGLState();
+	void setEnabled(GLenum cap, bool &current, bool enabled);
+	void useProgram(GLuint program);
+	void bindFramebuffer(GLenum target, GLuint fbo);
+	void setDepthWrite(bool enabled);
+	void setBlendFunc(GLenum equation, GLenum src, GLenum dst);
+	void setStencilOp(GLenum func, GLint ref, GLenum pass);
+	void setClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+	void setVertexAttribMask(uint32_t mask);
+	void setVertexAttribFormat(unsigned int attrib, const VertexAttribState &format);
+	void bindElementBuffer(GLuint buffer);
+	void bindVertexBufferInternal(unsigned int binding, const VertexBufferState &vb);
+	void setBufferUnit(BufferUnits &units, uint32_t &changed, unsigned int unit, const Descriptor &d);
+	void flushBufferUnits(GLenum target, const BufferUnits &units, uint32_t changed);
+	void flushTextureUnits(uint32_t changed);
+	void flushSamplerUnits(uint32_t changed);
+	void setImageUnit(unsigned int unit, const Descriptor &d);
+
+	// deleted objects are unbound by GL, keep shadow state in sync
+	void forgetBuffer(GLuint buffer);
+	void forgetTexture(GLuint tex);
+	void forgetSampler(GLuint sampler);
 
 	void recreateSwapchain();
-	void recreateRingBuffer(unsigned int newSize);
-	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
+	void createRingSegment(RingBufferSegment &seg, unsigned int size);
+	void deleteRingSegment(RingBufferSegment &seg);
+	RingBufferAllocation ringBufferAllocate(unsigned int size, unsigned int alignment);
+	unsigned int ringBufferNewSegment(unsigned int size);
+	void ringBufferEndFrame(Frame &frame);
+	void ringBufferRetireFrame(Frame &frame);
+	void ringBufferShutdown();
+
+	bool streamTextureUpload(TextureUpload &upload);
+	void processTextureUploads();
 
 	void waitForFrame(unsigned int frameIdx);
 	void deleteFrameInternal(Frame &f);
@@ -677,13 +1034,17 @@ struct RendererImpl : public RendererBase {
 	bool isRenderTargetFormatSupported(Format format) const;
 
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
+	ComputeShaderHandle  createComputeShader(const std::string &name, const ShaderMacros &macros);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
 	FragmentShaderHandle createFragmentShader(const std::string &name, const ShaderMacros &macros);
+	bool                 prepareShaders(const std::string &name, const ShaderMacros &macros);
+	bool                 prepareComputeShader(const std::string &name, const ShaderMacros &macros);
+	bool                 isPipelineReady(PipelineHandle handle);
 	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
 	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
 	PipelineHandle       createPipeline(const PipelineDesc &desc);
-	BufferHandle         createBuffer(uint32_t size, const void *contents);
-	BufferHandle         createEphemeralBuffer(uint32_t size, const void *contents);
+	BufferHandle         createBuffer(BufferUsage usage, uint32_t size, const void *contents);
+	EphemeralBuffer      createEphemeralBuffer(uint32_t size, const void *contents);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
 
@@ -691,7 +1052,9 @@ struct RendererImpl : public RendererBase {
 
 	TextureHandle        getRenderTargetTexture(RenderTargetHandle handle);
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+	bool                 isTextureReady(TextureHandle handle) const;
 
+	void updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents);
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
 	void deleteRenderPass(RenderPassHandle fbo);
@@ -699,6 +1062,9 @@ struct RendererImpl : public RendererBase {
 	void deleteTexture(TextureHandle handle);
 	void deleteRenderTarget(RenderTargetHandle &fbo);
 
+	bool canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const;
+	void aliasRenderTargets(const std::vector<RenderTargetHandle> &rts);
+
 
 	void setSwapchainDesc(const SwapchainDesc &desc);
 	MemoryStats getMemStats() const;
@@ -714,13 +1080,23 @@ struct RendererImpl : public RendererBase {
 
 	void bindPipeline(PipelineHandle pipeline);
 	void bindIndexBuffer(BufferHandle buffer, bool bit16);
+	void bindIndexBuffer(EphemeralBuffer buffer, bool bit16);
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
+	void bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer);
 
 	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int offset);
+
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+
+	void renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers);
+
+	void beginTimestampScope(const std::string &name);
+	void endTimestampScope();
 };
 
 
@@ -28,6 +28,7 @@ THE SOFTWARE.
 #include <string>
 #include <unordered_map>
 #include <array>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE 1
@@ -43,11 +44,13 @@ namespace renderer {
 #define MAX_VERTEX_ATTRIBS      4
 #define MAX_VERTEX_BUFFERS      1
 #define MAX_DESCRIPTOR_SETS     2  // per pipeline
+#define MAX_DESCRIPTOR_SET_BINDINGS 8  // per descriptor set
 #define MAX_TEXTURE_MIPLEVELS   14
 #define MAX_TEXTURE_SIZE        (1 << (MAX_TEXTURE_MIPLEVELS - 1))
 
 
 struct Buffer;
+struct ComputeShader;
 struct RendererImpl;
 struct DescriptorSetLayout;
 struct FragmentShader;
@@ -66,6 +69,7 @@ template <class T> class ResourceContainer;
 template <class T>
 class Handle {
 	friend class ResourceContainer<T>;
+	friend struct RendererImpl;
 
 	uint32_t handle;
 
@@ -128,6 +132,7 @@ public:
 
 
 typedef Handle<Buffer>               BufferHandle;
+typedef Handle<ComputeShader>        ComputeShaderHandle;
 typedef Handle<DescriptorSetLayout>  DSLayoutHandle;
 typedef Handle<FragmentShader>       FragmentShaderHandle;
 typedef Handle<Framebuffer>          FramebufferHandle;
@@ -139,6 +144,57 @@ typedef Handle<Texture>              TextureHandle;
 typedef Handle<VertexShader>         VertexShaderHandle;
 
 
+// reference to data in the ephemeral ringbuffer
+// says where the data is so using it needs no lookups
+// only valid during the frame it was created in
+struct EphemeralBuffer {
+	uint32_t  segment;
+	uint32_t  offset;
+	uint32_t  size;
+
+
+	EphemeralBuffer()
+	: segment(0)
+	, offset(0)
+	, size(0)
+	{
+	}
+
+
+	explicit operator bool() const {
+		return size != 0;
+	}
+};
+
+
+// how a pass uses a render target, barriers go from one to another
+enum class Access : uint8_t {
+	  ColorAttachment
+	, ComputeRead
+	, ComputeWrite
+	, DepthStencilAttachment
+	, FragmentRead
+	// blit to swapchain in presentFrame
+	, TransferRead
+};
+
+
+enum class BufferUsage : uint8_t {
+	// contents given at creation and never changed
+	  Static
+	// contents can be changed with updateBuffer
+	, Dynamic
+};
+
+
+enum class CompareOp : uint8_t {
+	  Always
+	, Equal
+	, Never
+	, NotEqual
+};
+
+
 enum class DescriptorType : uint8_t {
 	  End
 	, UniformBuffer
@@ -146,6 +202,11 @@ enum class DescriptorType : uint8_t {
 	, Sampler
 	, Texture
 	, CombinedSampler
+	// same as above but descriptor struct contains EphemeralBuffer instead of BufferHandle
+	, EphemeralUniformBuffer
+	, EphemeralStorageBuffer
+	// TextureHandle of a storage render target, written by compute shaders
+	, StorageImage
 	, Count
 };
 
@@ -163,6 +224,7 @@ enum class Format : uint8_t {
 	, RGB8
 	, RGBA8
 	, sRGBA8
+	, sBGRA8
 	, Depth16
 	, Depth16S8
 	, Depth24S8
@@ -173,11 +235,35 @@ enum class Format : uint8_t {
 
 enum class Layout : uint8_t {
 	  Invalid
+	// ready for presentFrame, only for the swapchain render target
+	, Present
 	, ShaderRead
 	, TransferSrc
 };
 
 
+// what happens to attachment contents at the start of a render pass
+enum class LoadOp : uint8_t {
+	  Clear
+	, DontCare
+	, Load
+};
+
+
+enum class StencilOp : uint8_t {
+	  Keep
+	, Replace
+	, Zero
+};
+
+
+// what happens to attachment contents at the end of a render pass
+enum class StoreOp : uint8_t {
+	  DontCare
+	, Store
+};
+
+
 enum class VSync : uint8_t {
 	  Off
 	, On
@@ -216,6 +302,8 @@ struct MemoryStats {
 	uint32_t subAllocationCount;
 	uint64_t usedBytes;
 	uint64_t unusedBytes;
+	// not allocated because transient render targets share memory
+	uint64_t aliasedBytes;
 
 
 	MemoryStats()
@@ -223,6 +311,7 @@ struct MemoryStats {
 	, subAllocationCount(0)
 	, usedBytes(0)
 	, unusedBytes(0)
+	, aliasedBytes(0)
 	{
 	}
 
@@ -236,6 +325,141 @@ struct MemoryStats {
 };
 
 
+struct RingBufferStats {
+	uint32_t segmentSize;
+	uint32_t numSegments;
+	uint32_t freeSegments;
+	// most segments a frame has needed recently
+	uint32_t highWaterMark;
+	uint32_t lastFrameSegments;
+	uint32_t growthEvents;
+	uint32_t shrinkEvents;
+	uint32_t oversizeAllocations;
+	uint64_t totalBytes;
+
+
+	RingBufferStats()
+	: segmentSize(0)
+	, numSegments(0)
+	, freeSegments(0)
+	, highWaterMark(0)
+	, lastFrameSegments(0)
+	, growthEvents(0)
+	, shrinkEvents(0)
+	, oversizeAllocations(0)
+	, totalBytes(0)
+	{
+	}
+
+	~RingBufferStats() {}
+
+	RingBufferStats(const RingBufferStats &stats)            = default;
+	RingBufferStats(RingBufferStats &&stats)                 = default;
+
+	RingBufferStats &operator=(const RingBufferStats &stats) = default;
+	RingBufferStats &operator=(RingBufferStats &&stats)      = default;
+};
+
+
+// API calls between two presentFrames, the same on every backend
+// resource creation and deletion outside frames counts towards the next one
+struct RenderStats {
+	uint32_t renderPasses;
+	uint32_t pipelineBinds;
+	uint32_t descriptorSetBinds;
+	uint32_t vertexBufferBinds;
+	uint32_t indexBufferBinds;
+	uint32_t drawCalls;
+	uint32_t dispatches;
+	uint32_t barriers;
+	uint32_t bufferUpdates;
+	uint32_t ephemeralBuffers;
+	uint64_t ephemeralBytes;
+	uint32_t resourcesCreated;
+	uint32_t resourcesDeleted;
+	// state changing GL calls issued and skipped because of cached state
+	// always 0 on other backends
+	uint32_t stateCallsIssued;
+	uint32_t stateCallsElided;
+
+
+	RenderStats()
+	: renderPasses(0)
+	, pipelineBinds(0)
+	, descriptorSetBinds(0)
+	, vertexBufferBinds(0)
+	, indexBufferBinds(0)
+	, drawCalls(0)
+	, dispatches(0)
+	, barriers(0)
+	, bufferUpdates(0)
+	, ephemeralBuffers(0)
+	, ephemeralBytes(0)
+	, resourcesCreated(0)
+	, resourcesDeleted(0)
+	, stateCallsIssued(0)
+	, stateCallsElided(0)
+	{
+	}
+
+	~RenderStats() {}
+
+	RenderStats(const RenderStats &stats)            = default;
+	RenderStats(RenderStats &&stats)                 = default;
+
+	RenderStats &operator=(const RenderStats &stats) = default;
+	RenderStats &operator=(RenderStats &&stats)      = default;
+};
+
+
+// dependency between two uses of a render target
+// changes layout if after needs a different one
+// discard means previous contents don't matter, before was an access through
+// another render target sharing the memory or the same as after on first use
+struct RenderTargetBarrier {
+	RenderTargetHandle  rt;
+	Access              before;
+	Access              after;
+	bool                discard;
+
+
+	RenderTargetBarrier()
+	: before(Access::ColorAttachment)
+	, after(Access::ColorAttachment)
+	, discard(false)
+	{
+	}
+};
+
+
+// GPU time spent between beginTimestampScope and endTimestampScope
+// min/avg/max are over the last frames which had a scope with the same name
+struct GPUTiming {
+	std::string  name;
+	double       milliseconds;
+	double       minMilliseconds;
+	double       avgMilliseconds;
+	double       maxMilliseconds;
+
+
+	GPUTiming()
+	: milliseconds(0.0)
+	, minMilliseconds(0.0)
+	, avgMilliseconds(0.0)
+	, maxMilliseconds(0.0)
+	{
+	}
+
+	~GPUTiming() {}
+
+	GPUTiming(const GPUTiming &timing)            = default;
+	GPUTiming(GPUTiming &&timing)                 = default;
+
+	GPUTiming &operator=(const GPUTiming &timing) = default;
+	GPUTiming &operator=(GPUTiming &&timing)      = default;
+};
+
+
 typedef std::unordered_map<std::string, std::string> ShaderMacros;
 
 
@@ -293,12 +517,19 @@ class PipelineDesc {
 	VertexShaderHandle    vertexShader_;
 	FragmentShaderHandle  fragmentShader_;
 	RenderPassHandle      renderPass_;
+	// compute pipelines have only this and descriptor set layouts
+	ComputeShaderHandle   computeShader_;
 	uint32_t              vertexAttribMask;
 	bool                  depthWrite_;
 	bool                  depthTest_;
 	bool                  cullFaces_;
 	bool                  scissorTest_;
 	bool                  blending_;
+	bool                  stencilTest_;
+	// fail and depth fail always keep, masks are always 0xFF
+	CompareOp             stencilCompare_;
+	StencilOp             stencilPass_;
+	uint8_t               stencilRef_;
 	// TODO: blend equation and function
 	// TODO: per-MRT blending
 
@@ -337,6 +568,11 @@ public:
 		return *this;
 	}
 
+	PipelineDesc &computeShader(ComputeShaderHandle h) {
+		computeShader_ = h;
+		return *this;
+	}
+
 	PipelineDesc &vertexAttrib(uint32_t attrib, uint8_t bufBinding, uint8_t count, VtxFormat format, uint8_t offset) {
 		assert(attrib < MAX_VERTEX_ATTRIBS);
 
@@ -394,6 +630,18 @@ public:
 		return *this;
 	}
 
+	PipelineDesc &stencilTest(bool s) {
+		stencilTest_ = s;
+		return *this;
+	}
+
+	PipelineDesc &stencilOp(CompareOp compare, StencilOp pass, uint8_t reference) {
+		stencilCompare_ = compare;
+		stencilPass_    = pass;
+		stencilRef_     = reference;
+		return *this;
+	}
+
 	PipelineDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -406,6 +654,10 @@ public:
 	, cullFaces_(false)
 	, scissorTest_(false)
 	, blending_(false)
+	, stencilTest_(false)
+	, stencilCompare_(CompareOp::Always)
+	, stencilPass_(StencilOp::Keep)
+	, stencilRef_(0)
 	{
 		for (unsigned int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
 			vertexAttribs[i].bufBinding = 0;
@@ -434,6 +686,9 @@ struct RenderPassDesc {
 	RenderPassDesc()
 	: depthStencilFormat_(Format::Invalid)
 	, colorFinalLayout_(Layout::ShaderRead)
+	, depthStencilFinalLayout_(Layout::ShaderRead)
+	, stencilLoadOp_(LoadOp::DontCare)
+	, stencilStoreOp_(StoreOp::DontCare)
 	{
 		std::fill(colorFormats_.begin(), colorFormats_.end(), Format::Invalid);
 	}
@@ -462,6 +717,23 @@ struct RenderPassDesc {
 		return *this;
 	}
 
+	// passes loading the stencil expect it in this layout too
+	RenderPassDesc &depthStencilFinalLayout(Layout l) {
+		assert(l == Layout::ShaderRead || l == Layout::TransferSrc);
+		depthStencilFinalLayout_ = l;
+		return *this;
+	}
+
+	RenderPassDesc &stencilLoadOp(LoadOp op) {
+		stencilLoadOp_ = op;
+		return *this;
+	}
+
+	RenderPassDesc &stencilStoreOp(StoreOp op) {
+		stencilStoreOp_ = op;
+		return *this;
+	}
+
 	RenderPassDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -472,6 +744,9 @@ private:
 	Format                                       depthStencilFormat_;
 	std::array<Format, MAX_COLOR_RENDERTARGETS>  colorFormats_;
 	Layout                                       colorFinalLayout_;
+	Layout                                       depthStencilFinalLayout_;
+	LoadOp                                       stencilLoadOp_;
+	StoreOp                                      stencilStoreOp_;
 	std::string                                  name_;
 
 	friend struct RendererImpl;
@@ -484,6 +759,8 @@ struct RenderTargetDesc {
 	, height_(0)
 	, format_(Format::Invalid)
 	, additionalViewFormat_(Format::Invalid)
+	, storage_(false)
+	, transient_(false)
 	{
 	}
 
@@ -518,6 +795,19 @@ struct RenderTargetDesc {
 		return *this;
 	}
 
+	// can be bound as StorageImage, format must not be sRGB
+	RenderTargetDesc &storage(bool s) {
+		storage_ = s;
+		return *this;
+	}
+
+	// contents don't survive from one frame to the next
+	// has no memory until aliasRenderTargets, can't be used in a framebuffer before that
+	RenderTargetDesc &transient(bool t) {
+		transient_ = t;
+		return *this;
+	}
+
 	RenderTargetDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -529,6 +819,8 @@ private:
 	// TODO: unsigned int multisample;
 	Format         format_;
 	Format         additionalViewFormat_;
+	bool           storage_;
+	bool           transient_;
 	std::string    name_;
 
 	friend struct RendererImpl;
@@ -578,6 +870,8 @@ private:
 
 struct SwapchainDesc {
 	unsigned int  width, height;
+	// frames in flight, CPU can get this many frames ahead of the GPU
+	// swapchain image count is asked to match but the surface might not allow it
 	unsigned int  numFrames;
 	VSync         vsync;
 	bool          fullscreen;
@@ -671,6 +965,7 @@ struct RendererDesc {
 	bool           tracing;
 	bool           skipShaderCache;
 	unsigned int   ephemeralRingBufSize;
+	unsigned int   uploadRingBufSize;
 	SwapchainDesc  swapchain;
 
 
@@ -679,6 +974,7 @@ struct RendererDesc {
 	, tracing(false)
 	, skipShaderCache(false)
 	, ephemeralRingBufSize(1 * 1048576)
+	, uploadRingBufSize(4 * 1048576)
 	{
 	}
 };
@@ -736,9 +1032,12 @@ public:
 	unsigned int getCurrentRefreshRate() const;
 	unsigned int getMaxRefreshRate() const;
 
-	// TODO: add buffer usage flags
-	BufferHandle          createBuffer(uint32_t size, const void *contents);
-	BufferHandle          createEphemeralBuffer(uint32_t size, const void *contents);
+	// contents can be nullptr for dynamic buffers
+	BufferHandle          createBuffer(BufferUsage usage, uint32_t size, const void *contents);
+	// can be called from several threads at once while the render thread isn't using the renderer
+	// except when tracing on OpenGL
+	EphemeralBuffer       createEphemeralBuffer(uint32_t size, const void *contents);
+	ComputeShaderHandle   createComputeShader(const std::string &name, const ShaderMacros &macros);
 	FragmentShaderHandle  createFragmentShader(const std::string &name, const ShaderMacros &macros);
 	FramebufferHandle     createFramebuffer(const FramebufferDesc &desc);
 	PipelineHandle        createPipeline(const PipelineDesc &desc);
@@ -749,6 +1048,19 @@ public:
 	VertexShaderHandle    createVertexShader(const std::string &name, const ShaderMacros &macros);
 	// TODO: non-ephemeral descriptor set
 
+	// starts compiling vertex and fragment shader in the background
+	// returns true when both are ready and create*Shader won't block on compiling
+	// does not block
+	bool prepareShaders(const std::string &name, const ShaderMacros &macros);
+
+	// same for a compute shader
+	bool prepareComputeShader(const std::string &name, const ShaderMacros &macros);
+
+	// the driver might still be compiling a pipeline after createPipeline returns
+	// returns true when bindPipeline won't block waiting for it
+	// does not block
+	bool isPipelineReady(PipelineHandle handle);
+
 	DSLayoutHandle createDescriptorSetLayout(const DescriptorLayout *layout);
 	template <typename T> void registerDescriptorSetLayout() {
 		T::layoutHandle = createDescriptorSetLayout(T::layout);
@@ -759,6 +1071,15 @@ public:
 	TextureHandle        getRenderTargetTexture(RenderTargetHandle handle);
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
 
+	// large textures might be uploaded over several frames
+	// returns false while contents are still being streamed in
+	bool isTextureReady(TextureHandle handle) const;
+
+	// changes part of a dynamic buffer
+	// must be called in a frame but outside a render pass
+	// draws after this see the new contents, frames already in flight keep the old ones
+	void updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents);
+
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
 	void deleteRenderPass(RenderPassHandle fbo);
@@ -766,10 +1087,30 @@ public:
 	void deleteSampler(SamplerHandle handle);
 	void deleteTexture(TextureHandle handle);
 
+	// whether the transient render targets can share one allocation
+	// says nothing about their lifetimes, FrameGraph checks those
+	bool canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const;
+	// allocates memory for transient render targets, all of them use the same memory
+	// a use of one destroys the contents of the others
+	// delete all of them at the same time
+	void aliasRenderTargets(const std::vector<RenderTargetHandle> &rts);
+
 
 	void setSwapchainDesc(const SwapchainDesc &desc);
 	glm::uvec2 getDrawableSize() const;
+	// render target for the swapchain image of the current frame
+	// rendering the last pass here avoids a blit in presentFrame
+	// only usable as the sole attachment of a framebuffer whose render pass has colorFinalLayout Present
+	// can't be sampled, deleted or aliased, size follows the drawable size
+	RenderTargetHandle getSwapchainRenderTarget() const;
+	Format getSwapchainFormat() const;
 	MemoryStats getMemStats() const;
+	RingBufferStats getRingBufferStats() const;
+	// counters of the last presented frame
+	RenderStats getFrameStats() const;
+	// timestamp scopes of the most recent frame whose results have come back from the GPU
+	// empty if the device doesn't support timestamps and always on the null renderer
+	std::vector<GPUTiming> getFrameTimings() const;
 
 	// rendering
 	void beginFrame();
@@ -788,11 +1129,33 @@ public:
 	}
 
 	void bindIndexBuffer(BufferHandle buffer, bool bit16);
+	void bindIndexBuffer(EphemeralBuffer buffer, bool bit16);
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
+	void bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+
+	// arguments are read from buffer when the GPU executes the draw
+	// five 32-bit values: indexCount, instanceCount, firstIndex, vertexOffset, firstInstance
+	// index buffer must be a BufferHandle
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int offset);
+
+	// needs a compute pipeline, must be outside a render pass
+	// buffer writes are visible to everything recorded after this
+	// storage image writes need a barrier from Access::ComputeWrite
+	// storage image contents are undefined before the dispatch, it must write all of them
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+
+	// must be outside a render pass
+	// usually issued by FrameGraph which knows who reads and writes what
+	void renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers);
+
+	// measure GPU time of the commands in between
+	// must be in a frame, can't be nested but can span render passes
+	void beginTimestampScope(const std::string &name);
+	void endTimestampScope();
 };
 
 
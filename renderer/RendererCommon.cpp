@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 #include <algorithm>
@@ -52,6 +53,15 @@ const char *descriptorTypeName(DescriptorType t) {
 	case DescriptorType::CombinedSampler:
 		return "CombinedSampler";
 
+	case DescriptorType::EphemeralUniformBuffer:
+		return "EphemeralUniformBuffer";
+
+	case DescriptorType::EphemeralStorageBuffer:
+		return "EphemeralStorageBuffer";
+
+	case DescriptorType::StorageImage:
+		return "StorageImage";
+
 	case DescriptorType::Count:
 		UNREACHABLE();  // shouldn't happen
 		return "Count";
@@ -84,6 +94,9 @@ bool isDepthFormat(Format format) {
 	case Format::sRGBA8:
 		return false;
 
+	case Format::sBGRA8:
+		return false;
+
 	case Format::Depth16:
 		return true;
 
@@ -121,9 +134,44 @@ bool issRGBFormat(Format format) {
 	case Format::sRGBA8:
 		return true;
 
+	case Format::sBGRA8:
+		return true;
+
+	case Format::Depth16:
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+		return false;
+
+	}
+
+	UNREACHABLE();
+	return false;
+}
+
+
+bool isStencilFormat(Format format) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+		return false;
+
+	case Format::R8:
+	case Format::RG8:
+	case Format::RGB8:
+	case Format::RGBA8:
+	case Format::sRGBA8:
+	case Format::sBGRA8:
+		return false;
+
 	case Format::Depth16:
+		return false;
+
 	case Format::Depth16S8:
 	case Format::Depth24S8:
+		return true;
+
 	case Format::Depth24X8:
 	case Format::Depth32Float:
 		return false;
@@ -135,6 +183,60 @@ bool issRGBFormat(Format format) {
 }
 
 
+// bytes per pixel, drivers might pad some of these
+unsigned int formatSize(Format format) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+		return 0;
+
+	case Format::R8:
+		return 1;
+
+	case Format::RG8:
+	case Format::Depth16:
+		return 2;
+
+	case Format::RGB8:
+	case Format::Depth16S8:
+		return 3;
+
+	case Format::RGBA8:
+	case Format::sRGBA8:
+	case Format::sBGRA8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+		return 4;
+
+	}
+
+	UNREACHABLE();
+	return 0;
+}
+
+
+Layout accessLayout(Access access) {
+	switch (access) {
+	case Access::ColorAttachment:
+	case Access::ComputeWrite:
+	case Access::DepthStencilAttachment:
+		// render pass or dispatch does its own transition
+		return Layout::Invalid;
+
+	case Access::ComputeRead:
+	case Access::FragmentRead:
+		return Layout::ShaderRead;
+
+	case Access::TransferRead:
+		return Layout::TransferSrc;
+	}
+
+	UNREACHABLE();
+	return Layout::Invalid;
+}
+
+
 const char *formatName(Format format) {
    switch (format) {
 	case Format::Invalid:
@@ -155,6 +257,9 @@ const char *formatName(Format format) {
 	case Format::sRGBA8:
 		return "sRGBA8";
 
+	case Format::sBGRA8:
+		return "sBGRA8";
+
 	case Format::Depth16:
 		return "Depth16";
 
@@ -228,6 +333,8 @@ public:
 
 
 std::vector<char> RendererBase::loadSource(const std::string &name) {
+	std::lock_guard<std::mutex> lock(shaderSourcesMutex);
+
 	auto it = shaderSources.find(name);
 	if (it != shaderSources.end()) {
 		return it->second;
@@ -244,9 +351,7 @@ std::vector<char> RendererBase::loadSource(const std::string &name) {
 const unsigned int shaderVersion = 1;
 
 
-std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind) {
-	// check spir-v cache first
-
+std::string RendererBase::spirvCacheName(const std::string &name, const ShaderMacros &macros) const {
 	std::string spvName = spirvCacheDir + name;
 	{
 		std::vector<std::string> sorted;
@@ -265,6 +370,65 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 			spvName += "_" + s;
 		}
 	}
+
+	return spvName;
+}
+
+
+std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind) {
+	PROFILE_FUNCTION();
+
+	auto it = pendingSpirv.find(spirvCacheName(name, macros));
+	if (it != pendingSpirv.end()) {
+		// already compiling in the background, wait for it
+		auto result = std::move(it->second.result);
+		pendingSpirv.erase(it);
+		return result.get();
+	}
+
+	return loadOrCompileSpirv(name, macros, kind);
+}
+
+
+bool RendererBase::compileSpirvAsync(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind) {
+	std::string spvName = spirvCacheName(name, macros);
+	auto it = pendingSpirv.find(spvName);
+	if (it == pendingSpirv.end()) {
+		LOG("Compiling \"%s\" in the background\n", spvName.c_str());
+		PendingSpirv pending;
+		pending.result = std::async(std::launch::async, [this, name, macros, kind] () {
+			return loadOrCompileSpirv(name, macros, kind);
+		}).share();
+		pending.lastRequested = frameNum;
+		pendingSpirv.emplace(std::move(spvName), std::move(pending));
+		return false;
+	}
+
+	it->second.lastRequested = frameNum;
+	return it->second.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+void RendererBase::dropAbandonedSpirv() {
+	for (auto it = pendingSpirv.begin(); it != pendingSpirv.end(); ) {
+		// frameNum has already been incremented for the next frame
+		// destroying a running std::async future blocks until it's done so keep those until they finish
+		if (it->second.lastRequested + 1 < frameNum && it->second.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			LOG("Dropping unused shader \"%s\"\n", it->first.c_str());
+			it = pendingSpirv.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+
+std::vector<uint32_t> RendererBase::loadOrCompileSpirv(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind) {
+	PROFILE_FUNCTION();
+
+	// check spir-v cache first
+
+	std::string spvName = spirvCacheName(name, macros);
 	LOG("Looking for \"%s\" in cache...\n", spvName.c_str());
 	std::string cacheName = spvName + ".cache";
 	spvName = spvName + ".spv";
@@ -381,61 +545,95 @@ unsigned int Renderer::getMaxRefreshRate() const {
 }
 
 
-BufferHandle Renderer::createBuffer(uint32_t size, const void *contents) {
-	return impl->createBuffer(size, contents);
+BufferHandle Renderer::createBuffer(BufferUsage usage, uint32_t size, const void *contents) {
+	impl->frameStats.resourcesCreated++;
+	return impl->createBuffer(usage, size, contents);
 }
 
 
-BufferHandle Renderer::createEphemeralBuffer(uint32_t size, const void *contents) {
+EphemeralBuffer Renderer::createEphemeralBuffer(uint32_t size, const void *contents) {
+	// can be called from several threads
+	impl->frameEphemeralBuffers.fetch_add(1, std::memory_order_relaxed);
+	impl->frameEphemeralBytes.fetch_add(size, std::memory_order_relaxed);
 	return impl->createEphemeralBuffer(size, contents);
 }
 
 
+ComputeShaderHandle Renderer::createComputeShader(const std::string &name, const ShaderMacros &macros) {
+	impl->frameStats.resourcesCreated++;
+	return impl->createComputeShader(name, macros);
+}
+
+
 FragmentShaderHandle Renderer::createFragmentShader(const std::string &name, const ShaderMacros &macros) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createFragmentShader(name, macros);
 }
 
 
 FramebufferHandle Renderer::createFramebuffer(const FramebufferDesc &desc) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createFramebuffer(desc);
 }
 
 
 PipelineHandle Renderer::createPipeline(const PipelineDesc &desc) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createPipeline(desc);
 }
 
 
 RenderPassHandle Renderer::createRenderPass(const RenderPassDesc &desc) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createRenderPass(desc);
 }
 
 
 RenderTargetHandle Renderer::createRenderTarget(const RenderTargetDesc &desc) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createRenderTarget(desc);
 }
 
 
 SamplerHandle Renderer::createSampler(const SamplerDesc &desc) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createSampler(desc);
 }
 
 
 VertexShaderHandle Renderer::createVertexShader(const std::string &name, const ShaderMacros &macros) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createVertexShader(name, macros);
 }
 
 
 TextureHandle Renderer::createTexture(const TextureDesc &desc) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createTexture(desc);
 }
 
 
 DSLayoutHandle Renderer::createDescriptorSetLayout(const DescriptorLayout *layout) {
+	impl->frameStats.resourcesCreated++;
 	return impl->createDescriptorSetLayout(layout);
 }
 
 
+bool Renderer::prepareShaders(const std::string &name, const ShaderMacros &macros) {
+	return impl->prepareShaders(name, macros);
+}
+
+
+bool Renderer::prepareComputeShader(const std::string &name, const ShaderMacros &macros) {
+	return impl->prepareComputeShader(name, macros);
+}
+
+
+bool Renderer::isPipelineReady(PipelineHandle handle) {
+	return impl->isPipelineReady(handle);
+}
+
+
 TextureHandle Renderer::getRenderTargetTexture(RenderTargetHandle handle) {
 	return impl->getRenderTargetTexture(handle);
 }
@@ -446,33 +644,60 @@ TextureHandle Renderer::getRenderTargetView(RenderTargetHandle handle, Format f)
 }
 
 
+bool Renderer::isTextureReady(TextureHandle handle) const {
+	return impl->isTextureReady(handle);
+}
+
+
+void Renderer::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents) {
+	impl->updateBuffer(handle, offset, size, contents);
+	impl->frameStats.bufferUpdates++;
+}
+
+
 void Renderer::deleteBuffer(BufferHandle handle) {
 	impl->deleteBuffer(handle);
+	impl->frameStats.resourcesDeleted++;
 }
 
 
 void Renderer::deleteFramebuffer(FramebufferHandle handle) {
 	impl->deleteFramebuffer(handle);
+	impl->frameStats.resourcesDeleted++;
 }
 
 
 void Renderer::deleteRenderPass(RenderPassHandle handle) {
 	impl->deleteRenderPass(handle);
+	impl->frameStats.resourcesDeleted++;
 }
 
 
 void Renderer::deleteRenderTarget(RenderTargetHandle &rt) {
 	impl->deleteRenderTarget(rt);
+	impl->frameStats.resourcesDeleted++;
 }
 
 
 void Renderer::deleteSampler(SamplerHandle handle) {
 	impl->deleteSampler(handle);
+	impl->frameStats.resourcesDeleted++;
 }
 
 
 void Renderer::deleteTexture(TextureHandle handle) {
 	impl->deleteTexture(handle);
+	impl->frameStats.resourcesDeleted++;
+}
+
+
+bool Renderer::canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const {
+	return impl->canAliasRenderTargets(rts);
+}
+
+
+void Renderer::aliasRenderTargets(const std::vector<RenderTargetHandle> &rts) {
+	impl->aliasRenderTargets(rts);
 }
 
 
@@ -486,6 +711,21 @@ MemoryStats Renderer::getMemStats() const {
 }
 
 
+RingBufferStats Renderer::getRingBufferStats() const {
+	return impl->getRingBufferStats();
+}
+
+
+RenderStats Renderer::getFrameStats() const {
+	return impl->getFrameStats();
+}
+
+
+std::vector<GPUTiming> Renderer::getFrameTimings() const {
+	return impl->getFrameTimings();
+}
+
+
 void Renderer::beginFrame() {
 	impl->beginFrame();
 }
@@ -493,11 +733,14 @@ void Renderer::beginFrame() {
 
 void Renderer::presentFrame(RenderTargetHandle image) {
 	impl->presentFrame(image);
+	impl->endFrameStats();
+	impl->dropAbandonedSpirv();
 }
 
 
 void Renderer::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
 	impl->beginRenderPass(rpHandle, fbHandle);
+	impl->frameStats.renderPasses++;
 }
 
 
@@ -508,21 +751,37 @@ void Renderer::endRenderPass() {
 
 void Renderer::bindPipeline(PipelineHandle pipeline) {
 	impl->bindPipeline(pipeline);
+	impl->frameStats.pipelineBinds++;
 }
 
 
 void Renderer::bindIndexBuffer(BufferHandle buffer, bool bit16) {
 	impl->bindIndexBuffer(buffer, bit16);
+	impl->frameStats.indexBufferBinds++;
+}
+
+
+void Renderer::bindIndexBuffer(EphemeralBuffer buffer, bool bit16) {
+	impl->bindIndexBuffer(buffer, bit16);
+	impl->frameStats.indexBufferBinds++;
 }
 
 
 void Renderer::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
 	impl->bindVertexBuffer(binding, buffer);
+	impl->frameStats.vertexBufferBinds++;
+}
+
+
+void Renderer::bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer) {
+	impl->bindVertexBuffer(binding, buffer);
+	impl->frameStats.vertexBufferBinds++;
 }
 
 
 void Renderer::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data) {
 	impl->bindDescriptorSet(index, layout, data);
+	impl->frameStats.descriptorSetBinds++;
 }
 
 
@@ -538,66 +797,287 @@ void Renderer::setViewport(unsigned int x, unsigned int y, unsigned int width, u
 
 void Renderer::draw(unsigned int firstVertex, unsigned int vertexCount) {
 	impl->draw(firstVertex, vertexCount);
+	impl->frameStats.drawCalls++;
 }
 
 
 void Renderer::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
 	impl->drawIndexedInstanced(vertexCount, instanceCount);
+	impl->frameStats.drawCalls++;
 }
 
 
 void Renderer::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex) {
 	impl->drawIndexedOffset(vertexCount, firstIndex);
+	impl->frameStats.drawCalls++;
 }
 
 
-unsigned int RendererImpl::ringBufferAllocate(unsigned int size, unsigned int alignment) {
+void Renderer::drawIndexedIndirect(BufferHandle buffer, unsigned int offset) {
+	impl->drawIndexedIndirect(buffer, offset);
+	impl->frameStats.drawCalls++;
+}
+
+
+void Renderer::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+	impl->dispatch(x, y, z);
+	impl->frameStats.dispatches++;
+}
+
+
+void Renderer::renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers) {
+	impl->renderTargetBarriers(barriers);
+	impl->frameStats.barriers += static_cast<uint32_t>(barriers.size());
+}
+
+
+void Renderer::beginTimestampScope(const std::string &name) {
+	impl->beginTimestampScope(name);
+}
+
+
+void Renderer::endTimestampScope() {
+	impl->endTimestampScope();
+}
+
+
+RingBufferAllocation RendererImpl::ringBufferAllocate(unsigned int size, unsigned int alignment) {
+	assert(size != 0);
 	assert(alignment != 0);
 	assert(isPow2(alignment));
+	assert(isPow2(ringAlign));
+	assert(ringAlign <= ringSegmentSize);
+
+	if (alignment > ringAlign) {
+		LOG("Ringbuffer alignment %u is larger than %u\n", alignment, ringAlign);
+		throw std::runtime_error("Ringbuffer alignment too large");
+	}
+
+	// every allocation is rounded up to ringAlign so the ring pointer stays aligned
+	// and any offset it returns is good for every kind of buffer
+	const unsigned int alignedSize = (size + ringAlign - 1) & ~(ringAlign - 1);
+
+	if (alignedSize > ringSegmentSize) {
+		// too big for a normal segment, give it one of its own
+		// it's deleted instead of recycled when the frame has synced
+		std::lock_guard<std::mutex> lock(ephemeralMutex);
+
+		RingBufferAllocation a;
+		a.segment = ringBufferNewSegment(nextPow2(alignedSize));
+		a.offset  = 0;
+		ringBufStats.oversizeAllocations++;
+
+		return a;
+	}
+
+	while (true) {
+		// lock-free fast path, safe to call from several threads at once
+		uint64_t     reserved   = ringBufPtr.fetch_add(alignedSize, std::memory_order_acq_rel);
+		unsigned int segment    = static_cast<unsigned int>(reserved >> 32);
+		unsigned int offset     = static_cast<unsigned int>(reserved);
+		assert((offset & (ringAlign - 1)) == 0);
+
+		if (segment != NO_RING_SEGMENT && offset + alignedSize <= ringSegments[segment].size) {
+			RingBufferAllocation a;
+			a.segment = segment;
+			a.offset  = offset;
+			return a;
+		}
+
+		// current segment is full, need a new one
+		std::lock_guard<std::mutex> lock(ephemeralMutex);
+		if ((ringBufPtr.load(std::memory_order_acquire) >> 32) != segment) {
+			// someone else already switched segments, try again
+			continue;
+		}
+
+		RingBufferAllocation a;
+		a.segment = ringBufferNewSegment(ringSegmentSize);
+		a.offset  = 0;
+		ringBufPtr.store((uint64_t(a.segment) << 32) | alignedSize, std::memory_order_release);
+
+		return a;
+	}
+}
+
+
+unsigned int RendererImpl::ringBufferNewSegment(unsigned int size) {
+	// caller must hold ephemeralMutex
+	assert(isPow2(size));
 
-	if (size > ringBufSize) {
-		unsigned int newSize = nextPow2(size);
-		LOG("WARNING: out of ringbuffer space, reallocating to %u bytes\n", newSize);
-		recreateRingBuffer(newSize);
+	unsigned int s = NO_RING_SEGMENT;
+	if (size == ringSegmentSize && !freeRingSegments.empty()) {
+		s = freeRingSegments.back();
+		freeRingSegments.pop_back();
+	} else {
+		for (unsigned int i = 0; i < MAX_RING_SEGMENTS; i++) {
+			if (ringSegments[i].size == 0) {
+				s = i;
+				break;
+			}
+		}
+
+		if (s == NO_RING_SEGMENT) {
+			LOG("Out of ringbuffer segments\n");
+			throw std::runtime_error("Out of ringbuffer segments");
+		}
+
+		createRingSegment(ringSegments[s], size);
+		assert(ringSegments[s].size == size);
 
-		assert(ringBufPtr == 0);
+		ringBufStats.numSegments++;
+		ringBufStats.totalBytes += size;
+		if (size == ringSegmentSize) {
+			ringBufStats.growthEvents++;
+			LOG("ringbuffer grew to %u segments\n", ringBufStats.numSegments);
+		}
 	}
 
-	// sub-allocate from persistent coherent buffer
-	// round current pointer up to necessary alignment
-	const unsigned int add   = alignment - 1;
-	const unsigned int mask  = ~add;
-	unsigned int alignedPtr  = (ringBufPtr + add) & mask;
-	assert(ringBufPtr <= alignedPtr);
-	// TODO: ring buffer size should be pow2, se should use add & mask here too
-	unsigned int beginPtr    =  alignedPtr % ringBufSize;
-
-	if (beginPtr + size >= ringBufSize) {
-		// we went past the end and have to go back to beginning
-		// TODO: add and mask here too
-		ringBufPtr = (ringBufPtr / ringBufSize + 1) * ringBufSize;
-		assert((ringBufPtr & ~mask) == 0);
-		alignedPtr  = (ringBufPtr + add) & mask;
-		beginPtr    =  alignedPtr % ringBufSize;
-		assert(beginPtr + size < ringBufSize);
-		assert(beginPtr == 0);
+	currentRingSegments.push_back(s);
+
+	return s;
+}
+
+
+void RendererImpl::ringBufferEndFrame(Frame &frame) {
+	std::lock_guard<std::mutex> lock(ephemeralMutex);
+
+	// segments filled during this frame can be recycled once it has synced
+	assert(frame.ringSegments.empty());
+	unsigned int used  = static_cast<unsigned int>(currentRingSegments.size());
+	frame.ringSegments = std::move(currentRingSegments);
+	currentRingSegments.clear();
+
+	// next frame starts a new segment
+	ringBufPtr.store((uint64_t(NO_RING_SEGMENT) << 32) | ringSegmentSize, std::memory_order_release);
+
+	// high water mark is the max over the last window so it also comes down
+	ringBufStats.lastFrameSegments = used;
+	ringBufStats.highWaterMark     = std::max(ringBufStats.highWaterMark, used);
+	ringWindowMax                  = std::max(ringWindowMax, used);
+	ringWindowFrames++;
+	if (ringWindowFrames == RING_HIGH_WATER_WINDOW) {
+		ringBufStats.highWaterMark = ringWindowMax;
+		ringWindowMax              = 0;
+		ringWindowFrames           = 0;
 	}
-	ringBufPtr = alignedPtr + size;
 
-	// ran out of buffer space?
-	if (ringBufPtr >= lastSyncedRingBufPtr + ringBufSize) {
-		unsigned int newSize = ringBufSize * 2;
-		assert(size < newSize);
+	// keep enough free segments for every frame in flight at high water mark
+	// release the rest
+	unsigned int wanted = ringBufStats.highWaterMark * static_cast<unsigned int>(frames.size());
+	while (freeRingSegments.size() > wanted) {
+		auto &seg = ringSegments[freeRingSegments.back()];
+		freeRingSegments.pop_back();
+
+		ringBufStats.numSegments--;
+		ringBufStats.totalBytes -= seg.size;
+		ringBufStats.shrinkEvents++;
+		deleteRingSegment(seg);
+	}
+}
+
+
+void RendererImpl::ringBufferRetireFrame(Frame &frame) {
+	std::lock_guard<std::mutex> lock(ephemeralMutex);
+
+	for (unsigned int s : frame.ringSegments) {
+		auto &seg = ringSegments[s];
+		if (seg.size == ringSegmentSize) {
+			freeRingSegments.push_back(s);
+		} else {
+			ringBufStats.numSegments--;
+			ringBufStats.totalBytes -= seg.size;
+			deleteRingSegment(seg);
+		}
+	}
+	frame.ringSegments.clear();
+}
+
 
-		LOG("WARNING: out of ringbuffer space, reallocating to %u bytes\n", newSize);
-		recreateRingBuffer(newSize);
+void RendererImpl::ringBufferShutdown() {
+	// all frames must have been retired
+	std::lock_guard<std::mutex> lock(ephemeralMutex);
 
-		assert(ringBufPtr == 0);
-		beginPtr   = 0;
-		ringBufPtr = size;
+	currentRingSegments.clear();
+	freeRingSegments.clear();
+	for (auto &seg : ringSegments) {
+		if (seg.size != 0) {
+			deleteRingSegment(seg);
+		}
 	}
+	ringBufStats.numSegments = 0;
+	ringBufStats.totalBytes  = 0;
+}
+
+
+RingBufferStats RendererBase::getRingBufferStats() {
+	std::lock_guard<std::mutex> lock(ephemeralMutex);
+
+	RingBufferStats stats  = ringBufStats;
+	stats.segmentSize      = ringSegmentSize;
+	stats.freeSegments     = static_cast<uint32_t>(freeRingSegments.size());
 
-	return beginPtr;
+	return stats;
+}
+
+
+std::vector<GPUTiming> RendererBase::getFrameTimings() const {
+	return frameTimings;
+}
+
+
+RenderStats RendererBase::getFrameStats() const {
+	return lastFrameStats;
+}
+
+
+void RendererBase::endFrameStats() {
+	lastFrameStats                  = frameStats;
+	lastFrameStats.ephemeralBuffers = frameEphemeralBuffers.exchange(0, std::memory_order_relaxed);
+	lastFrameStats.ephemeralBytes   = frameEphemeralBytes.exchange(0, std::memory_order_relaxed);
+	frameStats                      = RenderStats();
+}
+
+
+void RendererBase::updateTimingHistory() {
+	// forget scopes which didn't appear so a pass which comes back
+	// after being culled or switched off starts from scratch
+	for (auto it = timingHistory.begin(); it != timingHistory.end(); ) {
+		bool found = false;
+		for (const auto &t : frameTimings) {
+			if (t.name == it->first) {
+				found = true;
+				break;
+			}
+		}
+
+		if (found) {
+			++it;
+		} else {
+			it = timingHistory.erase(it);
+		}
+	}
+
+	for (auto &t : frameTimings) {
+		TimingHistory &h = timingHistory[t.name];
+		h.milliseconds[h.next] = t.milliseconds;
+		h.next  = (h.next + 1) % TIMING_HISTORY;
+		h.count = std::min(h.count + 1, static_cast<unsigned int>(TIMING_HISTORY));
+
+		double minMs = h.milliseconds[0];
+		double maxMs = h.milliseconds[0];
+		double sum   = 0.0;
+		for (unsigned int i = 0; i < h.count; i++) {
+			double ms = h.milliseconds[i];
+			minMs = std::min(minMs, ms);
+			maxMs = std::max(maxMs, ms);
+			sum  += ms;
+		}
+
+		t.minMilliseconds = minMs;
+		t.avgMilliseconds = sum / h.count;
+		t.maxMilliseconds = maxMs;
+	}
 }
 
 
@@ -606,4 +1086,14 @@ glm::uvec2 Renderer::getDrawableSize() const {
 }
 
 
+RenderTargetHandle Renderer::getSwapchainRenderTarget() const {
+	return impl->swapchainRenderTarget;
+}
+
+
+Format Renderer::getSwapchainFormat() const {
+	return impl->swapchainFormat;
+}
+
+
 }	// namespace renderer
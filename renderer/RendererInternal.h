@@ -30,10 +30,64 @@ THE SOFTWARE.
 
 #include <shaderc/shaderc.h>
 
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+
 
 namespace renderer {
 
 
+// fixed so segments can be read from other threads while new ones are created
+#define MAX_RING_SEGMENTS       256
+
+#define NO_RING_SEGMENT         0xFFFFFFFFU
+
+// frames over which ringbuffer high water mark is measured
+#define RING_HIGH_WATER_WINDOW  120
+
+// per frame, each scope uses two queries
+#define MAX_TIMESTAMP_SCOPES    32
+
+// frames over which timestamp scope min/avg/max are measured
+#define TIMING_HISTORY          120
+
+
+struct TimingHistory {
+	std::array<double, TIMING_HISTORY>  milliseconds;
+	unsigned int                        count;
+	unsigned int                        next;
+
+
+	TimingHistory()
+	: count(0)
+	, next(0)
+	{
+		milliseconds.fill(0.0);
+	}
+};
+
+
+struct RingBufferAllocation {
+	unsigned int segment;
+	unsigned int offset;
+};
+
+
+struct PendingSpirv {
+	std::shared_future<std::vector<uint32_t> >  result;
+	// frameNum of the latest compileSpirvAsync call asking for this
+	unsigned int                                lastRequested;
+
+
+	PendingSpirv()
+	: lastRequested(0)
+	{
+	}
+};
+
+
 template <class T>
 class ResourceContainer {
 	std::unordered_map<unsigned int, T> resources;
@@ -102,6 +156,13 @@ public:
 	}
 
 
+	template <typename F> void forEach(F &&f) {
+		for (auto &r : resources) {
+			f(r.second);
+		}
+	}
+
+
 	template <typename F> void clearWith(F &&f) {
 		auto it = resources.begin();
 		while (it != resources.end()) {
@@ -117,6 +178,10 @@ const char *descriptorTypeName(DescriptorType t);
 
 bool isDepthFormat(Format format);
 bool issRGBFormat(Format format);
+bool isStencilFormat(Format format);
+unsigned int formatSize(Format format);
+// layout a render target must be in for access, Invalid if it doesn't matter
+Layout accessLayout(Access access);
 
 
 struct RendererBase {
@@ -124,6 +189,9 @@ struct RendererBase {
 	SwapchainDesc wantedSwapchain;
 	bool          swapchainDirty;
 	glm::uvec2    drawableSize;
+	// stands for whichever swapchain image the current frame renders to
+	RenderTargetHandle  swapchainRenderTarget;
+	Format              swapchainFormat;
 
 	uint32_t                                 currentFrameIdx;
 	uint32_t                                 lastSyncedFrame;
@@ -136,12 +204,40 @@ struct RendererBase {
 
 	unsigned int   uboAlign;
 	unsigned int   ssboAlign;
-
-	unsigned int  ringBufSize;
-	unsigned int  ringBufPtr;
-	// we have synced with the GPU up to this ringbuffer index
-	unsigned int              lastSyncedRingBufPtr;
-
+	// every ring buffer allocation starts at a multiple of this
+	// set by the backend before the first allocation
+	unsigned int   ringAlign;
+
+	// ephemeral data lives in a chain of fixed size segments
+	// each frame fills its own segments, they're recycled when the frame has synced
+	unsigned int               ringSegmentSize;
+	// current segment in high 32 bits, offset in it in low 32 bits
+	std::atomic<uint64_t>      ringBufPtr;
+	// rest protected by ephemeralMutex
+	// segments filled since the last presentFrame
+	std::vector<unsigned int>  currentRingSegments;
+	std::vector<unsigned int>  freeRingSegments;
+	unsigned int               ringWindowMax;
+	unsigned int               ringWindowFrames;
+	RingBufferStats            ringBufStats;
+
+	// results of the latest frame which has synced
+	std::vector<GPUTiming>     frameTimings;
+	// recent results of each scope, circular
+	std::unordered_map<std::string, TimingHistory> timingHistory;
+	// counted by the Renderer forwarders
+	RenderStats                frameStats;
+	RenderStats                lastFrameStats;
+	// ephemeral buffers can be created from several threads
+	std::atomic<uint32_t>      frameEphemeralBuffers;
+	std::atomic<uint64_t>      frameEphemeralBytes;
+	// protects ringbuffer segment bookkeeping, ephemeral buffers can be created from several threads
+	std::mutex                 ephemeralMutex;
+	// some backends can only create ringbuffer segments on this thread
+	std::thread::id            renderThread;
+
+	// protects shaderSources, background shader compiles use it too
+	std::mutex                                           shaderSourcesMutex;
 	std::unordered_map<std::string, std::vector<char> > shaderSources;
 
 	// debugging
@@ -151,18 +247,47 @@ struct RendererBase {
 	bool validPipeline;
 	bool pipelineDrawn;
 	bool scissorSet;
+	bool inTimestampScope;
 
 	std::string spirvCacheDir;
 
+	// shaders being compiled in the background, keyed by cache name
+	// only touched from the main thread
+	std::unordered_map<std::string, PendingSpirv> pendingSpirv;
+
 
 	std::vector<char> loadSource(const std::string &name);
 
+	std::string spirvCacheName(const std::string &name, const ShaderMacros &macros) const;
+
 	std::vector<uint32_t> compileSpirv(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind);
 
+	std::vector<uint32_t> loadOrCompileSpirv(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind);
+
+	// returns true if spir-v is ready and compileSpirv won't block
+	bool compileSpirvAsync(const std::string &name, const ShaderMacros &macros, shaderc_shader_kind kind);
+
+	// forget finished background compiles which weren't asked for during the previous frame
+	// called after presentFrame
+	void dropAbandonedSpirv();
+
+	RingBufferStats getRingBufferStats();
+
+	std::vector<GPUTiming> getFrameTimings() const;
+
+	// call after frameTimings has been filled with a new frame's results
+	void updateTimingHistory();
+
+	RenderStats getFrameStats() const;
+
+	// called after presentFrame
+	void endFrameStats();
+
 	explicit RendererBase(const RendererDesc &desc)
 	: swapchainDesc(desc.swapchain)
 	, wantedSwapchain(desc.swapchain)
 	, swapchainDirty(true)
+	, swapchainFormat(Format::Invalid)
 	, currentFrameIdx(0)
 	, lastSyncedFrame(0)
 	, currentRefreshRate(0)
@@ -171,14 +296,20 @@ struct RendererBase {
 	, frameNum(0)
 	, uboAlign(0)
 	, ssboAlign(0)
-	, ringBufSize(0)
-	, ringBufPtr(0)
-	, lastSyncedRingBufPtr(0)
+	, ringAlign(0)
+	, ringSegmentSize(nextPow2(desc.ephemeralRingBufSize))
+	, ringBufPtr((uint64_t(NO_RING_SEGMENT) << 32) | ringSegmentSize)
+	, ringWindowMax(0)
+	, ringWindowFrames(0)
+	, frameEphemeralBuffers(0)
+	, frameEphemeralBytes(0)
+	, renderThread(std::this_thread::get_id())
 	, inFrame(false)
 	, inRenderPass(false)
 	, validPipeline(false)
 	, pipelineDrawn(false)
 	, scissorSet(false)
+	, inTimestampScope(false)
 	{
 		char *prefPath = SDL_GetPrefPath("", "SMAADemo");
 		spirvCacheDir = prefPath;
@@ -192,7 +323,12 @@ struct RendererBase {
 	RendererBase &operator=(const RendererBase &) = default;
 	RendererBase &operator=(RendererBase &&)      = default;
 
-	~RendererBase() {}
+	~RendererBase() {
+		// background compiles reference us, let them finish
+		for (auto &p : pendingSpirv) {
+			p.second.result.wait();
+		}
+	}
 };
 
 
@@ -27,6 +27,7 @@ THE SOFTWARE.
 #include <SDL_vulkan.h>
 
 #include "RendererInternal.h"
+#include "utils/Profiler.h"
 #include "utils/Utils.h"
 
 
@@ -77,6 +78,9 @@ static const std::array<vk::DescriptorType, uint8_t(DescriptorType::Count) - 1>
 	, vk::DescriptorType::eSampler
 	, vk::DescriptorType::eSampledImage
 	, vk::DescriptorType::eCombinedImageSampler
+	, vk::DescriptorType::eUniformBuffer
+	, vk::DescriptorType::eStorageBuffer
+	, vk::DescriptorType::eStorageImage
 } };
 
 
@@ -130,6 +134,9 @@ static vk::Format vulkanFormat(Format format) {
 	case Format::sRGBA8:
 		return vk::Format::eR8G8B8A8Srgb;
 
+	case Format::sBGRA8:
+		return vk::Format::eB8G8R8A8Srgb;
+
 	case Format::Depth16:
 		return vk::Format::eD16Unorm;
 
@@ -164,9 +171,19 @@ static VkBool32 VKAPI_PTR debugCallbackFunc(VkDebugReportFlagsEXT flags, VkDebug
 RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
 , graphicsQueueIndex(0)
+, timestampValidBits(0)
+, transferQueueIndex(0)
+, currentImageIdx(0)
+, currentBindPoint(vk::PipelineBindPoint::eGraphics)
+, aliasedBytes(0)
 , debugMarkers(false)
-, ringBufferMem(nullptr)
-, persistentMapping(nullptr)
+, stagingBufferMem(nullptr)
+, stagingMapping(nullptr)
+, stagingBufSize(0)
+, stagingBufPtr(0)
+, lastSyncedStagingBufPtr(0)
+, currentUploadBatch(0)
+, uploadsPending(false)
 {
 	bool enableValidation = desc.debug;
 	bool enableMarkers    = desc.tracing;
@@ -313,6 +330,8 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 	uboAlign  = static_cast<unsigned int>(deviceProperties.limits.minUniformBufferOffsetAlignment);
 	ssboAlign = static_cast<unsigned int>(deviceProperties.limits.minStorageBufferOffsetAlignment);
+	// vertex and index data only need 16
+	ringAlign = std::max(std::max(uboAlign, ssboAlign), 16U);
 
 	deviceFeatures = physicalDevice.getFeatures();
 
@@ -341,6 +360,7 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	LOG("%u queue families\n", static_cast<unsigned int>(queueProps.size()));
 
 	graphicsQueueIndex = static_cast<uint32_t>(queueProps.size());
+	transferQueueIndex = static_cast<uint32_t>(queueProps.size());
 	for (uint32_t i = 0; i < queueProps.size(); i++) {
 		const auto &q = queueProps.at(i);
 		LOG(" Queue family %u\n", i);
@@ -349,7 +369,8 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		LOG("  Timestamp valid bits: %u\n", q.timestampValidBits);
 		LOG("  Image transfer granularity: (%u, %u, %u)\n", q.minImageTransferGranularity.width, q.minImageTransferGranularity.height, q.minImageTransferGranularity.depth);
 
-		if (q.queueFlags & vk::QueueFlagBits::eGraphics) {
+		// we record compute dispatches in the same command buffer as graphics
+		if ((q.queueFlags & vk::QueueFlagBits::eGraphics) && (q.queueFlags & vk::QueueFlagBits::eCompute)) {
 			if (physicalDevice.getSurfaceSupportKHR(i, surface)) {
 				LOG("  Can present to our surface\n");
 				graphicsQueueIndex = i;
@@ -357,6 +378,14 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 				LOG("  Can't present to our surface\n");
 			}
 		}
+
+		// a transfer queue without graphics or compute is likely a separate DMA engine
+		if ((q.queueFlags & vk::QueueFlagBits::eTransfer) && !(q.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+			LOG("  Dedicated transfer queue\n");
+			if (transferQueueIndex == queueProps.size()) {
+				transferQueueIndex = i;
+			}
+		}
 	}
 
 	if (graphicsQueueIndex == queueProps.size()) {
@@ -366,12 +395,33 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 	LOG("Using queue %u for graphics\n", graphicsQueueIndex);
 
+	timestampValidBits = queueProps.at(graphicsQueueIndex).timestampValidBits;
+	if (timestampValidBits == 0) {
+		LOG("Graphics queue doesn't support timestamps, GPU timing disabled\n");
+	}
+
+	if (transferQueueIndex == queueProps.size()) {
+		// no dedicated transfer queue, do uploads on the graphics queue
+		transferQueueIndex = graphicsQueueIndex;
+	}
+
+	LOG("Using queue %u for transfers\n", transferQueueIndex);
+
 	std::array<float, 1> queuePriorities = { { 0.0f } };
 
-	vk::DeviceQueueCreateInfo queueCreateInfo;
-	queueCreateInfo.queueFamilyIndex  = graphicsQueueIndex;
-	queueCreateInfo.queueCount        = 1;
-	queueCreateInfo.pQueuePriorities  = &queuePriorities[0];;
+	std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
+	{
+		vk::DeviceQueueCreateInfo queueCreateInfo;
+		queueCreateInfo.queueFamilyIndex  = graphicsQueueIndex;
+		queueCreateInfo.queueCount        = 1;
+		queueCreateInfo.pQueuePriorities  = &queuePriorities[0];
+		queueCreateInfos.push_back(queueCreateInfo);
+
+		if (transferQueueIndex != graphicsQueueIndex) {
+			queueCreateInfo.queueFamilyIndex  = transferQueueIndex;
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+	}
 
 	std::unordered_set<std::string> availableExtensions;
 	{
@@ -403,8 +453,8 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	}
 
 	vk::DeviceCreateInfo deviceCreateInfo;
-	deviceCreateInfo.queueCreateInfoCount     = 1;
-	deviceCreateInfo.pQueueCreateInfos        = &queueCreateInfo;
+	deviceCreateInfo.queueCreateInfoCount     = static_cast<uint32_t>(queueCreateInfos.size());
+	deviceCreateInfo.pQueueCreateInfos        = &queueCreateInfos[0];
 	// TODO: enable only features we need
 	deviceCreateInfo.pEnabledFeatures         = &deviceFeatures;
 	deviceCreateInfo.enabledExtensionCount    = static_cast<uint32_t>(deviceExtensions.size());
@@ -422,7 +472,8 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 	vmaCreateAllocator(&allocatorInfo, &allocator);
 
-	queue = device.getQueue(graphicsQueueIndex, 0);
+	queue         = device.getQueue(graphicsQueueIndex, 0);
+	transferQueue = device.getQueue(transferQueueIndex, 0);
 
 	{
 		auto surfacePresentModes_ = physicalDevice.getSurfacePresentModesKHR(surface);
@@ -448,83 +499,245 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	}
 
 	recreateSwapchain();
-	recreateRingBuffer(desc.ephemeralRingBufSize);
+	recreateStagingBuffer(nextPow2(desc.uploadRingBufSize));
+
+	// TODO: number of upload batches is arbitrary
+	uploadBatches.resize(3);
+	{
+		vk::CommandPoolCreateInfo cp;
+		cp.flags            = vk::CommandPoolCreateFlagBits::eTransient;
+		cp.queueFamilyIndex = transferQueueIndex;
+
+		for (auto &b : uploadBatches) {
+			b.commandPool = device.createCommandPool(cp);
 
-	acquireSem    = device.createSemaphore(vk::SemaphoreCreateInfo());
-	renderDoneSem = device.createSemaphore(vk::SemaphoreCreateInfo());
+			vk::CommandBufferAllocateInfo info(b.commandPool, vk::CommandBufferLevel::ePrimary, 1);
+			auto bufs = device.allocateCommandBuffers(info);
+			assert(bufs.size() == 1);
+			b.commandBuffer = bufs.at(0);
+
+			b.fence = device.createFence(vk::FenceCreateInfo());
+		}
+	}
 
 	// TODO: load pipeline cache
 }
 
 
-void RendererImpl::recreateRingBuffer(unsigned int newSize) {
-	assert(newSize > 0);
+void RendererImpl::createRingSegment(RingBufferSegment &seg, unsigned int size) {
+	assert(seg.size == 0);
+	assert(!seg.buffer);
+	assert(seg.memory  == nullptr);
+	assert(seg.mapping == nullptr);
+	assert(size > 0);
+
+	vk::BufferCreateInfo rbInfo;
+	rbInfo.size  = size;
+	rbInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+	seg.buffer   = device.createBuffer(rbInfo);
+
+	VmaAllocationCreateInfo req = {};
+	req.flags          = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	req.usage          = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	req.requiredFlags  = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	VmaAllocationInfo  allocationInfo = {};
+	auto result = vmaAllocateMemoryForBuffer(allocator, seg.buffer, &req, &seg.memory, &allocationInfo);
+
+	if (result != VK_SUCCESS) {
+		LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(result)).c_str());
+		throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
+	}
 
-	// if buffer already exists, free it after it's no longer in use
-	if (ringBuffer) {
-		assert(ringBufSize       != 0);
-		assert(persistentMapping != nullptr);
+	LOG("ringbuffer segment memory type: %u\n",    allocationInfo.memoryType);
+	LOG("ringbuffer segment memory size: %u\n",    static_cast<unsigned int>(allocationInfo.size));
+	assert(seg.memory != nullptr);
+	assert(allocationInfo.offset == 0);
+	assert(allocationInfo.pMappedData != nullptr);
 
-		// create a Buffer object which we can put into deleteResources
-		Buffer buffer;
-		buffer.buffer          = ringBuffer;
-		ringBuffer             = vk::Buffer();
+	device.bindBufferMemory(seg.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
 
-		buffer.ringBufferAlloc = false;
+	seg.mapping = reinterpret_cast<char *>(allocationInfo.pMappedData);
+	seg.size    = size;
+}
 
-		buffer.memory          = ringBufferMem;
-		ringBufferMem          = VK_NULL_HANDLE;
-		persistentMapping      = nullptr;
 
-		buffer.size            = ringBufSize;
-		ringBufSize            = 0;
+void RendererImpl::deleteRingSegment(RingBufferSegment &seg) {
+	assert(seg.size != 0);
+	assert(seg.buffer);
+	assert(seg.memory != nullptr);
 
-		buffer.offset          = ringBufPtr;
-		ringBufPtr             = 0;
+	// only called for segments no frame in flight refers to
+	vmaFreeMemory(allocator, seg.memory);
+	seg.memory  = nullptr;
+	seg.mapping = nullptr;
+	device.destroyBuffer(seg.buffer);
+	seg.buffer  = vk::Buffer();
+	seg.size    = 0;
+}
 
-		buffer.lastUsedFrame   = frameNum;
 
-		deleteResources.emplace(std::move(buffer));
-	}
+void RendererImpl::recreateStagingBuffer(unsigned int newSize) {
+	assert(newSize > 0);
+	assert(isPow2(newSize));
+
+	if (stagingBuffer) {
+		// copies from the old buffer might still be pending, submit and wait for them
+		flushUploads();
+		for (unsigned int i = 0; i < uploadBatches.size(); i++) {
+			if (uploadBatches.at(i).outstanding) {
+				waitForUploadBatch(i);
+			}
+		}
 
-	assert(!ringBuffer);
-	assert(ringBufSize       == 0);
-	assert(ringBufPtr        == 0);
-	assert(persistentMapping == nullptr);
-	ringBufSize = newSize;
+		vmaFreeMemory(allocator, stagingBufferMem);
+		stagingBufferMem = nullptr;
+		stagingMapping   = nullptr;
+		device.destroyBuffer(stagingBuffer);
+		stagingBuffer    = vk::Buffer();
+	}
 
-	// create ringbuffer
-	vk::BufferCreateInfo rbInfo;
-	rbInfo.size  = newSize;
-	rbInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferSrc;
-	ringBuffer   = device.createBuffer(rbInfo);
+	assert(!stagingBuffer);
+	assert(stagingMapping == nullptr);
+	stagingBufSize          = newSize;
+	stagingBufPtr           = 0;
+	lastSyncedStagingBufPtr = 0;
 
-	assert(ringBufferMem == nullptr);
+	vk::BufferCreateInfo info;
+	info.size     = newSize;
+	info.usage    = vk::BufferUsageFlagBits::eTransferSrc;
+	stagingBuffer = device.createBuffer(info);
 
 	VmaAllocationCreateInfo req = {};
-	req.flags          = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
-	req.usage          = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	req.flags          = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	req.usage          = VMA_MEMORY_USAGE_CPU_ONLY;
 	req.requiredFlags  = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
 	VmaAllocationInfo  allocationInfo = {};
-	auto result = vmaAllocateMemoryForBuffer(allocator, ringBuffer, &req, &ringBufferMem, &allocationInfo);
+	auto result = vmaAllocateMemoryForBuffer(allocator, stagingBuffer, &req, &stagingBufferMem, &allocationInfo);
 
 	if (result != VK_SUCCESS) {
 		LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(result)).c_str());
 		throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
 	}
 
-	LOG("ringbuffer memory type: %u\n",    allocationInfo.memoryType);
-	LOG("ringbuffer memory offset: %u\n",  static_cast<unsigned int>(allocationInfo.offset));
-	LOG("ringbuffer memory size: %u\n",    static_cast<unsigned int>(allocationInfo.size));
-	assert(ringBufferMem != nullptr);
-	assert(allocationInfo.offset == 0);
+	LOG("staging buffer memory type: %u\n",    allocationInfo.memoryType);
+	LOG("staging buffer memory size: %u\n",    static_cast<unsigned int>(allocationInfo.size));
 	assert(allocationInfo.pMappedData != nullptr);
 
-	device.bindBufferMemory(ringBuffer, allocationInfo.deviceMemory, allocationInfo.offset);
+	device.bindBufferMemory(stagingBuffer, allocationInfo.deviceMemory, allocationInfo.offset);
+
+	stagingMapping = reinterpret_cast<char *>(allocationInfo.pMappedData);
+	assert(stagingMapping != nullptr);
+}
+
+
+unsigned int RendererImpl::stagingBufferAllocate(unsigned int size, unsigned int alignment) {
+	assert(size != 0);
+	assert(alignment != 0);
+	assert(isPow2(alignment));
+
+	if (size > stagingBufSize) {
+		unsigned int newSize = nextPow2(size);
+		LOG("WARNING: out of staging buffer space, reallocating to %u bytes\n", newSize);
+		recreateStagingBuffer(newSize);
+	}
+
+	// stagingBufSize is pow2 so we can wrap with a mask
+	const unsigned int add   = alignment - 1;
+	const unsigned int mask  = ~add;
+	unsigned int alignedPtr  = (stagingBufPtr + add) & mask;
+	unsigned int beginPtr    = alignedPtr & (stagingBufSize - 1);
+
+	if (beginPtr + size > stagingBufSize) {
+		// doesn't fit at the end, go back to beginning
+		alignedPtr = (stagingBufPtr & ~(stagingBufSize - 1)) + stagingBufSize;
+		beginPtr   = 0;
+	}
+
+	// space still used by copies which haven't completed yet?
+	while (alignedPtr + size > lastSyncedStagingBufPtr + stagingBufSize) {
+		flushUploads();
+
+		// batches are used round-robin so the oldest outstanding one is the first after current
+		bool waited = false;
+		for (unsigned int i = 0; i < uploadBatches.size(); i++) {
+			unsigned int idx = (currentUploadBatch + i) % uploadBatches.size();
+			if (uploadBatches.at(idx).outstanding) {
+				waitForUploadBatch(idx);
+				waited = true;
+				break;
+			}
+		}
+
+		if (!waited) {
+			// nothing pending, all of the buffer is free
+			lastSyncedStagingBufPtr = alignedPtr;
+		}
+	}
+
+	stagingBufPtr = alignedPtr + size;
+
+	return beginPtr;
+}
+
+
+vk::CommandBuffer RendererImpl::uploadCommandBuffer() {
+	auto &batch = uploadBatches.at(currentUploadBatch);
+
+	if (!batch.recording) {
+		if (batch.outstanding) {
+			waitForUploadBatch(currentUploadBatch);
+		}
+		assert(!batch.outstanding);
+
+		device.resetFences( { batch.fence } );
+		device.resetCommandPool(batch.commandPool, vk::CommandPoolResetFlags());
+		batch.commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+		batch.recording = true;
+	}
+
+	return batch.commandBuffer;
+}
+
+
+void RendererImpl::flushUploads() {
+	auto &batch = uploadBatches.at(currentUploadBatch);
+	if (!batch.recording) {
+		return;
+	}
+
+	batch.commandBuffer.end();
+
+	vk::SubmitInfo submit;
+	submit.commandBufferCount   = 1;
+	submit.pCommandBuffers      = &batch.commandBuffer;
+
+	transferQueue.submit({ submit }, batch.fence);
 
-	persistentMapping = reinterpret_cast<char *>(allocationInfo.pMappedData);
-	assert(persistentMapping != nullptr);
+	batch.recording    = false;
+	batch.outstanding  = true;
+	batch.stagingEnd   = stagingBufPtr;
+	uploadsPending     = true;
+
+	currentUploadBatch = (currentUploadBatch + 1) % uploadBatches.size();
+}
+
+
+void RendererImpl::waitForUploadBatch(unsigned int batchIdx) {
+	auto &batch = uploadBatches.at(batchIdx);
+	assert(batch.outstanding);
+	assert(!batch.recording);
+
+	auto waitResult = device.waitForFences({ batch.fence }, true, 1000000000ull);
+	if (waitResult != vk::Result::eSuccess) {
+		// TODO: handle these somehow
+		LOG("upload wait result is not success: %s\n", vk::to_string(waitResult).c_str());
+		throw std::runtime_error("upload wait result is not success");
+	}
+
+	batch.outstanding       = false;
+	lastSyncedStagingBufPtr = std::max(lastSyncedStagingBufPtr, batch.stagingEnd);
 }
 
 
@@ -533,13 +746,37 @@ RendererImpl::~RendererImpl() {
 	assert(device);
 	assert(surface);
 	assert(swapchain);
-	assert(ringBuffer);
-	assert(persistentMapping);
 
 	// TODO: save pipeline cache
 
+	// background pipeline compiles use shader modules and render passes
+	pipelines.forEach([this](Pipeline &p) {
+		if (!p.pipeline) {
+			finishPipeline(p);
+		}
+	} );
+
 	// TODO: if last frame is still pending we could add deleted resources to its list
 
+	flushUploads();
+	for (unsigned int i = 0; i < uploadBatches.size(); i++) {
+		auto &b = uploadBatches.at(i);
+		if (b.outstanding) {
+			waitForUploadBatch(i);
+		}
+		assert(!b.recording);
+
+		device.destroyFence(b.fence);
+		b.fence = vk::Fence();
+
+		device.freeCommandBuffers(b.commandPool, { b.commandBuffer });
+		b.commandBuffer = vk::CommandBuffer();
+
+		device.destroyCommandPool(b.commandPool);
+		b.commandPool = vk::CommandPool();
+	}
+	uploadBatches.clear();
+
 	for (unsigned int i = 0; i < frames.size(); i++) {
 		auto &f = frames.at(i);
 		if (f.outstanding) {
@@ -555,17 +792,19 @@ RendererImpl::~RendererImpl() {
 	}
 	deleteResources.clear();
 
-	device.destroySemaphore(renderDoneSem);
-	renderDoneSem = vk::Semaphore();
+	for (auto &i : swapchainImages) {
+		device.destroyImageView(i.imageView);
+		device.destroySemaphore(i.renderDoneSem);
+	}
+	swapchainImages.clear();
 
-	device.destroySemaphore(acquireSem);
-	acquireSem = vk::Semaphore();
+	ringBufferShutdown();
 
-	vmaFreeMemory(allocator, ringBufferMem);
-	ringBufferMem = nullptr;
-	persistentMapping = nullptr;
-	device.destroyBuffer(ringBuffer);
-	ringBuffer = vk::Buffer();
+	vmaFreeMemory(allocator, stagingBufferMem);
+	stagingBufferMem = nullptr;
+	stagingMapping = nullptr;
+	device.destroyBuffer(stagingBuffer);
+	stagingBuffer = vk::Buffer();
 
 	buffers.clearWith([this](Buffer &b) {
 		deleteBufferInternal(b);
@@ -595,6 +834,11 @@ RendererImpl::~RendererImpl() {
 		v.shaderModule = vk::ShaderModule();
 	} );
 
+	computeShaders.clearWith([this](ComputeShader &c) {
+		device.destroyShaderModule(c.shaderModule);
+		c.shaderModule = vk::ShaderModule();
+	} );
+
 	fragmentShaders.clearWith([this](FragmentShader &f) {
 		device.destroyShaderModule(f.shaderModule);
 		f.shaderModule = vk::ShaderModule();
@@ -605,6 +849,10 @@ RendererImpl::~RendererImpl() {
 		l.layout = vk::DescriptorSetLayout();
 	} );
 
+	// only a stand-in, the images belong to the swapchain
+	renderTargets.remove(swapchainRenderTarget);
+	swapchainRenderTarget = RenderTargetHandle();
+
 	renderTargets.clearWith([this](RenderTarget &rt) {
 		deleteRenderTargetInternal(rt);
 	} );
@@ -654,14 +902,22 @@ bool RendererImpl::isRenderTargetFormatSupported(Format format) const {
 }
 
 
-BufferHandle RendererImpl::createBuffer(uint32_t size, const void *contents) {
+BufferHandle RendererImpl::createBuffer(BufferUsage usage, uint32_t size, const void *contents) {
 	assert(size != 0);
-	assert(contents != nullptr);
+	assert(contents != nullptr || usage == BufferUsage::Dynamic);
 
 	vk::BufferCreateInfo info;
 	info.size  = size;
 	// TODO: usage flags should be parameters
-	info.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst;
+	info.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst;
+
+	std::array<uint32_t, 2> queueFamilies = { { graphicsQueueIndex, transferQueueIndex } };
+	if (transferQueueIndex != graphicsQueueIndex) {
+		// TODO: use exclusive mode and queue family ownership transfers
+		info.sharingMode           = vk::SharingMode::eConcurrent;
+		info.queueFamilyIndexCount = 2;
+		info.pQueueFamilyIndices   = &queueFamilies[0];
+	}
 
 	auto result    = buffers.add();
 	Buffer &buffer = result.first;
@@ -678,67 +934,48 @@ BufferHandle RendererImpl::createBuffer(uint32_t size, const void *contents) {
 	assert(allocationInfo.size > 0);
 	assert(allocationInfo.pMappedData == nullptr);
 	device.bindBufferMemory(buffer.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
-	buffer.offset = static_cast<uint32_t>(allocationInfo.offset);
-	buffer.size   = static_cast<uint32_t>(allocationInfo.size);
+	// offset and size are within the buffer, not the memory allocation
+	buffer.offset = 0;
+	buffer.size   = size;
+	buffer.usage  = usage;
 
-	// copy contents to GPU memory
-	// TODO: pick proper alignment based on usage flags
-	unsigned int beginPtr = ringBufferAllocate(size, std::max(uboAlign, ssboAlign));
-	memcpy(persistentMapping + beginPtr, contents, size);
-
-	// TODO: reuse command buffer for multiple copies
-	// TODO: use transfer queue instead of main queue
-	// TODO: share some of this stuff with createTexture
-	// TODO:  this uses the wrong command pool if we're not in a frame
-	//        for example during startup
-	//        add separate command pool(s) for transfers
-	vk::CommandBufferAllocateInfo cmdInfo(frames.at(currentFrameIdx).commandPool, vk::CommandBufferLevel::ePrimary, 1);
-	auto cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
+	if (!contents) {
+		return result.second;
+	}
+
+	// copy contents to GPU memory via staging buffer
+	// the copy is batched with other uploads and next frame submit waits for it
+	unsigned int beginPtr = stagingBufferAllocate(size, 16);
+	memcpy(stagingMapping + beginPtr, contents, size);
 
 	vk::BufferCopy copyRegion;
 	copyRegion.srcOffset = beginPtr;
 	copyRegion.dstOffset = 0;
 	copyRegion.size      = size;
 
-	cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-	cmdBuf.copyBuffer(ringBuffer, buffer.buffer, 1, &copyRegion);
-	cmdBuf.end();
-
-	vk::SubmitInfo submit;
-	submit.waitSemaphoreCount   = 0;
-	submit.commandBufferCount   = 1;
-	submit.pCommandBuffers      = &cmdBuf;
-	submit.signalSemaphoreCount = 0;
-
-	queue.submit({ submit }, vk::Fence());
-
-	// TODO: don't wait for idle here, use fence to make frame submit wait for it
-	queue.waitIdle();
-	device.freeCommandBuffers(frames.at(currentFrameIdx).commandPool, { cmdBuf } );
+	auto cmdBuf = uploadCommandBuffer();
+	cmdBuf.copyBuffer(stagingBuffer, buffer.buffer, 1, &copyRegion);
 
 	return result.second;
 }
 
 
-BufferHandle RendererImpl::createEphemeralBuffer(uint32_t size, const void *contents) {
+EphemeralBuffer RendererImpl::createEphemeralBuffer(uint32_t size, const void *contents) {
 	assert(size != 0);
 	assert(contents != nullptr);
 
 	// TODO: pick proper alignment based on usage flags
-	unsigned int beginPtr = ringBufferAllocate(size, std::max(uboAlign, ssboAlign));
-
-	memcpy(persistentMapping + beginPtr, contents, size);
+	auto alloc = ringBufferAllocate(size, std::max(uboAlign, ssboAlign));
+	const auto &seg = ringSegments[alloc.segment];
 
-	auto result    = buffers.add();
-	Buffer &buffer = result.first;
-	buffer.buffer          = ringBuffer;
-	buffer.ringBufferAlloc = true;
-	buffer.offset          = beginPtr;
-	buffer.size            = size;
+	memcpy(seg.mapping + alloc.offset, contents, size);
 
-	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
+	EphemeralBuffer buffer;
+	buffer.segment = alloc.segment;
+	buffer.offset  = alloc.offset;
+	buffer.size    = size;
 
-	return result.second;
+	return buffer;
 }
 
 
@@ -748,6 +985,9 @@ static vk::ImageLayout vulkanLayout(Layout l) {
 		UNREACHABLE();
 		return vk::ImageLayout::eUndefined;
 
+	case Layout::Present:
+		return vk::ImageLayout::ePresentSrcKHR;
+
 	case Layout::ShaderRead:
 		return vk::ImageLayout::eShaderReadOnlyOptimal;
 
@@ -760,6 +1000,37 @@ static vk::ImageLayout vulkanLayout(Layout l) {
 }
 
 
+static vk::AttachmentLoadOp vulkanLoadOp(LoadOp op) {
+	switch (op) {
+	case LoadOp::Clear:
+		return vk::AttachmentLoadOp::eClear;
+
+	case LoadOp::DontCare:
+		return vk::AttachmentLoadOp::eDontCare;
+
+	case LoadOp::Load:
+		return vk::AttachmentLoadOp::eLoad;
+	}
+
+	UNREACHABLE();
+	return vk::AttachmentLoadOp::eDontCare;
+}
+
+
+static vk::AttachmentStoreOp vulkanStoreOp(StoreOp op) {
+	switch (op) {
+	case StoreOp::DontCare:
+		return vk::AttachmentStoreOp::eDontCare;
+
+	case StoreOp::Store:
+		return vk::AttachmentStoreOp::eStore;
+	}
+
+	UNREACHABLE();
+	return vk::AttachmentStoreOp::eDontCare;
+}
+
+
 FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 	std::vector<vk::ImageView> attachmentViews;
 	unsigned int width, height;
@@ -770,6 +1041,20 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 	// TODO: make sure renderPass formats match actual framebuffer attachments
 	const auto &pass = renderPasses.get(desc.renderPass_);
 	assert(pass.renderPass);
+
+	if (desc.colors_[0] == swapchainRenderTarget) {
+		// swapchain images have no depth buffer to go with them
+		assert(!desc.depthStencil_);
+		assert(pass.desc.colorFinalLayout_ == Layout::Present);
+
+		auto result     = framebuffers.add();
+		Framebuffer &fb = result.first;
+		fb.desc         = desc;
+		createSwapchainFramebuffers(fb);
+
+		return result.second;
+	}
+
 	{
 		const auto &colorRT = renderTargets.get(desc.colors_[0]);
 		assert(colorRT.width  > 0);
@@ -817,6 +1102,44 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 }
 
 
+void RendererImpl::createSwapchainFramebuffers(Framebuffer &fb) {
+	assert(fb.desc.colors_[0] == swapchainRenderTarget);
+	assert(!fb.framebuffer);
+	assert(fb.imageFramebuffers.empty());
+
+	const auto &pass = renderPasses.get(fb.desc.renderPass_);
+	assert(pass.renderPass);
+	const auto &rt   = renderTargets.get(swapchainRenderTarget);
+	assert(rt.width  > 0);
+	assert(rt.height > 0);
+
+	fb.width  = rt.width;
+	fb.height = rt.height;
+
+	vk::FramebufferCreateInfo fbInfo;
+	fbInfo.renderPass       = pass.renderPass;
+	fbInfo.attachmentCount  = 1;
+	fbInfo.width            = rt.width;
+	fbInfo.height           = rt.height;
+	fbInfo.layers           = 1;
+
+	fb.imageFramebuffers.reserve(swapchainImages.size());
+	for (const auto &img : swapchainImages) {
+		assert(img.imageView);
+		fbInfo.pAttachments = &img.imageView;
+		fb.imageFramebuffers.push_back(device.createFramebuffer(fbInfo));
+
+		if (debugMarkers) {
+			vk::DebugMarkerObjectNameInfoEXT markerName;
+			markerName.objectType  = vk::DebugReportObjectTypeEXT::eFramebuffer;
+			markerName.object      = uint64_t(VkFramebuffer(fb.imageFramebuffers.back()));
+			markerName.pObjectName = fb.desc.name_.c_str();
+			device.debugMarkerSetObjectNameEXT(&markerName);
+		}
+	}
+}
+
+
 RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 	vk::RenderPassCreateInfo info;
 	vk::SubpassDescription subpass;
@@ -850,6 +1173,9 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 	subpass.pColorAttachments    = &colorAttachments[0];
 
 	bool hasDepthStencil = (desc.depthStencilFormat_ != Format::Invalid);
+	assert(hasDepthStencil || desc.stencilLoadOp_ == LoadOp::DontCare);
+	assert(hasDepthStencil || desc.stencilStoreOp_ == StoreOp::DontCare);
+	assert(!hasDepthStencil || isStencilFormat(desc.depthStencilFormat_) || desc.stencilLoadOp_ == LoadOp::DontCare);
 	vk::AttachmentReference depthAttachment;
 	if (hasDepthStencil) {
 		vk::ImageLayout layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
@@ -859,12 +1185,15 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 		// TODO: these should be customizable via RenderPassDesc
 		attach.loadOp         = vk::AttachmentLoadOp::eClear;
 		attach.storeOp        = vk::AttachmentStoreOp::eStore;
-		// TODO: stencil
-		attach.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
-		attach.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		attach.initialLayout  = vk::ImageLayout::eUndefined;
-		// TODO: finalLayout should come from desc
-		attach.finalLayout    = vk::ImageLayout::eShaderReadOnlyOptimal;
+		attach.stencilLoadOp  = vulkanLoadOp(desc.stencilLoadOp_);
+		attach.stencilStoreOp = vulkanStoreOp(desc.stencilStoreOp_);
+		if (desc.stencilLoadOp_ == LoadOp::Load) {
+			// contents come from the previous pass which left it in the same layout
+			attach.initialLayout  = vulkanLayout(desc.depthStencilFinalLayout_);
+		} else {
+			attach.initialLayout  = vk::ImageLayout::eUndefined;
+		}
+		attach.finalLayout    = vulkanLayout(desc.depthStencilFinalLayout_);
 		attachments.push_back(attach);
 
 		depthAttachment.attachment = static_cast<uint32_t>(attachments.size()) - 1;
@@ -881,50 +1210,27 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 	info.subpassCount    = 1;
 	info.pSubpasses      = &subpass;
 
-	// subpass dependencies (external)
-	// TODO: are these really necessary?
-	std::vector<vk::SubpassDependency> dependencies;
-	dependencies.reserve(hasDepthStencil ? 4 : 2);
-	{
-		vk::SubpassDependency d;
-		d.srcSubpass       = VK_SUBPASS_EXTERNAL;
-		d.dstSubpass       = 0;
-		d.srcStageMask     = vk::PipelineStageFlagBits::eBottomOfPipe;
-		d.dstStageMask     = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		d.srcAccessMask    = vk::AccessFlagBits::eMemoryRead;
-		d.dstAccessMask    = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
-		d.dependencyFlags  = vk::DependencyFlagBits::eByRegion;
-		dependencies.push_back(d);
-
-		if (hasDepthStencil) {
-			d.dstStageMask     = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-			d.dstAccessMask    = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-			dependencies.push_back(d);
-		}
-	}
-	{
-		vk::SubpassDependency d;
-		d.srcSubpass       = 0;
-		d.dstSubpass       = VK_SUBPASS_EXTERNAL;
-		d.srcStageMask     = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		d.dstStageMask     = vk::PipelineStageFlagBits::eTopOfPipe;
-		d.srcAccessMask    = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
-		d.dstAccessMask    = vk::AccessFlagBits::eMemoryRead;
-		d.dependencyFlags  = vk::DependencyFlagBits::eByRegion;
-		dependencies.push_back(d);
-
-		if (hasDepthStencil) {
-			d.srcStageMask     = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-			d.srcAccessMask    = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-			dependencies.push_back(d);
-		}
+	// renderTargetBarriers orders render targets against the passes around them
+	// except the swapchain image which only has the acquire semaphore
+	// chain its layout transition to the semaphore wait
+	vk::SubpassDependency dependency;
+	if (desc.colorFinalLayout_ == Layout::Present) {
+		dependency.srcSubpass       = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass       = 0;
+		dependency.srcStageMask     = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		dependency.dstStageMask     = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		dependency.srcAccessMask    = vk::AccessFlags();
+		dependency.dstAccessMask    = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+		dependency.dependencyFlags  = vk::DependencyFlagBits::eByRegion;
+
+		info.dependencyCount = 1;
+		info.pDependencies   = &dependency;
 	}
-	info.dependencyCount = static_cast<uint32_t>(dependencies.size());
-	info.pDependencies   = &dependencies[0];
 
 	auto result   = renderPasses.add();
 	RenderPass &r = result.first;
 	r.renderPass  = device.createRenderPass(info);
+	r.desc        = desc;
 
 	if (debugMarkers) {
 		vk::DebugMarkerObjectNameInfoEXT markerName;
@@ -938,18 +1244,151 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 }
 
 
+PipelineHandle RendererImpl::createComputePipeline(const PipelineDesc &desc) {
+	assert(desc.computeShader_);
+	assert(!desc.vertexShader_);
+	assert(!desc.fragmentShader_);
+	assert(!desc.renderPass_);
+
+	const auto &c = computeShaders.get(desc.computeShader_);
+
+	std::vector<vk::DescriptorSetLayout> layouts;
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		if (desc.descriptorSetLayouts[i]) {
+			const auto &layout = dsLayouts.get(desc.descriptorSetLayouts[i]);
+			layouts.push_back(layout.layout);
+		}
+	}
+
+	vk::PipelineLayoutCreateInfo layoutInfo;
+	layoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+	layoutInfo.pSetLayouts    = layouts.empty() ? nullptr : layouts.data();
+
+	auto layout = device.createPipelineLayout(layoutInfo);
+
+	auto id = pipelines.add();
+	Pipeline &p = id.first;
+	p.layout    = layout;
+	p.bindPoint = vk::PipelineBindPoint::eCompute;
+
+	// the driver compiles on another thread, bindPipeline waits for it if necessary
+	vk::ShaderModule computeShader = c.shaderModule;
+	std::string      name          = desc.name_;
+	p.pending = std::async(std::launch::async, [this, computeShader, layout, name] () {
+		vk::ComputePipelineCreateInfo info;
+		info.stage.stage  = vk::ShaderStageFlagBits::eCompute;
+		info.stage.module = computeShader;
+		info.stage.pName  = "main";
+		info.layout       = layout;
+
+		auto result = device.createComputePipeline(vk::PipelineCache(), info);
+
+		if (debugMarkers) {
+			vk::DebugMarkerObjectNameInfoEXT markerName;
+			markerName.objectType  = vk::DebugReportObjectTypeEXT::ePipeline;
+			markerName.object      = uint64_t(VkPipeline(result));
+			markerName.pObjectName = name.c_str();
+
+			device.debugMarkerSetObjectNameEXT(&markerName);
+		}
+
+		return result;
+	});
+
+	return id.second;
+}
+
+
+static vk::CompareOp vulkanCompareOp(CompareOp op) {
+	switch (op) {
+	case CompareOp::Always:
+		return vk::CompareOp::eAlways;
+
+	case CompareOp::Equal:
+		return vk::CompareOp::eEqual;
+
+	case CompareOp::Never:
+		return vk::CompareOp::eNever;
+
+	case CompareOp::NotEqual:
+		return vk::CompareOp::eNotEqual;
+	}
+
+	UNREACHABLE();
+	return vk::CompareOp::eAlways;
+}
+
+
+static vk::StencilOp vulkanStencilOp(StencilOp op) {
+	switch (op) {
+	case StencilOp::Keep:
+		return vk::StencilOp::eKeep;
+
+	case StencilOp::Replace:
+		return vk::StencilOp::eReplace;
+
+	case StencilOp::Zero:
+		return vk::StencilOp::eZero;
+	}
+
+	UNREACHABLE();
+	return vk::StencilOp::eKeep;
+}
+
+
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
-	vk::GraphicsPipelineCreateInfo info;
+	PROFILE_FUNCTION();
+
+	if (desc.computeShader_) {
+		return createComputePipeline(desc);
+	}
 
 	const auto &v = vertexShaders.get(desc.vertexShader_);
 	const auto &f = fragmentShaders.get(desc.fragmentShader_);
+	const auto &renderPass = renderPasses.get(desc.renderPass_);
+
+	std::vector<vk::DescriptorSetLayout> layouts;
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		if (desc.descriptorSetLayouts[i]) {
+			const auto &layout = dsLayouts.get(desc.descriptorSetLayouts[i]);
+			layouts.push_back(layout.layout);
+		}
+	}
+
+	vk::PipelineLayoutCreateInfo layoutInfo;
+	layoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+	layoutInfo.pSetLayouts    = layouts.empty() ? nullptr : layouts.data();
+
+	auto layout = device.createPipelineLayout(layoutInfo);
+
+	auto id = pipelines.add();
+	Pipeline &p = id.first;
+	p.layout   = layout;
+	p.scissor  = desc.scissorTest_;
+
+	// the driver compiles on another thread, bindPipeline waits for it if necessary
+	vk::ShaderModule vertexShader   = v.shaderModule;
+	vk::ShaderModule fragmentShader = f.shaderModule;
+	vk::RenderPass   vkRenderPass   = renderPass.renderPass;
+	p.pending = std::async(std::launch::async, [this, desc, vertexShader, fragmentShader, vkRenderPass, layout] () {
+		return buildGraphicsPipeline(desc, vertexShader, fragmentShader, vkRenderPass, layout);
+	});
+
+	return id.second;
+}
+
+
+vk::Pipeline RendererImpl::buildGraphicsPipeline(const PipelineDesc &desc, vk::ShaderModule vertexShader, vk::ShaderModule fragmentShader, vk::RenderPass renderPass, vk::PipelineLayout layout) const {
+	PROFILE_FUNCTION();
+
+	vk::GraphicsPipelineCreateInfo info;
 
 	std::array<vk::PipelineShaderStageCreateInfo, 2> stages;
 	stages[0].stage  = vk::ShaderStageFlagBits::eVertex;
-	stages[0].module = v.shaderModule;
+	stages[0].module = vertexShader;
 	stages[0].pName  = "main";
 	stages[1].stage  = vk::ShaderStageFlagBits::eFragment;
-	stages[1].module = f.shaderModule;
+	stages[1].module = fragmentShader;
 	stages[1].pName  = "main";
 
 	info.stageCount = 2;
@@ -1036,6 +1475,20 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 	ds.depthTestEnable  = desc.depthTest_;
 	ds.depthWriteEnable = desc.depthWrite_;
 	ds.depthCompareOp   = vk::CompareOp::eLess;
+	if (desc.stencilTest_) {
+		vk::StencilOpState stencil;
+		stencil.failOp      = vk::StencilOp::eKeep;
+		stencil.passOp      = vulkanStencilOp(desc.stencilPass_);
+		stencil.depthFailOp = vk::StencilOp::eKeep;
+		stencil.compareOp   = vulkanCompareOp(desc.stencilCompare_);
+		stencil.compareMask = 0xFF;
+		stencil.writeMask   = 0xFF;
+		stencil.reference   = desc.stencilRef_;
+
+		ds.stencilTestEnable = true;
+		ds.front             = stencil;
+		ds.back              = stencil;
+	}
 	info.pDepthStencilState = &ds;
 
 	std::vector<vk::PipelineColorBlendAttachmentState> colorBlendStates;
@@ -1066,23 +1519,8 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 	dyn.pDynamicStates    = &dynStates[0];
 	info.pDynamicState    = &dyn;
 
-	std::vector<vk::DescriptorSetLayout> layouts;
-	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
-		if (desc.descriptorSetLayouts[i]) {
-			const auto &layout = dsLayouts.get(desc.descriptorSetLayouts[i]);
-			layouts.push_back(layout.layout);
-		}
-	}
-
-	vk::PipelineLayoutCreateInfo layoutInfo;
-	layoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
-	layoutInfo.pSetLayouts    = &layouts[0];
-
-	auto layout = device.createPipelineLayout(layoutInfo);
-	info.layout = layout;
-
-	const auto &renderPass = renderPasses.get(desc.renderPass_);
-	info.renderPass = renderPass.renderPass;
+	info.layout     = layout;
+	info.renderPass = renderPass;
 
 	auto result = device.createGraphicsPipeline(vk::PipelineCache(), info);
 
@@ -1095,13 +1533,31 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 		device.debugMarkerSetObjectNameEXT(&markerName);
 	}
 
-	auto id = pipelines.add();
-	Pipeline &p = id.first;
-	p.pipeline = result;
-	p.layout   = layout;
-	p.scissor  = desc.scissorTest_;
+	return result;
+}
 
-	return id.second;
+
+void RendererImpl::finishPipeline(Pipeline &p) {
+	assert(!p.pipeline);
+	assert(p.pending.valid());
+
+	// waits for the compiler if it's not done yet
+	p.pipeline = p.pending.get();
+}
+
+
+bool RendererImpl::isPipelineReady(PipelineHandle handle) {
+	auto &p = pipelines.get(handle);
+	if (p.pipeline) {
+		return true;
+	}
+
+	if (p.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		return false;
+	}
+
+	finishPipeline(p);
+	return true;
 }
 
 
@@ -1130,6 +1586,11 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	} else {
 		flags |= vk::ImageUsageFlagBits::eColorAttachment;
 	}
+	if (desc.storage_) {
+		assert(!isDepthFormat(desc.format_));
+		assert(!issRGBFormat(desc.format_));
+		flags |= vk::ImageUsageFlagBits::eStorage;
+	}
 	info.usage       = flags;
 
 	auto result = renderTargets.add();
@@ -1138,6 +1599,7 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	rt.height = desc.height_;
 	rt.image = device.createImage(info);
 	rt.format = format;
+	rt.desc   = desc;
 
 	auto texResult   = textures.add();
 	Texture &tex     = texResult.first;
@@ -1154,6 +1616,14 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 		device.debugMarkerSetObjectNameEXT(&markerNameImage);
 	}
 
+	// TODO: std::move ?
+	rt.texture = texResult.second;
+
+	// transient ones get memory and views from aliasRenderTargets
+	if (desc.transient_) {
+		return result.second;
+	}
+
 	VmaAllocationCreateInfo req = {};
 	req.usage          = VMA_MEMORY_USAGE_GPU_ONLY;
 	VmaAllocationInfo  allocationInfo = {};
@@ -1161,10 +1631,22 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	vmaAllocateMemoryForImage(allocator, rt.image, &req, &tex.memory, &allocationInfo);
 	device.bindImageMemory(rt.image, allocationInfo.deviceMemory, allocationInfo.offset);
 
+	createRenderTargetViews(rt);
+
+	return result.second;
+}
+
+
+void RendererImpl::createRenderTargetViews(RenderTarget &rt) {
+	assert(rt.image);
+	assert(!rt.imageView);
+	const auto &desc = rt.desc;
+	auto &tex        = textures.get(rt.texture);
+
 	vk::ImageViewCreateInfo viewInfo;
 	viewInfo.image    = rt.image;
 	viewInfo.viewType = vk::ImageViewType::e2D;
-	viewInfo.format   = format;
+	viewInfo.format   = rt.format;
 	if (isDepthFormat(desc.format_)) {
 		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
 	} else {
@@ -1172,8 +1654,16 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	}
 	viewInfo.subresourceRange.levelCount = 1;
 	viewInfo.subresourceRange.layerCount = 1;
-	rt.imageView = device.createImageView(viewInfo);
-	tex.imageView    = rt.imageView;
+	tex.imageView    = device.createImageView(viewInfo);
+
+	if (isStencilFormat(desc.format_)) {
+		// attachment view needs both aspects but sampled views can only have one
+		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+		rt.imageView = device.createImageView(viewInfo);
+		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
+	} else {
+		rt.imageView = tex.imageView;
+	}
 
 	if (debugMarkers) {
 		vk::DebugMarkerObjectNameInfoEXT markerNameImageView;
@@ -1183,9 +1673,6 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 		device.debugMarkerSetObjectNameEXT(&markerNameImageView);
 	}
 
-	// TODO: std::move ?
-	rt.texture = texResult.second;
-
 	if (desc.additionalViewFormat_ != Format::Invalid) {
 		assert(isDepthFormat(desc.format_) == isDepthFormat(desc.additionalViewFormat_));
 		auto viewResult   = textures.add();
@@ -1208,8 +1695,6 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 			device.debugMarkerSetObjectNameEXT(&markerNameImageView);
 		}
 	}
-
-	return result.second;
 }
 
 
@@ -1258,6 +1743,24 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 }
 
 
+ComputeShaderHandle RendererImpl::createComputeShader(const std::string &name, const ShaderMacros &macros) {
+	std::string computeShaderName = name + ".comp";
+
+	// no VULKAN_FLIP, compute doesn't go through the rasterizer
+	std::vector<uint32_t> spirv = compileSpirv(computeShaderName, macros, shaderc_glsl_compute_shader);
+
+	auto result_ = computeShaders.add();
+
+	ComputeShader &c = result_.first;
+	vk::ShaderModuleCreateInfo info;
+	info.codeSize = spirv.size() * 4;
+	info.pCode    = &spirv[0];
+	c.shaderModule = device.createShaderModule(info);
+
+	return result_.second;
+}
+
+
 VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, const ShaderMacros &macros) {
 	std::string vertexShaderName   = name + ".vert";
 
@@ -1298,6 +1801,24 @@ FragmentShaderHandle RendererImpl::createFragmentShader(const std::string &name,
 }
 
 
+bool RendererImpl::prepareShaders(const std::string &name, const ShaderMacros &macros) {
+	// must match create*Shader so the results are found there
+	ShaderMacros macros_(macros);
+	macros_.emplace("VULKAN_FLIP", "1");
+
+	bool vertexReady   = compileSpirvAsync(name + ".vert", macros_, shaderc_glsl_vertex_shader);
+	bool fragmentReady = compileSpirvAsync(name + ".frag", macros_, shaderc_glsl_fragment_shader);
+
+	return vertexReady && fragmentReady;
+}
+
+
+bool RendererImpl::prepareComputeShader(const std::string &name, const ShaderMacros &macros) {
+	// must match createComputeShader, no VULKAN_FLIP
+	return compileSpirvAsync(name + ".comp", macros, shaderc_glsl_compute_shader);
+}
+
+
 TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	assert(desc.width_   > 0);
 	assert(desc.height_  > 0);
@@ -1318,6 +1839,14 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	assert(desc.format_ != Format::Depth16);
 	info.usage       = flags;
 
+	std::array<uint32_t, 2> queueFamilies = { { graphicsQueueIndex, transferQueueIndex } };
+	if (transferQueueIndex != graphicsQueueIndex) {
+		// TODO: use exclusive mode and queue family ownership transfers
+		info.sharingMode           = vk::SharingMode::eConcurrent;
+		info.queueFamilyIndexCount = 2;
+		info.pQueueFamilyIndices   = &queueFamilies[0];
+	}
+
 	auto result = textures.add();
 	Texture &tex = result.first;
 	tex.width  = desc.width_;
@@ -1357,93 +1886,80 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 		device.debugMarkerSetObjectNameEXT(&markerNameImageView);
 	}
 
-	// TODO: reuse command buffer for multiple copies
-	// TODO: use transfer queue instead of main queue
-	// TODO: share some of this stuff with createBuffer
-	// FIXME: this uses the wrong command bool if we're not in a frame
-	//        for example during startup
-	//        add separate command pool(s) for transfers
-	vk::CommandBufferAllocateInfo cmdInfo(frames.at(currentFrameIdx).commandPool, vk::CommandBufferLevel::ePrimary, 1);
-	auto cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
-
-	cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
-	// transition to transfer destination
+	// copy contents via staging buffer
+	// allocate all mip levels at once so a flush in between can't recycle earlier ones
+	std::vector<vk::BufferImageCopy> regions;
 	{
-		vk::ImageSubresourceRange range;
-		range.aspectMask            = vk::ImageAspectFlagBits::eColor;
-		range.baseMipLevel          = 0;
-		range.levelCount            = VK_REMAINING_MIP_LEVELS;
-		range.baseArrayLayer        = 0;
-		range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
-
-		vk::ImageMemoryBarrier barrier;
-		barrier.srcAccessMask        = vk::AccessFlagBits();
-		barrier.dstAccessMask        = vk::AccessFlagBits::eTransferWrite;
-		barrier.oldLayout            = vk::ImageLayout::eUndefined;
-		barrier.newLayout            = vk::ImageLayout::eTransferDstOptimal;
-		barrier.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
-		barrier.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
-		barrier.image                = tex.image;
-		barrier.subresourceRange     = range;
-
-		// TODO: relax stage flag bits
-		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {}, {}, { barrier });
+		unsigned int totalSize = 0;
+		for (unsigned int i = 0; i < desc.numMips_; i++) {
+			assert(desc.mipData_[i].data != nullptr);
+			assert(desc.mipData_[i].size != 0);
+			totalSize = (totalSize + 255) & ~255U;
+			totalSize += desc.mipData_[i].size;
+		}
 
-		// copy contents via ring buffer
-		std::vector<vk::BufferImageCopy> regions;
+		unsigned int beginPtr = stagingBufferAllocate(totalSize, 256);
 
 		vk::ImageSubresourceLayers layers;
 		layers.aspectMask = vk::ImageAspectFlagBits::eColor;
 		layers.layerCount = 1;
 
 		unsigned int w = desc.width_, h = desc.height_;
+		unsigned int offset = 0;
 		for (unsigned int i = 0; i < desc.numMips_; i++) {
-			assert(desc.mipData_[i].data != nullptr);
-			assert(desc.mipData_[i].size != 0);
 			unsigned int size = desc.mipData_[i].size;
-
-			// copy contents to GPU memory
-			unsigned int beginPtr = ringBufferAllocate(size, 256);
-			memcpy(persistentMapping + beginPtr, desc.mipData_[i].data, size);
+			offset = (offset + 255) & ~255U;
+			memcpy(stagingMapping + beginPtr + offset, desc.mipData_[i].data, size);
 
 			layers.mipLevel = i;
 
 			vk::BufferImageCopy region;
-			region.bufferOffset     = beginPtr;
+			region.bufferOffset     = beginPtr + offset;
 			// leave row length and image height 0 for tight packing
 			region.imageSubresource = layers;
 			region.imageExtent      = vk::Extent3D(w, h, 1);
 			regions.push_back(region);
 
+			offset += size;
 			w = std::max(w / 2, 1u);
 			h = std::max(h / 2, 1u);
 		}
-		cmdBuf.copyBufferToImage(ringBuffer, tex.image, vk::ImageLayout::eTransferDstOptimal, regions);
+	}
+
+	auto cmdBuf = uploadCommandBuffer();
+
+	// transition to transfer destination
+	{
+		vk::ImageSubresourceRange range;
+		range.aspectMask            = vk::ImageAspectFlagBits::eColor;
+		range.baseMipLevel          = 0;
+		range.levelCount            = VK_REMAINING_MIP_LEVELS;
+		range.baseArrayLayer        = 0;
+		range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
+
+		vk::ImageMemoryBarrier barrier;
+		barrier.srcAccessMask        = vk::AccessFlagBits();
+		barrier.dstAccessMask        = vk::AccessFlagBits::eTransferWrite;
+		barrier.oldLayout            = vk::ImageLayout::eUndefined;
+		barrier.newLayout            = vk::ImageLayout::eTransferDstOptimal;
+		barrier.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image                = tex.image;
+		barrier.subresourceRange     = range;
+
+		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { barrier });
+
+		cmdBuf.copyBufferToImage(stagingBuffer, tex.image, vk::ImageLayout::eTransferDstOptimal, regions);
 
 		// transition to shader use
+		// transfer queue can't name shader stages, the frame's semaphore wait makes the writes visible
 		barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
-		barrier.dstAccessMask       = vk::AccessFlagBits::eShaderRead;
+		barrier.dstAccessMask       = vk::AccessFlagBits();
 		barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
 		barrier.newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
-		// TODO: relax stage flag bits
-		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {}, {}, { barrier });
+		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), {}, {}, { barrier });
 	}
 
-	cmdBuf.end();
-
-	vk::SubmitInfo submit;
-	submit.waitSemaphoreCount   = 0;
-	submit.commandBufferCount   = 1;
-	submit.pCommandBuffers      = &cmdBuf;
-	submit.signalSemaphoreCount = 0;
-
-	queue.submit({ submit }, vk::Fence());
-
-	// TODO: don't wait for idle here, use fence to make frame submit wait for it
-	queue.waitIdle();
-	device.freeCommandBuffers(frames.at(currentFrameIdx).commandPool, { cmdBuf } );
-
 	return result.second;
 }
 
@@ -1502,6 +2018,12 @@ TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle handle, Forma
 }
 
 
+bool RendererImpl::isTextureReady(TextureHandle /* handle */) const {
+	// uploads are always complete before the next frame's commands execute
+	return true;
+}
+
+
 void RendererImpl::deleteBuffer(BufferHandle handle) {
 	buffers.removeWith(handle, [this](struct Buffer &b) {
 		// TODO: if b.lastUsedFrame has already been synced we could delete immediately
@@ -1510,6 +2032,50 @@ void RendererImpl::deleteBuffer(BufferHandle handle) {
 }
 
 
+void RendererImpl::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(size != 0);
+	assert(contents != nullptr);
+
+	auto &buffer = buffers.get(handle);
+	assert(buffer.usage == BufferUsage::Dynamic);
+	assert(buffer.buffer);
+	assert(offset + size <= buffer.size);
+	buffer.lastUsedFrame = frameNum;
+
+	// stage new contents in the ringbuffer, it's already multi-buffered per frame
+	auto alloc = ringBufferAllocate(size, 16);
+	const auto &seg = ringSegments[alloc.segment];
+	memcpy(seg.mapping + alloc.offset, contents, size);
+
+	const vk::PipelineStageFlags readStages = vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+
+	// earlier frames and draws might still be reading the old contents
+	// or compute shaders writing them
+	// barrier applies to everything submitted before on this queue so nothing waits on the CPU
+	vk::BufferMemoryBarrier barrier;
+	barrier.srcAccessMask       = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = buffer.buffer;
+	barrier.offset              = buffer.offset + offset;
+	barrier.size                = size;
+	currentCommandBuffer.pipelineBarrier(readStages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, { barrier }, {});
+
+	vk::BufferCopy copyRegion;
+	copyRegion.srcOffset = alloc.offset;
+	copyRegion.dstOffset = buffer.offset + offset;
+	copyRegion.size      = size;
+	currentCommandBuffer.copyBuffer(seg.buffer, buffer.buffer, 1, &copyRegion);
+
+	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask       = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readStages, vk::DependencyFlags(), {}, { barrier }, {});
+}
+
+
 void RendererImpl::deleteFramebuffer(FramebufferHandle handle) {
 	framebuffers.removeWith(handle, [this](Framebuffer &fb) {
 		// TODO: if lastUsedFrame has already been synced we could delete immediately
@@ -1527,6 +2093,8 @@ void RendererImpl::deleteRenderPass(RenderPassHandle handle) {
 
 
 void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
+	assert(!(handle == swapchainRenderTarget));
+
 	renderTargets.removeWith(handle, [this](struct RenderTarget &rt) {
 		// TODO: if lastUsedFrame has already been synced we could delete immediately
 		this->deleteResources.emplace(std::move(rt));
@@ -1534,6 +2102,66 @@ void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 }
 
 
+bool RendererImpl::canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const {
+	assert(!rts.empty());
+
+	// images of any format can share memory if there's a memory type all of them accept
+	uint32_t memoryTypeBits = ~0U;
+	for (const auto &handle : rts) {
+		const auto &rt = renderTargets.get(handle);
+		if (!rt.desc.transient_ || rt.imageView) {
+			return false;
+		}
+
+		auto req = device.getImageMemoryRequirements(rt.image);
+		memoryTypeBits &= req.memoryTypeBits;
+	}
+
+	return (memoryTypeBits != 0);
+}
+
+
+void RendererImpl::aliasRenderTargets(const std::vector<RenderTargetHandle> &rts) {
+	assert(canAliasRenderTargets(rts));
+
+	VkMemoryRequirements memReq = {};
+	memReq.memoryTypeBits = ~0U;
+	uint64_t totalSize    = 0;
+	for (const auto &handle : rts) {
+		auto req = device.getImageMemoryRequirements(renderTargets.get(handle).image);
+		memReq.size            = std::max(memReq.size,      req.size);
+		memReq.alignment       = std::max(memReq.alignment, req.alignment);
+		memReq.memoryTypeBits &= req.memoryTypeBits;
+		totalSize             += req.size;
+	}
+
+	VmaAllocationCreateInfo req = {};
+	req.usage          = VMA_MEMORY_USAGE_GPU_ONLY;
+	VmaAllocationInfo  allocationInfo = {};
+
+	// first one owns the memory and frees it when deleted
+	auto &owner = renderTargets.get(rts[0]);
+	auto &tex   = textures.get(owner.texture);
+	assert(tex.memory == nullptr);
+	auto result = vmaAllocateMemory(allocator, &memReq, &req, &tex.memory, &allocationInfo);
+
+	if (result != VK_SUCCESS) {
+		LOG("vmaAllocateMemory failed: %s\n", vk::to_string(vk::Result(result)).c_str());
+		throw std::runtime_error("vmaAllocateMemory failed");
+	}
+	assert(tex.memory != nullptr);
+
+	for (const auto &handle : rts) {
+		auto &rt = renderTargets.get(handle);
+		device.bindImageMemory(rt.image, allocationInfo.deviceMemory, allocationInfo.offset);
+		createRenderTargetViews(rt);
+	}
+
+	owner.aliasedBytes  = totalSize - memReq.size;
+	aliasedBytes       += owner.aliasedBytes;
+}
+
+
 void RendererImpl::deleteSampler(SamplerHandle handle) {
 	samplers.removeWith(handle, [this](struct Sampler &s) {
 		// TODO: if lastUsedFrame has already been synced we could delete immediately
@@ -1632,6 +2260,25 @@ static const std::array<vk::PresentModeKHR, numPresentModes> &vsyncMode(VSync mo
 void RendererImpl::recreateSwapchain() {
 	assert(swapchainDirty);
 
+	// earlier frames might still be rendering to the old images
+	// swapchain is not recreated often enough for this wait to matter
+	if (swapchain) {
+		device.waitIdle();
+
+		framebuffers.forEach([this] (Framebuffer &fb) {
+			for (auto &f : fb.imageFramebuffers) {
+				device.destroyFramebuffer(f);
+			}
+			fb.imageFramebuffers.clear();
+		} );
+
+		for (auto &i : swapchainImages) {
+			device.destroyImageView(i.imageView);
+			device.destroySemaphore(i.renderDoneSem);
+		}
+		swapchainImages.clear();
+	}
+
 	surfaceCapabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
 	LOG("image count min-max %u - %u\n", surfaceCapabilities.minImageCount, surfaceCapabilities.maxImageCount);
 	LOG("image extent min-max %ux%u - %ux%u\n", surfaceCapabilities.minImageExtent.width, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.width, surfaceCapabilities.maxImageExtent.height);
@@ -1656,22 +2303,24 @@ void RendererImpl::recreateSwapchain() {
 	swapchainDesc.width  = w;
 	swapchainDesc.height = h;
 
-	unsigned int numImages = wantedSwapchain.numFrames;
-	numImages = std::max(numImages, surfaceCapabilities.minImageCount);
+	// frames in flight are exactly what was asked for
+	// image count is only a request, the surface has limits and the driver can add more
+	unsigned int numFrames = std::max(wantedSwapchain.numFrames, 1U);
+	unsigned int numImages = std::max(numFrames, surfaceCapabilities.minImageCount);
 	if (surfaceCapabilities.maxImageCount != 0) {
 		numImages = std::min(numImages, surfaceCapabilities.maxImageCount);
 	}
 
-	LOG("Want %u images, using %u images\n", wantedSwapchain.numFrames, numImages);
+	LOG("Want %u frames in flight, asking for %u images\n", wantedSwapchain.numFrames, numImages);
 
 	swapchainDesc.fullscreen = wantedSwapchain.fullscreen;
-	swapchainDesc.numFrames  = numImages;
+	swapchainDesc.numFrames  = numFrames;
 	swapchainDesc.vsync      = wantedSwapchain.vsync;
 
-	if (frames.size() != numImages) {
-		if (numImages < frames.size()) {
+	if (frames.size() != numFrames) {
+		if (numFrames < frames.size()) {
 			// decreasing, delete old and resize
-			for (unsigned int i = numImages; i < frames.size(); i++) {
+			for (unsigned int i = numFrames; i < frames.size(); i++) {
 				auto &f = frames.at(i);
 				if (f.outstanding) {
 					// wait until complete
@@ -1681,11 +2330,11 @@ void RendererImpl::recreateSwapchain() {
 				// delete contents of Frame
 				deleteFrameInternal(f);
 			}
-			frames.resize(numImages);
+			frames.resize(numFrames);
 		} else {
 			// increasing, resize and initialize new
 			unsigned int oldSize = static_cast<unsigned int>(frames.size());
-			frames.resize(numImages);
+			frames.resize(numFrames);
 
 			// descriptor pool
 			// TODO: these limits are arbitrary, find better ones
@@ -1710,8 +2359,8 @@ void RendererImpl::recreateSwapchain() {
 				assert(!f.fence);
 				f.fence = device.createFence(vk::FenceCreateInfo());
 
-				// we fill this in after we've created the swapchain
-				assert(!f.image);
+				assert(!f.acquireSem);
+				f.acquireSem = device.createSemaphore(vk::SemaphoreCreateInfo());
 
 				assert(!f.dsPool);
 				f.dsPool = device.createDescriptorPool(dsInfo);
@@ -1725,6 +2374,17 @@ void RendererImpl::recreateSwapchain() {
 				auto bufs = device.allocateCommandBuffers(info);
 				assert(bufs.size() == 1);
 				f.commandBuffer = bufs.at(0);
+
+				assert(!f.uploadSemaphore);
+				f.uploadSemaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
+
+				assert(!f.queryPool);
+				if (timestampValidBits != 0) {
+					vk::QueryPoolCreateInfo qp;
+					qp.queryType  = vk::QueryType::eTimestamp;
+					qp.queryCount = 2 * MAX_TIMESTAMP_SCOPES;
+					f.queryPool = device.createQueryPool(qp);
+				}
 			}
 		}
 	}
@@ -1773,7 +2433,8 @@ void RendererImpl::recreateSwapchain() {
 	swapchainCreateInfo.imageColorSpace       = vk::ColorSpaceKHR::eSrgbNonlinear;
 	swapchainCreateInfo.imageExtent           = imageExtent;
 	swapchainCreateInfo.imageArrayLayers      = 1;
-	swapchainCreateInfo.imageUsage            = vk::ImageUsageFlagBits::eTransferDst;
+	// color attachment when the last pass renders there directly, transfer dst otherwise
+	swapchainCreateInfo.imageUsage            = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eColorAttachment;
 
 	// no concurrent access
 	swapchainCreateInfo.imageSharingMode      = vk::SharingMode::eExclusive;
@@ -1793,14 +2454,48 @@ void RendererImpl::recreateSwapchain() {
 	}
 	swapchain = newSwapchain;
 
-	std::vector<vk::Image> swapchainImages = device.getSwapchainImagesKHR(swapchain);
-	assert(swapchainImages.size() == frames.size());
-	assert(swapchainImages.size() == numImages);
+	std::vector<vk::Image> images = device.getSwapchainImagesKHR(swapchain);
+	assert(images.size() >= numImages);
+	LOG("Got %u swapchain images for %u frames in flight\n", static_cast<unsigned int>(images.size()), numFrames);
+
+	vk::ImageViewCreateInfo viewInfo;
+	viewInfo.viewType                    = vk::ImageViewType::e2D;
+	viewInfo.format                      = surfaceFormat;
+	viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	assert(swapchainImages.empty());
+	swapchainImages.resize(images.size());
+	for (unsigned int i = 0; i < images.size(); i++) {
+		auto &img         = swapchainImages.at(i);
+		img.image         = images.at(i);
+		viewInfo.image    = img.image;
+		img.imageView     = device.createImageView(viewInfo);
+		img.renderDoneSem = device.createSemaphore(vk::SemaphoreCreateInfo());
+	}
 
-	for (unsigned int i = 0; i < numImages; i++) {
-		frames.at(i).image = swapchainImages.at(i);
+	// no image or memory of its own, those come from the acquired swapchain image
+	if (!swapchainRenderTarget) {
+		auto result           = renderTargets.add();
+		swapchainRenderTarget = result.second;
+	}
+	swapchainFormat = Format::sBGRA8;
+	assert(vulkanFormat(swapchainFormat) == surfaceFormat);
+	{
+		auto &rt  = renderTargets.get(swapchainRenderTarget);
+		rt.width  = swapchainDesc.width;
+		rt.height = swapchainDesc.height;
+		rt.format = surfaceFormat;
+		rt.desc.width(swapchainDesc.width).height(swapchainDesc.height).format(swapchainFormat).name("swapchain");
 	}
 
+	framebuffers.forEach([this] (Framebuffer &fb) {
+		if (fb.desc.colors_[0] == swapchainRenderTarget) {
+			createSwapchainFramebuffers(fb);
+		}
+	} );
+
 	swapchainDirty = false;
 }
 
@@ -1814,11 +2509,14 @@ MemoryStats RendererImpl::getMemStats() const {
 	stats.subAllocationCount = vmaStats.total.unusedRangeCount;
 	stats.usedBytes          = vmaStats.total.usedBytes;
 	stats.unusedBytes        = vmaStats.total.unusedBytes;
+	stats.aliasedBytes       = aliasedBytes;
 	return stats;
 }
 
 
 void RendererImpl::beginFrame() {
+	PROFILE_FUNCTION();
+
 	assert(!inFrame);
 	inFrame       = true;
 	inRenderPass  = false;
@@ -1830,8 +2528,19 @@ void RendererImpl::beginFrame() {
 		assert(!swapchainDirty);
 	}
 
+	currentFrameIdx        = frameNum % frames.size();
+	assert(currentFrameIdx < frames.size());
+
+	// frames are a ringbuffer
+	// if the frame we want to reuse is still pending on the GPU, wait for it
+	// its acquire semaphore is free again after that
+	if (frames.at(currentFrameIdx).outstanding) {
+		waitForFrame(currentFrameIdx);
+	}
+	assert(!frames.at(currentFrameIdx).outstanding);
+
 	// acquire next image
-	auto imageIdx_         = device.acquireNextImageKHR(swapchain, UINT64_MAX, acquireSem, vk::Fence());
+	auto imageIdx_         = device.acquireNextImageKHR(swapchain, UINT64_MAX, frames.at(currentFrameIdx).acquireSem, vk::Fence());
 	if (imageIdx_.result == vk::Result::eSuccess) {
 		// nothing to do
 	} else if (imageIdx_.result == vk::Result::eErrorOutOfDateKHR) {
@@ -1841,7 +2550,7 @@ void RendererImpl::beginFrame() {
 		recreateSwapchain();
 		assert(!swapchainDirty);
 
-		imageIdx_ = device.acquireNextImageKHR(swapchain, UINT64_MAX, acquireSem, vk::Fence());
+		imageIdx_ = device.acquireNextImageKHR(swapchain, UINT64_MAX, frames.at(currentFrameIdx).acquireSem, vk::Fence());
 		if (imageIdx_.result != vk::Result::eSuccess) {
 			// nope, still wrong
 			LOG("acquireNextImageKHR failed: %s\n", vk::to_string(imageIdx_.result).c_str());
@@ -1853,16 +2562,12 @@ void RendererImpl::beginFrame() {
 		throw std::runtime_error("acquireNextImageKHR failed");
 	}
 
-	currentFrameIdx        = imageIdx_.value;
-	assert(currentFrameIdx < frames.size());
+	currentImageIdx        = imageIdx_.value;
+	assert(currentImageIdx < swapchainImages.size());
 	auto &frame            = frames.at(currentFrameIdx);
 
-	// frames are a ringbuffer
-	// if the frame we want to reuse is still pending on the GPU, wait for it
-	if (frame.outstanding) {
-		waitForFrame(currentFrameIdx);
-	}
-	assert(!frame.outstanding);
+	// freshly acquired image, contents are undefined
+	renderTargets.get(swapchainRenderTarget).currentLayout = Layout::Invalid;
 
 	device.resetFences( { frame.fence } );
 
@@ -1870,6 +2575,10 @@ void RendererImpl::beginFrame() {
 	currentCommandBuffer = frame.commandBuffer;
 	currentCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+	if (frame.queryPool) {
+		currentCommandBuffer.resetQueryPool(frame.queryPool, 0, 2 * MAX_TIMESTAMP_SCOPES);
+	}
+
 	currentPipelineLayout = vk::PipelineLayout();
 
 	// mark buffers deleted during gap between frames to be deleted when this frame has synced
@@ -1883,7 +2592,10 @@ void RendererImpl::beginFrame() {
 
 
 void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
+	PROFILE_FUNCTION();
+
 	assert(inFrame);
+	assert(!inTimestampScope);
 	inFrame = false;
 
 	const auto &rt = renderTargets.get(rtHandle);
@@ -1891,15 +2603,10 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 	auto &frame = frames.at(currentFrameIdx);
 	device.resetFences( { frame.fence } );
 
-	vk::Image image        = frame.image;
-	vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal;
+	const auto &swapchainImage = swapchainImages.at(currentImageIdx);
+	vk::Image image            = swapchainImage.image;
 
-	// transition image to transfer dst optimal
 	vk::ImageMemoryBarrier barrier;
-	barrier.srcAccessMask       = vk::AccessFlagBits();
-	barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
-	barrier.oldLayout           = vk::ImageLayout::eUndefined;
-	barrier.newLayout           = layout;
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image               = image;
@@ -1912,49 +2619,97 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 	range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
 	barrier.subresourceRange    = range;
 
-	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+	// first stage touching the swapchain image, acquireSem is waited for there
+	vk::PipelineStageFlags acquireStage;
 
-	vk::ImageBlit blit;
-	blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	blit.srcSubresource.layerCount = 1;
-	blit.srcOffsets[1]             = vk::Offset3D(rt.width, rt.height, 1);
-	blit.dstSubresource            = blit.srcSubresource;
-	blit.dstOffsets[1]             = blit.srcOffsets[1];
+	if (rtHandle == swapchainRenderTarget) {
+		// the last render pass drew straight into the swapchain image
+		acquireStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
 
-	// blit draw image to presentation image
-	currentCommandBuffer.blitImage(rt.image, vk::ImageLayout::eTransferSrcOptimal, image, layout, { blit }, vk::Filter::eNearest);
+		if (rt.currentLayout == Layout::Invalid) {
+			// nothing rendered this frame but present still needs the layout
+			barrier.srcAccessMask       = vk::AccessFlagBits();
+			barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
+			barrier.oldLayout           = vk::ImageLayout::eUndefined;
+			barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
+			currentCommandBuffer.pipelineBarrier(acquireStage, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+		} else {
+			assert(rt.currentLayout == Layout::Present);
+		}
+	} else {
+		assert(rt.currentLayout == Layout::TransferSrc);
+		acquireStage = vk::PipelineStageFlagBits::eTransfer;
 
-	// transition to present
-	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
-	barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
-	barrier.oldLayout           = layout;
-	barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
-	barrier.image               = image;
-	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+		vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal;
+
+		// transition image to transfer dst optimal
+		barrier.srcAccessMask       = vk::AccessFlagBits();
+		barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+		barrier.oldLayout           = vk::ImageLayout::eUndefined;
+		barrier.newLayout           = layout;
+
+		// waits for acquireSem which is waited for in the transfer stage
+		currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+
+		vk::ImageBlit blit;
+		blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[1]             = vk::Offset3D(rt.width, rt.height, 1);
+		blit.dstSubresource            = blit.srcSubresource;
+		blit.dstOffsets[1]             = blit.srcOffsets[1];
+
+		// blit draw image to presentation image
+		currentCommandBuffer.blitImage(rt.image, vk::ImageLayout::eTransferSrcOptimal, image, layout, { blit }, vk::Filter::eNearest);
+
+		// transition to present
+		barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
+		barrier.oldLayout           = layout;
+		barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
+		// renderDoneSem signal covers everything so no need to wait here
+		currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+	}
 
 	// submit command buffer
-	// TODO: reduce wait mask
-	vk::PipelineStageFlags acquireWaitStage = vk::PipelineStageFlagBits::eAllCommands;
+	// swapchain image is only touched by the blit or the last render pass
+	// uploads can be consumed anywhere
+	std::array<vk::Semaphore, 2>          waitSemaphores = { { frame.acquireSem, frame.uploadSemaphore } };
+	std::array<vk::PipelineStageFlags, 2> waitStages     = { { acquireStage, vk::PipelineStageFlagBits::eAllCommands } };
+	uint32_t                              numWaits       = 1;
+
+	// if there were uploads make this frame wait for them
+	// semaphore signal covers all earlier submissions on the transfer queue
+	// so one signal is enough no matter how many batches there were
+	flushUploads();
+	if (uploadsPending) {
+		vk::SubmitInfo uploadSubmit;
+		uploadSubmit.signalSemaphoreCount = 1;
+		uploadSubmit.pSignalSemaphores    = &frame.uploadSemaphore;
+		transferQueue.submit({ uploadSubmit }, vk::Fence());
+
+		uploadsPending = false;
+		numWaits       = 2;
+	}
 
 	currentCommandBuffer.end();
 	vk::SubmitInfo submit;
-	submit.waitSemaphoreCount   = 1;
-	submit.pWaitSemaphores      = &acquireSem;
-	submit.pWaitDstStageMask    = &acquireWaitStage;
+	submit.waitSemaphoreCount   = numWaits;
+	submit.pWaitSemaphores      = &waitSemaphores[0];
+	submit.pWaitDstStageMask    = &waitStages[0];
 	submit.commandBufferCount   = 1;
 	submit.pCommandBuffers      = &currentCommandBuffer;
 	submit.signalSemaphoreCount = 1;
-	submit.pSignalSemaphores    = &renderDoneSem;
+	submit.pSignalSemaphores    = &swapchainImage.renderDoneSem;
 
 	queue.submit({ submit }, frame.fence);
 
 	// present
 	vk::PresentInfoKHR presentInfo;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores    = &renderDoneSem;
+	presentInfo.pWaitSemaphores    = &swapchainImage.renderDoneSem;
 	presentInfo.swapchainCount     = 1;
 	presentInfo.pSwapchains        = &swapchain;
-	presentInfo.pImageIndices      = &currentFrameIdx;
+	presentInfo.pImageIndices      = &currentImageIdx;
 
 	auto presentResult = queue.presentKHR(&presentInfo);
 	if (presentResult == vk::Result::eSuccess) {
@@ -1967,7 +2722,7 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 		LOG("presentKHR failed: %s\n", vk::to_string(presentResult).c_str());
 		throw std::runtime_error("presentKHR failed");
 	}
-	frame.usedRingBufPtr = ringBufPtr;
+	ringBufferEndFrame(frame);
 	frame.outstanding = true;
 	frame.lastFrameNum = frameNum;
 
@@ -1997,7 +2752,30 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 
 	frame.outstanding    = false;
 	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
-	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+
+	// the fence has signaled so query results are available without waiting
+	frameTimings.clear();
+	if (!frame.timestampScopes.empty()) {
+		assert(frame.queryPool);
+		unsigned int numQueries = static_cast<unsigned int>(2 * frame.timestampScopes.size());
+		std::array<uint64_t, 2 * MAX_TIMESTAMP_SCOPES> results;
+		auto queryResult = device.getQueryPoolResults(frame.queryPool, 0, numQueries, numQueries * sizeof(uint64_t), &results[0], sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+		if (queryResult == vk::Result::eSuccess) {
+			const uint64_t mask = (timestampValidBits < 64) ? ((uint64_t(1) << timestampValidBits) - 1) : ~uint64_t(0);
+			for (unsigned int i = 0; i < frame.timestampScopes.size(); i++) {
+				uint64_t ticks = (results[2 * i + 1] - results[2 * i]) & mask;
+
+				GPUTiming t;
+				t.name         = std::move(frame.timestampScopes.at(i));
+				t.milliseconds = double(ticks) * deviceProperties.limits.timestampPeriod / 1000000.0;
+				frameTimings.push_back(std::move(t));
+			}
+		} else {
+			LOG("getQueryPoolResults failed: %s\n", vk::to_string(queryResult).c_str());
+		}
+		frame.timestampScopes.clear();
+	}
+	updateTimingHistory();
 
 	// reset per-frame pools
 	device.resetCommandPool(frame.commandPool, vk::CommandPoolResetFlags());
@@ -2008,32 +2786,17 @@ void RendererImpl::waitForFrame(unsigned int frameIdx) {
 	}
 	frame.deleteResources.clear();
 
-	for (auto handle : frame.ephemeralBuffers) {
-		Buffer &buffer = buffers.get(handle);
-		assert(buffer.size   >  0);
-
-		buffer.buffer          = vk::Buffer();
-		buffer.ringBufferAlloc = false;
-		buffer.memory          = 0;
-		buffer.size            = 0;
-		buffer.offset          = 0;
-		buffer.lastUsedFrame   = 0;
-
-		buffers.remove(handle);
-	}
-	frame.ephemeralBuffers.clear();
+	ringBufferRetireFrame(frame);
 }
 
 
 void RendererImpl::deleteBufferInternal(Buffer &b) {
-	assert(!b.ringBufferAlloc);
 	assert(b.lastUsedFrame <= lastSyncedFrame);
 	this->device.destroyBuffer(b.buffer);
 	assert(b.memory != nullptr);
 	vmaFreeMemory(this->allocator, b.memory);
 
 	b.buffer          = vk::Buffer();
-	b.ringBufferAlloc = false;
 	b.memory          = 0;
 	b.size            = 0;
 	b.offset          = 0;
@@ -2044,6 +2807,10 @@ void RendererImpl::deleteBufferInternal(Buffer &b) {
 void RendererImpl::deleteFramebufferInternal(Framebuffer &fb) {
 	device.destroyFramebuffer(fb.framebuffer);
 	fb.framebuffer = vk::Framebuffer();
+	for (auto &f : fb.imageFramebuffers) {
+		device.destroyFramebuffer(f);
+	}
+	fb.imageFramebuffers.clear();
 	fb.width       = 0;
 	fb.height      = 0;
 }
@@ -2053,7 +2820,11 @@ void RendererImpl::deleteRenderTargetInternal(RenderTarget &rt) {
 	assert(rt.texture);
 	auto &tex = this->textures.get(rt.texture);
 	assert(tex.image == rt.image);
-	assert(tex.imageView == rt.imageView);
+	assert(tex.imageView);
+	if (tex.imageView != rt.imageView) {
+		// separate depth+stencil attachment view
+		this->device.destroyImageView(tex.imageView);
+	}
 
 	if (rt.additionalView) {
 		auto &view = this->textures.get(rt.additionalView);
@@ -2076,9 +2847,14 @@ void RendererImpl::deleteRenderTargetInternal(RenderTarget &rt) {
 	tex.imageView    = vk::ImageView();
 	tex.renderTarget = false;
 
-	assert(tex.memory != nullptr);
-	vmaFreeMemory(this->allocator, tex.memory);
-	tex.memory = nullptr;
+	// other render targets aliasing the memory have no allocation of their own
+	if (tex.memory != nullptr) {
+		vmaFreeMemory(this->allocator, tex.memory);
+		tex.memory = nullptr;
+	}
+	assert(this->aliasedBytes >= rt.aliasedBytes);
+	this->aliasedBytes -= rt.aliasedBytes;
+	rt.aliasedBytes     = 0;
 
 	this->textures.remove(rt.texture);
 	rt.texture = TextureHandle();
@@ -2126,8 +2902,9 @@ void RendererImpl::deleteFrameInternal(Frame &f) {
 	device.destroyFence(f.fence);
 	f.fence = vk::Fence();
 
-	// owned by swapchain, don't delete
-	f.image = vk::Image();
+	assert(f.acquireSem);
+	device.destroySemaphore(f.acquireSem);
+	f.acquireSem = vk::Semaphore();
 
 	assert(f.dsPool);
 	device.destroyDescriptorPool(f.dsPool);
@@ -2141,6 +2918,16 @@ void RendererImpl::deleteFrameInternal(Frame &f) {
 	device.destroyCommandPool(f.commandPool);
 	f.commandPool = vk::CommandPool();
 
+	assert(f.uploadSemaphore);
+	device.destroySemaphore(f.uploadSemaphore);
+	f.uploadSemaphore = vk::Semaphore();
+
+	if (f.queryPool) {
+		device.destroyQueryPool(f.queryPool);
+		f.queryPool = vk::QueryPool();
+	}
+	f.timestampScopes.clear();
+
 	assert(f.deleteResources.empty());
 }
 
@@ -2154,9 +2941,16 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 	const auto &pass = renderPasses.get(rpHandle);
 	assert(pass.renderPass);
 	const auto &fb   = framebuffers.get(fbHandle);
-	assert(fb.framebuffer);
+	vk::Framebuffer framebuffer = fb.framebuffer;
+	if (!framebuffer) {
+		// renders to the swapchain, pick the acquired image
+		framebuffer = fb.imageFramebuffers.at(currentImageIdx);
+	}
+	assert(framebuffer);
 	assert(fb.width  > 0);
 	assert(fb.height > 0);
+	// initialLayout of a loaded stencil assumes the previous pass left it like this
+	assert(pass.desc.stencilLoadOp_ != LoadOp::Load || renderTargets.get(fb.desc.depthStencil_).currentLayout == pass.desc.depthStencilFinalLayout_);
 	// TODO: should be customizable
 	// clear image
 	std::array<float, 4> color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
@@ -2167,7 +2961,7 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 
 	vk::RenderPassBeginInfo info;
 	info.renderPass                = pass.renderPass;
-	info.framebuffer               = fb.framebuffer;
+	info.framebuffer               = framebuffer;
 	info.renderArea.extent.width   = fb.width;
 	info.renderArea.extent.height  = fb.height;
 	info.clearValueCount           = 2;
@@ -2176,6 +2970,8 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 	currentCommandBuffer.beginRenderPass(info, vk::SubpassContents::eInline);
 
 	currentPipelineLayout = vk::PipelineLayout();
+	currentRenderPass     = rpHandle;
+	currentFramebuffer    = fbHandle;
 }
 
 
@@ -2185,12 +2981,29 @@ void RendererImpl::endRenderPass() {
 	inRenderPass = false;
 
 	currentCommandBuffer.endRenderPass();
+
+	const auto &pass = renderPasses.get(currentRenderPass);
+	const auto &fb   = framebuffers.get(currentFramebuffer);
+
+	for (const auto &color : fb.desc.colors_) {
+		if (color) {
+			auto &colorRT = renderTargets.get(color);
+			colorRT.currentLayout = pass.desc.colorFinalLayout_;
+		}
+	}
+
+	if (fb.desc.depthStencil_) {
+		auto &depthRT = renderTargets.get(fb.desc.depthStencil_);
+		depthRT.currentLayout = pass.desc.depthStencilFinalLayout_;
+	}
+
+	currentRenderPass  = RenderPassHandle();
+	currentFramebuffer = FramebufferHandle();
 }
 
 
 void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 	assert(inFrame);
-	assert(inRenderPass);
 	assert(pipelineDrawn);
 	pipelineDrawn = false;
 	validPipeline = true;
@@ -2198,9 +3011,21 @@ void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 
 	// TODO: make sure current renderpass matches the one in pipeline
 
-	const auto &p = pipelines.get(pipeline);
-	currentCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, p.pipeline);
+	auto &p = pipelines.get(pipeline);
+	if (!p.pipeline) {
+		finishPipeline(p);
+	}
+	currentCommandBuffer.bindPipeline(p.bindPoint, p.pipeline);
 	currentPipelineLayout = p.layout;
+	currentBindPoint      = p.bindPoint;
+
+	if (p.bindPoint == vk::PipelineBindPoint::eCompute) {
+		assert(!inRenderPass);
+		currentStorageBuffers.clear();
+		return;
+	}
+
+	assert(inRenderPass);
 
 	if (!p.scissor) {
 		// Vulkan always requires a scissor rect
@@ -2226,12 +3051,19 @@ void RendererImpl::bindIndexBuffer(BufferHandle buffer, bool bit16) {
 	auto &b = buffers.get(buffer);
 	b.lastUsedFrame = frameNum;
 	// "normal" buffers begin from beginning of buffer
-	vk::DeviceSize offset = 0;
-	if (b.ringBufferAlloc) {
-		// but ephemeral buffers use the ringbuffer and an offset
-		offset = b.offset;
-	}
-	currentCommandBuffer.bindIndexBuffer(b.buffer, offset, bit16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+	currentCommandBuffer.bindIndexBuffer(b.buffer, 0, bit16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+}
+
+
+void RendererImpl::bindIndexBuffer(EphemeralBuffer buffer, bool bit16) {
+	assert(inFrame);
+	assert(validPipeline);
+
+	// ephemeral buffers use the ringbuffer segment and an offset
+	const auto &seg = ringSegments[buffer.segment];
+	assert(seg.buffer);
+	assert(buffer.offset + buffer.size <= seg.size);
+	currentCommandBuffer.bindIndexBuffer(seg.buffer, buffer.offset, bit16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
 }
 
 
@@ -2243,14 +3075,23 @@ void RendererImpl::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
 	b.lastUsedFrame = frameNum;
 	// "normal" buffers begin from beginning of buffer
 	vk::DeviceSize offset = 0;
-	if (b.ringBufferAlloc) {
-		// but ephemeral buffers use the ringbuffer and an offset
-		offset = b.offset;
-	}
 	currentCommandBuffer.bindVertexBuffers(binding, 1, &b.buffer, &offset);
 }
 
 
+void RendererImpl::bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer) {
+	assert(inFrame);
+	assert(validPipeline);
+
+	// ephemeral buffers use the ringbuffer segment and an offset
+	const auto &seg = ringSegments[buffer.segment];
+	assert(seg.buffer);
+	assert(buffer.offset + buffer.size <= seg.size);
+	vk::DeviceSize offset = buffer.offset;
+	currentCommandBuffer.bindVertexBuffers(binding, 1, &seg.buffer, &offset);
+}
+
+
 void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layoutHandle, const void *data_) {
 	assert(inFrame);
 	assert(validPipeline);
@@ -2308,6 +3149,32 @@ void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layout
 			write.pBufferInfo = &bufferWrites.back();
 
 			writes.push_back(write);
+
+			if (l.type == DescriptorType::StorageBuffer && currentBindPoint == vk::PipelineBindPoint::eCompute) {
+				// dispatch might write it
+				currentStorageBuffers.push_back(bufWrite);
+			}
+		} break;
+
+		case DescriptorType::EphemeralUniformBuffer:
+		case DescriptorType::EphemeralStorageBuffer: {
+			const EphemeralBuffer &buffer = *reinterpret_cast<const EphemeralBuffer *>(data + l.offset);
+			assert(buffer.size > 0);
+			const auto &seg = ringSegments[buffer.segment];
+			assert(seg.buffer);
+			assert(buffer.offset + buffer.size <= seg.size);
+
+			vk::DescriptorBufferInfo  bufWrite;
+			bufWrite.buffer = seg.buffer;
+			bufWrite.offset = buffer.offset;
+			bufWrite.range  = buffer.size;
+
+			// we trust that reserve() above makes sure this doesn't reallocate the storage
+			bufferWrites.push_back(bufWrite);
+
+			write.pBufferInfo = &bufferWrites.back();
+
+			writes.push_back(write);
 		} break;
 
 		case DescriptorType::Sampler: {
@@ -2365,6 +3232,26 @@ void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layout
 			writes.push_back(write);
 		} break;
 
+		case DescriptorType::StorageImage: {
+			TextureHandle texHandle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
+			const auto &tex = textures.get(texHandle);
+			assert(tex.image);
+			assert(tex.imageView);
+			assert(tex.renderTarget);
+			assert(currentBindPoint == vk::PipelineBindPoint::eCompute);
+
+			vk::DescriptorImageInfo imgWrite;
+			imgWrite.imageView   = tex.imageView;
+			imgWrite.imageLayout = vk::ImageLayout::eGeneral;
+
+			// we trust that reserve() above makes sure this doesn't reallocate the storage
+			imageWrites.push_back(imgWrite);
+
+			write.pImageInfo = &imageWrites.back();
+
+			writes.push_back(write);
+		} break;
+
 		case DescriptorType::Count:
 			UNREACHABLE(); // shouldn't happen
 			break;
@@ -2375,7 +3262,7 @@ void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layout
 	}
 
 	device.updateDescriptorSets(writes, {});
-	currentCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, currentPipelineLayout, dsIndex, { ds }, {});
+	currentCommandBuffer.bindDescriptorSets(currentBindPoint, currentPipelineLayout, dsIndex, { ds }, {});
 }
 
 
@@ -2437,6 +3324,262 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firs
 }
 
 
+void RendererImpl::drawIndexedIndirect(BufferHandle handle, unsigned int offset) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(offset % 4 == 0);
+	pipelineDrawn = true;
+
+	auto &buffer = buffers.get(handle);
+	assert(buffer.buffer);
+	assert(offset + sizeof(vk::DrawIndexedIndirectCommand) <= buffer.size);
+	buffer.lastUsedFrame = frameNum;
+
+	currentCommandBuffer.drawIndexedIndirect(buffer.buffer, buffer.offset + offset, 1, 0);
+}
+
+
+void RendererImpl::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(currentBindPoint == vk::PipelineBindPoint::eCompute);
+	assert(x > 0);
+	assert(y > 0);
+	assert(z > 0);
+	pipelineDrawn = true;
+
+	// render targets were already ordered by renderTargetBarriers
+	// storage buffers might still be read by earlier draws and dispatches
+	// or be used to draw right after so they need their own barriers
+	const vk::PipelineStageFlags bufferStages = vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+	std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+	bufferBarriers.reserve(currentStorageBuffers.size());
+	for (const auto &b : currentStorageBuffers) {
+		vk::BufferMemoryBarrier barrier;
+		barrier.srcAccessMask       = vk::AccessFlagBits::eShaderWrite;
+		barrier.dstAccessMask       = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer              = b.buffer;
+		barrier.offset              = b.offset;
+		barrier.size                = b.range;
+		bufferBarriers.push_back(barrier);
+	}
+
+	if (!bufferBarriers.empty()) {
+		currentCommandBuffer.pipelineBarrier(bufferStages, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), {}, bufferBarriers, {});
+	}
+
+	currentCommandBuffer.dispatch(x, y, z);
+
+	if (!bufferBarriers.empty()) {
+		for (auto &barrier : bufferBarriers) {
+			barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+			barrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead;
+		}
+		currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, bufferStages, vk::DependencyFlags(), {}, bufferBarriers, {});
+	}
+}
+
+
+static vk::PipelineStageFlags vulkanAccessStages(Access access) {
+	switch (access) {
+	case Access::ColorAttachment:
+		return vk::PipelineStageFlagBits::eColorAttachmentOutput;
+
+	case Access::ComputeRead:
+	case Access::ComputeWrite:
+		return vk::PipelineStageFlagBits::eComputeShader;
+
+	case Access::DepthStencilAttachment:
+		return vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+
+	case Access::FragmentRead:
+		return vk::PipelineStageFlagBits::eFragmentShader;
+
+	case Access::TransferRead:
+		return vk::PipelineStageFlagBits::eTransfer;
+	}
+
+	UNREACHABLE();
+	return vk::PipelineStageFlagBits::eAllCommands;
+}
+
+
+static vk::AccessFlags vulkanAccessFlags(Access access) {
+	switch (access) {
+	case Access::ColorAttachment:
+		return vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+
+	case Access::ComputeRead:
+	case Access::FragmentRead:
+		return vk::AccessFlagBits::eShaderRead;
+
+	case Access::ComputeWrite:
+		return vk::AccessFlagBits::eShaderWrite;
+
+	case Access::DepthStencilAttachment:
+		return vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+	case Access::TransferRead:
+		return vk::AccessFlagBits::eTransferRead;
+	}
+
+	UNREACHABLE();
+	return vk::AccessFlags();
+}
+
+
+static vk::ImageAspectFlags vulkanAspect(vk::Format format) {
+	switch (format) {
+	case vk::Format::eD16Unorm:
+	case vk::Format::eX8D24UnormPack32:
+	case vk::Format::eD32Sfloat:
+		return vk::ImageAspectFlagBits::eDepth;
+
+	case vk::Format::eD16UnormS8Uint:
+	case vk::Format::eD24UnormS8Uint:
+		return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+
+	default:
+		return vk::ImageAspectFlagBits::eColor;
+	}
+}
+
+
+void RendererImpl::renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers) {
+	assert(inFrame);
+	assert(!inRenderPass);
+
+	vk::PipelineStageFlags srcStages;
+	vk::PipelineStageFlags dstStages;
+	std::vector<vk::ImageMemoryBarrier> imageBarriers;
+	imageBarriers.reserve(barriers.size());
+	std::vector<vk::MemoryBarrier> memoryBarriers;
+
+	for (const auto &b : barriers) {
+		// acquire semaphore and render pass dependencies take care of the swapchain image
+		if (b.rt == swapchainRenderTarget) {
+			continue;
+		}
+
+		auto &rt = renderTargets.get(b.rt);
+		if (b.discard && b.after != Access::ComputeWrite) {
+			// memory was last used through another image
+			// wait for that but the layout of this one is unknown
+			// render pass takes it from undefined
+			assert(accessLayout(b.after) == Layout::Invalid);
+			vk::MemoryBarrier barrier;
+			barrier.srcAccessMask = vulkanAccessFlags(b.before);
+			barrier.dstAccessMask = vulkanAccessFlags(b.after);
+			memoryBarriers.push_back(barrier);
+
+			srcStages |= vulkanAccessStages(b.before);
+			dstStages |= vulkanAccessStages(b.after);
+
+			rt.currentLayout = Layout::Invalid;
+			continue;
+		}
+
+		// storage images are in general layout which the Layout enum doesn't have
+		// they're written whole so the previous contents don't matter
+		vk::ImageLayout oldLayout;
+		vk::ImageLayout newLayout;
+		if (b.after == Access::ComputeWrite) {
+			oldLayout        = vk::ImageLayout::eUndefined;
+			newLayout        = vk::ImageLayout::eGeneral;
+			rt.currentLayout = Layout::Invalid;
+		} else {
+			// attachments don't need a transition, render pass does its own
+			Layout layout = accessLayout(b.after);
+			if (layout == Layout::Invalid) {
+				layout = rt.currentLayout;
+			}
+
+			if (b.before == Access::ComputeWrite) {
+				oldLayout = vk::ImageLayout::eGeneral;
+				if (layout == Layout::Invalid) {
+					// render pass takes it from undefined but has to wait for the dispatch
+					layout = Layout::ShaderRead;
+				}
+			} else if (layout == Layout::Invalid) {
+				// never used, nothing to wait for
+				continue;
+			} else {
+				// never written, contents don't matter
+				oldLayout = (rt.currentLayout == Layout::Invalid) ? vk::ImageLayout::eUndefined : vulkanLayout(rt.currentLayout);
+			}
+
+			newLayout        = vulkanLayout(layout);
+			rt.currentLayout = layout;
+		}
+
+		vk::ImageMemoryBarrier barrier;
+		barrier.srcAccessMask       = vulkanAccessFlags(b.before);
+		barrier.dstAccessMask       = vulkanAccessFlags(b.after);
+		barrier.oldLayout           = oldLayout;
+		barrier.newLayout           = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image               = rt.image;
+
+		vk::ImageSubresourceRange range;
+		range.aspectMask            = vulkanAspect(rt.format);
+		range.baseMipLevel          = 0;
+		range.levelCount            = 1;
+		range.baseArrayLayer        = 0;
+		range.layerCount            = 1;
+		barrier.subresourceRange    = range;
+		imageBarriers.push_back(barrier);
+
+		srcStages |= vulkanAccessStages(b.before);
+		dstStages |= vulkanAccessStages(b.after);
+	}
+
+	if (imageBarriers.empty() && memoryBarriers.empty()) {
+		return;
+	}
+
+	currentCommandBuffer.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags(), memoryBarriers, {}, imageBarriers);
+}
+
+
+void RendererImpl::beginTimestampScope(const std::string &name) {
+	assert(inFrame);
+	assert(!inTimestampScope);
+	inTimestampScope = true;
+
+	auto &frame = frames.at(currentFrameIdx);
+	if (!frame.queryPool) {
+		return;
+	}
+
+	assert(frame.timestampScopes.size() < MAX_TIMESTAMP_SCOPES);
+	uint32_t idx = static_cast<uint32_t>(frame.timestampScopes.size());
+	frame.timestampScopes.push_back(name);
+
+	currentCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool, 2 * idx);
+}
+
+
+void RendererImpl::endTimestampScope() {
+	assert(inFrame);
+	assert(inTimestampScope);
+	inTimestampScope = false;
+
+	auto &frame = frames.at(currentFrameIdx);
+	if (!frame.queryPool) {
+		return;
+	}
+
+	assert(!frame.timestampScopes.empty());
+	uint32_t idx = static_cast<uint32_t>(frame.timestampScopes.size() - 1);
+
+	currentCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frame.queryPool, 2 * idx + 1);
+}
+
+
 } // namespace renderer
 
 
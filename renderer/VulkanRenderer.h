@@ -74,36 +74,34 @@ namespace renderer {
 
 
 struct Buffer {
-	bool           ringBufferAlloc;
 	uint32_t       size;
 	uint32_t       offset;
 	vk::Buffer     buffer;
 	VmaAllocation  memory;
 	uint32_t       lastUsedFrame;
+	BufferUsage    usage;
 	// TODO: access type bits (for debugging)
 
 
 	Buffer()
-	: ringBufferAlloc(false)
-	, size(0)
+	: size(0)
 	, offset(0)
 	, memory(nullptr)
 	, lastUsedFrame(0)
+	, usage(BufferUsage::Static)
 	{}
 
 	Buffer(const Buffer &)            = delete;
 	Buffer &operator=(const Buffer &) = delete;
 
 	Buffer(Buffer &&other)
-	: ringBufferAlloc(other.ringBufferAlloc)
-	, size(other.size)
+	: size(other.size)
 	, offset(other.offset)
 	, buffer(other.buffer)
 	, memory(other.memory)
 	, lastUsedFrame(other.lastUsedFrame)
+	, usage(other.usage)
 	{
-
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = vk::Buffer();
@@ -119,14 +117,13 @@ struct Buffer {
 		assert(!buffer);
 		assert(!memory);
 
-		ringBufferAlloc       = other.ringBufferAlloc;
 		size                  = other.size;
 		offset                = other.offset;
 		buffer                = other.buffer;
 		memory                = other.memory;
 		lastUsedFrame         = other.lastUsedFrame;
+		usage                 = other.usage;
 
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = vk::Buffer();
@@ -137,7 +134,6 @@ struct Buffer {
 	}
 
 	~Buffer() {
-		assert(!ringBufferAlloc);
 		assert(size   == 0);
 		assert(offset == 0);
 		assert(!buffer);
@@ -154,6 +150,39 @@ struct Buffer {
 };
 
 
+struct ComputeShader {
+	vk::ShaderModule shaderModule;
+
+
+	ComputeShader() {}
+
+	ComputeShader(const ComputeShader &)            = delete;
+	ComputeShader &operator=(const ComputeShader &) = delete;
+
+	ComputeShader(ComputeShader &&other)
+	: shaderModule(other.shaderModule)
+	{
+		other.shaderModule = vk::ShaderModule();
+	}
+
+	ComputeShader &operator=(ComputeShader &&other) {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(!shaderModule);
+		shaderModule       = other.shaderModule;
+		other.shaderModule = vk::ShaderModule();
+
+		return *this;
+	}
+
+	~ComputeShader() {
+		assert(!shaderModule);
+	}
+};
+
+
 struct DescriptorSetLayout {
 	std::vector<DescriptorLayout>  descriptors;
 	vk::DescriptorSetLayout        layout;
@@ -230,6 +259,9 @@ struct FragmentShader {
 struct Framebuffer {
 	unsigned int     width, height;
 	vk::Framebuffer  framebuffer;
+	// one per swapchain image instead of framebuffer when rendering to the swapchain
+	// indexed by the acquired image, not the frame
+	std::vector<vk::Framebuffer>  imageFramebuffers;
 	FramebufferDesc  desc;
 	// TODO: store info about attachments to allow tracking layout
 
@@ -246,11 +278,13 @@ struct Framebuffer {
 	: width(other.width)
 	, height(other.height)
 	, framebuffer(other.framebuffer)
+	, imageFramebuffers(std::move(other.imageFramebuffers))
 	, desc(other.desc)
 	{
 		other.width       = 0;
 		other.height      = 0;
 		other.framebuffer = vk::Framebuffer();
+		assert(other.imageFramebuffers.empty());
 	}
 
 	Framebuffer &operator=(Framebuffer &&other) {
@@ -259,42 +293,55 @@ struct Framebuffer {
 		}
 
 		assert(!framebuffer);
+		assert(imageFramebuffers.empty());
 
 		width             = other.width;
 		height            = other.height;
 		framebuffer       = other.framebuffer;
+		imageFramebuffers = std::move(other.imageFramebuffers);
 		desc              = other.desc;
 
 		other.width       = 0;
 		other.height      = 0;
 		other.framebuffer = vk::Framebuffer();
+		assert(other.imageFramebuffers.empty());
 
 		return *this;
 	}
 
 	~Framebuffer() {
 		assert(!framebuffer);
+		assert(imageFramebuffers.empty());
 	}
 
 
 	bool operator==(const Framebuffer &other) const {
-		return this->framebuffer == other.framebuffer;
+		return this->framebuffer == other.framebuffer
+		    && this->imageFramebuffers == other.imageFramebuffers;
 	}
 
 	size_t getHash() const {
+		if (!framebuffer) {
+			assert(!imageFramebuffers.empty());
+			return VK_HASH(VkFramebuffer(imageFramebuffers[0]));
+		}
 		return VK_HASH(VkFramebuffer(framebuffer));
 	}
 };
 
 
 struct Pipeline {
-	vk::Pipeline       pipeline;
-	vk::PipelineLayout layout;
-	bool               scissor;
+	// null until pending has been collected
+	vk::Pipeline          pipeline;
+	vk::PipelineLayout    layout;
+	vk::PipelineBindPoint bindPoint;
+	bool                  scissor;
+	std::future<vk::Pipeline>  pending;
 
 
 	Pipeline()
-	: scissor(false)
+	: bindPoint(vk::PipelineBindPoint::eGraphics)
+	, scissor(false)
 	{}
 
 	Pipeline(const Pipeline &)            = delete;
@@ -303,11 +350,14 @@ struct Pipeline {
 	Pipeline(Pipeline &&other)
 	: pipeline(other.pipeline)
 	, layout(other.layout)
+	, bindPoint(other.bindPoint)
 	, scissor(other.scissor)
+	, pending(std::move(other.pending))
 	{
-		other.pipeline = vk::Pipeline();
-		other.layout   = vk::PipelineLayout();
-		other.scissor  = false;
+		other.pipeline  = vk::Pipeline();
+		other.layout    = vk::PipelineLayout();
+		other.bindPoint = vk::PipelineBindPoint::eGraphics;
+		other.scissor   = false;
 	}
 
 	Pipeline &operator=(Pipeline &&other) {
@@ -317,14 +367,18 @@ struct Pipeline {
 
 		assert(!pipeline);
 		assert(!layout);
+		assert(!pending.valid());
 
-		pipeline       = other.pipeline;
-		layout         = other.layout;
-		scissor        = other.scissor;
+		pipeline        = other.pipeline;
+		layout          = other.layout;
+		bindPoint       = other.bindPoint;
+		scissor         = other.scissor;
+		pending         = std::move(other.pending);
 
-		other.pipeline = vk::Pipeline();
-		other.layout   = vk::PipelineLayout();
-		other.scissor  = false;
+		other.pipeline  = vk::Pipeline();
+		other.layout    = vk::PipelineLayout();
+		other.bindPoint = vk::PipelineBindPoint::eGraphics;
+		other.scissor   = false;
 
 		return *this;
 	}
@@ -332,12 +386,14 @@ struct Pipeline {
 	~Pipeline() {
 		assert(!pipeline);
 		assert(!layout);
+		assert(!pending.valid());
 	}
 };
 
 
 struct RenderPass {
-	vk::RenderPass renderPass;
+	vk::RenderPass  renderPass;
+	RenderPassDesc  desc;
 
 
 	RenderPass() {}
@@ -347,6 +403,7 @@ struct RenderPass {
 
 	RenderPass(RenderPass &&other)
 	: renderPass(other.renderPass)
+	, desc(other.desc)
 	{
 		other.renderPass = vk::RenderPass();
 	}
@@ -359,6 +416,7 @@ struct RenderPass {
 		assert(!renderPass);
 
 		renderPass       = other.renderPass;
+		desc             = other.desc;
 
 		other.renderPass = vk::RenderPass();
 
@@ -387,12 +445,17 @@ struct RenderTarget{
 	vk::Image     image;
 	vk::Format    format;
 	vk::ImageView imageView;
+	// views are created late for transient render targets
+	RenderTargetDesc     desc;
+	// memory saved by other render targets aliasing this one
+	uint64_t             aliasedBytes;
 
 
 	RenderTarget()
 	: width(0)
 	, height(0)
 	, currentLayout(Layout::Invalid)
+	, aliasedBytes(0)
 	{}
 
 	RenderTarget(const RenderTarget &)            = delete;
@@ -407,6 +470,8 @@ struct RenderTarget{
 	, image(other.image)
 	, format(other.format)
 	, imageView(other.imageView)
+	, desc(other.desc)
+	, aliasedBytes(other.aliasedBytes)
 	{
 		other.width         = 0;
 		other.height        = 0;
@@ -416,6 +481,8 @@ struct RenderTarget{
 		other.image         = vk::Image();
 		other.format        = vk::Format::eUndefined;
 		other.imageView     = vk::ImageView();
+		other.desc          = RenderTargetDesc();
+		other.aliasedBytes  = 0;
 	}
 
 	RenderTarget &operator=(RenderTarget &&other) {
@@ -434,6 +501,8 @@ struct RenderTarget{
 		image               = other.image;
 		format              = other.format;
 		imageView           = other.imageView;
+		desc                = other.desc;
+		aliasedBytes        = other.aliasedBytes;
 
 		other.width         = 0;
 		other.height        = 0;
@@ -443,6 +512,8 @@ struct RenderTarget{
 		other.image         = vk::Image();
 		other.format        = vk::Format::eUndefined;
 		other.imageView     = vk::ImageView();
+		other.desc          = RenderTargetDesc();
+		other.aliasedBytes  = 0;
 
 		return *this;
 	}
@@ -662,16 +733,58 @@ namespace std {
 namespace renderer {
 
 
+struct RingBufferSegment {
+	unsigned int   size;
+	char           *mapping;
+	vk::Buffer     buffer;
+	VmaAllocation  memory;
+
+
+	RingBufferSegment()
+	: size(0)
+	, mapping(nullptr)
+	, memory(nullptr)
+	{}
+
+	RingBufferSegment(const RingBufferSegment &)            = delete;
+	RingBufferSegment &operator=(const RingBufferSegment &) = delete;
+
+	RingBufferSegment(RingBufferSegment &&)                 = delete;
+	RingBufferSegment &operator=(RingBufferSegment &&)      = delete;
+
+	~RingBufferSegment() {
+		assert(size == 0);
+		assert(!buffer);
+		assert(!memory);
+	}
+};
+
+
+// the image belongs to the swapchain, the rest is ours
+struct SwapchainImage {
+	vk::Image          image;
+	vk::ImageView      imageView;
+	// signaled when rendering to the image is done, present waits for it
+	// per image since nothing tells when present is done with it
+	vk::Semaphore      renderDoneSem;
+};
+
+
+// one frame in flight, how many there are doesn't depend on swapchain image count
 struct Frame {
 	bool                      outstanding;
 	uint32_t                  lastFrameNum;
-	unsigned int              usedRingBufPtr;
-	std::vector<BufferHandle> ephemeralBuffers;
+	std::vector<unsigned int> ringSegments;
 	vk::Fence          fence;
-	vk::Image          image;
+	// signaled when the swapchain image this frame renders to has been acquired
+	vk::Semaphore      acquireSem;
 	vk::DescriptorPool dsPool;
 	vk::CommandPool    commandPool;
 	vk::CommandBuffer  commandBuffer;
+	vk::Semaphore      uploadSemaphore;
+	// null if the queue doesn't support timestamps
+	vk::QueryPool      queryPool;
+	std::vector<std::string>  timestampScopes;
 
 	// std::vector has some kind of issue with variant with non-copyable types, so use unordered_set
 	std::unordered_set<Resource>     deleteResources;
@@ -680,16 +793,17 @@ struct Frame {
 	Frame()
 	: outstanding(false)
 	, lastFrameNum(0)
-	, usedRingBufPtr(0)
 	{}
 
 	~Frame() {
-		assert(ephemeralBuffers.empty());
+		assert(ringSegments.empty());
 		assert(!fence);
-		assert(!image);
+		assert(!acquireSem);
 		assert(!dsPool);
 		assert(!commandPool);
 		assert(!commandBuffer);
+		assert(!uploadSemaphore);
+		assert(!queryPool);
 		assert(!outstanding);
 		assert(deleteResources.empty());
 	}
@@ -700,35 +814,39 @@ struct Frame {
 	Frame(Frame &&other)
 	: outstanding(other.outstanding)
 	, lastFrameNum(other.lastFrameNum)
-	, usedRingBufPtr(other.usedRingBufPtr)
-	, ephemeralBuffers(std::move(other.ephemeralBuffers))
+	, ringSegments(std::move(other.ringSegments))
 	, fence(other.fence)
-	, image(other.image)
+	, acquireSem(other.acquireSem)
 	, dsPool(other.dsPool)
 	, commandPool(other.commandPool)
 	, commandBuffer(other.commandBuffer)
+	, uploadSemaphore(other.uploadSemaphore)
+	, queryPool(other.queryPool)
+	, timestampScopes(std::move(other.timestampScopes))
 	, deleteResources(std::move(other.deleteResources))
 	{
-		other.image = vk::Image();
 		other.fence = vk::Fence();
+		other.acquireSem = vk::Semaphore();
 		other.dsPool = vk::DescriptorPool();
 		other.commandPool = vk::CommandPool();
 		other.commandBuffer = vk::CommandBuffer();
+		other.uploadSemaphore = vk::Semaphore();
+		other.queryPool = vk::QueryPool();
 		other.outstanding      = false;
 		other.lastFrameNum     = 0;
-		other.usedRingBufPtr   = 0;
+		assert(other.ringSegments.empty());
 		assert(other.deleteResources.empty());
 	}
 
 	Frame &operator=(Frame &&other) {
-		assert(!image);
-		image = other.image;
-		other.image = vk::Image();
-
 		assert(!fence);
 		fence = other.fence;
 		other.fence = vk::Fence();
 
+		assert(!acquireSem);
+		acquireSem = other.acquireSem;
+		other.acquireSem = vk::Semaphore();
+
 		assert(!dsPool);
 		dsPool = other.dsPool;
 		other.dsPool = vk::DescriptorPool();
@@ -741,9 +859,15 @@ struct Frame {
 		commandBuffer = other.commandBuffer;
 		other.commandBuffer = vk::CommandBuffer();
 
-		assert(ephemeralBuffers.empty());
-		ephemeralBuffers = std::move(other.ephemeralBuffers);
-		assert(other.ephemeralBuffers.empty());
+		assert(!uploadSemaphore);
+		uploadSemaphore = other.uploadSemaphore;
+		other.uploadSemaphore = vk::Semaphore();
+
+		assert(!queryPool);
+		queryPool = other.queryPool;
+		other.queryPool = vk::QueryPool();
+
+		timestampScopes = std::move(other.timestampScopes);
 
 		outstanding = other.outstanding;
 		other.outstanding = false;
@@ -751,8 +875,9 @@ struct Frame {
 		lastFrameNum = other.lastFrameNum;
 		other.lastFrameNum = 0;
 
-		usedRingBufPtr       = other.usedRingBufPtr;
-		other.usedRingBufPtr = 0;
+		assert(ringSegments.empty());
+		ringSegments = std::move(other.ringSegments);
+		assert(other.ringSegments.empty());
 
 		deleteResources = std::move(other.deleteResources);
 		assert(other.deleteResources.empty());
@@ -762,12 +887,33 @@ struct Frame {
 };
 
 
+// a batch of buffer and texture uploads recorded into one command buffer
+// and submitted on the transfer queue
+struct UploadBatch {
+	vk::CommandPool    commandPool;
+	vk::CommandBuffer  commandBuffer;
+	vk::Fence          fence;
+	// staging buffer pointer after this batch's copies, free up to here once fence is signaled
+	unsigned int       stagingEnd;
+	bool               recording;
+	bool               outstanding;
+
+
+	UploadBatch()
+	: stagingEnd(0)
+	, recording(false)
+	, outstanding(false)
+	{}
+};
+
+
 struct RendererImpl : public RendererBase {
 	SDL_Window                              *window;
 
 	std::vector<Frame>                      frames;
 
 	ResourceContainer<Buffer>               buffers;
+	ResourceContainer<ComputeShader>        computeShaders;
 	ResourceContainer<DescriptorSetLayout>  dsLayouts;
 	ResourceContainer<FragmentShader>       fragmentShaders;
 	ResourceContainer<Framebuffer>          framebuffers;
@@ -787,34 +933,71 @@ struct RendererImpl : public RendererBase {
 	vk::SurfaceKHR                          surface;
 	vk::PhysicalDeviceMemoryProperties      memoryProperties;
 	uint32_t                                graphicsQueueIndex;
+	// 0 if graphics queue doesn't support timestamps
+	uint32_t                                timestampValidBits;
+	uint32_t                                transferQueueIndex;
 	std::unordered_set<vk::Format>          surfaceFormats;
 	vk::SurfaceCapabilitiesKHR              surfaceCapabilities;
 	std::unordered_set<vk::PresentModeKHR>  surfacePresentModes;
 	vk::SwapchainKHR                        swapchain;
+	std::vector<SwapchainImage>             swapchainImages;
+	// acquired for the current frame
+	uint32_t                                currentImageIdx;
 	vk::Queue                               queue;
-
-	vk::Semaphore                           acquireSem;
-	vk::Semaphore                           renderDoneSem;
+	vk::Queue                               transferQueue;
 
 	vk::CommandBuffer                       currentCommandBuffer;
 	vk::PipelineLayout                      currentPipelineLayout;
+	vk::PipelineBindPoint                   currentBindPoint;
+	// for tracking attachment layouts at the end of the render pass
+	RenderPassHandle                        currentRenderPass;
+	FramebufferHandle                       currentFramebuffer;
+	// storage buffers in descriptor sets bound since the last compute pipeline
+	// render targets are ordered by renderTargetBarriers but buffers aren't
+	std::vector<vk::DescriptorBufferInfo>   currentStorageBuffers;
 	vk::Viewport                            currentViewport;
 
 	VmaAllocator                            allocator;
+	uint64_t                                aliasedBytes;
 
 	bool                                    debugMarkers;
 
-	vk::Buffer                              ringBuffer;
-	VmaAllocation                           ringBufferMem;
-	char                                    *persistentMapping;
+	std::array<RingBufferSegment, MAX_RING_SEGMENTS>  ringSegments;
+
+	vk::Buffer                              stagingBuffer;
+	VmaAllocation                           stagingBufferMem;
+	char                                    *stagingMapping;
+	unsigned int                            stagingBufSize;
+	unsigned int                            stagingBufPtr;
+	unsigned int                            lastSyncedStagingBufPtr;
+
+	std::vector<UploadBatch>                uploadBatches;
+	unsigned int                            currentUploadBatch;
+	// uploads have been submitted since the last frame submit
+	bool                                    uploadsPending;
 
 	// std::vector has some kind of issue with variant with non-copyable types, so use unordered_set
 	std::unordered_set<Resource>            deleteResources;
 
 
 	void recreateSwapchain();
-	void recreateRingBuffer(unsigned int newSize);
-	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
+	// for framebuffers using the swapchain render target, needs swapchain image views
+	void createSwapchainFramebuffers(Framebuffer &fb);
+	// needs memory bound to the image
+	void createRenderTargetViews(RenderTarget &rt);
+	void createRingSegment(RingBufferSegment &seg, unsigned int size);
+	void deleteRingSegment(RingBufferSegment &seg);
+	RingBufferAllocation ringBufferAllocate(unsigned int size, unsigned int alignment);
+	unsigned int ringBufferNewSegment(unsigned int size);
+	void ringBufferEndFrame(Frame &frame);
+	void ringBufferRetireFrame(Frame &frame);
+	void ringBufferShutdown();
+
+	void recreateStagingBuffer(unsigned int newSize);
+	unsigned int stagingBufferAllocate(unsigned int size, unsigned int alignment);
+	vk::CommandBuffer uploadCommandBuffer();
+	void flushUploads();
+	void waitForUploadBatch(unsigned int batchIdx);
 
 	void waitForFrame(unsigned int frameIdx);
 
@@ -879,13 +1062,22 @@ struct RendererImpl : public RendererBase {
 	bool isRenderTargetFormatSupported(Format format) const;
 
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
+	ComputeShaderHandle  createComputeShader(const std::string &name, const ShaderMacros &macros);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
 	FragmentShaderHandle createFragmentShader(const std::string &name, const ShaderMacros &macros);
+	bool                 prepareShaders(const std::string &name, const ShaderMacros &macros);
+	bool                 prepareComputeShader(const std::string &name, const ShaderMacros &macros);
+	bool                 isPipelineReady(PipelineHandle handle);
 	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
 	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
 	PipelineHandle       createPipeline(const PipelineDesc &desc);
-	BufferHandle         createBuffer(uint32_t size, const void *contents);
-	BufferHandle         createEphemeralBuffer(uint32_t size, const void *contents);
+	PipelineHandle       createComputePipeline(const PipelineDesc &desc);
+	// called on a background thread
+	vk::Pipeline         buildGraphicsPipeline(const PipelineDesc &desc, vk::ShaderModule vertexShader, vk::ShaderModule fragmentShader, vk::RenderPass renderPass, vk::PipelineLayout layout) const;
+	// blocks if the driver is still compiling
+	void                 finishPipeline(Pipeline &p);
+	BufferHandle         createBuffer(BufferUsage usage, uint32_t size, const void *contents);
+	EphemeralBuffer      createEphemeralBuffer(uint32_t size, const void *contents);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
 
@@ -893,7 +1085,9 @@ struct RendererImpl : public RendererBase {
 
 	TextureHandle        getRenderTargetTexture(RenderTargetHandle handle);
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+	bool                 isTextureReady(TextureHandle handle) const;
 
+	void updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *contents);
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
 	void deleteRenderPass(RenderPassHandle fbo);
@@ -901,6 +1095,9 @@ struct RendererImpl : public RendererBase {
 	void deleteTexture(TextureHandle handle);
 	void deleteRenderTarget(RenderTargetHandle &fbo);
 
+	bool canAliasRenderTargets(const std::vector<RenderTargetHandle> &rts) const;
+	void aliasRenderTargets(const std::vector<RenderTargetHandle> &rts);
+
 
 	void setSwapchainDesc(const SwapchainDesc &desc);
 	MemoryStats getMemStats() const;
@@ -916,13 +1113,23 @@ struct RendererImpl : public RendererBase {
 
 	void bindPipeline(PipelineHandle pipeline);
 	void bindIndexBuffer(BufferHandle buffer, bool bit16);
+	void bindIndexBuffer(EphemeralBuffer buffer, bool bit16);
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
+	void bindVertexBuffer(unsigned int binding, EphemeralBuffer buffer);
 
 	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int offset);
+
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+
+	void renderTargetBarriers(const std::vector<RenderTargetBarrier> &barriers);
+
+	void beginTimestampScope(const std::string &name);
+	void endTimestampScope();
 };
 
 
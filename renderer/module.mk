@@ -4,6 +4,7 @@ d              := $(dir)
 
 
 FILES:= \
+	FrameGraph.cpp \
 	NullRenderer.cpp \
 	OpenGLRenderer.cpp \
 	RendererCommon.cpp \
@@ -3,6 +3,12 @@
 #define ATTR_COLOR 2
 
 
+#define CULL_GROUP_SIZE  64
+
+// compute SMAA works on square tiles of this many pixels per side
+#define SMAA_TILE_SIZE   16
+
+
 struct SMAAParameters {
 	float threshold;
 	float depthThreshold;
@@ -39,6 +45,12 @@ layout(set = 0, binding = 0, std140) uniform Globals
 	float predicationScale;
 	float predicationStrength;
 	float pad0;
+
+	// packed cube position is grid coordinates * spacing + origin
+	float cubeGridSpacing;
+	float cubeGridOrigin;
+	float pad1;
+	float pad2;
 };
 
 
@@ -60,3 +72,34 @@ struct Cube {
 	vec3   color;
 	float  pad1;
 };
+
+
+struct CullParameters {
+	// normalized frustum planes, xyz is normal and w distance
+	vec4   planes[6];
+	float  cubeRadius;
+	uint   numCubes;
+	uint   pad0;
+	uint   pad1;
+};
+
+
+// same layout as VkDrawIndexedIndirectCommand and GL DrawElementsIndirectCommand
+struct DrawIndexedIndirectArgs {
+	uint   indexCount;
+	uint   instanceCount;
+	uint   firstIndex;
+	int    vertexOffset;
+	uint   firstInstance;
+};
+
+
+struct PackedCube {
+	// grid coordinates, 10 bits each
+	uint   position;
+	// smallest three quaternion, 10 bits per component
+	// index of the dropped largest component in the top 2 bits
+	uint   rotation;
+	// sRGB RGBA8
+	uint   color;
+};
@@ -600,6 +600,12 @@ SamplerState PointSampler { Filter = MIN_MAG_MIP_POINT; AddressU = Clamp; Addres
 #error you must define the shading language: SMAA_HLSL_*, SMAA_GLSL_* or SMAA_CUSTOM_SL
 #endif
 
+// edge detection discards pixels without edges
+// compute shaders can't, they define this to return no edges instead
+#ifndef SMAA_DISCARD
+#define SMAA_DISCARD discard
+#endif
+
 
 #if SMAA_FLIP_Y
 
@@ -751,7 +757,7 @@ float2 SMAALumaEdgeDetectionPS(float2 texcoord,
 
     // Then discard if there is no edge:
     if (dot(edges, float2(1.0, 1.0)) == 0.0)
-        discard;
+        SMAA_DISCARD;
 
     // Calculate right and bottom deltas:
     float Lright = dot(SMAASamplePoint(colorTex, offset[1].xy).rgb, weights);
@@ -813,7 +819,7 @@ float2 SMAAColorEdgeDetectionPS(float2 texcoord,
 
     // Then discard if there is no edge:
     if (dot(edges, float2(1.0, 1.0)) == 0.0)
-        discard;
+        SMAA_DISCARD;
 
     // Calculate right and bottom deltas:
     float3 Cright = SMAASamplePoint(colorTex, offset[1].xy).rgb;
@@ -857,7 +863,7 @@ float2 SMAADepthEdgeDetectionPS(float2 texcoord,
     float2 edges = step(SMAA_DEPTH_THRESHOLD, delta);
 
     if (dot(edges, float2(1.0, 1.0)) == 0.0)
-        discard;
+        SMAA_DISCARD;
 
     return edges;
 }
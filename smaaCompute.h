@@ -0,0 +1,63 @@
+// SMAA porting functions for compute shaders
+// include before smaa.h
+
+// every texture access goes through a function named after the texture
+// so a pass can replace the ones it keeps in shared memory
+// define SMAA_TILED_<TEXTURE> and provide smaaSample_<texture> and smaaSamplePoint_<texture> yourself
+
+#define SMAA_CUSTOM_SL 1
+
+// texels are addressed directly so the application has to say which way up images are stored
+#ifndef SMAA_FLIP_Y
+#error SMAA_FLIP_Y must be defined
+#endif  // SMAA_FLIP_Y
+
+#define SMAATexture2D(tex) sampler2D tex
+#define SMAATexturePass2D(tex) tex
+#define SMAASampleLevelZero(tex, coord) smaaSample_##tex(tex, coord)
+#define SMAASampleLevelZeroPoint(tex, coord) smaaSamplePoint_##tex(tex, coord)
+#define SMAASampleLevelZeroOffset(tex, coord, offset) smaaSample_##tex(tex, coord + vec2(offset) * SMAA_RT_METRICS.xy)
+#define SMAASample(tex, coord) smaaSample_##tex(tex, coord)
+#define SMAASamplePoint(tex, coord) smaaSamplePoint_##tex(tex, coord)
+#define SMAASampleOffset(tex, coord, offset) smaaSample_##tex(tex, coord + vec2(offset) * SMAA_RT_METRICS.xy)
+#define SMAAGather(tex, coord) textureGather(tex, coord)
+#define SMAA_FLATTEN
+#define SMAA_BRANCH
+#define SMAA_DISCARD return float2(0.0, 0.0)
+#define lerp(a, b, t) mix(a, b, t)
+#define saturate(a) clamp(a, 0.0, 1.0)
+#define mad(a, b, c) fma(a, b, c)
+#define float2 vec2
+#define float3 vec3
+#define float4 vec4
+#define int2 ivec2
+#define int3 ivec3
+#define int4 ivec4
+#define bool2 bvec2
+#define bool3 bvec3
+#define bool4 bvec4
+
+
+// no derivatives in compute so everything samples level zero
+#define SMAA_HARDWARE_SAMPLER(name) \
+vec4 smaaSample_##name(sampler2D t, vec2 coord) { return textureLod(t, coord, 0.0); } \
+vec4 smaaSamplePoint_##name(sampler2D t, vec2 coord) { return textureLod(t, coord, 0.0); }
+
+
+// smaa.h passes predication and depth textures through this name
+SMAA_HARDWARE_SAMPLER(tex)
+
+SMAA_HARDWARE_SAMPLER(areaTex)
+SMAA_HARDWARE_SAMPLER(blendTex)
+SMAA_HARDWARE_SAMPLER(currentColorTex)
+SMAA_HARDWARE_SAMPLER(previousColorTex)
+SMAA_HARDWARE_SAMPLER(searchTex)
+SMAA_HARDWARE_SAMPLER(velocityTex)
+
+#ifndef SMAA_TILED_COLORTEX
+SMAA_HARDWARE_SAMPLER(colorTex)
+#endif  // SMAA_TILED_COLORTEX
+
+#ifndef SMAA_TILED_EDGESTEX
+SMAA_HARDWARE_SAMPLER(edgesTex)
+#endif  // SMAA_TILED_EDGESTEX
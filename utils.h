@@ -59,3 +59,22 @@ vec3 sRGB2linear(vec3 v) {
     return vec3(sRGB2linear(v.x), sRGB2linear(v.y), sRGB2linear(v.z));
 }
 
+
+// smallest three quaternion, see packQuaternion in smaaDemo.cpp
+vec4 unpackQuaternion(uint packed) {
+    uvec3 bits  = uvec3(packed, packed >> 10, packed >> 20) & 0x3FFU;
+    vec3 small  = (vec3(bits) * (2.0 / 1023.0) - 1.0) * 0.70710678;
+    float large = sqrt(max(0.0, 1.0 - dot(small, small)));
+
+    uint index  = packed >> 30;
+    if (index == 0) {
+        return vec4(large, small);
+    } else if (index == 1) {
+        return vec4(small.x, large, small.yz);
+    } else if (index == 2) {
+        return vec4(small.xy, large, small.z);
+    } else {
+        return vec4(small, large);
+    }
+}
+
@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#include <algorithm>
+
+#include <cassert>
+#include <cinttypes>
+
+#include "FramePacer.h"
+#include "Utils.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <ctime>
+
+#elif defined(_WIN32)
+
+// windows.h min and max macros break std::min
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+
+// windows 10 1803 and later, older ones fail to create the timer with it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif  // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+
+#else  // __linux__
+
+#include <chrono>
+#include <thread>
+
+#endif  // __linux__
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif  // defined(__SSE2__) || defined(_M_X64)
+
+
+// spin at least this long even if sleeps have been waking up on time
+#define SPIN_MARGIN    (200ULL * 1000ULL)
+
+#define INITIAL_SLACK  (1000ULL * 1000ULL)
+
+// a few very late wakeups shouldn't turn the whole wait into spinning
+// also limited to half a period so there's always some time left to sleep and measure
+#define MAX_SLACK      (4ULL * 1000ULL * 1000ULL)
+
+
+FramePacer::FramePacer(std::function<uint64_t()> &&clock_)
+: clock(std::move(clock_))
+, period(0)
+, nextTarget(0)
+, slack(INITIAL_SLACK)
+#ifdef _WIN32
+, timer(nullptr)
+#endif  // _WIN32
+, maxError(0)
+{
+	histogram.fill(0);
+
+#ifdef _WIN32
+
+	// default timer resolution is too coarse for this
+	timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!timer) {
+		LOG("High resolution waitable timer not available\n");
+		timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	}
+
+#endif  // _WIN32
+}
+
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+
+	if (timer) {
+		CloseHandle(timer);
+		timer = nullptr;
+	}
+
+#endif  // _WIN32
+
+	LOG("frame start error histogram, slack %" PRIu64 " ns, max error %" PRIu64 " ns\n", slack, maxError);
+	for (unsigned int i = 0; i < FRAME_PACER_BUCKETS; i++) {
+		if (histogram[i] == 0) {
+			continue;
+		}
+
+		if (i == 0) {
+			LOG("  < 1 us: %u\n", histogram[i]);
+		} else if (i + 1 == FRAME_PACER_BUCKETS) {
+			LOG("  >= %u us: %u\n", 1U << (i - 1), histogram[i]);
+		} else {
+			LOG("  %u - %u us: %u\n", 1U << (i - 1), 1U << i, histogram[i]);
+		}
+	}
+}
+
+
+void FramePacer::setFrameRate(unsigned int fps) {
+	assert(fps > 0);
+	period = 1000000000ULL / fps;
+	slack  = std::min(slack, period / 2);
+}
+
+
+void FramePacer::sleepFor(uint64_t nanoseconds) {
+#ifdef __linux__
+
+	// absolute deadline so being interrupted doesn't stretch the sleep
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	uint64_t ns = uint64_t(deadline.tv_nsec) + nanoseconds;
+	deadline.tv_sec  += ns / 1000000000ULL;
+	deadline.tv_nsec  = ns % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+	}
+
+#elif defined(_WIN32)
+
+	if (!timer) {
+		Sleep(static_cast<DWORD>(nanoseconds / 1000000ULL));
+		return;
+	}
+
+	// negative is relative, in 100 ns units
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -static_cast<LONGLONG>(nanoseconds / 100ULL);
+	if (SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+		WaitForSingleObject(timer, INFINITE);
+	}
+
+#else  // __linux__
+
+	std::this_thread::sleep_for(std::chrono::nanoseconds(nanoseconds));
+
+#endif  // __linux__
+}
+
+
+void FramePacer::recordError(uint64_t error) {
+	maxError = std::max(maxError, error);
+
+	uint64_t us     = error / 1000;
+	unsigned int i  = 0;
+	while (us != 0 && i + 1 < FRAME_PACER_BUCKETS) {
+		us >>= 1;
+		i++;
+	}
+	histogram[i]++;
+}
+
+
+uint64_t FramePacer::wait() {
+	assert(period != 0);
+
+	uint64_t now = clock();
+	if (nextTarget == 0) {
+		// nothing to be late for yet
+		nextTarget = now + period;
+		return now;
+	}
+
+	uint64_t target = nextTarget;
+	if (now < target) {
+		uint64_t margin = slack + SPIN_MARGIN;
+		if (target - now <= margin) {
+			// no sleep means no measurement, decay slowly so a few bad wakeups
+			// or frames which take most of the period don't leave us spinning for good
+			slack -= slack / 32;
+		} else {
+			uint64_t wanted = target - now - margin;
+			uint64_t before = now;
+			sleepFor(wanted);
+			now = clock();
+
+			// grow quickly so the next frame doesn't miss too, shrink slowly
+			uint64_t late = std::max(now - before, wanted) - wanted;
+			if (late > slack) {
+				slack += (late - slack) / 2;
+			} else {
+				slack -= (slack - late) / 32;
+			}
+			slack = std::min(slack, std::min(uint64_t(MAX_SLACK), period / 2));
+		}
+
+		while (now < target) {
+#ifdef HAVE_SSE2
+			_mm_pause();
+#endif  // HAVE_SSE2
+			now = clock();
+		}
+	}
+
+	recordError(now - target);
+
+	// stay on the original schedule unless a whole frame was missed
+	// then start over instead of rushing frames to catch up
+	nextTarget = target + period;
+	if (nextTarget <= now) {
+		nextTarget = now + period;
+	}
+
+	return now;
+}
+
+
+void FramePacer::reset() {
+	nextTarget = 0;
+}
+
+
+void FramePacer::clearHistogram() {
+	histogram.fill(0);
+	maxError = 0;
+}
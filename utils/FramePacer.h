@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+
+#include <array>
+#include <functional>
+
+#include <cstdint>
+
+
+// error histogram buckets, bucket i holds errors in [2^(i-1), 2^i) microseconds
+// bucket 0 is under one microsecond and the last one everything above
+#define FRAME_PACER_BUCKETS  16
+
+
+// waits until the start of the next frame
+// sleeps most of the way and spins the rest, the sleep is shortened by
+// how late the OS has recently woken us up
+class FramePacer {
+	std::function<uint64_t()>              clock;
+
+	uint64_t                               period;
+	// 0 when not pacing
+	uint64_t                               nextTarget;
+	// how late sleeps wake up, continuously adjusted
+	uint64_t                               slack;
+
+#ifdef _WIN32
+	// waitable timer HANDLE, keeps windows.h out of this header
+	void                                   *timer;
+#endif  // _WIN32
+
+	std::array<uint32_t, FRAME_PACER_BUCKETS>  histogram;
+	uint64_t                               maxError;
+
+
+	void sleepFor(uint64_t nanoseconds);
+
+	void recordError(uint64_t error);
+
+public:
+
+	// clock returns nanoseconds
+	explicit FramePacer(std::function<uint64_t()> &&clock_);
+
+	FramePacer(const FramePacer &)            = delete;
+	FramePacer(FramePacer &&)                 = delete;
+
+	FramePacer &operator=(const FramePacer &) = delete;
+	FramePacer &operator=(FramePacer &&)      = delete;
+
+	~FramePacer();
+
+	void setFrameRate(unsigned int fps);
+
+	// returns the time it waited until
+	uint64_t wait();
+
+	// start over from the current time on the next wait()
+	// call when frames weren't paced for a while
+	void reset();
+
+	uint64_t getSlack() const {
+		return slack;
+	}
+
+	// how late frames started compared to their targets
+	const std::array<uint32_t, FRAME_PACER_BUCKETS> &getErrorHistogram() const {
+		return histogram;
+	}
+
+	uint64_t getMaxError() const {
+		return maxError;
+	}
+
+	void clearHistogram();
+};
+
+
+#endif  // FRAMEPACER_H
@@ -0,0 +1,253 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#include "Profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <cassert>
+#include <cinttypes>
+
+#include "Utils.h"
+
+
+// events kept per thread, older ones are overwritten
+#define PROFILER_RING_SIZE  65536
+
+
+namespace {
+
+
+struct ProfileEvent {
+	const char  *name;
+	uint64_t    beginTicks;
+	uint64_t    endTicks;
+	// rings are reused when threads exit so this is per event
+	uint32_t    tid;
+};
+
+
+// atomics so a capture can read slots the owner is overwriting
+// torn events are detected from head afterwards and dropped
+// release / acquire are plain moves on x86
+struct ProfileSlot {
+	std::atomic<const char *>  name;
+	std::atomic<uint64_t>      beginTicks;
+	std::atomic<uint64_t>      endTicks;
+	std::atomic<uint32_t>      tid;
+};
+
+
+struct ProfileRing {
+	// only written by the owning thread
+	std::array<ProfileSlot, PROFILER_RING_SIZE>   events;
+	// number of events ever written, incremented after the event is written
+	std::atomic<uint64_t>                         head;
+
+	// rest protected by ringsMutex
+	bool                                          owned;
+	uint32_t                                      tid;
+
+
+	ProfileRing()
+	: head(0)
+	, owned(false)
+	, tid(0)
+	{
+	}
+};
+
+
+std::mutex                                 ringsMutex;
+std::vector<std::unique_ptr<ProfileRing> > rings;
+uint32_t                                   nextTid    = 0;
+
+uint64_t                                   tickBase   = 0;
+uint64_t                                   freqMult   = 1;
+uint64_t                                   freqDiv    = 1;
+
+
+// gives the ring back when the thread exits
+// background shader compiles start new threads so they'd pile up otherwise
+struct RingOwner {
+	ProfileRing *ring;
+
+
+	RingOwner()
+	: ring(nullptr)
+	{
+	}
+
+	~RingOwner() {
+		if (ring) {
+			std::unique_lock<std::mutex> lock(ringsMutex);
+			ring->owned = false;
+		}
+	}
+};
+
+
+thread_local RingOwner ringOwner;
+
+
+ProfileRing *acquireRing() {
+	std::unique_lock<std::mutex> lock(ringsMutex);
+
+	ProfileRing *ring = nullptr;
+	for (auto &r : rings) {
+		if (!r->owned) {
+			ring = r.get();
+			break;
+		}
+	}
+
+	if (!ring) {
+		rings.emplace_back(std::make_unique<ProfileRing>());
+		ring = rings.back().get();
+	}
+
+	ring->owned = true;
+	ring->tid   = nextTid++;
+
+	return ring;
+}
+
+
+void appendEscaped(std::string &out, const char *str) {
+	for (const char *c = str; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			out += '\\';
+		}
+		out += *c;
+	}
+}
+
+
+void appendMicroseconds(std::string &out, uint64_t ticks) {
+	uint64_t nanoseconds = (ticks - tickBase) * freqMult / freqDiv;
+
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%" PRIu64 ".%03u", nanoseconds / 1000, static_cast<unsigned int>(nanoseconds % 1000));
+	out += buf;
+}
+
+
+}  // namespace
+
+
+void profilerInit(uint64_t tickBase_, uint64_t freqMult_, uint64_t freqDiv_) {
+	assert(freqMult_ != 0);
+	assert(freqDiv_  != 0);
+
+	tickBase = tickBase_;
+	freqMult = freqMult_;
+	freqDiv  = freqDiv_;
+}
+
+
+void profilerRecord(const char *name, uint64_t beginTicks, uint64_t endTicks) {
+	ProfileRing *ring = ringOwner.ring;
+	if (!ring) {
+		ring = acquireRing();
+		ringOwner.ring = ring;
+	}
+
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	ProfileSlot &slot = ring->events[head % PROFILER_RING_SIZE];
+	slot.name.store(name,             std::memory_order_release);
+	slot.beginTicks.store(beginTicks, std::memory_order_release);
+	slot.endTicks.store(endTicks,     std::memory_order_release);
+	slot.tid.store(ring->tid,         std::memory_order_release);
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+
+void profilerWriteTrace(const std::string &filename) {
+	std::vector<ProfileEvent> events;
+
+	{
+		// only keeps rings from being added while we walk them
+		// the owning threads keep writing
+		std::unique_lock<std::mutex> lock(ringsMutex);
+		for (const auto &r : rings) {
+			uint64_t head  = r->head.load(std::memory_order_acquire);
+			uint64_t first = (head > PROFILER_RING_SIZE) ? (head - PROFILER_RING_SIZE) : 0;
+			size_t oldSize = events.size();
+			for (uint64_t i = first; i < head; i++) {
+				const ProfileSlot &slot = r->events[i % PROFILER_RING_SIZE];
+				ProfileEvent e;
+				e.name       = slot.name.load(std::memory_order_acquire);
+				e.beginTicks = slot.beginTicks.load(std::memory_order_acquire);
+				e.endTicks   = slot.endTicks.load(std::memory_order_acquire);
+				e.tid        = slot.tid.load(std::memory_order_acquire);
+				events.push_back(e);
+			}
+
+			// drop the ones the owner might have overwritten while we copied
+			// plus one since the slot at newHead might be half written
+			uint64_t newHead = r->head.load(std::memory_order_acquire);
+			if (newHead + 1 - first > PROFILER_RING_SIZE) {
+				uint64_t overwritten = std::min(newHead + 1 - first - PROFILER_RING_SIZE, head - first);
+				events.erase(events.begin() + oldSize, events.begin() + oldSize + overwritten);
+			}
+		}
+	}
+
+	std::string json;
+	json.reserve(events.size() * 96 + 64);
+	json += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool firstEvent = true;
+	for (const auto &e : events) {
+		if (!firstEvent) {
+			json += ",\n";
+		}
+		firstEvent = false;
+
+		json += "{\"name\":\"";
+		appendEscaped(json, e.name);
+		json += "\",\"ph\":\"X\",\"pid\":0,\"tid\":";
+		json += std::to_string(e.tid);
+		json += ",\"ts\":";
+		appendMicroseconds(json, e.beginTicks);
+		json += ",\"dur\":";
+		// relative to tickBase so the same conversion works for durations
+		appendMicroseconds(json, tickBase + (e.endTicks - e.beginTicks));
+		json += "}";
+	}
+	json += "\n]}\n";
+
+	writeFile(filename, json.c_str(), json.size());
+	LOG("Wrote %u profiler events to \"%s\"\n", static_cast<unsigned int>(events.size()), filename.c_str());
+}
+
+
+#endif  // ENABLE_PROFILER
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+
+// CPU profiler, build with PROFILER=y to enable
+// otherwise the macros expand to nothing
+
+#ifdef ENABLE_PROFILER
+
+
+#include <string>
+
+#include <cstdint>
+
+#include <SDL.h>
+
+
+#define PROFILER_CONCAT2(a, b) a ## b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT2(a, b)
+
+// name must outlive the profiler, use string literals
+#define PROFILE_SCOPE(name) ProfileScope PROFILER_CONCAT(profileScope_, __COUNTER__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+
+
+// tickBase, freqMult and freqDiv as in SMAADemo::getNanoseconds so both give the same times
+void profilerInit(uint64_t tickBase, uint64_t freqMult, uint64_t freqDiv);
+
+// called by ProfileScope, only touches the calling thread's ring
+void profilerRecord(const char *name, uint64_t beginTicks, uint64_t endTicks);
+
+// write the events still in the rings as Chrome trace event JSON
+// can be opened in chrome://tracing or Perfetto
+void profilerWriteTrace(const std::string &filename);
+
+
+class ProfileScope {
+	const char  *name;
+	uint64_t    beginTicks;
+
+public:
+
+	explicit ProfileScope(const char *name_)
+	: name(name_)
+	, beginTicks(SDL_GetPerformanceCounter())
+	{
+	}
+
+	~ProfileScope() {
+		profilerRecord(name, beginTicks, SDL_GetPerformanceCounter());
+	}
+
+	ProfileScope(const ProfileScope &)            = delete;
+	ProfileScope(ProfileScope &&)                 = delete;
+
+	ProfileScope &operator=(const ProfileScope &) = delete;
+	ProfileScope &operator=(ProfileScope &&)      = delete;
+};
+
+
+#else  // ENABLE_PROFILER
+
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+
+
+#endif  // ENABLE_PROFILER
+
+
+#endif  // PROFILER_H
@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#include <cassert>
+
+#include "WorkerPool.h"
+
+
+WorkerPool::WorkerPool(unsigned int numThreads)
+: job(nullptr)
+, numChunks(0)
+, nextChunk(0)
+, generation(0)
+, busy(0)
+, quit(false)
+{
+	threads.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		threads.emplace_back([this] () { workerMain(); } );
+	}
+}
+
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		assert(busy == 0);
+		quit = true;
+	}
+	wakeup.notify_all();
+
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+
+void WorkerPool::runChunks(const ChunkFunc &f, unsigned int count) {
+	unsigned int i;
+	while ((i = nextChunk.fetch_add(1, std::memory_order_relaxed)) < count) {
+		f(i);
+	}
+}
+
+
+void WorkerPool::workerMain() {
+	unsigned int seen = 0;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wakeup.wait(lock, [&] () { return quit || generation != seen; } );
+		if (quit) {
+			return;
+		}
+
+		seen = generation;
+		const ChunkFunc &f  = *job;
+		unsigned int count  = numChunks;
+
+		lock.unlock();
+		runChunks(f, count);
+		lock.lock();
+
+		assert(busy > 0);
+		busy--;
+		if (busy == 0) {
+			finished.notify_one();
+		}
+	}
+}
+
+
+void WorkerPool::run(unsigned int count, const ChunkFunc &f) {
+	// not worth waking anyone up
+	if (threads.empty() || count <= 1) {
+		for (unsigned int i = 0; i < count; i++) {
+			f(i);
+		}
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		assert(busy == 0);
+		assert(job == nullptr);
+		job       = &f;
+		numChunks = count;
+		nextChunk.store(0, std::memory_order_relaxed);
+		busy      = static_cast<unsigned int>(threads.size());
+		generation++;
+	}
+	wakeup.notify_all();
+
+	runChunks(f, count);
+
+	// f must stay alive until every worker has let go of it
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] () { return busy == 0; } );
+	job = nullptr;
+}
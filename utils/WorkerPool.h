@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2015-2017 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// mingw fuckery...
+#if defined(__GNUC__) && defined(_WIN32)
+
+#include <mingw.condition_variable.h>
+#include <mingw.mutex.h>
+#include <mingw.thread.h>
+
+#endif  // defined(__GNUC__) && defined(_WIN32)
+
+
+// threads which stay around between jobs, so splitting small per frame work
+// doesn't pay for creating and joining threads every time
+// only one thread at a time may call run
+class WorkerPool {
+	typedef std::function<void(unsigned int)>  ChunkFunc;
+
+	std::vector<std::thread>  threads;
+
+	std::mutex                mutex;
+	std::condition_variable   wakeup;
+	std::condition_variable   finished;
+
+	// current job, protected by mutex except nextChunk
+	const ChunkFunc           *job;
+	unsigned int              numChunks;
+	std::atomic<unsigned int> nextChunk;
+	// bumped for every job so workers know they haven't seen it yet
+	unsigned int              generation;
+	// workers still inside the current job
+	unsigned int              busy;
+	bool                      quit;
+
+
+	void workerMain();
+
+	void runChunks(const ChunkFunc &f, unsigned int count);
+
+public:
+
+	// numThreads in addition to the thread calling run
+	explicit WorkerPool(unsigned int numThreads);
+
+	WorkerPool(const WorkerPool &)            = delete;
+	WorkerPool(WorkerPool &&)                 = delete;
+
+	WorkerPool &operator=(const WorkerPool &) = delete;
+	WorkerPool &operator=(WorkerPool &&)      = delete;
+
+	~WorkerPool();
+
+	// calls f(i) for every i in [0, count) and returns when all are done
+	// the calling thread takes chunks too
+	void run(unsigned int count, const ChunkFunc &f);
+};
+
+
+#endif  // WORKERPOOL_H
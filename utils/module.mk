@@ -4,7 +4,10 @@ d              := $(dir)
 
 
 FILES:= \
+	FramePacer.cpp \
+	Profiler.cpp \
 	Utils.cpp \
+	WorkerPool.cpp \
 	# empty line
 
 